@@ -1,4 +1,6 @@
+#include <glm/geometric.hpp>
 #include <render/ray.h>
+#include <render/ray_trace_camera.h>
 #include <render/renderer.h>
 #include <volume/gradient_volume.h>
 #include <volume/volume.h>
@@ -46,6 +48,28 @@ public:
     provide_const_member_function_access(getGradientLinearInterpolate)
 };
 
+// Pinhole camera looking at a point without requiring a window (unlike ui::Trackball).
+class TestCamera : public render::RayTraceCamera {
+public:
+    TestCamera(const glm::vec3& position, const glm::vec3& lookAt)
+        : m_position(position)
+        , m_forward(glm::normalize(lookAt - position))
+    {
+    }
+
+    glm::vec3 position() const override { return m_position; }
+    glm::vec3 forward() const override { return m_forward; }
+    render::Ray generateRay(const glm::vec2& pixel) const override
+    {
+        const glm::vec3 right = glm::normalize(glm::cross(m_forward, glm::vec3(0, 1, 0)));
+        const glm::vec3 up = glm::cross(right, m_forward);
+        return render::Ray { m_position, glm::normalize(m_forward + 0.5f * (pixel.x * right + pixel.y * up)), 0.0f, 0.0f };
+    }
+
+private:
+    glm::vec3 m_position, m_forward;
+};
+
 class TestRenderer : public render::Renderer {
 public:
     using render::Renderer::Renderer;
@@ -1,9 +1,36 @@
 // Can access the header files from the viewer...
 #include "test_classes.h"
+#include "ipc/frame_cache.h"
+#include "ipc/frame_delta.h"
+#include "render/splat_renderer.h"
+#include "session/auto_tune.h"
+#include "session/session.h"
+#include "ui/histogram_image.h"
 #include "ui/window.h"
+#include "volume/chunked_volume.h"
+#include "volume/slice_stream.h"
+#include "volume/summed_volume.h"
+#include "volume/volume_filter.h"
 #include <algorithm>
+#include <array>
 #include <catch2/catch.hpp>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <glm/common.hpp>
 #include <glm/gtc/type_ptr.hpp>
+#include <glm/gtx/component_wise.hpp>
+#include <glm/vector_relational.hpp>
+#include <limits>
+#include <sstream>
+#include <thread>
+#include <variant>
+#ifndef _WIN32
+#include <sys/stat.h>
+#endif
 
 /*
 GradientVolume:
@@ -25,6 +52,27 @@ Renderer:
     - getTF2DOpacity : m_pVolume, m_pGradientVolume, m_config.TF2DRadius, m_config.TF2DIntensity 
 */
 
+// 32^3 volume with a sphere of radius 8 (value 200) in the center and a background of 10.
+static volume::Volume makeSphereVolume()
+{
+    const glm::ivec3 dim { 32 };
+    std::vector<uint16_t> data(size_t(dim.x * dim.y * dim.z));
+    for (int z = 0; z < dim.z; z++)
+        for (int y = 0; y < dim.y; y++)
+            for (int x = 0; x < dim.x; x++)
+                data[size_t(x + dim.x * (y + dim.y * z))] = uint16_t(glm::length(glm::vec3(x, y, z) - 16.0f) < 8.0f ? 200 : 10);
+    return volume::Volume { data, dim };
+}
+
+// Pseudo-random voxels in [0, 1000).
+static std::vector<uint16_t> makeNoiseVoxels(const glm::ivec3& dim)
+{
+    std::vector<uint16_t> out(size_t(dim.x) * size_t(dim.y) * size_t(dim.z));
+    for (size_t i = 0; i < out.size(); i++)
+        out[i] = uint16_t((i * 7919) % 1000);
+    return out;
+}
+
 TEST_CASE("Volume Tests")
 {
     REQUIRE_NOTHROW(TestVolume::test_weight(0.f));
@@ -46,3 +94,1005 @@ TEST_CASE("Gradient Volume Tests")
     const TestGradientVolume gradient { volume };
     REQUIRE_NOTHROW(gradient.test_getGradientLinearInterpolate(glm::vec3(100.f)));
 }
+
+TEST_CASE("Anisotropic Spacing Tests")
+{
+    // The spacing follows from the coordinate space extent and is relative to the finest axis.
+    std::istringstream header { "ndim=3\ndim1=4\ndim2=4\ndim3=3\nnspace=3\nveclen=1\ndata=byte\nfield=uniform\nmin_ext=0.0 0.0 0.0\nmax_ext=1.5 1.5 2.0  # mm\n\f\f" };
+    REQUIRE(volume::readFieldHeader(header).spacing == glm::vec3(0.5f, 0.5f, 1.0f));
+
+    // Sphere with a radius of 16 in the center of a 64^3 world, once sampled isotropically and once with half the
+    // number of (twice as thick) slices along z. Large enough that the sphere stays clear of the border (samples
+    // close to it evaluate to 0).
+    const auto makeSphere = [](const glm::ivec3& dim, const glm::vec3& spacing) {
+        std::vector<uint16_t> data(size_t(dim.x * dim.y * dim.z));
+        for (int z = 0; z < dim.z; z++)
+            for (int y = 0; y < dim.y; y++)
+                for (int x = 0; x < dim.x; x++)
+                    data[size_t(x + dim.x * (y + dim.y * z))] = uint16_t(glm::length(glm::vec3(x, y, z) * spacing - 32.0f) < 16.0f ? 200 : 10);
+        return volume::Volume { data, dim, spacing };
+    };
+    volume::Volume isotropic = makeSphere(glm::ivec3(64), glm::vec3(1.0f));
+    volume::Volume anisotropic = makeSphere(glm::ivec3(64, 64, 32), glm::vec3(1.0f, 1.0f, 2.0f));
+    REQUIRE(volume::Volume(std::vector<uint16_t>(8), glm::ivec3(2), glm::vec3(0.5f, 0.5f, 1.0f)).spacing() == glm::vec3(1.0f, 1.0f, 2.0f));
+    REQUIRE(anisotropic.extent() == isotropic.extent());
+
+    // Gradients are in world coordinates.
+    const volume::GradientVolume gradients { anisotropic, volume::GradientStorage::Full };
+    const auto slope = [&](int z) { return (anisotropic.getVoxel(32, 32, z + 1) - anisotropic.getVoxel(32, 32, z - 1)) / 4.0f; };
+    REQUIRE(gradients.getGradient(32, 32, 8).dir.z == slope(8));
+
+    // Both render the same sphere (up to the sampling of its surface) when viewed from the side.
+    const TestCamera camera { glm::vec3(140.0f, 32.25f, 31.75f), glm::vec3(32.0f, 32.25f, 31.75f) };
+    render::RenderConfig config {};
+    config.renderMode = render::RenderMode::RenderIso;
+    config.renderResolution = glm::ivec2(48);
+    config.isoValue = 100.0f;
+    const auto hitCount = [&](volume::Volume& volume) {
+        volume.interpolationMode = volume::InterpolationMode::Linear;
+        const volume::GradientVolume gradientVolume { volume };
+        render::Renderer renderer { &volume, &gradientVolume, &camera, config };
+        renderer.render();
+        const auto frameBuffer = renderer.frameBuffer();
+        return std::count_if(std::begin(frameBuffer), std::end(frameBuffer), [](const glm::vec4& color) { return color.r > 0.0f; });
+    };
+    const auto isotropicCount = hitCount(isotropic);
+    REQUIRE(isotropicCount > 100);
+    REQUIRE(std::abs(hitCount(anisotropic) - isotropicCount) < isotropicCount / 10);
+}
+
+TEST_CASE("Voxel Type Tests")
+{
+    // Signed CT data in Hounsfield units (little endian).
+    const std::array<int16_t, 8> hounsfield { -1024, -1000, -500, 0, 40, 400, 1000, 3071 };
+    const auto filePath = std::filesystem::temp_directory_path() / "volvis_voxel_type_test.fld";
+    {
+        std::ofstream file { filePath, std::ios::binary };
+        file << "# AVS field file\nndim=3\ndim1=2\ndim2=2\ndim3=2\nnspace=3\nveclen=1\ndata=signed_short\nfield=uniform\n\f\f";
+        for (const int16_t value : hounsfield)
+            file.put(char(uint16_t(value) & 0xFF)).put(char(uint16_t(value) >> 8));
+    }
+    {
+        const volume::Volume volume { filePath };
+        REQUIRE(volume.valueMapping().fileType == volume::VoxelType::Int16);
+        REQUIRE(volume.minimum() == 0.0f);
+        REQUIRE(volume.maximum() == 4095.0f);
+        for (size_t i = 0; i < hounsfield.size(); i++)
+            REQUIRE(volume::fileValue(volume.valueMapping(), float(volume.data()[i])) == float(hounsfield[i]));
+    }
+    std::filesystem::remove(filePath);
+
+    // Float voxels are quantized to 16 bits over their range.
+    const std::array<float, 4> floats { -2.5f, 0.0f, 0.001f, 7.5f };
+    std::vector<char> bytes(floats.size() * sizeof(float));
+    std::memcpy(bytes.data(), floats.data(), bytes.size());
+    const volume::ValueMapping floatMapping = volume::chooseValueMapping(bytes, volume::VoxelType::Float32);
+    std::vector<uint16_t> decoded(floats.size());
+    volume::decodeVoxels(bytes, floatMapping, decoded);
+    REQUIRE(decoded.front() == 0);
+    REQUIRE(decoded.back() == std::numeric_limits<uint16_t>::max());
+    for (size_t i = 0; i < floats.size(); i++)
+        REQUIRE(std::abs(volume::fileValue(floatMapping, float(decoded[i])) - floats[i]) <= floatMapping.scale / 2.0f + 1e-6f);
+
+    // Unsigned types are stored as is, also when streamed.
+    const std::array<char, 2> unsignedBytes { char(0xFF), char(0x01) };
+    volume::decodeVoxels(unsignedBytes, volume::defaultValueMapping(volume::VoxelType::UInt16), gsl::span(decoded).first(1));
+    REQUIRE(decoded[0] == 0x01FF);
+    volume::decodeVoxels(unsignedBytes, volume::defaultValueMapping(volume::VoxelType::Int8), gsl::span(decoded).first(2));
+    REQUIRE(decoded[0] == 127);
+    REQUIRE(decoded[1] == 129);
+}
+
+TEST_CASE("Multi-Channel Volume Tests")
+{
+    // Three interleaved byte channels: a sphere in the first, a constant in the second and a ramp along x in the third.
+    const glm::ivec3 dim { 24 };
+    const auto filePath = std::filesystem::temp_directory_path() / "volvis_multi_channel_test.fld";
+    {
+        std::ofstream file { filePath, std::ios::binary };
+        file << "ndim=3\ndim1=24\ndim2=24\ndim3=24\nnspace=3\nveclen=3\ndata=byte\nfield=uniform\n\f\f";
+        for (int z = 0; z < dim.z; z++)
+            for (int y = 0; y < dim.y; y++)
+                for (int x = 0; x < dim.x; x++)
+                    file.put(char(glm::length(glm::vec3(x, y, z) - 12.0f) < 6.0f ? 200 : 0)).put(char(100)).put(char(x * 8));
+    }
+    volume::Volume volume { filePath };
+    std::filesystem::remove(filePath);
+    REQUIRE(volume.channelCount() == 3);
+    REQUIRE(volume.channelData().size() == volume.data().size());
+    for (size_t i = 0; i < volume.data().size(); i++) {
+        const glm::u16vec4 channels = volume.channelData()[i];
+        REQUIRE(channels.w == 0);
+        REQUIRE(volume.data()[i] == std::max({ channels.x, channels.y, channels.z }));
+    }
+
+    // All channels are interpolated at once.
+    volume.interpolationMode = volume::InterpolationMode::Linear;
+    REQUIRE(volume.getChannelsInterpolate(glm::vec3(10.5f, 3.25f, 20.75f)) == glm::vec4(0.0f, 100.0f, 84.0f, 0.0f));
+    REQUIRE(volume.getChannelsInterpolate(glm::vec3(-1.0f, 3.25f, 20.75f)) == glm::vec4(0.0f));
+
+    // Compositing uses the channel transfer functions: only the channels with a non-zero opacity are visible.
+    const volume::GradientVolume gradientVolume { volume };
+    const TestCamera camera { glm::vec3(60.0f, 12.25f, 11.75f), glm::vec3(12.0f, 12.25f, 11.75f) };
+    render::RenderConfig config {};
+    config.renderMode = render::RenderMode::RenderComposite;
+    config.renderResolution = glm::ivec2(16);
+    render::Renderer renderer { &volume, &gradientVolume, &camera, config };
+    auto transferFunctions = render::defaultChannelTransferFunctions(volume);
+    transferFunctions[0] = { glm::vec3(1, 0, 0), 100.0f, 200.0f, 1.0f };
+    transferFunctions[1].opacity = 0.0f;
+    transferFunctions[2].opacity = 0.0f;
+    renderer.setChannelTransferFunctions(transferFunctions);
+    const auto centerPixel = [&]() {
+        renderer.render();
+        return renderer.frameBuffer()[size_t(8 * 16 + 8)];
+    };
+    const glm::vec4 sphere = centerPixel();
+    REQUIRE(sphere.r > 0.5f);
+    REQUIRE(sphere.g == 0.0f);
+    REQUIRE(sphere.b == 0.0f);
+
+    transferFunctions[1] = { glm::vec3(0, 1, 0), 0.0f, 100.0f, 0.05f };
+    renderer.setChannelTransferFunctions(transferFunctions);
+    REQUIRE(centerPixel().g > 0.0f);
+}
+
+TEST_CASE("Memory Budget Tests")
+{
+    const glm::ivec3 dim { 16 };
+    const std::vector<uint16_t> data = makeNoiseVoxels(dim);
+    const volume::Volume volume { data, dim };
+
+    // Quantized gradients are within one quantization step (at most 1000 / 2 / 32767) of the full gradients.
+    const volume::GradientVolume full { volume, volume::GradientStorage::Full };
+    const volume::GradientVolume quantized { volume, volume::GradientStorage::Quantized };
+    const volume::GradientVolume onTheFly { volume, volume::GradientStorage::OnTheFly };
+    for (int z = 0; z < dim.z; z++) {
+        for (int y = 0; y < dim.y; y++) {
+            for (int x = 0; x < dim.x; x++) {
+                const glm::vec3 gradient = full.getGradient(x, y, z).dir;
+                REQUIRE(onTheFly.getGradient(x, y, z).dir == gradient);
+                REQUIRE(glm::all(glm::lessThan(glm::abs(quantized.getGradient(x, y, z).dir - gradient), glm::vec3(0.02f))));
+            }
+        }
+    }
+    REQUIRE(quantized.maxMagnitude() == Approx(full.maxMagnitude()).epsilon(1e-3));
+
+    // The budget selects the most accurate storage that still fits.
+    const size_t voxelCount = data.size();
+    memory::setMemoryBudget(memory::totalMemoryUsage() + voxelCount * sizeof(volume::GradientVoxel));
+    REQUIRE(volume::chooseGradientStorage(dim) == volume::GradientStorage::Full);
+    memory::setMemoryBudget(memory::totalMemoryUsage() + voxelCount * 8);
+    REQUIRE(volume::chooseGradientStorage(dim) == volume::GradientStorage::Quantized);
+    memory::setMemoryBudget(memory::totalMemoryUsage());
+    REQUIRE(volume::chooseGradientStorage(dim) == volume::GradientStorage::OnTheFly);
+    memory::setMemoryBudget({});
+
+    // Budgets on the command line are whole MiB.
+    REQUIRE(memory::parseMebibytes("512") == size_t(512) * 1024 * 1024);
+    REQUIRE(!memory::parseMebibytes("512MB"));
+    REQUIRE(!memory::parseMebibytes("-1"));
+    REQUIRE(!memory::parseMebibytes("99999999999999999999"));
+
+    // Copies are accounted separately, moved-from objects are not accounted.
+    const size_t usageBefore = memory::totalMemoryUsage();
+    {
+        memory::TrackedMemory original { "Test", 100 };
+        memory::TrackedMemory copy = original;
+        const memory::TrackedMemory moved = std::move(original);
+        REQUIRE(memory::totalMemoryUsage() == usageBefore + 200);
+        copy.setSize(50);
+        REQUIRE(memory::totalMemoryUsage() == usageBefore + 150);
+    }
+    REQUIRE(memory::totalMemoryUsage() == usageBefore);
+}
+
+TEST_CASE("Volume Filter Tests")
+{
+    // Linear ramp along x with a single noisy voxel in the center.
+    const glm::ivec3 dim { 16 };
+    std::vector<uint16_t> data(size_t(dim.x * dim.y * dim.z));
+    for (int z = 0; z < dim.z; z++)
+        for (int y = 0; y < dim.y; y++)
+            for (int x = 0; x < dim.x; x++)
+                data[size_t(x + dim.x * (y + dim.y * z))] = uint16_t(100 + 10 * x);
+    const size_t center = size_t(8 + dim.x * (8 + dim.y * 8));
+    data[center] = 1000;
+    const volume::Volume volume { data, dim };
+
+    // The median removes the spike, smoothing filters keep the ramp (away from the border).
+    const volume::Volume median = volume::filterVolume(volume, volume::VolumeFilter::Median, 1.0f);
+    REQUIRE(median.getVoxel(8, 8, 8) == 180.0f);
+    const volume::Volume gaussian = volume::filterVolume(volume, volume::VolumeFilter::Gaussian, 1.0f);
+    REQUIRE(gaussian.getVoxel(8, 3, 3) == 180.0f);
+    REQUIRE(gaussian.getVoxel(8, 8, 8) < 300.0f);
+    const volume::Volume box = volume::filterVolume(volume, volume::VolumeFilter::Box, 1.0f);
+    REQUIRE(box.getVoxel(5, 3, 3) == 150.0f);
+
+    // Filtering keeps the spacing of anisotropic volumes.
+    const volume::Volume anisotropic { data, dim, glm::vec3(1.0f, 1.0f, 2.5f) };
+    for (auto filter : { volume::VolumeFilter::None, volume::VolumeFilter::Gaussian, volume::VolumeFilter::Box, volume::VolumeFilter::Median })
+        REQUIRE(volume::filterVolume(anisotropic, filter, 1.0f).spacing() == glm::vec3(1.0f, 1.0f, 2.5f));
+
+    // Filters work on the stored values, so the result keeps the value mapping (e.g. Hounsfield units of int16 CT
+    // data or the quantization of float32 data) and the rounding back to stored values stays within it.
+    for (const volume::ValueMapping mapping : { volume::ValueMapping { volume::VoxelType::Int16, -1024.0f, 1.0f }, volume::ValueMapping { volume::VoxelType::Float32, -2.0f, 0.25f } }) {
+        const volume::Volume mapped { data, dim, glm::vec3(1.0f), mapping };
+        for (auto filter : { volume::VolumeFilter::Gaussian, volume::VolumeFilter::Box }) {
+            const volume::Volume filtered = volume::filterVolume(mapped, filter, 1.0f);
+            REQUIRE(filtered.valueMapping().fileType == mapping.fileType);
+            REQUIRE(filtered.valueMapping().offset == mapping.offset);
+            REQUIRE(filtered.valueMapping().scale == mapping.scale);
+            REQUIRE(volume::fileValue(filtered.valueMapping(), filtered.getVoxel(8, 3, 3)) == volume::fileValue(mapping, 180.0f));
+        }
+    }
+
+    // All gradient operators measure the slope of the ramp, on the fly or precomputed.
+    for (auto gradientOperator : { volume::GradientOperator::CentralDifference, volume::GradientOperator::Sobel, volume::GradientOperator::GaussianDerivative }) {
+        const volume::GradientVolume full { median, volume::GradientStorage::Full, gradientOperator };
+        const volume::GradientVolume onTheFly { median, volume::GradientStorage::OnTheFly, gradientOperator };
+        REQUIRE(full.getGradient(8, 8, 8).dir.x == Approx(10.0f));
+        REQUIRE(full.getGradient(8, 8, 8).dir.y == Approx(0.0f).margin(1e-3));
+        REQUIRE(onTheFly.getGradient(8, 8, 8).dir.x == Approx(full.getGradient(8, 8, 8).dir.x));
+        REQUIRE(onTheFly.getGradient(4, 3, 2).dir.x == Approx(full.getGradient(4, 3, 2).dir.x));
+    }
+}
+
+TEST_CASE("Volume Edit Tests")
+{
+    const glm::ivec3 dim { 20, 18, 16 };
+    const std::vector<uint16_t> data = makeNoiseVoxels(dim);
+    volume::Volume volume { data, dim };
+    volume::GradientVolume fullGradients { volume, volume::GradientStorage::Full };
+    volume::GradientVolume sobelGradients { volume, volume::GradientStorage::Quantized, volume::GradientOperator::Sobel };
+
+    const volume::Brush brushes[] {
+        { volume::BrushMode::Paint, glm::vec3(9.5f, 8.0f, 7.0f), 3.0f, 500.0f },
+        { volume::BrushMode::Erase, glm::vec3(1.0f, 2.0f, 3.0f), 4.0f, 0.0f },
+        { volume::BrushMode::Carve, glm::vec3(15.0f, 10.0f, 12.0f), 2.5f, 300.0f }
+    };
+    for (const auto& brush : brushes) {
+        const volume::DirtyRegion region = volume.applyBrush(brush);
+        REQUIRE(!volume::isEmpty(region));
+        fullGradients.update(region);
+        sobelGradients.update(region);
+    }
+
+    // The incrementally updated data is identical to the data derived from the edited voxels from scratch.
+    const volume::Volume expected { std::vector<uint16_t>(std::begin(volume.data()), std::end(volume.data())), dim };
+    REQUIRE(expected.data()[size_t(9 + dim.x * (8 + dim.y * 7))] == 500);
+    REQUIRE(volume.histogram() == expected.histogram());
+    const auto ranges = volume.minMaxBricks().ranges();
+    const auto expectedRanges = expected.minMaxBricks().ranges();
+    for (size_t i = 0; i < ranges.size(); i++) {
+        REQUIRE(ranges[i].minimum == expectedRanges[i].minimum);
+        REQUIRE(ranges[i].maximum == expectedRanges[i].maximum);
+    }
+    const volume::GradientVolume expectedFullGradients { expected, volume::GradientStorage::Full };
+    const volume::GradientVolume expectedSobelGradients { expected, volume::GradientStorage::Quantized, volume::GradientOperator::Sobel };
+    for (int z = 0; z < dim.z; z++) {
+        for (int y = 0; y < dim.y; y++) {
+            for (int x = 0; x < dim.x; x++) {
+                REQUIRE(fullGradients.getGradient(x, y, z).dir == expectedFullGradients.getGradient(x, y, z).dir);
+                REQUIRE(glm::all(glm::lessThan(glm::abs(sobelGradients.getGradient(x, y, z).dir - expectedSobelGradients.getGradient(x, y, z).dir), glm::vec3(0.05f))));
+            }
+        }
+    }
+}
+
+TEST_CASE("Chunked Volume Tests")
+{
+    // Smooth data with a constant region, like the air around a scan. Not a multiple of the chunk size.
+    const glm::ivec3 dim { 21, 18, 13 };
+    std::vector<uint16_t> data(size_t(dim.x * dim.y * dim.z));
+    for (size_t i = 0; i < data.size(); i++)
+        data[i] = i < data.size() / 3 ? 0 : uint16_t(1000 + (i * 31) % 4000);
+    const volume::Volume volume { data, dim };
+
+    const auto filePath = std::filesystem::temp_directory_path() / "volvis_chunked_volume_test.cvol";
+    REQUIRE(volume::writeChunkedVolume(filePath, volume, 8, 3));
+    {
+        volume::ChunkedVolumeReader reader { filePath };
+        REQUIRE(reader.isValid());
+        REQUIRE(reader.levelCount() == 3);
+        REQUIRE(reader.dims(2) == glm::ivec3(6, 5, 4));
+        REQUIRE(reader.compressedSize() < reader.uncompressedSize());
+        REQUIRE(reader.readLevel(0) == data);
+
+        // Only the chunks that overlap the region are read.
+        const auto region = reader.readRegion(0, volume::DirtyRegion { glm::ivec3(9, 0, 0), glm::ivec3(12, 3, 3) });
+        const auto index = [&](int x, int y, int z) { return size_t(x + dim.x * (y + dim.y * z)); };
+        REQUIRE(region[index(8, 7, 7)] == data[index(8, 7, 7)]);
+        REQUIRE(region[index(15, 7, 7)] == data[index(15, 7, 7)]);
+        REQUIRE(region[index(16, 7, 7)] == 0);
+        REQUIRE(region[index(8, 8, 7)] == 0);
+
+        // Lower levels are the average of 2x2x2 voxels.
+        const auto level1 = reader.readLevel(1);
+        REQUIRE(level1.size() == 11 * 9 * 7);
+        const uint32_t sum = data[index(20, 16, 12)] + data[index(20, 17, 12)];
+        REQUIRE(level1.back() == uint16_t((sum + 1) / 2));
+    }
+    // The viewer loads chunked files like field files.
+    REQUIRE(volume::Volume(filePath).data().size() == data.size());
+
+    // A header that claims more chunks than the file can index is rejected before the index is allocated.
+    {
+        std::fstream file { filePath, std::ios::binary | std::ios::in | std::ios::out };
+        const glm::ivec3 hugeDims { 1 << 30 };
+        file.seekp(2 * sizeof(uint32_t));
+        file.write(reinterpret_cast<const char*>(glm::value_ptr(hugeDims)), sizeof(hugeDims));
+    }
+    REQUIRE(!volume::ChunkedVolumeReader(filePath).isValid());
+    std::filesystem::remove(filePath);
+
+    // Corrupt chunks are detected.
+    const auto compressed = volume::compressVoxels(data);
+    std::vector<uint16_t> decompressed(data.size());
+    REQUIRE(volume::decompressVoxels(compressed, decompressed));
+    REQUIRE(decompressed == data);
+    REQUIRE(!volume::decompressVoxels(gsl::span<const uint8_t>(compressed).first(compressed.size() - 1), decompressed));
+}
+
+TEST_CASE("Slice Stream Tests")
+{
+    const glm::ivec3 dim { 12, 10, 24 };
+    const size_t sliceSize = size_t(dim.x * dim.y);
+    // Voxels in the first half are below 500, such that appending slices extends the value range.
+    std::vector<uint16_t> data = makeNoiseVoxels(dim);
+    for (size_t i = 0; i < data.size() / 2; i++)
+        data[i] %= 500;
+
+    // Read a field file through a stream.
+    const auto filePath = std::filesystem::temp_directory_path() / "volvis_slice_stream_test.fld";
+    {
+        std::ofstream file { filePath, std::ios::binary };
+        file << "ndim=3\ndim1=" << dim.x << "\ndim2=" << dim.y << "\ndim3=" << dim.z << "\nnspace=3\nveclen=1\ndata=short\nfield=uniform\n\f\f";
+        for (const uint16_t voxel : data)
+            file << char(voxel & 0xFF) << char(voxel >> 8);
+    }
+    std::vector<uint16_t> streamed;
+    {
+        volume::SliceStream stream { filePath };
+        while (!stream.isFinished())
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        REQUIRE(stream.dims() == dim);
+        streamed = stream.takeSlices();
+    }
+    std::filesystem::remove(filePath);
+    REQUIRE(streamed == data);
+
+    // A field file written like the slice feeder does keeps the spacing and the voxel type of the source volume.
+    {
+        const volume::Volume source { data, dim, glm::vec3(1.0f, 1.0f, 2.0f), volume::ValueMapping { volume::VoxelType::Int16, -1024.0f, 1.0f } };
+        {
+            std::ofstream file { filePath, std::ios::binary };
+            volume::FieldHeader header {};
+            header.dim = dim;
+            header.optVoxelType = volume::VoxelType::Int16;
+            header.spacing = source.spacing();
+            volume::writeFieldHeader(file, header);
+            std::vector<char> bytes(data.size() * sizeof(int16_t));
+            volume::encodeVoxels(source.data(), source.valueMapping(), bytes);
+            file.write(bytes.data(), std::streamsize(bytes.size()));
+        }
+        volume::SliceStream stream { filePath };
+        while (!stream.isFinished())
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        REQUIRE(stream.dims() == dim);
+        REQUIRE(stream.spacing() == source.spacing());
+        REQUIRE(stream.valueMapping().fileType == volume::VoxelType::Int16);
+        const std::vector<uint16_t> slices = stream.takeSlices();
+        REQUIRE(slices.size() == data.size());
+        for (size_t i = 0; i < data.size(); i++)
+            REQUIRE(volume::fileValue(stream.valueMapping(), float(slices[i])) == volume::fileValue(source.valueMapping(), float(data[i])));
+    }
+    std::filesystem::remove(filePath);
+
+    // Without following, a stream stops at the end of a file that misses slices.
+    {
+        std::ofstream file { filePath, std::ios::binary };
+        file << "ndim=3\ndim1=" << dim.x << "\ndim2=" << dim.y << "\ndim3=" << dim.z << "\nnspace=3\nveclen=1\ndata=short\nfield=uniform\n\f\f";
+        for (size_t i = 0; i < sliceSize * 3 + 5; i++)
+            file << char(data[i] & 0xFF) << char(data[i] >> 8);
+    }
+    {
+        volume::SliceStream stream { filePath };
+        while (!stream.isFinished())
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        REQUIRE(stream.takeSlices() == std::vector<uint16_t>(std::begin(data), std::begin(data) + sliceSize * 3));
+    }
+    std::filesystem::remove(filePath);
+#ifndef _WIN32
+    // Closing a stream of a named pipe that never gets a writer does not wait for one.
+    const auto pipePath = std::filesystem::temp_directory_path() / "volvis_slice_stream_test.pipe";
+    std::filesystem::remove(pipePath);
+    REQUIRE(mkfifo(pipePath.c_str(), 0600) == 0);
+    {
+        volume::SliceStream stream { pipePath };
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        REQUIRE(!stream.dims());
+        REQUIRE(!stream.isFinished());
+    }
+    std::filesystem::remove(pipePath);
+#endif
+
+    // Growing the volume (and the quantization range of the gradients) in batches gives the same derived data as a
+    // volume that was created at once.
+    volume::Volume volume { std::vector<uint16_t>(std::begin(data), std::begin(data) + sliceSize * 8), glm::ivec3(dim.x, dim.y, 8) };
+    volume::GradientVolume fullGradients { volume, volume::GradientStorage::Full };
+    volume::GradientVolume quantizedGradients { volume, volume::GradientStorage::Quantized };
+    for (const auto& [first, last] : { std::pair { 8, 9 }, std::pair { 9, 16 }, std::pair { 16, 24 } }) {
+        const volume::DirtyRegion region = volume.appendSlices(gsl::span(data).subspan(sliceSize * size_t(first), sliceSize * size_t(last - first)));
+        REQUIRE(region.lower.z == first);
+        REQUIRE(region.upper == glm::ivec3(dim.x, dim.y, last));
+        fullGradients.grow();
+        quantizedGradients.grow();
+    }
+
+    const volume::Volume expected { data, dim };
+    REQUIRE(volume.dims() == dim);
+    REQUIRE(volume.minimum() == expected.minimum());
+    REQUIRE(volume.maximum() == expected.maximum());
+    REQUIRE(volume.histogram() == expected.histogram());
+    const auto ranges = volume.minMaxBricks().ranges();
+    const auto expectedRanges = expected.minMaxBricks().ranges();
+    REQUIRE(ranges.size() == expectedRanges.size());
+    for (size_t i = 0; i < ranges.size(); i++) {
+        REQUIRE(ranges[i].minimum == expectedRanges[i].minimum);
+        REQUIRE(ranges[i].maximum == expectedRanges[i].maximum);
+    }
+    const volume::GradientVolume expectedFullGradients { expected, volume::GradientStorage::Full };
+    const volume::GradientVolume expectedQuantizedGradients { expected, volume::GradientStorage::Quantized };
+    for (int z = 0; z < dim.z; z++) {
+        for (int y = 0; y < dim.y; y++) {
+            for (int x = 0; x < dim.x; x++) {
+                REQUIRE(fullGradients.getGradient(x, y, z).dir == expectedFullGradients.getGradient(x, y, z).dir);
+                REQUIRE(quantizedGradients.getGradient(x, y, z).dir == expectedQuantizedGradients.getGradient(x, y, z).dir);
+            }
+        }
+    }
+}
+
+TEST_CASE("Summed Volume Tests")
+{
+    const glm::ivec3 dim { 12, 10, 9 };
+    const std::vector<uint16_t> data = makeNoiseVoxels(dim);
+    const volume::Volume volume { data, dim };
+
+    // Compare against visiting all voxels of the box.
+    const auto checkBox = [&](const glm::ivec3& lower, const glm::ivec3& upper, const volume::IntegralHistogram& integralHistogram) {
+        double sum = 0.0, squaredSum = 0.0;
+        size_t count = 0, countAbove = 0;
+        for (int z = lower.z; z < upper.z; z++) {
+            for (int y = lower.y; y < upper.y; y++) {
+                for (int x = lower.x; x < upper.x; x++) {
+                    const float voxel = volume.getVoxel(x, y, z);
+                    sum += voxel;
+                    squaredSum += voxel * voxel;
+                    count++;
+                    countAbove += voxel >= 500.0f ? 1 : 0;
+                }
+            }
+        }
+        const volume::RegionStatistics statistics = volume::SummedVolumeTable(volume).statistics(lower, upper);
+        REQUIRE(statistics.count == count);
+        REQUIRE(statistics.mean == Approx(sum / double(count)));
+        REQUIRE(statistics.variance == Approx(squaredSum / double(count) - (sum / double(count)) * (sum / double(count))));
+        REQUIRE(integralHistogram.countAbove(lower, upper, 500.0f) == countAbove);
+    };
+    // Bins of width 20 (1000 values in 50 bins).
+    const volume::IntegralHistogram voxelHistogram { volume, 50, 1 };
+    REQUIRE(voxelHistogram.binWidth() == 20);
+    checkBox(glm::ivec3(0), dim, voxelHistogram);
+    checkBox(glm::ivec3(3, 1, 4), glm::ivec3(7, 10, 5), voxelHistogram);
+    // Boxes that are aligned to cells are exact.
+    const volume::IntegralHistogram cellHistogram { volume, 50, 4 };
+    checkBox(glm::ivec3(4, 0, 4), glm::ivec3(12, 8, 8), cellHistogram);
+}
+
+TEST_CASE("Session Tests")
+{
+    render::RenderConfig config {};
+    config.renderMode = render::RenderMode::RenderComposite;
+    config.renderResolution = glm::ivec2(123, 45);
+    config.isoValue = 1.0f / 3.0f;
+    config.tfColorMap[7] = glm::vec4(0.1f, 0.2f, 0.3f, 0.4f);
+    const session::CameraState camera { glm::vec3(1.5f, 2.0f, -3.25f), 100.0f / 7.0f, glm::quat(0.5f, 0.5f, -0.5f, 0.5f), 1.0f, 1.0f };
+
+    std::stringstream stream;
+    session::writeEvent(stream, session::Event { 0.25, session::RenderConfigEvent { config } });
+    session::writeEvent(stream, session::Event { 0.5, session::CameraEvent { camera } });
+    session::writeEvent(stream, session::Event { 1.0, session::LoadVolumeEvent { "some dir/volume.fld" } });
+
+    // Values must be read back bit-exact for the replay to be deterministic.
+    const auto configEvent = session::readEvent(stream);
+    REQUIRE(configEvent);
+    const auto& readConfig = std::get<session::RenderConfigEvent>(configEvent->data).renderConfig;
+    REQUIRE(readConfig.renderMode == config.renderMode);
+    REQUIRE(readConfig.renderResolution == config.renderResolution);
+    REQUIRE(readConfig.isoValue == config.isoValue);
+    REQUIRE(readConfig.tfColorMap[7] == config.tfColorMap[7]);
+
+    const auto cameraEvent = session::readEvent(stream);
+    REQUIRE(cameraEvent);
+    const auto& readCamera = std::get<session::CameraEvent>(cameraEvent->data).cameraState;
+    REQUIRE(readCamera.lookAt == camera.lookAt);
+    REQUIRE(readCamera.distance == camera.distance);
+    REQUIRE(readCamera.rotation == camera.rotation);
+
+    const auto loadEvent = session::readEvent(stream);
+    REQUIRE(loadEvent);
+    REQUIRE(std::get<session::LoadVolumeEvent>(loadEvent->data).filePath == "some dir/volume.fld");
+    REQUIRE(!session::readEvent(stream));
+}
+
+TEST_CASE("Auto-Tuning Tests")
+{
+    const glm::ivec3 dim { 16 };
+    std::vector<uint16_t> data(size_t(dim.x * dim.y * dim.z));
+    for (size_t i = 0; i < data.size(); i++)
+        data[i] = uint16_t((i * 7) % 200);
+    volume::Volume volume { data, dim };
+    volume.setBrickSize(4);
+    REQUIRE(volume.minMaxBricks().brickSize() == 4);
+
+    const auto key = session::makeTuningKey(volume, render::RenderMode::RenderIso);
+    const auto otherKey = session::makeTuningKey(volume, render::RenderMode::RenderMIP);
+    REQUIRE(key.datasetHash == otherKey.datasetHash);
+
+    // Saving a key again replaces its line, other keys are kept.
+    const auto filePath = std::filesystem::temp_directory_path() / "volvis_tuning_test.txt";
+    std::filesystem::remove(filePath);
+    REQUIRE(!session::loadTuning(filePath, key));
+    session::saveTuning(filePath, key, session::TuningParameters { 16, render::RenderTuning { 32 } });
+    session::saveTuning(filePath, otherKey, session::TuningParameters { 4, render::RenderTuning { 0 } });
+    session::saveTuning(filePath, key, session::TuningParameters { 32, render::RenderTuning { 8 } });
+    const auto tuning = session::loadTuning(filePath, key);
+    REQUIRE(tuning);
+    REQUIRE(tuning->brickSize == 32);
+    REQUIRE(tuning->renderTuning.tileSize == 8);
+    REQUIRE(session::loadTuning(filePath, otherKey)->brickSize == 4);
+
+    // Values that autoTune never chooses fall back to the defaults.
+    session::saveTuning(filePath, key, session::TuningParameters { 0, render::RenderTuning { 8 } });
+    REQUIRE(session::loadTuning(filePath, key)->brickSize == session::TuningParameters {}.brickSize);
+    session::saveTuning(filePath, key, session::TuningParameters { 16, render::RenderTuning { -3 } });
+    REQUIRE(session::loadTuning(filePath, key)->renderTuning.tileSize == session::TuningParameters {}.renderTuning.tileSize);
+    std::filesystem::remove(filePath);
+}
+
+TEST_CASE("Batch Rendering Tests")
+{
+    volume::Volume volume = makeSphereVolume();
+    volume.interpolationMode = volume::InterpolationMode::Linear;
+    const volume::GradientVolume gradientVolume { volume };
+
+    const TestCamera camera0 { glm::vec3(16, 16, -40), glm::vec3(16) };
+    const TestCamera camera1 { glm::vec3(60, 30, 16), glm::vec3(16) };
+    render::RenderConfig config {};
+    config.renderResolution = glm::ivec2(37, 29);
+    config.isoValue = 100.0f;
+    config.tfColorMapIndexStart = 0.0f;
+    config.tfColorMapIndexRange = volume.maximum();
+    std::fill(std::begin(config.tfColorMap), std::end(config.tfColorMap), glm::vec4(0.0f));
+    config.tfColorMap[255] = glm::vec4(1.0f, 0.5f, 0.0f, 0.2f);
+
+    for (const auto renderMode : { render::RenderMode::RenderIso, render::RenderMode::RenderComposite }) {
+        config.renderMode = renderMode;
+        render::Renderer renderer0 { &volume, &gradientVolume, &camera0, config };
+        render::Renderer renderer1 { &volume, &gradientVolume, &camera1, config };
+        renderer0.render();
+        renderer1.render();
+
+        const std::array<const render::RayTraceCamera*, 2> cameras { &camera0, &camera1 };
+        const auto frameBuffers = renderer0.renderBatch(cameras);
+        REQUIRE(frameBuffers.size() == 2);
+        REQUIRE(std::equal(std::begin(frameBuffers[0]), std::end(frameBuffers[0]), std::begin(renderer0.frameBuffer()), std::end(renderer0.frameBuffer())));
+        REQUIRE(std::equal(std::begin(frameBuffers[1]), std::end(frameBuffers[1]), std::begin(renderer1.frameBuffer()), std::end(renderer1.frameBuffer())));
+        REQUIRE(std::any_of(std::begin(frameBuffers[0]), std::end(frameBuffers[0]), [](const glm::vec4& color) { return color.a > 0.0f; }));
+    }
+}
+
+TEST_CASE("Picking Tests")
+{
+    volume::Volume volume = makeSphereVolume();
+    volume.interpolationMode = volume::InterpolationMode::Linear;
+    volume::GradientVolume gradientVolume { volume };
+    gradientVolume.interpolationMode = volume::InterpolationMode::Linear;
+
+    // Looks along +z, slightly oblique such that the samples do not lie on the voxel grid.
+    const TestCamera camera { glm::vec3(16.3f, 15.6f, -40.0f), glm::vec3(16.0f) };
+    render::RenderConfig config {};
+    config.renderResolution = glm::ivec2(16);
+    config.renderMode = render::RenderMode::RenderIso;
+    config.isoValue = 100.0f;
+    render::Renderer renderer { &volume, &gradientVolume, &camera, config };
+
+    // The front of the sphere, between the last voxel outside (z = 8) and the first voxel inside (z = 9).
+    const auto optSurface = renderer.pick(glm::vec2(0.0f));
+    REQUIRE(optSurface);
+    REQUIRE(optSurface->position.z > 8.0f);
+    REQUIRE(optSurface->position.z < 9.0f);
+    REQUIRE(optSurface->value == Approx(100.0f).margin(1.0f));
+    REQUIRE(optSurface->gradient.dir.z > 0.0f);
+
+    config.isoValue = 300.0f;
+    renderer.setConfig(config);
+    REQUIRE(!renderer.pick(glm::vec2(0.0f)));
+
+    config.renderMode = render::RenderMode::RenderMIP;
+    renderer.setConfig(config);
+    const auto optMaximum = renderer.pick(glm::vec2(0.0f));
+    REQUIRE(optMaximum);
+    REQUIRE(optMaximum->value == Approx(200.0f));
+
+    // Line profiles equal sampling point by point.
+    const glm::vec3 begin { 5.3f, 6.1f, 2.2f }, end { 27.7f, 25.8f, 29.5f };
+    for (const auto interpolationMode : { volume::InterpolationMode::Linear, volume::InterpolationMode::NearestNeighbour }) {
+        volume.interpolationMode = interpolationMode;
+        std::vector<float> profile(37);
+        volume.sampleLine(begin, end, profile);
+        for (size_t i = 0; i < profile.size(); i++)
+            REQUIRE(profile[i] == Approx(volume.getSampleInterpolate(begin + float(i) / 36.0f * (end - begin))).margin(1e-2));
+    }
+}
+
+TEST_CASE("Anti-Aliasing Tests")
+{
+    volume::Volume volume = makeSphereVolume();
+    volume.interpolationMode = volume::InterpolationMode::Linear;
+    const volume::GradientVolume gradientVolume { volume };
+
+    const TestCamera camera { glm::vec3(16.3f, 15.6f, -40.0f), glm::vec3(16.0f) };
+    render::RenderConfig config {};
+    config.renderResolution = glm::ivec2(64);
+    config.renderMode = render::RenderMode::RenderIso;
+    config.isoValue = 100.0f;
+    render::Renderer aliased { &volume, &gradientVolume, &camera, config };
+    aliased.render();
+    config.adaptiveSupersampling = true;
+    render::Renderer antiAliased { &volume, &gradientVolume, &camera, config };
+    antiAliased.render();
+
+    // Only the pixels along the silhouette are rendered again, all others are unchanged.
+    const size_t pixelCount = size_t(config.renderResolution.x * config.renderResolution.y);
+    REQUIRE(antiAliased.supersampledPixelCount() > 0);
+    REQUIRE(antiAliased.supersampledPixelCount() < pixelCount / 10);
+    size_t changedPixelCount = 0;
+    for (size_t i = 0; i < pixelCount; i++) {
+        if (antiAliased.frameBuffer()[i] != aliased.frameBuffer()[i])
+            changedPixelCount++;
+    }
+    REQUIRE(changedPixelCount > 0);
+    REQUIRE(changedPixelCount <= antiAliased.supersampledPixelCount());
+}
+
+TEST_CASE("Shadow Tests")
+{
+    // A block floating above a floor, lit from straight above.
+    const glm::ivec3 dim { 48 };
+    std::vector<uint16_t> data(size_t(dim.x * dim.y * dim.z));
+    for (int z = 0; z < dim.z; z++)
+        for (int y = 0; y < dim.y; y++)
+            for (int x = 0; x < dim.x; x++) {
+                const bool block = x >= 18 && x < 30 && z >= 18 && z < 30 && y >= 28 && y < 34;
+                data[size_t(x + dim.x * (y + dim.y * z))] = uint16_t(y < 12 || block ? 200 : 10);
+            }
+    const volume::Volume volume { data, dim };
+    const volume::GradientVolume gradientVolume { volume };
+
+    const TestCamera camera { glm::vec3(24.3f, 100.0f, -30.0f), glm::vec3(24.1f, 12.0f, 23.9f) };
+    render::RenderConfig config {};
+    config.renderResolution = glm::ivec2(64);
+    config.renderMode = render::RenderMode::RenderIso;
+    config.isoValue = 100.0f;
+    render::Renderer renderer { &volume, &gradientVolume, &camera, config };
+    renderer.render();
+    const std::vector<glm::vec4> unshadowed(std::begin(renderer.frameBuffer()), std::end(renderer.frameBuffer()));
+    renderer.setShadowLight(glm::vec3(0.0f, 1.0f, 0.0f));
+    renderer.render();
+
+    // The block casts a shadow on the floor (and only darkens pixels).
+    size_t shadowedCount = 0;
+    for (size_t i = 0; i < unshadowed.size(); i++) {
+        const glm::vec4 color = renderer.frameBuffer()[i];
+        if (color != unshadowed[i]) {
+            REQUIRE(glm::vec3(color) == glm::vec3(unshadowed[i]) * 0.25f);
+            shadowedCount++;
+        }
+    }
+    REQUIRE(shadowedCount > 0);
+    REQUIRE(shadowedCount < unshadowed.size() / 4);
+
+    renderer.setShadowLight({});
+    renderer.render();
+    REQUIRE(std::equal(std::begin(unshadowed), std::end(unshadowed), std::begin(renderer.frameBuffer())));
+}
+
+TEST_CASE("Ray Gradient Tests")
+{
+    // A fuzzy ball: the values fall off linearly from the center.
+    const glm::ivec3 dim { 48 };
+    std::vector<uint16_t> data(size_t(dim.x * dim.y * dim.z));
+    for (int z = 0; z < dim.z; z++)
+        for (int y = 0; y < dim.y; y++)
+            for (int x = 0; x < dim.x; x++)
+                data[size_t(x + dim.x * (y + dim.y * z))] = uint16_t(std::max(200.0f - 10.0f * glm::length(glm::vec3(x, y, z) - 23.5f), 0.0f));
+    volume::Volume volume { data, dim };
+    volume.interpolationMode = volume::InterpolationMode::Linear;
+    volume::GradientVolume gradientVolume { volume };
+    gradientVolume.interpolationMode = volume::InterpolationMode::Linear;
+
+    const TestCamera camera { glm::vec3(24.3f, 30.6f, -40.0f), glm::vec3(23.6f, 23.4f, 23.7f) };
+    render::RenderConfig config {};
+    config.renderResolution = glm::ivec2(64);
+    config.renderMode = render::RenderMode::RenderComposite;
+    config.volumeShading = true;
+    for (size_t i = 0; i < config.tfColorMap.size(); i++)
+        config.tfColorMap[i] = glm::vec4(1.0f, 0.8f, 0.6f, i >= 80 ? 0.2f : 0.0f);
+    config.tfColorMapIndexStart = 0.0f;
+    config.tfColorMapIndexRange = 256.0f;
+    render::Renderer renderer { &volume, &gradientVolume, &camera, config };
+    renderer.render();
+    const std::vector<glm::vec4> reference(std::begin(renderer.frameBuffer()), std::end(renderer.frameBuffer()));
+    renderer.setGradientEstimation(render::GradientEstimation::RaySamples);
+    renderer.render();
+
+    // Both estimates shade the ball about the same.
+    float maxDifference = 0.0f, maxAlpha = 0.0f;
+    for (size_t i = 0; i < reference.size(); i++) {
+        const glm::vec4 color = renderer.frameBuffer()[i];
+        REQUIRE(color.a == Approx(reference[i].a));
+        maxDifference = std::max(maxDifference, glm::compMax(glm::abs(color - reference[i])));
+        maxAlpha = std::max(maxAlpha, color.a);
+    }
+    REQUIRE(maxAlpha > 0.5f);
+    REQUIRE(maxDifference < 0.1f);
+}
+
+TEST_CASE("Splat Rendering Tests")
+{
+    // A thin line of opaque voxels in an otherwise transparent volume.
+    const glm::ivec3 dim { 32 };
+    std::vector<uint16_t> data(size_t(dim.x * dim.y * dim.z), 0);
+    for (int x = 4; x < 28; x++)
+        data[size_t(x + dim.x * (16 + dim.y * 16))] = 200;
+    const volume::Volume volume { data, dim };
+
+    const TestCamera camera { glm::vec3(16.3f, 15.6f, -40.0f), glm::vec3(16.0f) };
+    render::RenderConfig config {};
+    config.renderResolution = glm::ivec2(64);
+    config.renderMode = render::RenderMode::RenderComposite;
+    for (size_t i = 0; i < config.tfColorMap.size(); i++)
+        config.tfColorMap[i] = i >= config.tfColorMap.size() * 100 / 256 ? glm::vec4(1.0f, 0.5f, 0.0f, 0.8f) : glm::vec4(0.0f);
+    config.tfColorMapIndexStart = 0.0f;
+    config.tfColorMapIndexRange = 256.0f;
+    render::SplatRenderer renderer { &volume, &camera, config };
+    REQUIRE(renderer.render());
+
+    // Only the voxels of the line are splatted.
+    REQUIRE(renderer.splatCount() == 24);
+    const auto pixel = [&](int x, int y) { return renderer.frameBuffer()[size_t(x + config.renderResolution.x * y)]; };
+    REQUIRE(pixel(32, 32).a > 0.0f);
+    REQUIRE(pixel(0, 0).a == 0.0f);
+
+    // Splats that do not fit in the memory budget are left to the ray caster.
+    memory::setMemoryBudget(memory::totalMemoryUsage() / 2);
+    renderer.volumeChanged();
+    REQUIRE(!renderer.render());
+    memory::setMemoryBudget({});
+    renderer.volumeChanged();
+    REQUIRE(renderer.render());
+
+    // Changing the transfer function extracts the splats again.
+    std::fill(std::begin(config.tfColorMap), std::end(config.tfColorMap), glm::vec4(0.0f));
+    renderer.setConfig(config);
+    REQUIRE(renderer.render());
+    REQUIRE(renderer.splatCount() == 0);
+    REQUIRE(std::all_of(std::begin(renderer.frameBuffer()), std::end(renderer.frameBuffer()), [](const glm::vec4& color) { return color == glm::vec4(0.0f); }));
+}
+
+TEST_CASE("Transfer Function Edit Tests")
+{
+    const volume::Volume volume = makeSphereVolume();
+    const volume::GradientVolume gradientVolume { volume };
+
+    TestCamera camera { glm::vec3(16.3f, 15.6f, -40.0f), glm::vec3(16.0f) };
+    render::RenderConfig config {};
+    config.renderResolution = glm::ivec2(64);
+    config.renderMode = render::RenderMode::RenderComposite;
+    config.tfColorMapIndexStart = 0.0f;
+    config.tfColorMapIndexRange = 256.0f;
+    for (size_t i = 0; i < config.tfColorMap.size(); i++)
+        config.tfColorMap[i] = glm::vec4(1.0f, 1.0f, 1.0f, i < 5 ? 0.0f : 0.02f);
+    render::Renderer renderer { &volume, &gradientVolume, &camera, config };
+    renderer.render();
+    REQUIRE(!renderer.localizedTileCount());
+
+    // Only the tiles that see the sphere are rendered again when the color of its value changes, and the result is
+    // the same as rendering everything.
+    for (size_t i = 190; i < 210; i++)
+        config.tfColorMap[i] = glm::vec4(1.0f, 0.0f, 0.0f, 0.5f);
+    renderer.setConfig(config);
+    REQUIRE(renderer.hasLocalizedRender());
+    renderer.render();
+    REQUIRE(renderer.localizedTileCount());
+    REQUIRE(*renderer.localizedTileCount() > 0);
+    REQUIRE(*renderer.localizedTileCount() < 16);
+    render::Renderer reference { &volume, &gradientVolume, &camera, config };
+    reference.render();
+    REQUIRE(std::equal(std::begin(renderer.frameBuffer()), std::end(renderer.frameBuffer()), std::begin(reference.frameBuffer())));
+
+    // Any other change renders everything.
+    camera = TestCamera { glm::vec3(16.3f, 15.6f, 72.0f), glm::vec3(16.0f) };
+    config.tfColorMap[200] = glm::vec4(0.0f, 1.0f, 0.0f, 0.5f);
+    renderer.setConfig(config);
+    renderer.render();
+    REQUIRE(!renderer.localizedTileCount());
+}
+
+TEST_CASE("Block Rendering Tests")
+{
+    const glm::ivec3 dim { 32 };
+    std::vector<uint16_t> data(size_t(dim.x * dim.y * dim.z));
+    for (int z = 0; z < dim.z; z++)
+        for (int y = 0; y < dim.y; y++)
+            for (int x = 0; x < dim.x; x++)
+                data[size_t(x + dim.x * (y + dim.y * z))] = uint16_t(glm::length(glm::vec3(x, y, z) - 16.0f) < 10.0f ? 50 + 5 * x : 10);
+    volume::Volume volume { data, dim };
+    volume.interpolationMode = volume::InterpolationMode::Linear;
+    const volume::GradientVolume gradientVolume { volume };
+
+    const TestCamera camera { glm::vec3(70, 25, 40), glm::vec3(16) };
+    render::RenderConfig config {};
+    config.renderMode = render::RenderMode::RenderComposite;
+    config.renderResolution = glm::ivec2(40, 40);
+    config.tfColorMapIndexStart = 0.0f;
+    config.tfColorMapIndexRange = volume.maximum();
+    for (size_t i = 0; i < config.tfColorMap.size(); i++)
+        config.tfColorMap[i] = glm::vec4(float(i) / 255.0f, 0.5f, 0.2f, i > 20 ? 0.05f : 0.0f);
+
+    render::Renderer full { &volume, &gradientVolume, &camera, config };
+    full.render();
+
+    // Split the volume in two blocks along x; the camera looks from the upper side.
+    render::Renderer front { &volume, &gradientVolume, &camera, config };
+    front.setBlockBounds(render::Bounds { glm::vec3(15, 0, 0), glm::vec3(31) });
+    front.render();
+    render::Renderer back { &volume, &gradientVolume, &camera, config };
+    back.setBlockBounds(render::Bounds { glm::vec3(0), glm::vec3(15, 31, 31) });
+    back.render();
+
+    // Every sample belongs to exactly one block so compositing the blocks gives the same image.
+    for (size_t i = 0; i < full.frameBuffer().size(); i++) {
+        const glm::vec4 frontColor = front.frameBuffer()[i];
+        const glm::vec4 composited = frontColor + (1.0f - frontColor.a) * back.frameBuffer()[i];
+        REQUIRE(glm::all(glm::lessThan(glm::abs(composited - full.frameBuffer()[i]), glm::vec4(1e-5f))));
+    }
+
+    // Rendering the screen region by region (as sort-first workers do) gives the same image.
+    render::Renderer regions { &volume, &gradientVolume, &camera, config };
+    regions.renderRegion(glm::ivec2(0), glm::ivec2(16, 40));
+    for (int y = 0; y < 40; y++) {
+        for (int x = 0; x < 40; x++) {
+            const size_t i = size_t(x + 40 * y);
+            REQUIRE(regions.frameBuffer()[i] == (x < 16 ? full.frameBuffer()[i] : glm::vec4(0.0f)));
+        }
+    }
+    regions.renderRegion(glm::ivec2(16, 0), glm::ivec2(40, 25));
+    regions.renderRegion(glm::ivec2(16, 25), glm::ivec2(40, 40));
+    REQUIRE(std::equal(std::begin(full.frameBuffer()), std::end(full.frameBuffer()), std::begin(regions.frameBuffer()), std::end(regions.frameBuffer())));
+}
+
+TEST_CASE("Frame Delta Tests")
+{
+    // Resolution that is not a multiple of the tile size.
+    const glm::ivec2 resolution { 70, 45 };
+    std::vector<glm::u8vec4> frame(size_t(resolution.x * resolution.y));
+    for (size_t i = 0; i < frame.size(); i++)
+        frame[i] = glm::u8vec4(uint8_t(i), uint8_t(i / 256), 0, 255);
+
+    ipc::FrameDeltaEncoder encoder { 16 };
+    ipc::FrameDeltaDecoder decoder;
+    REQUIRE(decoder.decode(encoder.encode(frame, resolution)));
+    REQUIRE(decoder.resolution() == resolution);
+    REQUIRE(std::equal(std::begin(frame), std::end(frame), std::begin(decoder.frame()), std::end(decoder.frame())));
+
+    // Only the tile containing the changed pixel is sent.
+    frame[size_t(66 + 40 * resolution.x)] = glm::u8vec4(1, 2, 3, 4);
+    const auto delta = encoder.encode(frame, resolution);
+    ipc::FrameDeltaHeader header;
+    std::memcpy(&header, delta.data(), sizeof(header));
+    REQUIRE(header.changedTileCount == 1);
+    REQUIRE(decoder.decode(delta));
+    REQUIRE(std::equal(std::begin(frame), std::end(frame), std::begin(decoder.frame()), std::end(decoder.frame())));
+
+    // Truncated messages are rejected.
+    REQUIRE(!decoder.decode(gsl::span<const uint8_t>(delta.data(), delta.size() - 1)));
+    // So are resolutions that would allocate an absurd frame.
+    const ipc::FrameDeltaHeader hugeHeader { glm::ivec2(1 << 30), 16, 0 };
+    std::vector<uint8_t> hugeMessage(sizeof(hugeHeader));
+    std::memcpy(hugeMessage.data(), &hugeHeader, sizeof(hugeHeader));
+    REQUIRE(!decoder.decode(hugeMessage));
+    REQUIRE(decoder.resolution() == resolution);
+    // And tile sizes for which the tile count would overflow.
+    const ipc::FrameDeltaHeader hugeTileHeader { resolution, std::numeric_limits<int32_t>::max(), 0 };
+    std::memcpy(hugeMessage.data(), &hugeTileHeader, sizeof(hugeTileHeader));
+    REQUIRE(!decoder.decode(hugeMessage));
+}
+
+TEST_CASE("Frame Cache Tests")
+{
+    const glm::ivec2 resolution { 16, 16 };
+    const size_t frameBytes = size_t(resolution.x * resolution.y) * sizeof(glm::u8vec4);
+    const auto makeFrame = [&](uint8_t value) { return std::vector<glm::u8vec4>(size_t(resolution.x * resolution.y), glm::u8vec4(value)); };
+    ipc::FrameRequest request {};
+    request.cameraState = session::CameraState { glm::vec3(16.0f), 50.0f, glm::quat(1.0f, 0.0f, 0.0f, 0.0f), 1.0f, 1.0f };
+    request.renderConfig.renderResolution = resolution;
+
+    // Room for two frames.
+    ipc::FrameCache cache { 2 * frameBytes };
+    REQUIRE(cache.find(request).empty());
+    cache.insert(request, makeFrame(1));
+
+    // Poses that only differ by rounding errors (or the sign of the quaternion) share a frame...
+    ipc::FrameRequest similar = request;
+    similar.cameraState.distance += 1e-6f;
+    similar.cameraState.rotation = glm::quat(-1.0f, 0.0f, 0.0f, 0.0f);
+    REQUIRE(!cache.find(similar).empty());
+    REQUIRE(cache.find(similar)[0] == glm::u8vec4(1));
+    // ...while any change of the render state is a different frame.
+    ipc::FrameRequest iso = request;
+    iso.renderConfig.renderMode = render::RenderMode::RenderIso;
+    REQUIRE(cache.find(iso).empty());
+    cache.insert(iso, makeFrame(2));
+
+    // The least recently used frame is evicted.
+    REQUIRE(!cache.find(request).empty());
+    ipc::FrameRequest moved = request;
+    moved.cameraState.distance = 60.0f;
+    cache.insert(moved, makeFrame(3));
+    REQUIRE(cache.frameCount() == 2);
+    REQUIRE(cache.size() == 2 * frameBytes);
+    REQUIRE(cache.find(iso).empty());
+    REQUIRE(!cache.find(request).empty());
+    REQUIRE(cache.find(moved)[0] == glm::u8vec4(3));
+}
+
+TEST_CASE("Histogram Image Tests")
+{
+    // 16-bit histograms are re-binned to the size of the widget.
+    std::vector<int> histogram(65536, 0);
+    histogram[0] = 1000;
+    histogram[137] = 10;
+    histogram[65535] = 1;
+    const auto binned = ui::rebinHistogram(histogram, 475);
+    REQUIRE(binned.bins.size() <= 475);
+    REQUIRE(binned.bins.size() * size_t(binned.binWidth) >= histogram.size());
+    REQUIRE(binned.bins[0] == 1010);
+    REQUIRE(binned.bins.back() == 1);
+
+    // Bars are scaled to the highest bar, unless a logarithmic scale makes the small counts visible.
+    const int height = 100;
+    const auto columnHeight = [&](const std::vector<uint8_t>& image, size_t x) {
+        int out = 0;
+        for (int y = 0; y < height; y++)
+            out += image[x + size_t(y) * binned.bins.size()] != 0;
+        return out;
+    };
+    const auto linearImage = ui::createBarChartImage(binned.bins, height, 255, false);
+    const auto logImage = ui::createBarChartImage(binned.bins, height, 255, true);
+    REQUIRE(linearImage.size() == binned.bins.size() * size_t(height));
+    REQUIRE(columnHeight(linearImage, 0) == 90);
+    REQUIRE(columnHeight(linearImage, binned.bins.size() - 1) == 0);
+    REQUIRE(columnHeight(logImage, binned.bins.size() - 1) > 0);
+
+    // 2D histograms: logarithm of the counts, normalized to the full 16-bit range.
+    const glm::ivec2 res { 3, 2 };
+    const std::vector<int> bins { 0, 1, 3, 0, 0, 0 };
+    const auto density = ui::createDensityImage(bins, res, 3, glm::ivec2(1, 0), glm::ivec2(3, 1));
+    REQUIRE(density.size() == 2);
+    REQUIRE(std::abs(int(density[0]) - 32768) <= 1); // log(2) / log(4)
+    REQUIRE(density[1] == 65535);
+}
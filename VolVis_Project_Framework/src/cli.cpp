@@ -0,0 +1,698 @@
+// Command line (headless) tools that do not require a window.
+#ifdef VOLVIS_POSIX_IPC
+#include "ipc/render_client.h"
+#include "ipc/render_server.h"
+#include "ipc/shared_volume.h"
+#include "ipc/sort_first.h"
+#include "ipc/sort_last.h"
+#include <unistd.h> // getpid
+#endif
+#include "memory/memory_registry.h"
+#include "render/image.h"
+#include "render/renderer.h"
+#include "session/animation.h"
+#include "session/auto_tune.h"
+#include "session/replay.h"
+#include "session/session.h"
+#include "ui/trackball.h"
+#include "volume/chunked_volume.h"
+#include "volume/gradient_volume.h"
+#include "volume/summed_volume.h"
+#include "volume/volume.h"
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <fmt/format.h>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+static void printUsage()
+{
+    std::cout << "Usage:" << std::endl;
+    std::cout << "  VolVisCLI replay <session file> [--volume <fld file>] [--csv <output file>]" << std::endl;
+    std::cout << "      Re-render a session recorded with \"Viewer --record <session file>\" and report per-frame timings." << std::endl;
+    std::cout << "  VolVisCLI animate <animation script> <output directory> [--frames-in-flight <count>]" << std::endl;
+    std::cout << "      Render a scripted camera path to a PNG image sequence (see session/animation.h for the script format)." << std::endl;
+    std::cout << "  VolVisCLI thumbnails <animation script> <output png> [--views <count>]" << std::endl;
+    std::cout << "      Render a grid of views around the volume (using the settings of the script at time 0) in a single batch." << std::endl;
+    std::cout << "  VolVisCLI tune <animation script> [--file <tuning file>] [--frames <count>]" << std::endl;
+    std::cout << "      Find the fastest brick and tile sizes for the volume and settings of the script (at time 0) on this machine and store them (default volvis_tuning.txt)." << std::endl;
+    std::cout << "  VolVisCLI memory <fld file>" << std::endl;
+    std::cout << "      Load a volume as the viewer does and report how much memory every part uses." << std::endl;
+    std::cout << "  VolVisCLI stats <fld file> <x0> <y0> <z0> <x1> <y1> <z1>" << std::endl;
+    std::cout << "      Report the mean, variance and histogram of the voxels in the box [x0, x1) x [y0, y1) x [z0, z1)." << std::endl;
+    std::cout << "  VolVisCLI profile <fld file> <x0> <y0> <z0> <x1> <y1> <z1> [--samples <count>]" << std::endl;
+    std::cout << "      Print the (trilinearly interpolated) values along the line from (x0, y0, z0) to (x1, y1, z1)." << std::endl;
+    std::cout << "  VolVisCLI convert <fld file> <cvol file> [--chunk-size <voxels>] [--levels <count>]" << std::endl;
+    std::cout << "      Convert a volume to a chunked, compressed volume file (optionally with lower resolution levels) that all commands and the viewer can load." << std::endl;
+    std::cout << "  VolVisCLI feed <fld file> <output file | named pipe> [--slices-per-second <rate>]" << std::endl;
+    std::cout << "      Write a volume slice by slice like a scanner does during acquisition, to watch it with \"Viewer --stream <named pipe>\" or \"Viewer --stream-follow <output file>\"." << std::endl;
+#ifdef VOLVIS_POSIX_IPC
+    std::cout << "  VolVisCLI share <fld file> <name>" << std::endl;
+    std::cout << "      Publish a volume in shared memory until enter is pressed. Other commands attach to it with \"shm:<name>\"." << std::endl;
+    std::cout << "  VolVisCLI serve <fld file | shm:name> <socket path> [--tile-size <pixels>] [--frame-cache <MiB>]" << std::endl;
+    std::cout << "      Run a render server that other processes can request frames from over a Unix domain socket." << std::endl;
+    std::cout << "      The most recently used frames that fit in the frame cache are sent again without rendering them." << std::endl;
+    std::cout << "  VolVisCLI connect <socket path> <animation script> [--output <directory>]" << std::endl;
+    std::cout << "      Request the frames of an animation from a render server and report how much data was transferred." << std::endl;
+    std::cout << "  VolVisCLI sort-last <fld file | shm:name> <animation script> <output directory> [--processes <power of two>]" << std::endl;
+    std::cout << "      Render an animation with multiple processes that each render a block of the volume (sort-last compositing)." << std::endl;
+    std::cout << "  VolVisCLI sort-first <fld file | shm:name> <animation script> <output directory> [--processes <count>] [--tile-size <pixels>]" << std::endl;
+    std::cout << "      Render an animation with multiple processes that render screen tiles, balanced by the cost of each tile." << std::endl;
+#endif
+    std::cout << "Options for all commands:" << std::endl;
+    std::cout << "  --memory-budget <MiB>" << std::endl;
+    std::cout << "      Store the gradients quantized or compute them on the fly if they do not fit in the budget." << std::endl;
+}
+
+// Returns the value following the given option (e.g. --csv out.csv) if it was provided.
+static std::optional<std::string_view> findOption(const std::vector<std::string_view>& args, std::string_view option)
+{
+    const auto iter = std::find(std::begin(args), std::end(args), option);
+    if (iter == std::end(args) || iter + 1 == std::end(args))
+        return {};
+    return *(iter + 1);
+}
+
+// The whole text as a number, or nothing if it is not one.
+template <typename T>
+static std::optional<T> parseNumber(std::string_view text)
+{
+    T value {};
+    const auto [pEnd, error] = std::from_chars(text.data(), text.data() + text.size(), value);
+    if (error != std::errc() || pEnd != text.data() + text.size())
+        return {};
+    return value;
+}
+
+// The value of the option (or the default if it is not given), or nothing after an error if it is not a number.
+template <typename T>
+static std::optional<T> findNumberOption(const std::vector<std::string_view>& args, std::string_view option, T defaultValue)
+{
+    const auto optText = findOption(args, option);
+    if (!optText)
+        return defaultValue;
+    const auto optValue = parseNumber<T>(*optText);
+    if (!optValue)
+        std::cerr << "Invalid value " << *optText << " for " << option << ", expected a number" << std::endl;
+    return optValue;
+}
+
+// Parses the arguments of a point (x, y and z), or prints an error and returns nothing.
+template <typename T>
+static std::optional<glm::vec<3, T>> parsePoint(const std::vector<std::string_view>& args, size_t first)
+{
+    glm::vec<3, T> out;
+    for (int axis = 0; axis < 3; axis++) {
+        const std::string_view text = args[first + size_t(axis)];
+        const auto optValue = parseNumber<T>(text);
+        if (!optValue) {
+            std::cerr << "Invalid coordinate " << text << ", expected a number" << std::endl;
+            return {};
+        }
+        out[axis] = *optValue;
+    }
+    return out;
+}
+
+static int replay(const std::vector<std::string_view>& args)
+{
+    if (args.empty()) {
+        printUsage();
+        return 1;
+    }
+
+    const auto events = session::loadSession(args[0]);
+    std::optional<std::filesystem::path> optVolumeOverride;
+    if (const auto optVolume = findOption(args, "--volume"))
+        optVolumeOverride = *optVolume;
+    const auto frameTimings = session::replaySession(events, optVolumeOverride);
+    if (frameTimings.empty()) {
+        std::cerr << "Session did not contain any frames" << std::endl;
+        return 1;
+    }
+
+    if (const auto optCsvFile = findOption(args, "--csv")) {
+        std::ofstream csvFile { std::filesystem::path(*optCsvFile) };
+        csvFile << "frame,timestamp,render_mode,width,height,render_time_ms\n";
+        for (size_t i = 0; i < frameTimings.size(); i++) {
+            const auto& frame = frameTimings[i];
+            csvFile << fmt::format("{},{},{},{},{},{}\n", i, frame.timestamp, int(frame.renderMode), frame.renderResolution.x, frame.renderResolution.y,
+                std::chrono::duration<double, std::milli>(frame.renderTime).count());
+        }
+    }
+
+    std::vector<double> renderTimes;
+    for (const auto& frame : frameTimings)
+        renderTimes.push_back(std::chrono::duration<double, std::milli>(frame.renderTime).count());
+    std::sort(std::begin(renderTimes), std::end(renderTimes));
+    double total = 0.0;
+    for (const double renderTime : renderTimes)
+        total += renderTime;
+    const auto percentile = [&](double p) { return renderTimes[std::min(size_t(p * double(renderTimes.size())), renderTimes.size() - 1)]; };
+    std::cout << fmt::format("frames: {}\ntotal: {:.2f}ms\nmean: {:.2f}ms\nmedian: {:.2f}ms\np95: {:.2f}ms\nmax: {:.2f}ms",
+        renderTimes.size(), total, total / double(renderTimes.size()), percentile(0.5), percentile(0.95), renderTimes.back())
+              << std::endl;
+    return 0;
+}
+
+static int animate(const std::vector<std::string_view>& args)
+{
+    if (args.size() < 2) {
+        printUsage();
+        return 1;
+    }
+
+    const auto script = session::loadAnimationScript(args[0]);
+    const auto optFramesInFlight = findNumberOption(args, "--frames-in-flight", 4);
+    if (!optFramesInFlight)
+        return 1;
+    const int framesInFlight = std::max(*optFramesInFlight, 1);
+
+    using clock = std::chrono::high_resolution_clock;
+    const auto start = clock::now();
+    session::exportAnimation(script, args[1], framesInFlight);
+    const auto end = clock::now();
+    std::cout << fmt::format("Rendered {} frames in {:.2f}s", script.frameCount(), std::chrono::duration<double>(end - start).count()) << std::endl;
+    return 0;
+}
+
+static int thumbnails(const std::vector<std::string_view>& args)
+{
+    if (args.size() < 2) {
+        printUsage();
+        return 1;
+    }
+
+    const auto script = session::loadAnimationScript(args[0]);
+    const auto optViewCount = findNumberOption(args, "--views", 16);
+    if (!optViewCount)
+        return 1;
+    const int viewCount = std::max(*optViewCount, 1);
+
+    volume::Volume volume { script.volumeFile };
+    volume.interpolationMode = script.interpolationMode;
+    volume::GradientVolume gradientVolume { volume };
+    gradientVolume.interpolationMode = script.interpolationMode;
+
+    // Views are spread evenly around the volume, starting at the camera of the script.
+    std::vector<ui::Trackball> cameras;
+    cameras.reserve(size_t(viewCount));
+    std::vector<const render::RayTraceCamera*> cameraPointers;
+    const session::CameraState cameraState = session::evaluateCamera(script, volume.extent(), 0.0f);
+    for (int i = 0; i < viewCount; i++) {
+        session::CameraState viewCameraState = cameraState;
+        viewCameraState.rotation = glm::angleAxis(glm::radians(360.0f * float(i) / float(viewCount)), glm::vec3(0, 1, 0)) * cameraState.rotation;
+        session::setCameraState(cameras.emplace_back(nullptr, cameraState.fovy, cameraState.aspectRatio), viewCameraState);
+    }
+    for (const auto& camera : cameras)
+        cameraPointers.push_back(&camera);
+
+    using clock = std::chrono::high_resolution_clock;
+    render::Renderer renderer { &volume, &gradientVolume, &cameras[0], session::evaluateRenderConfig(script, volume.maximum(), 0.0f) };
+    const auto start = clock::now();
+    const auto frameBuffers = renderer.renderBatch(cameraPointers);
+    const auto end = clock::now();
+    std::cout << fmt::format("Rendered {} views in {:.2f}ms", viewCount, std::chrono::duration<double, std::milli>(end - start).count()) << std::endl;
+
+    // Combine the views into a single image.
+    const glm::ivec2 resolution = script.resolution;
+    const int columns = int(std::ceil(std::sqrt(float(viewCount))));
+    const glm::ivec2 gridResolution = resolution * glm::ivec2(columns, (viewCount + columns - 1) / columns);
+    std::vector<glm::u8vec4> grid(size_t(gridResolution.x) * size_t(gridResolution.y), glm::u8vec4(0));
+    for (int i = 0; i < viewCount; i++) {
+        const auto view = render::convertToRGBA8(frameBuffers[size_t(i)]);
+        const glm::ivec2 offset = glm::ivec2(i % columns, i / columns) * resolution;
+        for (int y = 0; y < resolution.y; y++) {
+            std::copy_n(&view[size_t(y * resolution.x)], resolution.x, &grid[size_t(offset.x + (offset.y + y) * gridResolution.x)]);
+        }
+    }
+    render::writeFile(std::filesystem::path(args[1]), render::encodePNG(grid, gridResolution));
+    return 0;
+}
+
+static int tune(const std::vector<std::string_view>& args)
+{
+    if (args.empty()) {
+        printUsage();
+        return 1;
+    }
+
+    const auto script = session::loadAnimationScript(args[0]);
+    const std::filesystem::path tuningFile { findOption(args, "--file").value_or("volvis_tuning.txt") };
+    const auto optFrameCount = findNumberOption(args, "--frames", 4);
+    if (!optFrameCount)
+        return 1;
+    const int frameCount = std::max(*optFrameCount, 1);
+
+    volume::Volume volume { script.volumeFile };
+    volume.interpolationMode = script.interpolationMode;
+    volume::GradientVolume gradientVolume { volume };
+    gradientVolume.interpolationMode = script.interpolationMode;
+
+    const auto config = session::evaluateRenderConfig(script, volume.maximum(), 0.0f);
+    const session::TuningParameters parameters = session::autoTune(volume, gradientVolume, config, frameCount);
+    session::saveTuning(tuningFile, session::makeTuningKey(volume, config.renderMode), parameters);
+    std::cout << fmt::format("Best: brick size {}, tile size {} (stored in {})", parameters.brickSize, parameters.renderTuning.tileSize, tuningFile.string()) << std::endl;
+    return 0;
+}
+
+static int memoryReport(const std::vector<std::string_view>& args)
+{
+    if (args.empty()) {
+        printUsage();
+        return 1;
+    }
+
+    const volume::Volume volume { std::filesystem::path(args[0]) };
+    const volume::GradientVolume gradientVolume { volume };
+    // Framebuffer at the default resolution of animation scripts.
+    const ui::Trackball camera { nullptr, glm::radians(60.0f), 1.0f };
+    render::RenderConfig config {};
+    config.renderResolution = glm::ivec2(512);
+    const render::Renderer renderer { &volume, &gradientVolume, &camera, config };
+
+    std::cout << "Gradient storage: " << volume::gradientStorageName(gradientVolume.storage()) << std::endl;
+    std::cout << memory::formatMemoryUsage();
+    return 0;
+}
+
+static int regionStatistics(const std::vector<std::string_view>& args)
+{
+    if (args.size() != 7) {
+        printUsage();
+        return 1;
+    }
+
+    const auto optLower = parsePoint<int>(args, 1), optUpper = parsePoint<int>(args, 4);
+    if (!optLower || !optUpper)
+        return 1;
+    const glm::ivec3 lower = *optLower, upper = *optUpper;
+
+    const volume::Volume volume { std::filesystem::path(args[0]) };
+
+    const volume::SummedVolumeTable summedVolumeTable { volume };
+    const volume::RegionStatistics statistics = summedVolumeTable.statistics(lower, upper);
+    std::cout << fmt::format("Voxels: {}\nMean: {}\nVariance: {}", statistics.count, statistics.mean, statistics.variance) << std::endl;
+
+    const volume::IntegralHistogram integralHistogram { volume };
+    std::cout << "Histogram (box rounded outwards to cells of " << integralHistogram.cellSize() << " voxels):" << std::endl;
+    const auto histogram = integralHistogram.histogram(lower, upper);
+    for (size_t bin = 0; bin < histogram.size(); bin++) {
+        const int binStart = int(bin) * integralHistogram.binWidth();
+        std::cout << fmt::format("  {} - {}: {}", binStart, binStart + integralHistogram.binWidth() - 1, histogram[bin]) << std::endl;
+    }
+    return 0;
+}
+
+static int lineProfile(const std::vector<std::string_view>& args)
+{
+    if (args.size() < 7) {
+        printUsage();
+        return 1;
+    }
+
+    const auto optBegin = parsePoint<float>(args, 1), optEnd = parsePoint<float>(args, 4);
+    const auto optSampleCount = findNumberOption(args, "--samples", 100);
+    if (!optBegin || !optEnd || !optSampleCount)
+        return 1;
+    const glm::vec3 begin = *optBegin, end = *optEnd;
+
+    volume::Volume volume { std::filesystem::path(args[0]) };
+    volume.interpolationMode = volume::InterpolationMode::Linear;
+    std::vector<float> profile(size_t(std::max(*optSampleCount, 2)));
+    volume.sampleLine(begin, end, profile);
+    for (size_t i = 0; i < profile.size(); i++) {
+        const glm::vec3 position = glm::mix(begin, end, float(i) / float(profile.size() - 1));
+        std::cout << fmt::format("{:.2f} {:.2f} {:.2f} {}", position.x, position.y, position.z, profile[i]) << std::endl;
+    }
+    return 0;
+}
+
+static int convertVolume(const std::vector<std::string_view>& args)
+{
+    if (args.size() < 2) {
+        printUsage();
+        return 1;
+    }
+    const auto optChunkSize = findNumberOption(args, "--chunk-size", 64);
+    const auto optLevelCount = findNumberOption(args, "--levels", 1);
+    if (!optChunkSize || !optLevelCount)
+        return 1;
+
+    const volume::Volume volume { std::filesystem::path(args[0]) };
+    const std::filesystem::path outputFile { args[1] };
+    if (!volume::writeChunkedVolume(outputFile, volume, *optChunkSize, *optLevelCount))
+        return 1;
+
+    // Read the file back to verify it and to measure the (parallel) decompression.
+    volume::ChunkedVolumeReader reader { outputFile };
+    using clock = std::chrono::high_resolution_clock;
+    const auto start = clock::now();
+    const auto voxels = reader.readLevel(0);
+    const auto end = clock::now();
+    if (!std::equal(std::begin(voxels), std::end(voxels), std::begin(volume.data()), std::end(volume.data()))) {
+        std::cerr << "Converted volume does not match the input" << std::endl;
+        return 1;
+    }
+    std::cout << fmt::format("{} levels in chunks of {}^3 voxels: {} -> {} ({:.1f}%), decompressed level 0 in {:.1f}ms",
+        reader.levelCount(), reader.chunkSize(), memory::formatBytes(reader.uncompressedSize()), memory::formatBytes(reader.compressedSize()),
+        100.0 * double(reader.compressedSize()) / double(reader.uncompressedSize()), std::chrono::duration<double, std::milli>(end - start).count())
+              << std::endl;
+    return 0;
+}
+
+// Stand-in for a scanner: the header is written first, followed by one slice at a time.
+static int feedSlices(const std::vector<std::string_view>& args)
+{
+    if (args.size() < 2) {
+        printUsage();
+        return 1;
+    }
+    const auto optSlicesPerSecond = findNumberOption(args, "--slices-per-second", 10.0f);
+    if (!optSlicesPerSecond)
+        return 1;
+    const float slicesPerSecond = *optSlicesPerSecond;
+
+    const volume::Volume volume { std::filesystem::path(args[0]) };
+    if (volume.channelCount() != 1) {
+        std::cerr << "Only volumes with a single channel can be streamed" << std::endl;
+        return 1;
+    }
+    const glm::ivec3 dim = volume.dims();
+    std::ofstream file { std::filesystem::path(args[1]), std::ios::binary };
+    if (!file.is_open()) {
+        std::cerr << "Could not open " << args[1] << " for writing" << std::endl;
+        return 1;
+    }
+    // Same spacing and voxel type as the input, such that the stream gives the same volume as loading it.
+    const volume::ValueMapping& valueMapping = volume.valueMapping();
+    volume::FieldHeader header {};
+    header.dim = dim;
+    header.optVoxelType = valueMapping.fileType;
+    header.spacing = volume.spacing();
+    volume::writeFieldHeader(file, header);
+    file.flush();
+
+    const auto sliceInterval = std::chrono::duration<float>(1.0f / std::max(slicesPerSecond, 0.001f));
+    const size_t sliceSize = size_t(dim.x) * size_t(dim.y);
+    std::vector<char> bytes(sliceSize * volume::voxelTypeSize(valueMapping.fileType));
+    for (int z = 0; z < dim.z && file.good(); z++) {
+        volume::encodeVoxels(volume.data().subspan(size_t(z) * sliceSize, sliceSize), valueMapping, bytes);
+        file.write(bytes.data(), std::streamsize(bytes.size()));
+        file.flush();
+        std::cout << "Slice " << z + 1 << " / " << dim.z << std::endl;
+        std::this_thread::sleep_for(sliceInterval);
+    }
+    return file.good() ? 0 : 1;
+}
+
+#ifdef VOLVIS_POSIX_IPC
+static int share(const std::vector<std::string_view>& args)
+{
+    if (args.size() < 2) {
+        printUsage();
+        return 1;
+    }
+
+    const volume::Volume volume { std::filesystem::path(args[0]) };
+    const volume::GradientVolume gradientVolume { volume };
+    const auto pSharedMemory = ipc::publishVolume(std::string(args[1]), volume, gradientVolume);
+    if (!pSharedMemory)
+        return 1;
+
+    std::cout << fmt::format("Published {} ({:.1f} MB) as \"shm:{}\", press enter to stop sharing", volume.fileName(), double(pSharedMemory->size()) / 1e6, args[1]) << std::endl;
+    std::cin.get();
+    return 0;
+}
+
+static int serve(const std::vector<std::string_view>& args)
+{
+    if (args.size() < 2) {
+        printUsage();
+        return 1;
+    }
+
+    const auto optTileSize = findNumberOption(args, "--tile-size", 32);
+    if (!optTileSize)
+        return 1;
+    const int tileSize = std::max(*optTileSize, 1);
+    size_t frameCacheBytes = 0;
+    if (const auto optFrameCache = findOption(args, "--frame-cache")) {
+        const auto optFrameCacheBytes = memory::parseMebibytes(*optFrameCache);
+        if (!optFrameCacheBytes) {
+            std::cerr << "Invalid frame cache size " << *optFrameCache << ", expected a number of MiB" << std::endl;
+            return 1;
+        }
+        frameCacheBytes = *optFrameCacheBytes;
+    }
+
+    auto pVolume = ipc::loadVolume(std::filesystem::path(args[0]));
+    if (!pVolume)
+        return 1;
+    ipc::RenderServer server { std::move(pVolume), tileSize, frameCacheBytes };
+    return server.run(std::filesystem::path(args[1])) ? 0 : 1;
+}
+
+static int connectClient(const std::vector<std::string_view>& args)
+{
+    if (args.size() < 2) {
+        printUsage();
+        return 1;
+    }
+
+    ipc::RenderClient client { std::filesystem::path(args[0]) };
+    if (!client.isConnected())
+        return 1;
+
+    // The volume of the script is ignored; the server decides which volume is rendered.
+    const auto script = session::loadAnimationScript(args[1]);
+    const auto optOutputDirectory = findOption(args, "--output");
+    if (optOutputDirectory)
+        std::filesystem::create_directories(*optOutputDirectory);
+
+    const auto& hello = client.serverHello();
+    const int frameCount = script.frameCount();
+    const size_t fullFrameSize = size_t(script.resolution.x) * size_t(script.resolution.y) * sizeof(glm::u8vec4);
+    size_t totalBytesReceived = 0;
+    double totalRenderTime = 0.0;
+    for (int i = 0; i < frameCount; i++) {
+        const float time = float(i) / script.fps;
+        const ipc::FrameRequest request {
+            session::evaluateCamera(script, glm::vec3(hello.volumeDims) * hello.volumeSpacing, time),
+            session::evaluateRenderConfig(script, hello.volumeMaximum, time),
+            script.interpolationMode
+        };
+        const auto optStatistics = client.requestFrame(request);
+        if (!optStatistics) {
+            std::cerr << "Lost connection to the render server" << std::endl;
+            return 1;
+        }
+
+        totalBytesReceived += optStatistics->bytesReceived;
+        totalRenderTime += optStatistics->renderTime;
+        std::cout << fmt::format("Frame {}: {} changed tiles, {} bytes ({:.1f}% of a full frame), rendered in {:.2f}ms",
+            i, optStatistics->changedTileCount, optStatistics->bytesReceived,
+            100.0 * double(optStatistics->bytesReceived) / double(fullFrameSize), optStatistics->renderTime * 1000.0)
+                  << std::endl;
+        if (optOutputDirectory)
+            render::writeFile(std::filesystem::path(*optOutputDirectory) / fmt::format("frame_{:05}.png", i), render::encodePNG(client.frame(), client.resolution()));
+    }
+    std::cout << fmt::format("Received {} bytes for {} frames ({:.1f}% of sending full frames), total render time {:.2f}ms",
+        totalBytesReceived, frameCount, 100.0 * double(totalBytesReceived) / double(fullFrameSize * size_t(frameCount)), totalRenderTime * 1000.0)
+              << std::endl;
+    return 0;
+}
+
+// Volume that worker processes attach to in shared memory instead of all loading their own copy.
+struct WorkerVolume {
+    std::string path; // "shm:<name>"
+    std::unique_ptr<ipc::SharedMemory> pSharedMemory; // Null if the volume was shared already.
+    glm::vec3 extent;
+    float maximum;
+};
+
+static std::optional<WorkerVolume> shareWithWorkers(std::string_view volumePath)
+{
+    auto pVolume = ipc::loadVolume(std::string(volumePath));
+    if (!pVolume)
+        return {};
+
+    WorkerVolume out { std::string(volumePath), nullptr, pVolume->volume.extent(), pVolume->volume.maximum() };
+    if (volumePath.rfind("shm:", 0) != 0) {
+        const std::string name = fmt::format("volvis_workers_{}", getpid());
+        out.pSharedMemory = ipc::publishVolume(name, pVolume->volume, pVolume->gradientVolume);
+        if (!out.pSharedMemory)
+            return {};
+        out.path = "shm:" + name;
+    }
+    return out;
+}
+
+static int sortLast(const std::vector<std::string_view>& args, const std::filesystem::path& executable)
+{
+    if (args.size() < 3) {
+        printUsage();
+        return 1;
+    }
+
+    const auto optProcessCount = findNumberOption(args, "--processes", 4);
+    if (!optProcessCount)
+        return 1;
+    const int processCount = std::max(*optProcessCount, 1);
+
+    const auto optVolume = shareWithWorkers(args[0]);
+    if (!optVolume)
+        return 1;
+    const glm::vec3 volumeExtent = optVolume->extent;
+    const float volumeMaximum = optVolume->maximum;
+
+    ipc::SortLastRenderer renderer { executable, optVolume->path, processCount };
+    if (!renderer.isRunning())
+        return 1;
+
+    const auto script = session::loadAnimationScript(args[1]);
+    const std::filesystem::path outputDirectory { args[2] };
+    std::filesystem::create_directories(outputDirectory);
+    for (int i = 0; i < script.frameCount(); i++) {
+        const float time = float(i) / script.fps;
+        const ipc::FrameRequest request {
+            session::evaluateCamera(script, volumeExtent, time),
+            session::evaluateRenderConfig(script, volumeMaximum, time),
+            script.interpolationMode
+        };
+
+        using clock = std::chrono::high_resolution_clock;
+        const auto start = clock::now();
+        const auto optStatistics = renderer.render(request);
+        const auto end = clock::now();
+        if (!optStatistics) {
+            std::cerr << "Sort-last worker failed" << std::endl;
+            return 1;
+        }
+        std::cout << fmt::format("Frame {}: {:.2f}ms (render {:.2f}ms, composite {:.2f}ms)", i,
+            std::chrono::duration<double, std::milli>(end - start).count(), optStatistics->renderTime * 1000.0, optStatistics->compositeTime * 1000.0)
+                  << std::endl;
+        render::writeFile(outputDirectory / fmt::format("frame_{:05}.png", i), render::encodePNG(render::convertToRGBA8(renderer.frameBuffer()), script.resolution));
+    }
+    return 0;
+}
+
+static int sortFirst(const std::vector<std::string_view>& args, const std::filesystem::path& executable)
+{
+    if (args.size() < 3) {
+        printUsage();
+        return 1;
+    }
+
+    const auto optProcessCount = findNumberOption(args, "--processes", 4);
+    const auto optTileSize = findNumberOption(args, "--tile-size", 32);
+    if (!optProcessCount || !optTileSize)
+        return 1;
+    const int processCount = std::max(*optProcessCount, 1);
+    const int tileSize = std::max(*optTileSize, 1);
+
+    const auto optVolume = shareWithWorkers(args[0]);
+    if (!optVolume)
+        return 1;
+
+    ipc::SortFirstRenderer renderer { executable, optVolume->path, processCount, tileSize };
+    if (!renderer.isRunning())
+        return 1;
+
+    const auto script = session::loadAnimationScript(args[1]);
+    const std::filesystem::path outputDirectory { args[2] };
+    std::filesystem::create_directories(outputDirectory);
+    for (int i = 0; i < script.frameCount(); i++) {
+        const float time = float(i) / script.fps;
+        const ipc::FrameRequest request {
+            session::evaluateCamera(script, optVolume->extent, time),
+            session::evaluateRenderConfig(script, optVolume->maximum, time),
+            script.interpolationMode
+        };
+
+        using clock = std::chrono::high_resolution_clock;
+        const auto start = clock::now();
+        const auto optStatistics = renderer.render(request);
+        const auto end = clock::now();
+        if (!optStatistics) {
+            std::cerr << "Sort-first rendering failed" << std::endl;
+            return 1;
+        }
+        std::cout << fmt::format("Frame {}: {:.2f}ms ({} workers, {} batches, worker render time {:.2f}ms - {:.2f}ms)", i,
+            std::chrono::duration<double, std::milli>(end - start).count(), optStatistics->workerCount, optStatistics->batchCount,
+            optStatistics->minWorkerTime * 1000.0, optStatistics->maxWorkerTime * 1000.0)
+                  << std::endl;
+        render::writeFile(outputDirectory / fmt::format("frame_{:05}.png", i), render::encodePNG(render::convertToRGBA8(renderer.frameBuffer()), script.resolution));
+    }
+    return 0;
+}
+#endif
+
+int main(int argc, char** argv)
+{
+    const std::vector<std::string_view> args(argv + 1, argv + argc);
+    if (args.empty()) {
+        printUsage();
+        return 1;
+    }
+
+    const std::string_view command = args[0];
+    const std::vector<std::string_view> commandArgs(std::begin(args) + 1, std::end(args));
+    if (const auto optMemoryBudget = findOption(commandArgs, "--memory-budget")) {
+        const auto optBudget = memory::parseMebibytes(*optMemoryBudget);
+        if (!optBudget) {
+            std::cerr << "Invalid memory budget " << *optMemoryBudget << ", expected a number of MiB" << std::endl;
+            return 1;
+        }
+        memory::setMemoryBudget(optBudget);
+    }
+
+    if (command == "replay")
+        return replay(commandArgs);
+    if (command == "animate")
+        return animate(commandArgs);
+    if (command == "thumbnails")
+        return thumbnails(commandArgs);
+    if (command == "tune")
+        return tune(commandArgs);
+    if (command == "memory")
+        return memoryReport(commandArgs);
+    if (command == "stats")
+        return regionStatistics(commandArgs);
+    if (command == "profile")
+        return lineProfile(commandArgs);
+    if (command == "convert")
+        return convertVolume(commandArgs);
+    if (command == "feed")
+        return feedSlices(commandArgs);
+#ifdef VOLVIS_POSIX_IPC
+    if (command == "share")
+        return share(commandArgs);
+    if (command == "serve")
+        return serve(commandArgs);
+    if (command == "connect")
+        return connectClient(commandArgs);
+    if (command == "sort-last")
+        return sortLast(commandArgs, argv[0]);
+    // Started by the sort-last command.
+    if (command == "sort-last-worker")
+        return ipc::runSortLastWorker(commandArgs);
+    if (command == "sort-first")
+        return sortFirst(commandArgs, argv[0]);
+    // Started by the sort-first command.
+    if (command == "sort-first-worker")
+        return ipc::runSortFirstWorker(commandArgs);
+#endif
+
+    printUsage();
+    return 1;
+}
@@ -0,0 +1,135 @@
+#include "frame_cache.h"
+#include <cmath>
+#include <cstring>
+
+static uint64_t hashBytes(const void* pData, size_t size, uint64_t hash);
+
+namespace ipc {
+
+FrameKey makeFrameKey(const FrameRequest& request, float poseQuantizationStep)
+{
+    const auto& camera = request.cameraState;
+    // q and -q are the same rotation.
+    const float sign = camera.rotation.w < 0.0f ? -1.0f : 1.0f;
+    const std::array pose { camera.lookAt.x, camera.lookAt.y, camera.lookAt.z, camera.distance,
+        sign * camera.rotation.x, sign * camera.rotation.y, sign * camera.rotation.z, sign * camera.rotation.w, camera.fovy, camera.aspectRatio };
+
+    FrameKey out;
+    for (size_t i = 0; i < pose.size(); i++)
+        out.quantizedPose[i] = int64_t(std::llround(double(pose[i]) / double(poseQuantizationStep)));
+    // Copy the padding bytes too because the render config is compared and hashed as raw memory.
+    std::memcpy(static_cast<void*>(&out.renderConfig), &request.renderConfig, sizeof(render::RenderConfig));
+    out.interpolationMode = request.interpolationMode;
+    return out;
+}
+
+bool operator==(const FrameKey& lhs, const FrameKey& rhs)
+{
+    return lhs.quantizedPose == rhs.quantizedPose && lhs.renderConfig == rhs.renderConfig && lhs.interpolationMode == rhs.interpolationMode;
+}
+
+size_t FrameCache::FrameKeyHash::operator()(const FrameKey& key) const
+{
+    uint64_t hash = 14695981039346656037ull; // FNV-1a offset basis.
+    hash = hashBytes(key.quantizedPose.data(), key.quantizedPose.size() * sizeof(int64_t), hash);
+    hash = hashBytes(&key.renderConfig, sizeof(key.renderConfig), hash);
+    hash = hashBytes(&key.interpolationMode, sizeof(key.interpolationMode), hash);
+    return size_t(hash);
+}
+
+FrameCache::FrameCache(size_t capacityBytes, float poseQuantizationStep)
+    : m_capacity(capacityBytes)
+    , m_poseQuantizationStep(poseQuantizationStep)
+    , m_memory("Frame cache")
+{
+}
+
+gsl::span<const glm::u8vec4> FrameCache::find(const FrameRequest& request)
+{
+    if (m_capacity == 0)
+        return {};
+
+    const auto iter = m_lookup.find(makeFrameKey(request, m_poseQuantizationStep));
+    if (iter == std::end(m_lookup)) {
+        m_missCount++;
+        return {};
+    }
+
+    // Move to the front of the list (iterators stay valid).
+    m_entries.splice(std::begin(m_entries), m_entries, iter->second);
+    m_hitCount++;
+    return iter->second->frame;
+}
+
+void FrameCache::insert(const FrameRequest& request, std::vector<glm::u8vec4> frame)
+{
+    const size_t frameBytes = frame.size() * sizeof(glm::u8vec4);
+    if (frameBytes > m_capacity)
+        return;
+
+    FrameKey key = makeFrameKey(request, m_poseQuantizationStep);
+    if (const auto iter = m_lookup.find(key); iter != std::end(m_lookup)) {
+        m_memory.setSize(m_memory.size() - iter->second->frame.size() * sizeof(glm::u8vec4));
+        m_entries.erase(iter->second);
+        m_lookup.erase(iter);
+    }
+    evict(frameBytes);
+
+    m_entries.push_front(Entry { key, std::move(frame) });
+    m_lookup.emplace(std::move(key), std::begin(m_entries));
+    m_memory.setSize(m_memory.size() + frameBytes);
+}
+
+void FrameCache::clear()
+{
+    m_entries.clear();
+    m_lookup.clear();
+    m_memory.setSize(0);
+}
+
+size_t FrameCache::capacity() const
+{
+    return m_capacity;
+}
+
+size_t FrameCache::size() const
+{
+    return m_memory.size();
+}
+
+size_t FrameCache::frameCount() const
+{
+    return m_entries.size();
+}
+
+size_t FrameCache::hitCount() const
+{
+    return m_hitCount;
+}
+
+size_t FrameCache::missCount() const
+{
+    return m_missCount;
+}
+
+void FrameCache::evict(size_t bytesNeeded)
+{
+    while (!m_entries.empty() && m_memory.size() + bytesNeeded > m_capacity) {
+        const Entry& entry = m_entries.back();
+        m_memory.setSize(m_memory.size() - entry.frame.size() * sizeof(glm::u8vec4));
+        m_lookup.erase(entry.key);
+        m_entries.pop_back();
+    }
+}
+
+}
+
+static uint64_t hashBytes(const void* pData, size_t size, uint64_t hash)
+{
+    const auto* pBytes = static_cast<const uint8_t*>(pData);
+    for (size_t i = 0; i < size; i++) {
+        hash ^= pBytes[i];
+        hash *= 1099511628211ull; // FNV-1a prime.
+    }
+    return hash;
+}
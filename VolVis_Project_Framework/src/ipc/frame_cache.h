@@ -0,0 +1,64 @@
+#pragma once
+#include "ipc/protocol.h"
+#include "memory/memory_registry.h"
+#include <array>
+#include <cstdint>
+#include <glm/gtc/type_precision.hpp> // glm::u8vec4
+#include <gsl/span>
+#include <list>
+#include <unordered_map>
+#include <vector>
+
+namespace ipc {
+
+// Identifies a frame: the camera pose rounded to a grid (such that poses that only differ by rounding errors share an
+// entry) and the rest of the render state, which has to match exactly.
+struct FrameKey {
+    std::array<int64_t, 10> quantizedPose;
+    render::RenderConfig renderConfig;
+    volume::InterpolationMode interpolationMode;
+};
+FrameKey makeFrameKey(const FrameRequest& request, float poseQuantizationStep);
+bool operator==(const FrameKey& lhs, const FrameKey& rhs);
+
+// Least recently used cache of RGBA8 frames. Users often switch back and forth between render modes or transfer
+// functions, or return to a previous view; those frames are returned from the cache instead of being rendered again.
+// The least recently used frames are evicted when the frames would use more than the capacity (zero disables the cache).
+class FrameCache {
+public:
+    FrameCache(size_t capacityBytes, float poseQuantizationStep = 1e-4f);
+
+    // Returns an empty span on a miss. The frame stays valid until the next call to insert() or clear().
+    gsl::span<const glm::u8vec4> find(const FrameRequest& request);
+    void insert(const FrameRequest& request, std::vector<glm::u8vec4> frame);
+    void clear();
+
+    size_t capacity() const;
+    size_t size() const; // Bytes used by the cached frames.
+    size_t frameCount() const;
+    size_t hitCount() const;
+    size_t missCount() const;
+
+private:
+    struct FrameKeyHash {
+        size_t operator()(const FrameKey& key) const;
+    };
+    struct Entry {
+        FrameKey key;
+        std::vector<glm::u8vec4> frame;
+    };
+    void evict(size_t bytesNeeded);
+
+private:
+    size_t m_capacity;
+    float m_poseQuantizationStep;
+    size_t m_hitCount { 0 }, m_missCount { 0 };
+
+    // Most recently used first.
+    std::list<Entry> m_entries;
+    std::unordered_map<FrameKey, std::list<Entry>::iterator, FrameKeyHash> m_lookup;
+
+    memory::TrackedMemory m_memory;
+};
+
+}
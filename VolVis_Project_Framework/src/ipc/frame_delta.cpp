@@ -0,0 +1,156 @@
+#include "frame_delta.h"
+#include "ipc/protocol.h"
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <tbb/parallel_for.h>
+
+// Rectangle of pixels covered by a tile (clipped to the image).
+struct TileRect {
+    glm::ivec2 begin, end;
+};
+
+static glm::ivec2 computeTileCount(const glm::ivec2& resolution, int tileSize);
+static TileRect computeTileRect(uint32_t tileIndex, const glm::ivec2& resolution, int tileSize);
+
+namespace ipc {
+
+FrameDeltaEncoder::FrameDeltaEncoder(int tileSize)
+    : m_tileSize(tileSize)
+{
+    assert(tileSize > 0);
+}
+
+std::vector<uint8_t> FrameDeltaEncoder::encode(gsl::span<const glm::u8vec4> frame, const glm::ivec2& resolution)
+{
+    assert(frame.size() == size_t(resolution.x) * size_t(resolution.y));
+
+    // Send everything if there is no previous frame to compare against.
+    const bool sendAll = resolution != m_resolution;
+    const glm::ivec2 tileCount = computeTileCount(resolution, m_tileSize);
+    const size_t numTiles = size_t(tileCount.x) * size_t(tileCount.y);
+
+    // Compare the tiles in parallel.
+    std::vector<uint8_t> tileChanged(numTiles, uint8_t(sendAll));
+    if (!sendAll) {
+        tbb::parallel_for(size_t(0), numTiles, [&](size_t tileIndex) {
+            const TileRect rect = computeTileRect(uint32_t(tileIndex), resolution, m_tileSize);
+            const size_t rowBytes = size_t(rect.end.x - rect.begin.x) * sizeof(glm::u8vec4);
+            for (int y = rect.begin.y; y < rect.end.y; y++) {
+                const size_t offset = size_t(rect.begin.x) + size_t(y) * size_t(resolution.x);
+                if (std::memcmp(&frame[offset], &m_previousFrame[offset], rowBytes) != 0) {
+                    tileChanged[tileIndex] = 1;
+                    return;
+                }
+            }
+        });
+    }
+
+    FrameDeltaHeader header { resolution, m_tileSize, 0 };
+    header.changedTileCount = uint32_t(std::count(std::begin(tileChanged), std::end(tileChanged), uint8_t(1)));
+
+    std::vector<uint8_t> out(sizeof(header));
+    std::memcpy(out.data(), &header, sizeof(header));
+    for (size_t tileIndex = 0; tileIndex < numTiles; tileIndex++) {
+        if (!tileChanged[tileIndex])
+            continue;
+
+        const TileRect rect = computeTileRect(uint32_t(tileIndex), resolution, m_tileSize);
+        const size_t rowBytes = size_t(rect.end.x - rect.begin.x) * sizeof(glm::u8vec4);
+        size_t writeOffset = out.size();
+        out.resize(out.size() + sizeof(uint32_t) + rowBytes * size_t(rect.end.y - rect.begin.y));
+
+        const uint32_t index = uint32_t(tileIndex);
+        std::memcpy(&out[writeOffset], &index, sizeof(index));
+        writeOffset += sizeof(index);
+        for (int y = rect.begin.y; y < rect.end.y; y++) {
+            std::memcpy(&out[writeOffset], &frame[size_t(rect.begin.x) + size_t(y) * size_t(resolution.x)], rowBytes);
+            writeOffset += rowBytes;
+        }
+    }
+
+    m_resolution = resolution;
+    m_previousFrame.assign(std::begin(frame), std::end(frame));
+    return out;
+}
+
+void FrameDeltaEncoder::reset()
+{
+    m_resolution = glm::ivec2(0);
+    m_previousFrame.clear();
+}
+
+bool FrameDeltaDecoder::decode(gsl::span<const uint8_t> message)
+{
+    FrameDeltaHeader header;
+    if (message.size() < sizeof(header))
+        return false;
+    std::memcpy(&header, message.data(), sizeof(header));
+    if (header.resolution.x < 0 || header.resolution.y < 0 || header.resolution.x > maxFrameResolution || header.resolution.y > maxFrameResolution)
+        return false;
+    // Larger tiles than frames would overflow the tile count.
+    if (header.tileSize <= 0 || header.tileSize > maxFrameResolution)
+        return false;
+
+    // Validate the message before modifying the frame.
+    const glm::ivec2 tileCount = computeTileCount(header.resolution, header.tileSize);
+    const size_t numTiles = size_t(tileCount.x) * size_t(tileCount.y);
+    std::vector<std::pair<uint32_t, size_t>> tiles; // Tile index + offset of its pixels in the message.
+    size_t readOffset = sizeof(header);
+    for (uint32_t i = 0; i < header.changedTileCount; i++) {
+        uint32_t tileIndex;
+        if (message.size() < readOffset + sizeof(tileIndex))
+            return false;
+        std::memcpy(&tileIndex, &message[readOffset], sizeof(tileIndex));
+        readOffset += sizeof(tileIndex);
+        if (tileIndex >= numTiles)
+            return false;
+
+        const TileRect rect = computeTileRect(tileIndex, header.resolution, header.tileSize);
+        const size_t tileBytes = size_t(rect.end.x - rect.begin.x) * size_t(rect.end.y - rect.begin.y) * sizeof(glm::u8vec4);
+        if (message.size() < readOffset + tileBytes)
+            return false;
+        tiles.emplace_back(tileIndex, readOffset);
+        readOffset += tileBytes;
+    }
+
+    if (header.resolution != m_resolution) {
+        m_resolution = header.resolution;
+        m_frame.assign(size_t(m_resolution.x) * size_t(m_resolution.y), glm::u8vec4(0));
+    }
+
+    tbb::parallel_for(size_t(0), tiles.size(), [&](size_t i) {
+        const auto [tileIndex, tileOffset] = tiles[i];
+        const TileRect rect = computeTileRect(tileIndex, m_resolution, header.tileSize);
+        const size_t rowBytes = size_t(rect.end.x - rect.begin.x) * sizeof(glm::u8vec4);
+        for (int y = rect.begin.y; y < rect.end.y; y++) {
+            std::memcpy(&m_frame[size_t(rect.begin.x) + size_t(y) * size_t(m_resolution.x)], &message[tileOffset + size_t(y - rect.begin.y) * rowBytes], rowBytes);
+        }
+    });
+    return true;
+}
+
+gsl::span<const glm::u8vec4> FrameDeltaDecoder::frame() const
+{
+    return m_frame;
+}
+
+glm::ivec2 FrameDeltaDecoder::resolution() const
+{
+    return m_resolution;
+}
+
+}
+
+static glm::ivec2 computeTileCount(const glm::ivec2& resolution, int tileSize)
+{
+    return (resolution + tileSize - 1) / tileSize;
+}
+
+static TileRect computeTileRect(uint32_t tileIndex, const glm::ivec2& resolution, int tileSize)
+{
+    const glm::ivec2 tileCount = computeTileCount(resolution, tileSize);
+    const glm::ivec2 tile { int(tileIndex) % tileCount.x, int(tileIndex) / tileCount.x };
+    const glm::ivec2 begin = tile * tileSize;
+    return TileRect { begin, glm::min(begin + tileSize, resolution) };
+}
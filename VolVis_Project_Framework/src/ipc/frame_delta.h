@@ -0,0 +1,49 @@
+#pragma once
+#include <cstdint>
+#include <glm/gtc/type_precision.hpp> // glm::u8vec4
+#include <glm/vec2.hpp>
+#include <gsl/span>
+#include <vector>
+
+namespace ipc {
+
+// An encoded frame starts with this header and is followed by changedTileCount tiles. Every tile is stored as its
+// (row-major) tile index followed by its pixels (RGBA8, row by row). Tiles at the right/bottom edge of the image are
+// clipped to the image.
+struct FrameDeltaHeader {
+    glm::ivec2 resolution;
+    int32_t tileSize;
+    uint32_t changedTileCount;
+};
+
+// Encodes frames as the set of tiles that changed with respect to the previously encoded frame. When the camera
+// only moves a little (or not at all) most of the image stays the same and only a fraction of the frame is sent.
+class FrameDeltaEncoder {
+public:
+    FrameDeltaEncoder(int tileSize = 32);
+
+    std::vector<uint8_t> encode(gsl::span<const glm::u8vec4> frame, const glm::ivec2& resolution);
+    // Forget the previous frame such that the next frame is sent in full.
+    void reset();
+
+private:
+    int m_tileSize;
+    glm::ivec2 m_resolution { 0 };
+    std::vector<glm::u8vec4> m_previousFrame;
+};
+
+// Reconstructs the frames on the receiving side by applying the tiles to the previous frame.
+class FrameDeltaDecoder {
+public:
+    // Returns false if the message is malformed, in which case the frame is left untouched.
+    bool decode(gsl::span<const uint8_t> message);
+
+    gsl::span<const glm::u8vec4> frame() const;
+    glm::ivec2 resolution() const;
+
+private:
+    glm::ivec2 m_resolution { 0 };
+    std::vector<glm::u8vec4> m_frame;
+};
+
+}
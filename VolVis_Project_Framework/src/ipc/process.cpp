@@ -0,0 +1,32 @@
+#include "process.h"
+#include <cstring>
+#include <iostream>
+#include <spawn.h>
+
+extern char** environ;
+
+namespace ipc {
+
+pid_t spawnProcess(std::vector<std::string> args, const std::vector<int>& closeFileDescriptors)
+{
+    posix_spawn_file_actions_t fileActions;
+    posix_spawn_file_actions_init(&fileActions);
+    for (const int fileDescriptor : closeFileDescriptors)
+        posix_spawn_file_actions_addclose(&fileActions, fileDescriptor);
+
+    std::vector<char*> argv;
+    for (auto& arg : args)
+        argv.push_back(arg.data());
+    argv.push_back(nullptr);
+
+    pid_t processId;
+    const int result = posix_spawnp(&processId, argv[0], &fileActions, nullptr, argv.data(), environ);
+    posix_spawn_file_actions_destroy(&fileActions);
+    if (result != 0) {
+        std::cerr << "Could not start process " << args[0] << ": " << std::strerror(result) << std::endl;
+        return -1;
+    }
+    return processId;
+}
+
+}
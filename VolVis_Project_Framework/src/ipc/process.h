@@ -0,0 +1,13 @@
+#pragma once
+#include <string>
+#include <sys/types.h>
+#include <vector>
+
+namespace ipc {
+
+// Start a child process (searching PATH if the executable has no directory) with the given arguments, where
+// args[0] is the executable. The listed file descriptors are closed in the child such that it only inherits the
+// sockets meant for it. Returns -1 if the process could not be started.
+pid_t spawnProcess(std::vector<std::string> args, const std::vector<int>& closeFileDescriptors);
+
+}
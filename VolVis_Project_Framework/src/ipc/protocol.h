@@ -0,0 +1,44 @@
+#pragma once
+#include "render/render_config.h"
+#include "session/session.h"
+#include "volume/volume.h"
+#include <cstdint>
+#include <glm/vec3.hpp>
+#include <type_traits>
+
+// Messages of the render server protocol. Server and client run on the same machine so the structs are sent as is.
+namespace ipc {
+
+static constexpr uint32_t renderServerMagic = 0x53525656; // "VVRS"
+static constexpr uint32_t renderServerVersion = 3;
+// Largest width and height of the frames that are requested or decoded.
+static constexpr int maxFrameResolution = 8192;
+
+// Sent by the server as soon as a client connects.
+struct ServerHello {
+    uint32_t magic;
+    uint32_t version;
+    glm::ivec3 volumeDims;
+    glm::vec3 volumeSpacing; // See volume::Volume::spacing.
+    float volumeMinimum;
+    float volumeMaximum;
+};
+
+// The client sends a request for every frame that it wants...
+struct FrameRequest {
+    session::CameraState cameraState;
+    render::RenderConfig renderConfig;
+    volume::InterpolationMode interpolationMode;
+};
+
+// ...and the server replies with this header followed by the encoded frame (see FrameDeltaEncoder).
+struct FrameResponse {
+    double renderTime; // Seconds, zero if the frame did not change or came from the frame cache.
+    uint64_t frameDeltaSize;
+};
+
+static_assert(std::is_trivially_copyable_v<ServerHello>);
+static_assert(std::is_trivially_copyable_v<FrameRequest>);
+static_assert(std::is_trivially_copyable_v<FrameResponse>);
+
+}
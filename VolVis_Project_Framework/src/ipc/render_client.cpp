@@ -0,0 +1,58 @@
+#include "render_client.h"
+#include <cstring>
+#include <iostream>
+
+namespace ipc {
+
+RenderClient::RenderClient(const std::filesystem::path& socketPath)
+    : m_socket(connectUnixSocket(socketPath))
+{
+    if (!m_socket.isValid())
+        return;
+
+    if (!m_socket.receive(m_serverHello) || m_serverHello.magic != renderServerMagic || m_serverHello.version != renderServerVersion) {
+        std::cerr << "Socket " << socketPath << " is not a compatible VolVis render server" << std::endl;
+        m_socket = Socket {};
+    }
+}
+
+bool RenderClient::isConnected() const
+{
+    return m_socket.isValid();
+}
+
+const ServerHello& RenderClient::serverHello() const
+{
+    return m_serverHello;
+}
+
+std::optional<RenderClient::FrameStatistics> RenderClient::requestFrame(const FrameRequest& request)
+{
+    FrameResponse response;
+    if (!m_socket.send(request) || !m_socket.receive(response))
+        return {};
+
+    m_receiveBuffer.resize(size_t(response.frameDeltaSize));
+    if (!m_socket.receiveAll(m_receiveBuffer.data(), m_receiveBuffer.size()))
+        return {};
+    if (!m_decoder.decode(m_receiveBuffer)) {
+        std::cerr << "Received malformed frame from the render server" << std::endl;
+        return {};
+    }
+
+    FrameDeltaHeader header;
+    std::memcpy(&header, m_receiveBuffer.data(), sizeof(header));
+    return FrameStatistics { response.renderTime, sizeof(response) + m_receiveBuffer.size(), header.changedTileCount };
+}
+
+gsl::span<const glm::u8vec4> RenderClient::frame() const
+{
+    return m_decoder.frame();
+}
+
+glm::ivec2 RenderClient::resolution() const
+{
+    return m_decoder.resolution();
+}
+
+}
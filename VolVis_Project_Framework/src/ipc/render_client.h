@@ -0,0 +1,36 @@
+#pragma once
+#include "ipc/frame_delta.h"
+#include "ipc/protocol.h"
+#include "ipc/socket.h"
+#include <filesystem>
+#include <optional>
+
+namespace ipc {
+
+// Connects to a RenderServer and reconstructs the frames that it sends.
+class RenderClient {
+public:
+    RenderClient(const std::filesystem::path& socketPath);
+
+    bool isConnected() const;
+    const ServerHello& serverHello() const;
+
+    struct FrameStatistics {
+        double renderTime; // Seconds (as measured by the server).
+        size_t bytesReceived;
+        uint32_t changedTileCount;
+    };
+    // Request a frame and wait for it to arrive. Returns an empty optional if the connection failed.
+    std::optional<FrameStatistics> requestFrame(const FrameRequest& request);
+
+    gsl::span<const glm::u8vec4> frame() const;
+    glm::ivec2 resolution() const;
+
+private:
+    Socket m_socket;
+    ServerHello m_serverHello {};
+    FrameDeltaDecoder m_decoder;
+    std::vector<uint8_t> m_receiveBuffer;
+};
+
+}
@@ -0,0 +1,87 @@
+#include "render_server.h"
+#include "render/image.h"
+#include <chrono>
+#include <iostream>
+#include <utility>
+
+namespace ipc {
+
+RenderServer::RenderServer(std::unique_ptr<LoadedVolume> pVolume, int tileSize, size_t frameCacheBytes)
+    : m_pVolume(std::move(pVolume))
+    , m_tileSize(tileSize)
+    , m_requestRenderer(m_pVolume.get())
+    , m_frameCache(frameCacheBytes)
+{
+}
+
+bool RenderServer::run(const std::filesystem::path& socketPath)
+{
+    const Socket listeningSocket = listenUnixSocket(socketPath);
+    if (!listeningSocket.isValid())
+        return false;
+
+    std::cout << "Listening on " << socketPath << std::endl;
+    while (true) {
+        Socket client = acceptConnection(listeningSocket);
+        if (!client.isValid())
+            break;
+        serveClient(client);
+    }
+    std::filesystem::remove(socketPath);
+    return true;
+}
+
+void RenderServer::serveClient(Socket& client)
+{
+    const auto& volume = m_pVolume->volume;
+    const ServerHello hello { renderServerMagic, renderServerVersion, volume.dims(), volume.spacing(), volume.minimum(), volume.maximum() };
+    if (!client.send(hello))
+        return;
+    std::cout << "Client connected" << std::endl;
+
+    // The client does not have a previous frame yet.
+    FrameDeltaEncoder encoder { m_tileSize };
+    FrameRequest request;
+    while (client.receive(request)) {
+        // Drop clients that send garbage instead of rendering (or looking up) a malformed request.
+        if (!isValidRequest(request)) {
+            std::cerr << "Invalid frame request, disconnecting client" << std::endl;
+            break;
+        }
+
+        // Frames from the cache are sent without rendering (and without touching the renderer, which keeps its frame).
+        double renderTime = 0.0;
+        std::vector<uint8_t> frameDelta;
+        if (const auto cachedFrame = m_frameCache.find(request); !cachedFrame.empty()) {
+            frameDelta = encoder.encode(cachedFrame, request.renderConfig.renderResolution);
+        } else {
+            renderTime = render(request);
+            auto frame = render::convertToRGBA8(m_requestRenderer.renderer().frameBuffer());
+            frameDelta = encoder.encode(frame, request.renderConfig.renderResolution);
+            m_frameCache.insert(request, std::move(frame));
+        }
+
+        const FrameResponse response { renderTime, uint64_t(frameDelta.size()) };
+        if (!client.send(response) || !client.sendAll(frameDelta.data(), frameDelta.size()))
+            break;
+    }
+    if (m_frameCache.capacity() > 0)
+        std::cout << "Client disconnected (frame cache: " << m_frameCache.hitCount() << " hits, " << m_frameCache.missCount() << " misses)" << std::endl;
+    else
+        std::cout << "Client disconnected" << std::endl;
+}
+
+double RenderServer::render(const FrameRequest& request)
+{
+    // Nothing changed so the framebuffer still contains the requested frame.
+    if (m_requestRenderer.setRequest(request) != RequestStatus::Changed)
+        return 0.0;
+
+    using clock = std::chrono::high_resolution_clock;
+    const auto start = clock::now();
+    m_requestRenderer.renderer().render();
+    const auto end = clock::now();
+    return std::chrono::duration<double>(end - start).count();
+}
+
+}
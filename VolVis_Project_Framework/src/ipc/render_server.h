@@ -0,0 +1,36 @@
+#pragma once
+#include "ipc/frame_cache.h"
+#include "ipc/frame_delta.h"
+#include "ipc/protocol.h"
+#include "ipc/request_renderer.h"
+#include "ipc/shared_volume.h"
+#include "ipc/socket.h"
+#include <filesystem>
+#include <memory>
+
+namespace ipc {
+
+// Renders frames on behalf of other processes on the same machine. Clients connect to a Unix domain socket, send
+// camera/render config requests (see protocol.h) and receive the frames as RGBA8 with tile-level delta encoding.
+// Clients are served one at a time; every client starts with a full frame. Recently rendered frames are kept in a
+// frame cache (shared by all clients) of up to frameCacheBytes.
+class RenderServer {
+public:
+    RenderServer(std::unique_ptr<LoadedVolume> pVolume, int tileSize = 32, size_t frameCacheBytes = 0);
+
+    // Serve clients until the listening socket fails. Returns false if the socket could not be created.
+    bool run(const std::filesystem::path& socketPath);
+
+private:
+    void serveClient(Socket& client);
+    // Returns the render time (zero if the previous frame could be reused).
+    double render(const FrameRequest& request);
+
+private:
+    std::unique_ptr<LoadedVolume> m_pVolume;
+    int m_tileSize;
+    RequestRenderer m_requestRenderer;
+    FrameCache m_frameCache;
+};
+
+}
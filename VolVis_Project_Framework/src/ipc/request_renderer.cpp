@@ -0,0 +1,84 @@
+#include "request_renderer.h"
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <glm/trigonometric.hpp>
+#include <glm/vector_relational.hpp>
+#include <iostream>
+
+static bool operator==(const session::CameraState& lhs, const session::CameraState& rhs);
+
+namespace ipc {
+
+RequestRenderer::RequestRenderer(LoadedVolume* pVolume)
+    : m_pVolume(pVolume)
+{
+}
+
+bool isValidRequest(const FrameRequest& request)
+{
+    const auto& config = request.renderConfig;
+    const auto& cameraState = request.cameraState;
+    return glm::all(glm::greaterThan(config.renderResolution, glm::ivec2(0))) && glm::all(glm::lessThanEqual(config.renderResolution, glm::ivec2(maxFrameResolution)))
+        && int(config.renderMode) >= int(render::RenderMode::RenderSlicer) && int(config.renderMode) <= int(render::RenderMode::RenderTF2D)
+        && int(request.interpolationMode) >= int(volume::InterpolationMode::NearestNeighbour) && int(request.interpolationMode) <= int(volume::InterpolationMode::Cubic)
+        // The renderer divides by the range of the transfer function and by the projection of the camera.
+        && std::isfinite(config.tfColorMapIndexRange) && config.tfColorMapIndexRange > 0.0f
+        && std::isfinite(cameraState.fovy) && cameraState.fovy > 0.0f && cameraState.fovy < glm::radians(180.0f)
+        && std::isfinite(cameraState.aspectRatio) && cameraState.aspectRatio > 0.0f;
+}
+
+RequestStatus RequestRenderer::setRequest(const FrameRequest& request)
+{
+    if (!isValidRequest(request)) {
+        std::cerr << "Invalid frame request" << std::endl;
+        return RequestStatus::Invalid;
+    }
+    if (m_optPreviousRequest && m_optPreviousRequest->cameraState == request.cameraState && m_optPreviousRequest->renderConfig == request.renderConfig && m_optPreviousRequest->interpolationMode == request.interpolationMode)
+        return RequestStatus::Unchanged;
+    m_optPreviousRequest = request;
+
+    // The field of view of the trackball cannot be changed after construction.
+    const auto& cameraState = request.cameraState;
+    if (!m_optCamera || m_optCamera->fovy() != cameraState.fovy || m_optCamera->aspectRatio() != cameraState.aspectRatio) {
+        m_optRenderer.reset();
+        m_optCamera.emplace(nullptr, cameraState.fovy, cameraState.aspectRatio);
+    }
+    session::setCameraState(*m_optCamera, cameraState);
+
+    m_pVolume->volume.interpolationMode = request.interpolationMode;
+    m_pVolume->gradientVolume.interpolationMode = request.interpolationMode;
+    if (!m_optRenderer) {
+        m_optRenderer.emplace(&m_pVolume->volume, &m_pVolume->gradientVolume, &m_optCamera.value(), request.renderConfig);
+        m_optRenderer->setBlockBounds(m_optBlockBounds);
+    } else {
+        m_optRenderer->setConfig(request.renderConfig);
+    }
+    return RequestStatus::Changed;
+}
+
+void RequestRenderer::setBlockBounds(const std::optional<render::Bounds>& optBlockBounds)
+{
+    m_optBlockBounds = optBlockBounds;
+    if (m_optRenderer)
+        m_optRenderer->setBlockBounds(optBlockBounds);
+}
+
+render::Renderer& RequestRenderer::renderer()
+{
+    assert(m_optRenderer);
+    return *m_optRenderer;
+}
+
+const ui::Trackball& RequestRenderer::camera() const
+{
+    assert(m_optCamera);
+    return *m_optCamera;
+}
+
+}
+
+static bool operator==(const session::CameraState& lhs, const session::CameraState& rhs)
+{
+    return std::memcmp(&lhs, &rhs, sizeof(session::CameraState)) == 0;
+}
@@ -0,0 +1,40 @@
+#pragma once
+#include "ipc/protocol.h"
+#include "ipc/shared_volume.h"
+#include "render/renderer.h"
+#include "ui/trackball.h"
+#include <optional>
+
+namespace ipc {
+
+enum class RequestStatus {
+    Changed,
+    Unchanged, // Equal to the previous request (the framebuffer is still valid).
+    Invalid, // Rejected, the renderer keeps the previous request.
+};
+
+// Requests come from other processes, so they are checked before they size buffers or select code paths.
+bool isValidRequest(const FrameRequest& request);
+
+// Camera + renderer of a process that renders on behalf of another process. The state is set by FrameRequests.
+class RequestRenderer {
+public:
+    RequestRenderer(LoadedVolume* pVolume);
+
+    RequestStatus setRequest(const FrameRequest& request);
+    // Only render the given block of the volume (see Renderer::setBlockBounds).
+    void setBlockBounds(const std::optional<render::Bounds>& optBlockBounds);
+
+    render::Renderer& renderer();
+    const ui::Trackball& camera() const;
+
+private:
+    LoadedVolume* m_pVolume;
+    std::optional<render::Bounds> m_optBlockBounds;
+
+    std::optional<ui::Trackball> m_optCamera;
+    std::optional<render::Renderer> m_optRenderer;
+    std::optional<FrameRequest> m_optPreviousRequest;
+};
+
+}
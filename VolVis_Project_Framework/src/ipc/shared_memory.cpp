@@ -0,0 +1,95 @@
+#include "shared_memory.h"
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Shared memory names have to start with a slash (and may not contain any other slashes).
+static std::string toSharedMemoryName(const std::string& name);
+
+namespace ipc {
+
+SharedMemory::SharedMemory(std::string name, void* pData, size_t size, bool owner)
+    : m_name(std::move(name))
+    , m_pData(pData)
+    , m_size(size)
+    , m_owner(owner)
+    , m_memory(owner ? "Shared memory (published)" : "Shared memory (attached)", size)
+{
+}
+
+SharedMemory::~SharedMemory()
+{
+    munmap(m_pData, m_size);
+    if (m_owner)
+        shm_unlink(m_name.c_str());
+}
+
+std::unique_ptr<SharedMemory> SharedMemory::create(const std::string& name, size_t size)
+{
+    const std::string sharedMemoryName = toSharedMemoryName(name);
+    shm_unlink(sharedMemoryName.c_str());
+    const int fileDescriptor = shm_open(sharedMemoryName.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fileDescriptor < 0) {
+        std::cerr << "Could not create shared memory " << sharedMemoryName << ": " << std::strerror(errno) << std::endl;
+        return nullptr;
+    }
+
+    void* pData = MAP_FAILED;
+    if (ftruncate(fileDescriptor, off_t(size)) == 0)
+        pData = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fileDescriptor, 0);
+    // The mapping stays valid after closing the file descriptor.
+    close(fileDescriptor);
+    if (pData == MAP_FAILED) {
+        std::cerr << "Could not map shared memory " << sharedMemoryName << ": " << std::strerror(errno) << std::endl;
+        shm_unlink(sharedMemoryName.c_str());
+        return nullptr;
+    }
+    return std::unique_ptr<SharedMemory>(new SharedMemory(sharedMemoryName, pData, size, true));
+}
+
+std::unique_ptr<SharedMemory> SharedMemory::openReadOnly(const std::string& name)
+{
+    const std::string sharedMemoryName = toSharedMemoryName(name);
+    const int fileDescriptor = shm_open(sharedMemoryName.c_str(), O_RDONLY, 0);
+    if (fileDescriptor < 0) {
+        std::cerr << "Could not open shared memory " << sharedMemoryName << ": " << std::strerror(errno) << std::endl;
+        return nullptr;
+    }
+
+    void* pData = MAP_FAILED;
+    struct stat fileStatus;
+    if (fstat(fileDescriptor, &fileStatus) == 0 && fileStatus.st_size > 0)
+        pData = mmap(nullptr, size_t(fileStatus.st_size), PROT_READ, MAP_SHARED, fileDescriptor, 0);
+    close(fileDescriptor);
+    if (pData == MAP_FAILED) {
+        std::cerr << "Could not map shared memory " << sharedMemoryName << ": " << std::strerror(errno) << std::endl;
+        return nullptr;
+    }
+    return std::unique_ptr<SharedMemory>(new SharedMemory(sharedMemoryName, pData, size_t(fileStatus.st_size), false));
+}
+
+std::byte* SharedMemory::data()
+{
+    return static_cast<std::byte*>(m_pData);
+}
+
+const std::byte* SharedMemory::data() const
+{
+    return static_cast<const std::byte*>(m_pData);
+}
+
+size_t SharedMemory::size() const
+{
+    return m_size;
+}
+
+}
+
+static std::string toSharedMemoryName(const std::string& name)
+{
+    return name.empty() || name[0] != '/' ? "/" + name : name;
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include "memory/memory_registry.h"
+#include <cstddef>
+#include <memory>
+#include <string>
+
+namespace ipc {
+
+// Named POSIX shared memory object that is mapped into the address space of this process.
+class SharedMemory {
+public:
+    SharedMemory(const SharedMemory&) = delete;
+    ~SharedMemory();
+
+    SharedMemory& operator=(const SharedMemory&) = delete;
+
+    // Create a shared memory object of the given size (replacing an existing object with the same name). The object
+    // is removed when the returned SharedMemory is destroyed; processes that attached to it keep their mapping.
+    static std::unique_ptr<SharedMemory> create(const std::string& name, size_t size);
+    // Map an existing shared memory object read-only. Returns nullptr if it does not exist.
+    static std::unique_ptr<SharedMemory> openReadOnly(const std::string& name);
+
+    std::byte* data();
+    const std::byte* data() const;
+    size_t size() const;
+
+private:
+    SharedMemory(std::string name, void* pData, size_t size, bool owner);
+
+private:
+    std::string m_name;
+    void* m_pData;
+    size_t m_size;
+    bool m_owner;
+    memory::TrackedMemory m_memory;
+};
+
+}
@@ -0,0 +1,197 @@
+#include "shared_volume.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <glm/vector_relational.hpp>
+#include <iostream>
+#include <limits>
+#include <string_view>
+
+static constexpr uint32_t sharedVolumeMagic = 0x56535656; // "VVSV"
+static constexpr uint32_t sharedVolumeVersion = 3;
+static constexpr std::string_view sharedVolumePrefix = "shm:";
+
+// Start of the shared memory, followed by the arrays at the given offsets.
+struct SharedVolumeHeader {
+    // Written last such that other processes never attach to a partially written volume.
+    uint32_t magic;
+    uint32_t version;
+    char fileName[256];
+
+    glm::ivec3 dims;
+    glm::vec3 spacing;
+    volume::ValueMapping valueMapping;
+    float minimum, maximum;
+    float minMagnitude, maxMagnitude;
+    int32_t brickSize;
+    glm::ivec3 brickDims;
+
+    uint64_t voxelOffset;
+    uint64_t gradientOffset;
+    uint64_t histogramOffset, histogramSize;
+    uint64_t brickRangeOffset, brickRangeCount;
+};
+
+static uint64_t alignOffset(uint64_t offset);
+static bool isValidLayout(const SharedVolumeHeader& header, size_t size);
+static bool arrayFits(uint64_t offset, uint64_t count, size_t elementSize, size_t alignment, size_t size);
+
+namespace ipc {
+
+LoadedVolume::LoadedVolume(const std::filesystem::path& volumeFile)
+    : volume(volumeFile)
+    , gradientVolume(volume)
+{
+}
+
+LoadedVolume::LoadedVolume(volume::Volume&& volume_, volume::GradientVolume&& gradientVolume_)
+    : volume(std::move(volume_))
+    , gradientVolume(std::move(gradientVolume_))
+{
+}
+
+std::unique_ptr<SharedMemory> publishVolume(const std::string& name, const volume::Volume& volume, const volume::GradientVolume& gradientVolume)
+{
+    // The header has no channel count, so attached processes would see the maximum over the channels instead.
+    if (volume.channelCount() != 1) {
+        std::cerr << "Only volumes with a single channel can be shared" << std::endl;
+        return nullptr;
+    }
+
+    const auto voxels = volume.data();
+    const auto gradients = gradientVolume.data();
+    const auto histogram = volume.histogram();
+    const auto brickRanges = volume.minMaxBricks().ranges();
+
+    SharedVolumeHeader header {};
+    header.version = sharedVolumeVersion;
+    const std::string_view fileName = volume.fileName();
+    std::memcpy(header.fileName, fileName.data(), std::min(fileName.size(), sizeof(header.fileName) - 1));
+    header.dims = volume.dims();
+    header.spacing = volume.spacing();
+    header.valueMapping = volume.valueMapping();
+    header.minimum = volume.minimum();
+    header.maximum = volume.maximum();
+    header.minMagnitude = gradientVolume.minMagnitude();
+    header.maxMagnitude = gradientVolume.maxMagnitude();
+    header.brickSize = volume.minMaxBricks().brickSize();
+    header.brickDims = volume.minMaxBricks().dims();
+    header.voxelOffset = alignOffset(sizeof(header));
+    header.gradientOffset = alignOffset(header.voxelOffset + voxels.size_bytes());
+    // Gradients are always shared in full, also when this process stores them quantized or computes them on the fly.
+    const size_t gradientSize = voxels.size() * sizeof(volume::GradientVoxel);
+    header.histogramOffset = alignOffset(header.gradientOffset + gradientSize);
+    header.histogramSize = histogram.size();
+    header.brickRangeOffset = alignOffset(header.histogramOffset + histogram.size() * sizeof(int));
+    header.brickRangeCount = brickRanges.size();
+    const uint64_t totalSize = header.brickRangeOffset + brickRanges.size_bytes();
+
+    auto pSharedMemory = SharedMemory::create(name, size_t(totalSize));
+    if (!pSharedMemory)
+        return nullptr;
+
+    std::byte* pData = pSharedMemory->data();
+    std::memcpy(pData + header.voxelOffset, voxels.data(), voxels.size_bytes());
+    if (gradients.empty()) {
+        auto* pGradients = reinterpret_cast<volume::GradientVoxel*>(pData + header.gradientOffset);
+        const glm::ivec3 dims = volume.dims();
+        for (int z = 0; z < dims.z; z++) {
+            for (int y = 0; y < dims.y; y++) {
+                for (int x = 0; x < dims.x; x++)
+                    *pGradients++ = gradientVolume.getGradient(x, y, z);
+            }
+        }
+    } else {
+        std::memcpy(pData + header.gradientOffset, gradients.data(), gradients.size_bytes());
+    }
+    std::memcpy(pData + header.histogramOffset, histogram.data(), histogram.size() * sizeof(int));
+    std::memcpy(pData + header.brickRangeOffset, brickRanges.data(), brickRanges.size_bytes());
+    std::memcpy(pData, &header, sizeof(header));
+
+    // Mark the volume as complete.
+    std::atomic_ref<uint32_t>(reinterpret_cast<SharedVolumeHeader*>(pData)->magic).store(sharedVolumeMagic, std::memory_order_release);
+    return pSharedMemory;
+}
+
+std::unique_ptr<LoadedVolume> attachVolume(const std::string& name)
+{
+    std::shared_ptr<SharedMemory> pSharedMemory = SharedMemory::openReadOnly(name);
+    if (!pSharedMemory)
+        return nullptr;
+
+    // The mapping is read-only but atomic_ref requires a non-const reference (loads do not write).
+    auto* pHeader = reinterpret_cast<SharedVolumeHeader*>(pSharedMemory->data());
+    if (pSharedMemory->size() < sizeof(SharedVolumeHeader)
+        || std::atomic_ref<uint32_t>(pHeader->magic).load(std::memory_order_acquire) != sharedVolumeMagic
+        || pHeader->version != sharedVolumeVersion) {
+        std::cerr << "Shared memory " << name << " does not contain a (complete) VolVis volume" << std::endl;
+        return nullptr;
+    }
+    const SharedVolumeHeader& header = *pHeader;
+    if (!isValidLayout(header, pSharedMemory->size())) {
+        std::cerr << "Shared memory " << name << " is truncated or corrupt" << std::endl;
+        return nullptr;
+    }
+    const size_t voxelCount = size_t(header.dims.x) * size_t(header.dims.y) * size_t(header.dims.z);
+
+    const std::byte* pData = pSharedMemory->data();
+    const gsl::span<const uint16_t> voxels { reinterpret_cast<const uint16_t*>(pData + header.voxelOffset), voxelCount };
+    const gsl::span<const volume::GradientVoxel> gradients { reinterpret_cast<const volume::GradientVoxel*>(pData + header.gradientOffset), voxelCount };
+    // The histogram and min/max bricks are tiny compared to the voxels so they are copied.
+    const auto* pHistogram = reinterpret_cast<const int*>(pData + header.histogramOffset);
+    std::vector<int> histogram(pHistogram, pHistogram + header.histogramSize);
+    const auto* pBrickRanges = reinterpret_cast<const volume::BrickRange*>(pData + header.brickRangeOffset);
+    volume::MinMaxBricks minMaxBricks { header.brickSize, header.brickDims, std::vector<volume::BrickRange>(pBrickRanges, pBrickRanges + header.brickRangeCount) };
+
+    // Both volumes keep the shared memory mapped.
+    const std::string fileName(header.fileName, strnlen(header.fileName, sizeof(header.fileName)));
+    return std::make_unique<LoadedVolume>(
+        volume::Volume(pSharedMemory, voxels, header.dims, fileName, header.minimum, header.maximum, std::move(histogram), std::move(minMaxBricks), header.spacing, header.valueMapping),
+        volume::GradientVolume(pSharedMemory, gradients, header.dims, header.minMagnitude, header.maxMagnitude));
+}
+
+std::unique_ptr<LoadedVolume> loadVolume(const std::filesystem::path& path)
+{
+    const std::string pathString = path.string();
+    if (pathString.rfind(sharedVolumePrefix, 0) == 0)
+        return attachVolume(pathString.substr(sharedVolumePrefix.size()));
+    return std::make_unique<LoadedVolume>(path);
+}
+
+}
+
+// Align arrays to cache lines.
+static uint64_t alignOffset(uint64_t offset)
+{
+    constexpr uint64_t alignment = 64;
+    return (offset + alignment - 1) / alignment * alignment;
+}
+
+// Whether all arrays that the header points to lie within the shared memory and match the dimensions. The memory
+// may have been written by any process, so nothing is trusted before it is checked.
+static bool isValidLayout(const SharedVolumeHeader& header, size_t size)
+{
+    if (glm::any(glm::lessThanEqual(header.dims, glm::ivec3(0))) || header.brickSize <= 0)
+        return false;
+    // Dimensions whose voxels could not possibly fit are rejected before multiplying them.
+    const size_t maxVoxelCount = size / sizeof(uint16_t);
+    const size_t sliceSize = size_t(header.dims.x) * size_t(header.dims.y);
+    if (size_t(header.dims.x) > maxVoxelCount || size_t(header.dims.y) > maxVoxelCount / size_t(header.dims.x) || size_t(header.dims.z) > maxVoxelCount / sliceSize)
+        return false;
+    const size_t voxelCount = sliceSize * size_t(header.dims.z);
+
+    const glm::ivec3 brickDims = (header.dims - 1) / header.brickSize + 1;
+    const size_t brickCount = size_t(brickDims.x) * size_t(brickDims.y) * size_t(brickDims.z);
+    return header.brickDims == brickDims && header.brickRangeCount == brickCount
+        && header.histogramSize > 0 && header.histogramSize <= size_t(std::numeric_limits<uint16_t>::max()) + 1
+        && arrayFits(header.voxelOffset, voxelCount, sizeof(uint16_t), alignof(uint16_t), size)
+        && arrayFits(header.gradientOffset, voxelCount, sizeof(volume::GradientVoxel), alignof(volume::GradientVoxel), size)
+        && arrayFits(header.histogramOffset, header.histogramSize, sizeof(int), alignof(int), size)
+        && arrayFits(header.brickRangeOffset, header.brickRangeCount, sizeof(volume::BrickRange), alignof(volume::BrickRange), size);
+}
+
+// Whether count aligned elements starting at offset lie within the first size bytes (without overflowing).
+static bool arrayFits(uint64_t offset, uint64_t count, size_t elementSize, size_t alignment, size_t size)
+{
+    return offset % alignment == 0 && offset <= size && count <= (size - offset) / elementSize;
+}
@@ -0,0 +1,33 @@
+#pragma once
+#include "ipc/shared_memory.h"
+#include "volume/gradient_volume.h"
+#include "volume/volume.h"
+#include <filesystem>
+#include <memory>
+#include <string>
+
+namespace ipc {
+
+// Volume + gradient volume that were either loaded from disk or attached from shared memory.
+struct LoadedVolume {
+    LoadedVolume(const std::filesystem::path& volumeFile);
+    LoadedVolume(volume::Volume&& volume, volume::GradientVolume&& gradientVolume);
+
+    volume::Volume volume;
+    volume::GradientVolume gradientVolume;
+};
+
+// Copy the voxels, gradients and derived data (histogram, min/max bricks) into named shared memory such that
+// other processes on the same machine can attach to it instead of loading the volume themselves. The volume is
+// unpublished when the returned object is destroyed (processes that are attached keep their mapping). Later changes
+// to the volume are not published. Returns nullptr for volumes with multiple channels.
+std::unique_ptr<SharedMemory> publishVolume(const std::string& name, const volume::Volume& volume, const volume::GradientVolume& gradientVolume);
+
+// Attach to a volume published by another process. The voxels and gradients are not copied; they are read
+// directly from the (read-only) shared memory mapping. Returns nullptr if there is no such volume.
+std::unique_ptr<LoadedVolume> attachVolume(const std::string& name);
+
+// Paths of the form "shm:<name>" attach to a published volume, all other paths are loaded from disk.
+std::unique_ptr<LoadedVolume> loadVolume(const std::filesystem::path& path);
+
+}
@@ -0,0 +1,148 @@
+#include "socket.h"
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <utility>
+
+static bool fillSocketAddress(const std::filesystem::path& socketPath, sockaddr_un& address);
+
+namespace ipc {
+
+Socket::Socket(int fileDescriptor)
+    : m_fileDescriptor(fileDescriptor)
+{
+}
+
+Socket::Socket(Socket&& other) noexcept
+    : m_fileDescriptor(std::exchange(other.m_fileDescriptor, -1))
+{
+}
+
+Socket::~Socket()
+{
+    if (m_fileDescriptor >= 0)
+        close(m_fileDescriptor);
+}
+
+Socket& Socket::operator=(Socket&& other) noexcept
+{
+    if (this != &other) {
+        if (m_fileDescriptor >= 0)
+            close(m_fileDescriptor);
+        m_fileDescriptor = std::exchange(other.m_fileDescriptor, -1);
+    }
+    return *this;
+}
+
+bool Socket::isValid() const
+{
+    return m_fileDescriptor >= 0;
+}
+
+int Socket::fileDescriptor() const
+{
+    return m_fileDescriptor;
+}
+
+bool Socket::sendAll(const void* pData, size_t size)
+{
+    // Writing to a socket that was closed by the other side should return an error instead of raising SIGPIPE.
+#ifdef MSG_NOSIGNAL
+    constexpr int flags = MSG_NOSIGNAL;
+#else
+    constexpr int flags = 0;
+#endif
+
+    const auto* pBytes = static_cast<const char*>(pData);
+    while (size > 0) {
+        const ssize_t bytesSent = ::send(m_fileDescriptor, pBytes, size, flags);
+        if (bytesSent < 0 && errno == EINTR)
+            continue;
+        if (bytesSent <= 0)
+            return false;
+        pBytes += bytesSent;
+        size -= size_t(bytesSent);
+    }
+    return true;
+}
+
+bool Socket::receiveAll(void* pData, size_t size)
+{
+    auto* pBytes = static_cast<char*>(pData);
+    while (size > 0) {
+        const ssize_t bytesReceived = ::recv(m_fileDescriptor, pBytes, size, 0);
+        if (bytesReceived < 0 && errno == EINTR)
+            continue;
+        if (bytesReceived <= 0)
+            return false;
+        pBytes += bytesReceived;
+        size -= size_t(bytesReceived);
+    }
+    return true;
+}
+
+Socket listenUnixSocket(const std::filesystem::path& socketPath)
+{
+    sockaddr_un address;
+    if (!fillSocketAddress(socketPath, address))
+        return {};
+
+    Socket out { socket(AF_UNIX, SOCK_STREAM, 0) };
+    if (!out.isValid()) {
+        std::cerr << "Could not create socket: " << std::strerror(errno) << std::endl;
+        return {};
+    }
+
+    // Remove the socket file of a previous run.
+    unlink(address.sun_path);
+    if (bind(out.fileDescriptor(), reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0 || listen(out.fileDescriptor(), 4) != 0) {
+        std::cerr << "Could not listen on " << socketPath << ": " << std::strerror(errno) << std::endl;
+        return {};
+    }
+    return out;
+}
+
+Socket acceptConnection(const Socket& listeningSocket)
+{
+    while (true) {
+        const int fileDescriptor = accept(listeningSocket.fileDescriptor(), nullptr, nullptr);
+        if (fileDescriptor >= 0)
+            return Socket { fileDescriptor };
+        if (errno != EINTR) {
+            std::cerr << "Could not accept connection: " << std::strerror(errno) << std::endl;
+            return {};
+        }
+    }
+}
+
+Socket connectUnixSocket(const std::filesystem::path& socketPath)
+{
+    sockaddr_un address;
+    if (!fillSocketAddress(socketPath, address))
+        return {};
+
+    Socket out { socket(AF_UNIX, SOCK_STREAM, 0) };
+    if (!out.isValid() || connect(out.fileDescriptor(), reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0) {
+        std::cerr << "Could not connect to " << socketPath << ": " << std::strerror(errno) << std::endl;
+        return {};
+    }
+    return out;
+}
+
+}
+
+static bool fillSocketAddress(const std::filesystem::path& socketPath, sockaddr_un& address)
+{
+    const std::string pathString = socketPath.string();
+    std::memset(&address, 0, sizeof(address));
+    if (pathString.size() >= sizeof(address.sun_path)) {
+        std::cerr << "Socket path " << socketPath << " is too long" << std::endl;
+        return false;
+    }
+    address.sun_family = AF_UNIX;
+    std::memcpy(address.sun_path, pathString.c_str(), pathString.size() + 1);
+    return true;
+}
@@ -0,0 +1,50 @@
+#pragma once
+#include <cstddef>
+#include <filesystem>
+#include <type_traits>
+
+namespace ipc {
+
+// Stream socket (owns the file descriptor). Only available on POSIX systems.
+class Socket {
+public:
+    Socket() = default;
+    explicit Socket(int fileDescriptor);
+    Socket(const Socket&) = delete;
+    Socket(Socket&& other) noexcept;
+    ~Socket();
+
+    Socket& operator=(const Socket&) = delete;
+    Socket& operator=(Socket&& other) noexcept;
+
+    bool isValid() const;
+    int fileDescriptor() const;
+
+    // Blocks until all data has been sent/received. Returns false if the connection was closed or an error occurred.
+    bool sendAll(const void* pData, size_t size);
+    bool receiveAll(void* pData, size_t size);
+
+    template <typename T>
+    bool send(const T& value)
+    {
+        static_assert(std::is_trivially_copyable_v<T>);
+        return sendAll(&value, sizeof(T));
+    }
+    template <typename T>
+    bool receive(T& value)
+    {
+        static_assert(std::is_trivially_copyable_v<T>);
+        return receiveAll(&value, sizeof(T));
+    }
+
+private:
+    int m_fileDescriptor { -1 };
+};
+
+// Create a Unix domain socket that listens at the given path (an existing socket file at that path is replaced).
+Socket listenUnixSocket(const std::filesystem::path& socketPath);
+// Wait for a client to connect to the listening socket.
+Socket acceptConnection(const Socket& listeningSocket);
+Socket connectUnixSocket(const std::filesystem::path& socketPath);
+
+}
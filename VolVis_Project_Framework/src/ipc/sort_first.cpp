@@ -0,0 +1,304 @@
+#include "sort_first.h"
+#include "ipc/process.h"
+#include "ipc/request_renderer.h"
+#include "ipc/shared_volume.h"
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <glm/common.hpp>
+#include <iostream>
+#include <limits>
+#include <numeric>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <tbb/global_control.h>
+#include <thread>
+#include <unistd.h>
+
+// Aim for this many batches per worker per frame: more batches balance the load better but cost more round trips.
+static constexpr int batchesPerWorker = 4;
+
+enum class SortFirstCommand : uint32_t {
+    Frame, // Followed by a FrameRequest.
+    Tiles // Followed by tileCount tile indices (uint32_t).
+};
+struct SortFirstMessage {
+    SortFirstCommand command;
+    uint32_t tileCount;
+};
+// The answer to a Tiles message contains one result per tile, each followed by the pixels of the tile (row by row).
+struct SortFirstTileResult {
+    uint32_t tileIndex;
+    float renderTime;
+};
+
+static glm::ivec2 computeTileCount(const glm::ivec2& resolution, int tileSize);
+static std::pair<glm::ivec2, glm::ivec2> computeTileRect(uint32_t tileIndex, const glm::ivec2& resolution, int tileSize);
+
+namespace ipc {
+
+SortFirstRenderer::SortFirstRenderer(const std::filesystem::path& executable, const std::string& volumePath, int processCount, int tileSize)
+    : m_tileSize(tileSize)
+{
+    std::vector<std::array<int, 2>> pairs;
+    for (int i = 0; i < processCount; i++) {
+        std::array<int, 2> pair;
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, pair.data()) != 0) {
+            std::cerr << "Could not create socket pair: " << std::strerror(errno) << std::endl;
+            break;
+        }
+        pairs.push_back(pair);
+    }
+
+    for (const auto& pair : pairs) {
+        // The worker only keeps its own socket open such that it notices when the coordinator goes away.
+        std::vector<int> closeFileDescriptors;
+        for (const auto& otherPair : pairs) {
+            closeFileDescriptors.push_back(otherPair[0]);
+            if (otherPair[1] != pair[1])
+                closeFileDescriptors.push_back(otherPair[1]);
+        }
+
+        const pid_t processId = spawnProcess({ executable.string(), "sort-first-worker", volumePath, std::to_string(pair[1]), std::to_string(tileSize), std::to_string(processCount) }, closeFileDescriptors);
+        close(pair[1]);
+        if (processId < 0) {
+            close(pair[0]);
+            continue;
+        }
+        m_workers.push_back(Worker { processId, Socket { pair[0] }, {}, 0.0 });
+    }
+}
+
+SortFirstRenderer::~SortFirstRenderer()
+{
+    for (Worker& worker : m_workers)
+        stopWorker(worker);
+}
+
+bool SortFirstRenderer::isRunning() const
+{
+    return std::any_of(std::begin(m_workers), std::end(m_workers), [](const Worker& worker) { return worker.socket.isValid(); });
+}
+
+std::optional<SortFirstRenderer::FrameStatistics> SortFirstRenderer::render(const FrameRequest& request)
+{
+    const glm::ivec2 resolution = request.renderConfig.renderResolution;
+    const glm::ivec2 tileCount2D = computeTileCount(resolution, m_tileSize);
+    const size_t tileCount = size_t(tileCount2D.x) * size_t(tileCount2D.y);
+    if (resolution != m_resolution) {
+        // Without timings of a previous frame all tiles are assumed to be equally expensive.
+        m_resolution = resolution;
+        m_tileCosts.assign(tileCount, 1.0f);
+        m_frameBuffer.resize(size_t(resolution.x) * size_t(resolution.y));
+    }
+
+    const SortFirstMessage frameMessage { SortFirstCommand::Frame, 0 };
+    for (Worker& worker : m_workers) {
+        worker.renderTime = 0.0;
+        if (worker.socket.isValid() && (!worker.socket.send(frameMessage) || !worker.socket.send(request)))
+            stopWorker(worker);
+    }
+    const int workerCount = int(std::count_if(std::begin(m_workers), std::end(m_workers), [](const Worker& worker) { return worker.socket.isValid(); }));
+    if (workerCount == 0)
+        return {};
+
+    // Hand out the most expensive tiles first such that the cheap tiles at the end fill up the gaps.
+    std::deque<uint32_t> pendingTiles(tileCount);
+    std::iota(std::begin(pendingTiles), std::end(pendingTiles), 0u);
+    std::stable_sort(std::begin(pendingTiles), std::end(pendingTiles), [&](uint32_t lhs, uint32_t rhs) { return m_tileCosts[lhs] > m_tileCosts[rhs]; });
+    const float totalCost = std::accumulate(std::begin(m_tileCosts), std::end(m_tileCosts), 0.0f);
+    const float batchCost = totalCost / float(workerCount * batchesPerWorker);
+
+    FrameStatistics out { 0, 0, 0.0, 0.0 };
+    size_t remainingTiles = tileCount;
+    std::vector<pollfd> pollFileDescriptors;
+    std::vector<Worker*> pollWorkers;
+    while (remainingTiles > 0) {
+        // Give every idle worker a new batch.
+        for (Worker& worker : m_workers) {
+            if (!worker.socket.isValid() || !worker.batch.empty() || pendingTiles.empty())
+                continue;
+
+            std::vector<uint32_t> batch;
+            float cost = 0.0f;
+            while (!pendingTiles.empty() && (batch.empty() || cost + m_tileCosts[pendingTiles.front()] <= batchCost)) {
+                cost += m_tileCosts[pendingTiles.front()];
+                batch.push_back(pendingTiles.front());
+                pendingTiles.pop_front();
+            }
+            if (sendBatch(worker, batch)) {
+                out.batchCount++;
+            } else {
+                pendingTiles.insert(std::begin(pendingTiles), std::begin(batch), std::end(batch));
+                stopWorker(worker);
+            }
+        }
+
+        pollFileDescriptors.clear();
+        pollWorkers.clear();
+        for (Worker& worker : m_workers) {
+            if (worker.socket.isValid() && !worker.batch.empty()) {
+                pollFileDescriptors.push_back(pollfd { worker.socket.fileDescriptor(), POLLIN, 0 });
+                pollWorkers.push_back(&worker);
+            }
+        }
+        if (pollFileDescriptors.empty()) {
+            std::cerr << "All sort-first workers have stopped" << std::endl;
+            return {};
+        }
+        if (poll(pollFileDescriptors.data(), pollFileDescriptors.size(), -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            std::cerr << "Could not poll sort-first workers: " << std::strerror(errno) << std::endl;
+            return {};
+        }
+
+        for (size_t i = 0; i < pollFileDescriptors.size(); i++) {
+            if (pollFileDescriptors[i].revents == 0)
+                continue;
+
+            Worker& worker = *pollWorkers[i];
+            const size_t batchSize = worker.batch.size();
+            if (receiveBatch(worker)) {
+                remainingTiles -= batchSize;
+            } else {
+                // Crash isolation: the tiles of the worker are rendered by the others.
+                std::cerr << "Sort-first worker " << worker.processId << " stopped, redistributing its tiles" << std::endl;
+                pendingTiles.insert(std::begin(pendingTiles), std::begin(worker.batch), std::end(worker.batch));
+                stopWorker(worker);
+            }
+        }
+    }
+
+    out.minWorkerTime = std::numeric_limits<double>::max();
+    for (const Worker& worker : m_workers) {
+        if (!worker.socket.isValid())
+            continue;
+        out.workerCount++;
+        out.maxWorkerTime = std::max(out.maxWorkerTime, worker.renderTime);
+        out.minWorkerTime = std::min(out.minWorkerTime, worker.renderTime);
+    }
+    return out;
+}
+
+gsl::span<const glm::vec4> SortFirstRenderer::frameBuffer() const
+{
+    return m_frameBuffer;
+}
+
+bool SortFirstRenderer::sendBatch(Worker& worker, std::vector<uint32_t> batch)
+{
+    const SortFirstMessage message { SortFirstCommand::Tiles, uint32_t(batch.size()) };
+    if (!worker.socket.send(message) || !worker.socket.sendAll(batch.data(), batch.size() * sizeof(uint32_t)))
+        return false;
+    worker.batch = std::move(batch);
+    return true;
+}
+
+bool SortFirstRenderer::receiveBatch(Worker& worker)
+{
+    for (size_t i = 0; i < worker.batch.size(); i++) {
+        SortFirstTileResult result;
+        if (!worker.socket.receive(result) || std::find(std::begin(worker.batch), std::end(worker.batch), result.tileIndex) == std::end(worker.batch))
+            return false;
+
+        const auto [begin, end] = computeTileRect(result.tileIndex, m_resolution, m_tileSize);
+        for (int y = begin.y; y < end.y; y++) {
+            if (!worker.socket.receiveAll(&m_frameBuffer[size_t(y) * size_t(m_resolution.x) + size_t(begin.x)], size_t(end.x - begin.x) * sizeof(glm::vec4)))
+                return false;
+        }
+        m_tileCosts[result.tileIndex] = result.renderTime;
+        worker.renderTime += result.renderTime;
+    }
+    worker.batch.clear();
+    return true;
+}
+
+void SortFirstRenderer::stopWorker(Worker& worker)
+{
+    // Workers exit when their socket is closed.
+    worker.socket = Socket {};
+    if (worker.processId > 0)
+        waitpid(worker.processId, nullptr, 0);
+    worker.processId = -1;
+}
+
+// Arguments: <volume> <socket> <tile size> <process count>
+int runSortFirstWorker(const std::vector<std::string_view>& args)
+{
+    if (args.size() != 4)
+        return 1;
+    Socket coordinator { std::stoi(std::string(args[1])) };
+    const int tileSize = std::stoi(std::string(args[2]));
+    const int processCount = std::stoi(std::string(args[3]));
+
+    // All workers run on the same machine so divide the cores between them.
+    const tbb::global_control threadLimit { tbb::global_control::max_allowed_parallelism, size_t(std::max(int(std::thread::hardware_concurrency()) / processCount, 1)) };
+
+    auto pVolume = loadVolume(std::string(args[0]));
+    if (!pVolume)
+        return 1;
+    RequestRenderer requestRenderer { pVolume.get() };
+    std::optional<glm::ivec2> optResolution;
+
+    std::vector<uint32_t> tiles;
+    std::vector<uint8_t> response;
+    SortFirstMessage message;
+    while (coordinator.receive(message)) {
+        if (message.command == SortFirstCommand::Frame) {
+            FrameRequest request;
+            if (!coordinator.receive(request))
+                return 1;
+            if (requestRenderer.setRequest(request) == RequestStatus::Invalid)
+                return 1;
+            optResolution = request.renderConfig.renderResolution;
+            continue;
+        }
+
+        tiles.resize(message.tileCount);
+        if (message.command != SortFirstCommand::Tiles || !optResolution || !coordinator.receiveAll(tiles.data(), tiles.size() * sizeof(uint32_t)))
+            return 1;
+
+        // Render the tiles one by one (each tile uses all threads of the worker) to measure their cost.
+        render::Renderer& renderer = requestRenderer.renderer();
+        const glm::ivec2 resolution = *optResolution;
+        const auto frameBuffer = renderer.frameBuffer();
+        response.clear();
+        for (const uint32_t tileIndex : tiles) {
+            using clock = std::chrono::high_resolution_clock;
+            const auto [begin, end] = computeTileRect(tileIndex, resolution, tileSize);
+            const auto start = clock::now();
+            renderer.renderRegion(begin, end);
+            const SortFirstTileResult result { tileIndex, std::chrono::duration<float>(clock::now() - start).count() };
+
+            const auto* pResult = reinterpret_cast<const uint8_t*>(&result);
+            response.insert(std::end(response), pResult, pResult + sizeof(result));
+            for (int y = begin.y; y < end.y; y++) {
+                const auto* pRow = reinterpret_cast<const uint8_t*>(&frameBuffer[size_t(y) * size_t(resolution.x) + size_t(begin.x)]);
+                response.insert(std::end(response), pRow, pRow + size_t(end.x - begin.x) * sizeof(glm::vec4));
+            }
+        }
+        if (!coordinator.sendAll(response.data(), response.size()))
+            return 1;
+    }
+    return 0;
+}
+
+}
+
+static glm::ivec2 computeTileCount(const glm::ivec2& resolution, int tileSize)
+{
+    return (resolution + tileSize - 1) / tileSize;
+}
+
+// Pixels [begin, end) covered by the tile (tiles at the right and top of the screen may be smaller).
+static std::pair<glm::ivec2, glm::ivec2> computeTileRect(uint32_t tileIndex, const glm::ivec2& resolution, int tileSize)
+{
+    const glm::ivec2 tileCount = computeTileCount(resolution, tileSize);
+    const glm::ivec2 begin = glm::ivec2(int(tileIndex) % tileCount.x, int(tileIndex) / tileCount.x) * tileSize;
+    return { begin, glm::min(begin + tileSize, resolution) };
+}
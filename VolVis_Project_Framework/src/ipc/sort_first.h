@@ -0,0 +1,67 @@
+#pragma once
+#include "ipc/protocol.h"
+#include "ipc/socket.h"
+#include <filesystem>
+#include <glm/vec2.hpp>
+#include <glm/vec4.hpp>
+#include <gsl/span>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <sys/types.h>
+#include <vector>
+
+// Sort-first distributed rendering: the screen is divided into tiles that are rendered by a pool of worker processes
+// which attach to the volume in shared memory. Tiles are handed out on demand in batches of roughly equal cost, where
+// the cost of a tile is its render time in the previous frame, such that expensive parts of the image (e.g. dense
+// regions in composite mode) are spread over all workers. A worker that crashes only loses its current batch, which
+// is handed to the remaining workers.
+namespace ipc {
+
+class SortFirstRenderer {
+public:
+    // Spawn processCount workers by running "<executable> sort-first-worker ..." which should call runSortFirstWorker.
+    // Workers load the volume with ipc::loadVolume, so use "shm:<name>" to share a single copy.
+    SortFirstRenderer(const std::filesystem::path& executable, const std::string& volumePath, int processCount, int tileSize = 32);
+    SortFirstRenderer(const SortFirstRenderer&) = delete;
+    ~SortFirstRenderer();
+
+    SortFirstRenderer& operator=(const SortFirstRenderer&) = delete;
+
+    // False once all workers have died.
+    bool isRunning() const;
+
+    struct FrameStatistics {
+        int workerCount; // Workers that are still alive at the end of the frame.
+        int batchCount;
+        double maxWorkerTime; // Total render time of the busiest worker (seconds).
+        double minWorkerTime; // Total render time of the least busy worker that is alive (seconds).
+    };
+    // Render a frame, returns an empty optional if no worker is left to finish it.
+    std::optional<FrameStatistics> render(const FrameRequest& request);
+    gsl::span<const glm::vec4> frameBuffer() const;
+
+private:
+    struct Worker {
+        pid_t processId;
+        Socket socket;
+        std::vector<uint32_t> batch; // Tiles that the worker is rendering.
+        double renderTime;
+    };
+    bool sendBatch(Worker& worker, std::vector<uint32_t> batch);
+    bool receiveBatch(Worker& worker);
+    void stopWorker(Worker& worker);
+
+private:
+    int m_tileSize;
+    std::vector<Worker> m_workers;
+
+    glm::ivec2 m_resolution { 0 };
+    std::vector<float> m_tileCosts;
+    std::vector<glm::vec4> m_frameBuffer;
+};
+
+// Entry point of the worker processes (the arguments are created by SortFirstRenderer).
+int runSortFirstWorker(const std::vector<std::string_view>& args);
+
+}
@@ -0,0 +1,285 @@
+#include "sort_last.h"
+#include "ipc/process.h"
+#include "ipc/request_renderer.h"
+#include "ipc/shared_volume.h"
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <future>
+#include <glm/common.hpp>
+#include <iostream>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <tbb/global_control.h>
+#include <tbb/parallel_for.h>
+#include <thread>
+
+// Sent by a worker after every frame, followed by the pixels in [pixelBegin, pixelEnd).
+struct SortLastResult {
+    double renderTime;
+    double compositeTime;
+    uint64_t pixelBegin, pixelEnd;
+};
+
+static int countRounds(int processCount);
+static void compositeHalves(gsl::span<glm::vec4> image, gsl::span<const glm::vec4> other, bool imageInFront, render::RenderMode renderMode);
+
+namespace ipc {
+
+VolumeBlock computeVolumeBlock(const glm::ivec3& volumeDims, int rank, int processCount)
+{
+    const int levels = countRounds(processCount);
+    VolumeBlock out { render::Bounds { glm::vec3(0.0f), glm::vec3(volumeDims - 1) }, {} };
+    auto& [lower, upper] = out.bounds.IndividualBounds;
+    for (int level = 0; level < levels; level++) {
+        // Split the longest axis in the middle (at a voxel boundary).
+        const glm::vec3 extent = upper - lower;
+        const int axis = extent.x >= extent.y && extent.x >= extent.z ? 0 : (extent.y >= extent.z ? 1 : 2);
+        const float position = std::floor((lower[axis] + upper[axis]) / 2.0f);
+        out.splits.push_back({ axis, position });
+
+        if ((rank >> (levels - 1 - level)) & 1)
+            lower[axis] = position;
+        else
+            upper[axis] = position;
+    }
+    return out;
+}
+
+std::pair<size_t, size_t> binarySwapPixelRange(size_t pixelCount, int rank, int rounds)
+{
+    size_t begin = 0, end = pixelCount;
+    for (int round = 0; round < rounds; round++) {
+        const size_t middle = (begin + end) / 2;
+        if (rank & (1 << round))
+            begin = middle;
+        else
+            end = middle;
+    }
+    return { begin, end };
+}
+
+SortLastRenderer::SortLastRenderer(const std::filesystem::path& executable, const std::string& volumePath, int processCount)
+{
+    const int rounds = countRounds(processCount);
+    if (rounds < 0) {
+        std::cerr << "The number of sort-last processes has to be a power of two" << std::endl;
+        return;
+    }
+
+    // One socket pair between the coordinator and every worker, and one between the partners of every round.
+    std::vector<std::array<int, 2>> coordinatorPairs(static_cast<size_t>(processCount));
+    std::vector<std::vector<int>> workerFileDescriptors(static_cast<size_t>(processCount));
+    std::vector<int> allFileDescriptors;
+    // Without all sockets no worker is started (so isRunning() is false) and the sockets created so far are closed.
+    const auto socketPairFailed = [&]() {
+        std::cerr << "Could not create socket pair: " << std::strerror(errno) << std::endl;
+        for (const int fileDescriptor : allFileDescriptors)
+            close(fileDescriptor);
+    };
+    for (auto& pair : coordinatorPairs) {
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, pair.data()) != 0) {
+            socketPairFailed();
+            return;
+        }
+        allFileDescriptors.insert(std::end(allFileDescriptors), std::begin(pair), std::end(pair));
+    }
+    for (int round = 0; round < rounds; round++) {
+        for (int rank = 0; rank < processCount; rank++) {
+            const int partner = rank ^ (1 << round);
+            if (partner < rank)
+                continue;
+            std::array<int, 2> pair;
+            if (socketpair(AF_UNIX, SOCK_STREAM, 0, pair.data()) != 0) {
+                socketPairFailed();
+                return;
+            }
+            workerFileDescriptors[size_t(rank)].push_back(pair[0]);
+            workerFileDescriptors[size_t(partner)].push_back(pair[1]);
+            allFileDescriptors.insert(std::end(allFileDescriptors), std::begin(pair), std::end(pair));
+        }
+    }
+
+    for (int rank = 0; rank < processCount; rank++) {
+        std::vector<std::string> args { executable.string(), "sort-last-worker", volumePath, std::to_string(rank), std::to_string(processCount),
+            std::to_string(coordinatorPairs[size_t(rank)][1]) };
+        for (const int fileDescriptor : workerFileDescriptors[size_t(rank)])
+            args.push_back(std::to_string(fileDescriptor));
+
+        // The worker only keeps its own sockets open such that it notices when the other side goes away.
+        std::vector<int> closeFileDescriptors;
+        for (const int fileDescriptor : allFileDescriptors) {
+            if (fileDescriptor != coordinatorPairs[size_t(rank)][1] && std::find(std::begin(workerFileDescriptors[size_t(rank)]), std::end(workerFileDescriptors[size_t(rank)]), fileDescriptor) == std::end(workerFileDescriptors[size_t(rank)]))
+                closeFileDescriptors.push_back(fileDescriptor);
+        }
+
+        const pid_t processId = spawnProcess(std::move(args), closeFileDescriptors);
+        if (processId < 0)
+            break;
+        m_workerProcesses.push_back(processId);
+    }
+
+    // The coordinator only keeps its side of the coordinator sockets.
+    for (const auto& pair : coordinatorPairs) {
+        m_workerSockets.emplace_back(pair[0]);
+        close(pair[1]);
+    }
+    for (const auto& fileDescriptors : workerFileDescriptors) {
+        for (const int fileDescriptor : fileDescriptors)
+            close(fileDescriptor);
+    }
+    if (m_workerProcesses.size() != size_t(processCount))
+        m_workerSockets.clear();
+}
+
+SortLastRenderer::~SortLastRenderer()
+{
+    // Workers exit when their coordinator socket is closed.
+    m_workerSockets.clear();
+    for (const pid_t processId : m_workerProcesses)
+        waitpid(processId, nullptr, 0);
+}
+
+bool SortLastRenderer::isRunning() const
+{
+    return !m_workerSockets.empty();
+}
+
+std::optional<SortLastRenderer::FrameStatistics> SortLastRenderer::render(const FrameRequest& request)
+{
+    if (!isRunning())
+        return {};
+
+    for (Socket& worker : m_workerSockets) {
+        if (!worker.send(request))
+            return {};
+    }
+
+    const glm::ivec2 resolution = request.renderConfig.renderResolution;
+    m_frameBuffer.resize(size_t(resolution.x) * size_t(resolution.y));
+    FrameStatistics out { 0.0, 0.0 };
+    for (Socket& worker : m_workerSockets) {
+        SortLastResult result;
+        if (!worker.receive(result) || result.pixelBegin > result.pixelEnd || result.pixelEnd > m_frameBuffer.size())
+            return {};
+        if (!worker.receiveAll(&m_frameBuffer[result.pixelBegin], (result.pixelEnd - result.pixelBegin) * sizeof(glm::vec4)))
+            return {};
+        out.renderTime = std::max(out.renderTime, result.renderTime);
+        out.compositeTime = std::max(out.compositeTime, result.compositeTime);
+    }
+    return out;
+}
+
+gsl::span<const glm::vec4> SortLastRenderer::frameBuffer() const
+{
+    return m_frameBuffer;
+}
+
+// Arguments: <volume> <rank> <process count> <coordinator socket> <partner socket of every round>
+int runSortLastWorker(const std::vector<std::string_view>& args)
+{
+    if (args.size() < 4)
+        return 1;
+    const int rank = std::stoi(std::string(args[1]));
+    const int processCount = std::stoi(std::string(args[2]));
+    const int rounds = countRounds(processCount);
+    if (rounds < 0 || args.size() != size_t(4 + rounds))
+        return 1;
+    Socket coordinator { std::stoi(std::string(args[3])) };
+    std::vector<Socket> partners;
+    for (int round = 0; round < rounds; round++)
+        partners.emplace_back(std::stoi(std::string(args[size_t(4 + round)])));
+
+    // All workers run on the same machine so divide the cores between them.
+    const tbb::global_control threadLimit { tbb::global_control::max_allowed_parallelism, size_t(std::max(int(std::thread::hardware_concurrency()) / processCount, 1)) };
+
+    auto pVolume = loadVolume(std::string(args[0]));
+    if (!pVolume)
+        return 1;
+    const VolumeBlock block = computeVolumeBlock(pVolume->volume.dims(), rank, processCount);
+    RequestRenderer requestRenderer { pVolume.get() };
+    requestRenderer.setBlockBounds(block.bounds);
+
+    std::vector<glm::vec4> image;
+    std::vector<glm::vec4> received;
+    FrameRequest request;
+    while (coordinator.receive(request)) {
+        using clock = std::chrono::high_resolution_clock;
+        const auto renderStart = clock::now();
+
+        // Compositing works on a copy so the framebuffer can be reused if the request did not change.
+        const RequestStatus status = requestRenderer.setRequest(request);
+        if (status == RequestStatus::Invalid)
+            return 1;
+        if (status == RequestStatus::Changed)
+            requestRenderer.renderer().render();
+        const auto frameBuffer = requestRenderer.renderer().frameBuffer();
+        image.assign(std::begin(frameBuffer), std::end(frameBuffer));
+        const auto renderEnd = clock::now();
+
+        size_t begin = 0, end = image.size();
+        for (int round = 0; round < rounds; round++) {
+            const size_t middle = (begin + end) / 2;
+            const bool lowerHalf = (rank & (1 << round)) == 0;
+            const size_t keepBegin = lowerHalf ? begin : middle, keepEnd = lowerHalf ? middle : end;
+            const size_t sendBegin = lowerHalf ? middle : begin, sendEnd = lowerHalf ? end : middle;
+
+            // Send and receive at the same time, otherwise both sides may block on a full socket buffer.
+            Socket& partner = partners[size_t(round)];
+            received.resize(keepEnd - keepBegin);
+            auto sendResult = std::async(std::launch::async, [&]() { return partner.sendAll(&image[sendBegin], (sendEnd - sendBegin) * sizeof(glm::vec4)); });
+            const bool receiveResult = partner.receiveAll(received.data(), received.size() * sizeof(glm::vec4));
+            if (!sendResult.get() || !receiveResult)
+                return 1;
+
+            // The blocks of both processes lie on different sides of the split of their common ancestor.
+            const BlockSplit& split = block.splits[size_t(rounds - 1 - round)];
+            const bool lowerInFront = requestRenderer.camera().position()[split.axis] < split.position * pVolume->volume.spacing()[split.axis];
+            compositeHalves(gsl::span(image).subspan(keepBegin, keepEnd - keepBegin), received, lowerHalf == lowerInFront, request.renderConfig.renderMode);
+            begin = keepBegin;
+            end = keepEnd;
+        }
+        const auto compositeEnd = clock::now();
+
+        const SortLastResult result {
+            std::chrono::duration<double>(renderEnd - renderStart).count(),
+            std::chrono::duration<double>(compositeEnd - renderEnd).count(),
+            begin, end
+        };
+        if (!coordinator.send(result) || !coordinator.sendAll(&image[begin], (end - begin) * sizeof(glm::vec4)))
+            return 1;
+    }
+    return 0;
+}
+
+}
+
+// Number of binary swap rounds (log2 of the process count), or -1 if the count is not a power of two.
+static int countRounds(int processCount)
+{
+    if (processCount < 1 || (processCount & (processCount - 1)) != 0)
+        return -1;
+    int rounds = 0;
+    while ((1 << rounds) < processCount)
+        rounds++;
+    return rounds;
+}
+
+// Composite the pixels of the other process into the image. MIP takes the maximum instead because it does not
+// depend on the order of the samples.
+static void compositeHalves(gsl::span<glm::vec4> image, gsl::span<const glm::vec4> other, bool imageInFront, render::RenderMode renderMode)
+{
+    assert(image.size() == other.size());
+    tbb::parallel_for(size_t(0), image.size(), [&](size_t i) {
+        if (renderMode == render::RenderMode::RenderMIP) {
+            image[i] = glm::max(image[i], other[i]);
+        } else {
+            // Premultiplied alpha "over" operator.
+            const glm::vec4& front = imageInFront ? image[i] : other[i];
+            const glm::vec4& back = imageInFront ? other[i] : image[i];
+            image[i] = front + (1.0f - front.a) * back;
+        }
+    });
+}
@@ -0,0 +1,71 @@
+#pragma once
+#include "ipc/protocol.h"
+#include "ipc/socket.h"
+#include "render/renderer.h"
+#include <filesystem>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+#include <gsl/span>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <sys/types.h>
+#include <utility>
+#include <vector>
+
+// Sort-last distributed rendering: the volume is split into blocks (the leaves of a kd-tree) and every worker process
+// renders the part of the image that its block covers. The partial images are composited with binary swap: in round r
+// every process exchanges half of its current image region with the process whose rank differs in bit r, such that
+// all processes share the compositing work. Processes communicate over local sockets and attach to the volume in
+// shared memory, so a single machine can run several workers.
+namespace ipc {
+
+struct BlockSplit {
+    int axis;
+    float position;
+};
+
+struct VolumeBlock {
+    render::Bounds bounds;
+    // Splits of the ancestors of the block in the kd-tree, starting at the root. The block is on the upper side of
+    // the split at level l if bit (levels - 1 - l) of its rank is set.
+    std::vector<BlockSplit> splits;
+};
+
+// The number of processes has to be a power of two.
+VolumeBlock computeVolumeBlock(const glm::ivec3& volumeDims, int rank, int processCount);
+// Range of pixels [begin, end) that the process owns after the given number of binary swap rounds.
+std::pair<size_t, size_t> binarySwapPixelRange(size_t pixelCount, int rank, int rounds);
+
+// Starts the worker processes and gathers the composited image.
+class SortLastRenderer {
+public:
+    // Spawn processCount workers (a power of two) by running "<executable> sort-last-worker ..." which should call
+    // runSortLastWorker. Workers load the volume with ipc::loadVolume, so use "shm:<name>" to share a single copy.
+    SortLastRenderer(const std::filesystem::path& executable, const std::string& volumePath, int processCount);
+    SortLastRenderer(const SortLastRenderer&) = delete;
+    ~SortLastRenderer();
+
+    SortLastRenderer& operator=(const SortLastRenderer&) = delete;
+
+    // False if the workers could not be started (an error was printed).
+    bool isRunning() const;
+
+    struct FrameStatistics {
+        double renderTime; // Slowest worker (seconds).
+        double compositeTime; // Slowest worker (seconds).
+    };
+    // Render a frame, returns an empty optional if a worker failed.
+    std::optional<FrameStatistics> render(const FrameRequest& request);
+    gsl::span<const glm::vec4> frameBuffer() const;
+
+private:
+    std::vector<pid_t> m_workerProcesses;
+    std::vector<Socket> m_workerSockets;
+    std::vector<glm::vec4> m_frameBuffer;
+};
+
+// Entry point of the worker processes (the arguments are created by SortLastRenderer).
+int runSortLastWorker(const std::vector<std::string_view>& args);
+
+}
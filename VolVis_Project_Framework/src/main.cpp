@@ -5,7 +5,14 @@
 #include "imgui/imgui_impl_glfw.h"
 #include "imgui/imgui_impl_opengl3.h"
 
+#ifdef VOLVIS_POSIX_IPC
+#include "ipc/shared_volume.h"
+#endif
+#include "memory/memory_registry.h"
 #include "render/renderer.h"
+#include "render/splat_renderer.h"
+#include "session/auto_tune.h"
+#include "session/session.h"
 #include "ui/full_screen_texture_gl.h"
 #include "ui/menu.h"
 #include "ui/surface_cube.h"
@@ -13,16 +20,25 @@
 #include "ui/window.h"
 #include "ui/wireframe_cube.h"
 #include "volume/gradient_volume.h"
+#include "volume/slice_stream.h"
 #include "volume/volume.h"
+#include "volume/volume_filter.h"
 #include <chrono>
 #include <cmath> // log2
+#include <glm/common.hpp>
 #include <glm/geometric.hpp>
 #include <glm/gtx/component_wise.hpp>
 #include <glm/vec3.hpp>
+#include <glm/vector_relational.hpp>
 #include <imgui.h>
 #include <iostream>
+#include <limits>
+#include <memory>
 #include <optional>
 #include <ratio>
+#include <string>
+#include <string_view>
+#include <utility>
 #include <vector>
 
 int main(int argc, char** argv)
@@ -50,39 +66,270 @@ int main(int argc, char** argv)
     std::optional<volume::Volume> optVolume;
     std::optional<volume::GradientVolume> optGradientVolume;
     std::optional<render::Renderer> optRenderer;
+    // Object-order alternative to the ray caster for compositing sparse volumes (toggled in the menu).
+    std::optional<render::SplatRenderer> optSplatRenderer;
     ui::Menu volVisMenu { viewportSize };
 
+    // Optionally record all user interaction to a session file that can be replayed with "VolVisCLI replay".
+    std::optional<session::SessionRecorder> optSessionRecorder;
+    // Optionally publish every loaded volume in shared memory such that other processes can attach to it.
+    std::optional<std::string> optShareName;
+    // Optionally show a volume while its slices are still being acquired.
+    std::optional<volume::SliceStream> optSliceStream;
+    // Optionally tune the brick and tile sizes for every loaded volume (results are stored in the given file).
+    std::optional<std::filesystem::path> optTuningFile;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        const std::string_view option = argv[i];
+        if (option == "--record")
+            optSessionRecorder.emplace(argv[i + 1]);
+        else if (option == "--share")
+            optShareName = argv[i + 1];
+        else if (option == "--stream") // File or named pipe that a scanner (or "VolVisCLI feed") writes slices to.
+            optSliceStream.emplace(argv[i + 1]);
+        else if (option == "--stream-follow") // Like --stream, but keeps waiting at the end of a file that is still growing.
+            optSliceStream.emplace(argv[i + 1], true);
+        else if (option == "--auto-tune")
+            optTuningFile = argv[i + 1];
+        else if (option == "--memory-budget") { // MiB, used to choose the storage of the gradients.
+            if (const auto optBudget = memory::parseMebibytes(argv[i + 1]))
+                memory::setMemoryBudget(optBudget);
+            else
+                std::cerr << "Invalid memory budget " << argv[i + 1] << ", expected a number of MiB" << std::endl;
+        } else
+            std::cerr << "Unknown option " << option << std::endl;
+    }
+#ifdef VOLVIS_POSIX_IPC
+    std::unique_ptr<ipc::SharedMemory> pSharedVolume;
+    // A published volume is a copy that does not change along with the volume shown here.
+    if (optShareName && optSliceStream) {
+        std::cerr << "Streamed volumes cannot be shared, ignoring --share" << std::endl;
+        optShareName.reset();
+    }
+#else
+    if (optShareName)
+        std::cerr << "Sharing volumes is not supported on this platform" << std::endl;
+#endif
+    auto recordEvent = [&](const session::EventData& eventData) {
+        if (optSessionRecorder)
+            optSessionRecorder->record(eventData);
+    };
+
     // Whether to redraw because the user interacted with the application. When this is the reason for the
     // redraw then dynamic resolution scaling is enabled. After the user interaction, one more render is
     // performed at the full (selected) resolution. When the application is static no renders are performed.
     bool redrawUserInteraction = false;
     bool redrawFullResolution = true;
-    auto loadVolume = [&](const std::filesystem::path& filePath) {
-        optVolume.emplace(filePath.string());
+    // Compute the gradients of the (new) volume and create a renderer for it.
+    auto setupVolume = [&](volume::GradientOperator gradientOperator) {
         optVolume->interpolationMode = volVisMenu.interpolationMode();
-        optGradientVolume.emplace(optVolume.value());
+        optGradientVolume.emplace(optVolume.value(), volume::chooseGradientStorage(optVolume->dims()), gradientOperator);
+        optGradientVolume->interpolationMode = volVisMenu.interpolationMode();
+        // Tune before sharing the volume because the brick size may change.
+        std::optional<session::TuningParameters> optTuning;
+        if (optTuningFile)
+            optTuning = session::loadOrAutoTune(*optTuningFile, optVolume.value(), optGradientVolume.value(), volVisMenu.renderConfig());
+#ifdef VOLVIS_POSIX_IPC
+        if (optShareName) {
+            pSharedVolume.reset();
+            pSharedVolume = ipc::publishVolume(*optShareName, optVolume.value(), optGradientVolume.value());
+        }
+#endif
         optRenderer.emplace(&optVolume.value(), &optGradientVolume.value(), &trackballCamera, volVisMenu.renderConfig());
+        if (optTuning)
+            optRenderer->setTuning(optTuning->renderTuning);
+        optRenderer->setShadowLight(volVisMenu.shadowLight());
+        optRenderer->setGradientEstimation(volVisMenu.gradientEstimation());
+        optSplatRenderer.emplace(&optVolume.value(), &trackballCamera, volVisMenu.renderConfig());
+        volVisMenu.setLoadedVolume(optVolume.value(), optGradientVolume.value());
+        redrawUserInteraction = true;
+    };
+    auto loadVolume = [&](const std::filesystem::path& filePath) {
+        recordEvent(session::RenderConfigEvent { volVisMenu.renderConfig() });
+        recordEvent(session::InterpolationModeEvent { volVisMenu.interpolationMode() });
+        recordEvent(session::LoadVolumeEvent { std::filesystem::absolute(filePath) });
+        // Stop appending streamed slices to whatever volume is shown.
+        optSliceStream.reset();
+
+        // Release the previous volume first such that it does not count against the memory budget.
+        optSplatRenderer.reset();
+        optRenderer.reset();
+        optGradientVolume.reset();
+        optVolume.reset();
+
+        optVolume.emplace(filePath.string());
+        setupVolume(volume::GradientOperator::CentralDifference);
 
-        const float maxDimension = float(glm::compMax(optVolume->dims()));
+        const float maxDimension = glm::compMax(optVolume->extent());
         trackballCamera.setDistance(maxDimension);
         trackballCamera.setWorldScale(maxDimension);
-        trackballCamera.setLookAt(glm::vec3(optVolume->dims()) / 2.0f);
+        trackballCamera.setLookAt(optVolume->extent() / 2.0f);
+    };
+    auto preprocessVolume = [&](volume::VolumeFilter filter, float filterSize, volume::GradientOperator gradientOperator) {
+        if (!optVolume)
+            return;
+
+        volume::Volume filteredVolume = volume::filterVolume(optVolume.value(), filter, filterSize);
+        optSplatRenderer.reset();
+        optRenderer.reset();
+        optGradientVolume.reset();
+        optVolume.reset();
+
+        optVolume.emplace(std::move(filteredVolume));
+        setupVolume(gradientOperator);
+    };
 
-        volVisMenu.setLoadedVolume(optVolume.value(), optGradientVolume.value());
+    // Pixels (in NDC) that have to be rendered again because the volume was edited since the last frame.
+    std::optional<std::pair<glm::vec2, glm::vec2>> optEditedScreenRegion;
+    // Render the pixels again whose rays pass through the region (in voxel coordinates) in the next frame.
+    auto invalidateRegion = [&](const volume::DirtyRegion& sampleRegion) {
+        // The camera looks at the volume in world coordinates.
+        const glm::vec3 worldLower = glm::vec3(sampleRegion.lower) * optVolume->spacing();
+        const glm::vec3 worldUpper = glm::vec3(sampleRegion.upper) * optVolume->spacing();
+        glm::vec2 lower { std::numeric_limits<float>::max() }, upper { std::numeric_limits<float>::lowest() };
+        for (int corner = 0; corner < 8; corner++) {
+            const glm::bvec3 isUpper { (corner & 1) != 0, (corner & 2) != 0, (corner & 4) != 0 };
+            const auto optCornerPixel = trackballCamera.projectToScreen(glm::mix(worldLower, worldUpper, glm::vec3(isUpper)));
+            if (!optCornerPixel) {
+                // Part of the region is behind the camera.
+                lower = glm::vec2(-1.0f);
+                upper = glm::vec2(1.0f);
+                break;
+            }
+            lower = glm::min(lower, *optCornerPixel);
+            upper = glm::max(upper, *optCornerPixel);
+        }
+        if (optEditedScreenRegion)
+            optEditedScreenRegion = std::pair { glm::min(lower, optEditedScreenRegion->first), glm::max(upper, optEditedScreenRegion->second) };
+        else
+            optEditedScreenRegion = std::pair { lower, upper };
+    };
+    auto editVolume = [&](const glm::vec2& pixel) {
+#ifdef VOLVIS_POSIX_IPC
+        if (pSharedVolume) {
+            static bool warned = false;
+            if (!warned)
+                std::cerr << "Volumes that are shared with other processes cannot be edited" << std::endl;
+            warned = true;
+            return;
+        }
+#endif
+        const auto optPick = optRenderer->pick(pixel);
+        if (!optPick)
+            return;
+
+        // Only the voxels inside the brush and the data derived from them are updated.
+        volume::Brush brush = volVisMenu.brush();
+        brush.center = optPick->position;
+        const volume::DirtyRegion gradientRegion = optGradientVolume->dependentRegion(volume::brushRegion(brush, optVolume->dims()));
+        volVisMenu.beginVolumeEdit(optVolume.value(), optGradientVolume.value(), gradientRegion);
+        optGradientVolume->update(optVolume->applyBrush(brush));
+        volVisMenu.endVolumeEdit(optVolume.value(), optGradientVolume.value(), gradientRegion);
+        optRenderer->volumeChanged();
+        optSplatRenderer->volumeChanged();
+
+        // Samples read voxels (and gradients) up to 2 voxels away from their position (cubic interpolation).
+        invalidateRegion(volume::expandRegion(gradientRegion, 2, optVolume->dims()));
+    };
+    // Append the slices that were received since the previous frame. Like edits, only the derived data and the
+    // pixels that depend on the new slices are updated.
+    auto receiveSlices = [&]() {
+        std::vector<uint16_t> slices = optSliceStream->takeSlices();
+        if (slices.empty())
+            return;
+
+        const glm::ivec3 streamDims = optSliceStream->dims().value();
+        if (!optVolume) {
+            const int depth = int(slices.size() / (size_t(streamDims.x) * size_t(streamDims.y)));
+            optVolume.emplace(std::move(slices), glm::ivec3(streamDims.x, streamDims.y, depth), optSliceStream->spacing(), optSliceStream->valueMapping());
+            setupVolume(volume::GradientOperator::CentralDifference);
+
+            // Frame the complete volume such that the camera does not move while the slices arrive.
+            const glm::vec3 streamExtent = glm::vec3(streamDims) * optVolume->spacing();
+            const float maxDimension = glm::compMax(streamExtent);
+            trackballCamera.setDistance(maxDimension);
+            trackballCamera.setWorldScale(maxDimension);
+            trackballCamera.setLookAt(streamExtent / 2.0f);
+            return;
+        }
 
-        redrawUserInteraction = true;
+        const int oldDepth = optVolume->dims().z;
+        const float oldMinimum = optVolume->minimum(), oldMaximum = optVolume->maximum();
+        const volume::DirtyRegion oldGradientRegion = optGradientVolume->dependentRegion({ glm::ivec3(0, 0, oldDepth), streamDims });
+        volVisMenu.beginVolumeEdit(optVolume.value(), optGradientVolume.value(), oldGradientRegion);
+        optVolume->appendSlices(slices);
+        const volume::DirtyRegion gradientRegion = optGradientVolume->grow();
+        // If the value range grew, the histograms are binned differently and the transfer functions are mapped to the new
+        // range (and the gradients may have been quantized again).
+        const bool rangeGrew = optVolume->minimum() != oldMinimum || optVolume->maximum() != oldMaximum;
+        if (rangeGrew || gradientRegion.lower.z < oldGradientRegion.lower.z)
+            volVisMenu.updateHistograms(optVolume.value(), optGradientVolume.value());
+        else
+            volVisMenu.endVolumeEdit(optVolume.value(), optGradientVolume.value(), gradientRegion);
+        optRenderer->volumeChanged();
+        optSplatRenderer->volumeChanged();
+
+        if (volVisMenu.renderConfig().renderMode == render::RenderMode::RenderSlicer) {
+            // The slice plane goes through the center of the volume, which moved.
+            redrawUserInteraction = true;
+        } else {
+            // Samples within 5 voxels of the border evaluate to 0 (see Volume::getSampleTriLinearInterpolation), so
+            // the samples in front of the previous last slice change too.
+            const int firstSlice = std::max(std::min(gradientRegion.lower.z - 2, oldDepth - 7), 0);
+            invalidateRegion({ glm::ivec3(0, 0, firstSlice), optVolume->dims() });
+        }
     };
 
+    // First end point of the line profile that is being picked.
+    std::optional<glm::vec3> optProfileBegin;
+
     // Callbacks.
     volVisMenu.setLoadVolumeCallback(loadVolume);
+    volVisMenu.setPreprocessCallback(preprocessVolume);
     volVisMenu.setRenderConfigChangedCallback(
         [&](const render::RenderConfig& renderConfig) {
-            if (optRenderer)
+            recordEvent(session::RenderConfigEvent { renderConfig });
+            if (optRenderer) {
                 optRenderer->setConfig(renderConfig);
+                optSplatRenderer->setConfig(renderConfig);
+            }
+            redrawUserInteraction = true;
+        });
+    volVisMenu.setChannelTransferFunctionsChangedCallback(
+        [&](const render::ChannelTransferFunctions& transferFunctions) {
+            if (optRenderer)
+                optRenderer->setChannelTransferFunctions(transferFunctions);
+            redrawUserInteraction = true;
+        });
+    volVisMenu.setShadowLightChangedCallback(
+        [&](const std::optional<glm::vec3>& optLightDirection) {
+            if (optRenderer)
+                optRenderer->setShadowLight(optLightDirection);
+            redrawUserInteraction = true;
+        });
+    volVisMenu.setGradientEstimationChangedCallback(
+        [&](render::GradientEstimation gradientEstimation) {
+            if (optRenderer)
+                optRenderer->setGradientEstimation(gradientEstimation);
+            redrawUserInteraction = true;
+        });
+    volVisMenu.setSplattingChangedCallback(
+        [&](bool) {
             redrawUserInteraction = true;
         });
+    // The splat renderer only replaces compositing of scalar volumes.
+    auto useSplatting = [&]() {
+        return volVisMenu.splatting() && volVisMenu.renderConfig().renderMode == render::RenderMode::RenderComposite && optVolume->channelCount() == 1;
+    };
+    // Ray cast the frame if the splats do not fit in the memory budget. Returns the framebuffer that was rendered.
+    auto renderFrame = [&]() {
+        if (useSplatting() && optSplatRenderer->render())
+            return optSplatRenderer->frameBuffer();
+        optRenderer->render();
+        return optRenderer->frameBuffer();
+    };
     volVisMenu.setInterpolationModeChangedCallback(
         [&](volume::InterpolationMode interpolationMode) {
+            recordEvent(session::InterpolationModeEvent { interpolationMode });
             if (optVolume) {
                 optVolume->interpolationMode = interpolationMode;
                 optGradientVolume->interpolationMode = interpolationMode;
@@ -91,6 +338,7 @@ int main(int argc, char** argv)
         });
     myWindow.registerWindowResizeCallback(
         [&](const glm::ivec2& newWindowSize) {
+            recordEvent(session::WindowResizeEvent { newWindowSize });
             // Maintain aspect ratio!
             const int potentialWidth = newWindowSize.x - menuWidth;
             const int potentialHeight = newWindowSize.y;
@@ -111,25 +359,65 @@ int main(int argc, char** argv)
     std::chrono::duration<double> renderTime { 0 };
     while (!myWindow.shouldClose()) {
         myWindow.updateInput();
+        if (optSliceStream)
+            receiveSlices();
 
         if (optRenderer.has_value()) {
+            // The framebuffer is drawn on the left side of the screen next to the menu.
+            const glm::ivec2 borders = ((windowSize - glm::ivec2(menuWidth, 0) - baseRenderResolution)) / 2;
+
+            const glm::vec2 viewportPos = (myWindow.cursorPos() - glm::vec2(borders)) / glm::vec2(baseRenderResolution);
+            const glm::vec2 cursorPixel { viewportPos.x * 2.0f - 1.0f, 1.0f - viewportPos.y * 2.0f };
+            const bool cursorInViewport = glm::all(glm::lessThanEqual(glm::abs(cursorPixel), glm::vec2(1.0f))) && !ImGui::GetIO().WantCaptureMouse;
+
+            // Edit the volume while shift and the left mouse button are held (the trackball ignores the mouse then).
+            const bool editing = (myWindow.isKeyPressed(GLFW_KEY_LEFT_SHIFT) || myWindow.isKeyPressed(GLFW_KEY_RIGHT_SHIFT))
+                && myWindow.isMouseButtonPressed(GLFW_MOUSE_BUTTON_LEFT) && !ImGui::GetIO().WantCaptureMouse;
+            if (editing && cursorInViewport)
+                editVolume(cursorPixel);
+
+            // Probe the volume under the cursor (a pick only takes microseconds so do it every frame). Clicking with
+            // ctrl held picks the end points of a line profile.
+            static bool prevProfileClick = false;
+            const bool profileClick = (myWindow.isKeyPressed(GLFW_KEY_LEFT_CONTROL) || myWindow.isKeyPressed(GLFW_KEY_RIGHT_CONTROL))
+                && myWindow.isMouseButtonPressed(GLFW_MOUSE_BUTTON_LEFT);
+            if (cursorInViewport) {
+                const auto optPick = optRenderer->pick(cursorPixel);
+                volVisMenu.setPick(optPick);
+                if (optPick && profileClick && !prevProfileClick) {
+                    if (optProfileBegin) {
+                        const glm::vec3 profileEnd = optPick->position;
+                        // Four samples per voxel.
+                        std::vector<float> profile(size_t(std::max(int(glm::length(profileEnd - *optProfileBegin) * 4.0f), 2)));
+                        optVolume->sampleLine(*optProfileBegin, profileEnd, profile);
+                        volVisMenu.setLineProfile(*optProfileBegin, profileEnd, std::move(profile));
+                        optProfileBegin.reset();
+                    } else {
+                        optProfileBegin = optPick->position;
+                    }
+                }
+            }
+            prevProfileClick = profileClick;
+
             // If camera changed in any way then we need to redraw.
             static glm::mat4 prevViewMatrix = glm::identity<glm::mat4>();
             const glm::mat4 viewMatrix = trackballCamera.viewMatrix();
             if (prevViewMatrix != viewMatrix) {
                 prevViewMatrix = viewMatrix;
+                recordEvent(session::CameraEvent { session::getCameraState(trackballCamera) });
                 redrawUserInteraction = true;
             }
             // If previous frame we rendered at a lower resolution (because something changed) then it will request to draw
             // the next frame in full resolution. If the user is still holding the mouse button then we can reasonably assume
             // that (s)he is not finished with the interaction (so we should keep rendering at a lower resolution).
-            if (redrawFullResolution && (myWindow.isMouseButtonPressed(GLFW_MOUSE_BUTTON_LEFT) || myWindow.isMouseButtonPressed(GLFW_MOUSE_BUTTON_RIGHT)))
+            if (redrawFullResolution && !editing && (myWindow.isMouseButtonPressed(GLFW_MOUSE_BUTTON_LEFT) || myWindow.isMouseButtonPressed(GLFW_MOUSE_BUTTON_RIGHT)))
                 redrawUserInteraction = true;
 
             // We draw when either the user has interacted (camera matrix changed or render config changed (see callback)) or if
             //  last frame we rendered at a lower resolution and we want to now render at the full resolution.
             if (redrawUserInteraction || redrawFullResolution) {
-                if (redrawUserInteraction) {
+                // Transfer function edits only render the affected tiles again, so they stay at full resolution.
+                if (redrawUserInteraction && !optRenderer->hasLocalizedRender()) {
                     // Reduce the resolution if the performance drops below the target frame time.
                     // Estimated performance when rendering at full resolution (resolution returned from menu).
                     // This way we can dynamically update the resolution while the user is moving the camera since
@@ -153,24 +441,41 @@ int main(int argc, char** argv)
                 redrawUserInteraction = false;
 
                 using clock = std::chrono::high_resolution_clock;
+                recordEvent(session::RenderEvent {});
                 const auto start = clock::now();
-                optRenderer->render();
+                const auto frameBuffer = renderFrame();
                 const auto end = clock::now();
                 renderTime = end - start;
 
-                fullScreenTextureGL.update(optRenderer->frameBuffer(), volVisMenu.renderConfig().renderResolution);
+                fullScreenTextureGL.update(frameBuffer, volVisMenu.renderConfig().renderResolution);
+                optEditedScreenRegion.reset();
+            } else if (optEditedScreenRegion && useSplatting()) {
+                // Splatting is cheap for sparse volumes, so edits render the whole frame again.
+                const auto frameBuffer = renderFrame();
+                optEditedScreenRegion.reset();
+
+                fullScreenTextureGL.update(frameBuffer, volVisMenu.renderConfig().renderResolution);
+            } else if (optEditedScreenRegion) {
+                // Only the pixels whose rays pass through the edited region can change.
+                const glm::ivec2 resolution = volVisMenu.renderConfig().renderResolution;
+                const auto toPixels = [&](const glm::vec2& ndc) { return (ndc * 0.5f + 0.5f) * glm::vec2(resolution); };
+                const glm::ivec2 begin = glm::clamp(glm::ivec2(glm::floor(toPixels(optEditedScreenRegion->first))), glm::ivec2(0), resolution);
+                const glm::ivec2 end = glm::clamp(glm::ivec2(glm::ceil(toPixels(optEditedScreenRegion->second))) + 1, glm::ivec2(0), resolution);
+                optRenderer->renderRegion(begin, end);
+                optEditedScreenRegion.reset();
+
+                fullScreenTextureGL.update(optRenderer->frameBuffer(), resolution);
             }
 
             // === Drawing the framebuffer to the screen and adding the wireframe. ===
 
             // Make the wireframe slightly larger than the volume to prevent z-fighting
             constexpr float wireframeMargin = 0.05f;
-            const auto wireframeCubeSize = glm::vec3(optVolume->dims()) * (1.0f + wireframeMargin);
-            const auto wireframeCubeOffset = -glm::vec3(optVolume->dims()) * wireframeMargin * 0.5f;
+            const auto wireframeCubeSize = optVolume->extent() * (1.0f + wireframeMargin);
+            const auto wireframeCubeOffset = -optVolume->extent() * wireframeMargin * 0.5f;
             constexpr glm::vec3 wireframeColor { 1.0f };
 
             // Draw on the left side of the screen next to the menu.
-            const glm::ivec2 borders = ((windowSize - glm::ivec2(menuWidth, 0) - baseRenderResolution)) / 2;
             glViewport(borders.x, borders.y, GLsizei(baseRenderResolution.x * dpiScaling.x), GLsizei(baseRenderResolution.y * dpiScaling.y));
 
             // Enable depth testing and clear the color/depth buffers.
@@ -183,7 +488,7 @@ int main(int argc, char** argv)
             glDepthMask(GL_TRUE);
             glDepthFunc(GL_LEQUAL);
             glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
-            surfaceCube.draw(trackballCamera, optVolume->dims());
+            surfaceCube.draw(trackballCamera, optVolume->extent());
 
             // Enable color writes and depth blending.
             glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
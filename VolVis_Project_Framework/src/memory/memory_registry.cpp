@@ -0,0 +1,199 @@
+#include "memory_registry.h"
+#include <algorithm>
+#include <charconv>
+#include <fmt/format.h>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <utility>
+
+struct Registry {
+    struct Entry {
+        size_t bytes { 0 };
+        int count { 0 };
+    };
+
+    std::mutex mutex;
+    std::map<std::string, Entry, std::less<>> entries;
+    std::optional<size_t> optBudget;
+};
+
+static Registry& getRegistry();
+static void addToRegistry(std::string_view name, size_t bytes, int count);
+static void removeFromRegistry(std::string_view name, size_t bytes, int count);
+
+namespace memory {
+
+TrackedMemory::TrackedMemory(std::string_view name, size_t bytes)
+    : m_name(name)
+    , m_bytes(bytes)
+    , m_tracked(true)
+{
+    addToRegistry(m_name, m_bytes, 1);
+}
+
+TrackedMemory::TrackedMemory(const TrackedMemory& other)
+    : m_name(other.m_name)
+    , m_bytes(other.m_bytes)
+    , m_tracked(other.m_tracked)
+{
+    if (m_tracked)
+        addToRegistry(m_name, m_bytes, 1);
+}
+
+TrackedMemory::TrackedMemory(TrackedMemory&& other) noexcept
+    : m_name(std::move(other.m_name))
+    , m_bytes(other.m_bytes)
+    , m_tracked(std::exchange(other.m_tracked, false))
+{
+}
+
+TrackedMemory::~TrackedMemory()
+{
+    if (m_tracked)
+        removeFromRegistry(m_name, m_bytes, 1);
+}
+
+TrackedMemory& TrackedMemory::operator=(const TrackedMemory& other)
+{
+    if (this != &other)
+        *this = TrackedMemory(other);
+    return *this;
+}
+
+TrackedMemory& TrackedMemory::operator=(TrackedMemory&& other) noexcept
+{
+    if (this != &other) {
+        if (m_tracked)
+            removeFromRegistry(m_name, m_bytes, 1);
+        m_name = std::move(other.m_name);
+        m_bytes = other.m_bytes;
+        m_tracked = std::exchange(other.m_tracked, false);
+    }
+    return *this;
+}
+
+void TrackedMemory::setSize(size_t bytes)
+{
+    if (m_tracked) {
+        removeFromRegistry(m_name, m_bytes, 0);
+        addToRegistry(m_name, bytes, 0);
+    }
+    m_bytes = bytes;
+}
+
+size_t TrackedMemory::size() const
+{
+    return m_bytes;
+}
+
+std::vector<MemoryUsage> memoryUsage()
+{
+    Registry& registry = getRegistry();
+    std::vector<MemoryUsage> out;
+    {
+        std::scoped_lock lock { registry.mutex };
+        for (const auto& [name, entry] : registry.entries)
+            out.push_back({ name, entry.bytes, entry.count });
+    }
+    std::stable_sort(std::begin(out), std::end(out), [](const MemoryUsage& lhs, const MemoryUsage& rhs) { return lhs.bytes > rhs.bytes; });
+    return out;
+}
+
+size_t totalMemoryUsage()
+{
+    Registry& registry = getRegistry();
+    std::scoped_lock lock { registry.mutex };
+    size_t out = 0;
+    for (const auto& [name, entry] : registry.entries)
+        out += entry.bytes;
+    return out;
+}
+
+void setMemoryBudget(std::optional<size_t> optBudget)
+{
+    Registry& registry = getRegistry();
+    std::scoped_lock lock { registry.mutex };
+    registry.optBudget = optBudget;
+}
+
+std::optional<size_t> memoryBudget()
+{
+    Registry& registry = getRegistry();
+    std::scoped_lock lock { registry.mutex };
+    return registry.optBudget;
+}
+
+size_t availableMemory()
+{
+    const auto optBudget = memoryBudget();
+    if (!optBudget)
+        return std::numeric_limits<size_t>::max();
+    const size_t used = totalMemoryUsage();
+    return used < *optBudget ? *optBudget - used : 0;
+}
+
+std::string formatMemoryUsage()
+{
+    std::string out;
+    for (const auto& usage : memoryUsage())
+        out += fmt::format("{:<28} {:>10} ({}x)\n", usage.name, formatBytes(usage.bytes), usage.count);
+    out += fmt::format("{:<28} {:>10}\n", "Total", formatBytes(totalMemoryUsage()));
+    if (const auto optBudget = memoryBudget())
+        out += fmt::format("{:<28} {:>10}\n", "Budget", formatBytes(*optBudget));
+    return out;
+}
+
+std::string formatBytes(size_t bytes)
+{
+    if (bytes < 1024)
+        return fmt::format("{} B", bytes);
+    if (bytes < 1024 * 1024)
+        return fmt::format("{:.1f} KiB", double(bytes) / 1024.0);
+    if (bytes < size_t(1024) * 1024 * 1024)
+        return fmt::format("{:.1f} MiB", double(bytes) / (1024.0 * 1024.0));
+    return fmt::format("{:.2f} GiB", double(bytes) / (1024.0 * 1024.0 * 1024.0));
+}
+
+std::optional<size_t> parseMebibytes(std::string_view text)
+{
+    constexpr size_t mebibyte = 1024 * 1024;
+    size_t mebibytes;
+    const auto [pEnd, error] = std::from_chars(text.data(), text.data() + text.size(), mebibytes);
+    if (error != std::errc() || pEnd != text.data() + text.size() || mebibytes > std::numeric_limits<size_t>::max() / mebibyte)
+        return {};
+    return mebibytes * mebibyte;
+}
+
+}
+
+// Function-local static such that objects with static storage duration can be tracked safely.
+static Registry& getRegistry()
+{
+    static Registry registry;
+    return registry;
+}
+
+static void addToRegistry(std::string_view name, size_t bytes, int count)
+{
+    Registry& registry = getRegistry();
+    std::scoped_lock lock { registry.mutex };
+    auto iter = registry.entries.find(name);
+    if (iter == std::end(registry.entries))
+        iter = registry.entries.emplace(std::string(name), Registry::Entry {}).first;
+    iter->second.bytes += bytes;
+    iter->second.count += count;
+}
+
+static void removeFromRegistry(std::string_view name, size_t bytes, int count)
+{
+    Registry& registry = getRegistry();
+    std::scoped_lock lock { registry.mutex };
+    const auto iter = registry.entries.find(name);
+    if (iter == std::end(registry.entries))
+        return;
+    iter->second.bytes -= bytes;
+    iter->second.count -= count;
+    if (iter->second.count == 0)
+        registry.entries.erase(iter);
+}
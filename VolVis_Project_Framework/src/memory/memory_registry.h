@@ -0,0 +1,55 @@
+#pragma once
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Accounting of the memory used by the subsystems (volume, gradients, framebuffers, caches, ...). Every subsystem owns
+// TrackedMemory objects that report their size to a process-wide registry, which is shown in the menu and the CLI.
+// The registry also holds an optional memory budget that subsystems use to choose between storage options (e.g.
+// volume::chooseGradientStorage).
+namespace memory {
+
+// Memory that is accounted to the given name for as long as the object exists. Copies are accounted separately.
+class TrackedMemory {
+public:
+    TrackedMemory() = default; // Not tracked.
+    explicit TrackedMemory(std::string_view name, size_t bytes = 0);
+    TrackedMemory(const TrackedMemory& other);
+    TrackedMemory(TrackedMemory&& other) noexcept;
+    ~TrackedMemory();
+
+    TrackedMemory& operator=(const TrackedMemory& other);
+    TrackedMemory& operator=(TrackedMemory&& other) noexcept;
+
+    void setSize(size_t bytes);
+    size_t size() const;
+
+private:
+    std::string m_name;
+    size_t m_bytes { 0 };
+    bool m_tracked { false };
+};
+
+struct MemoryUsage {
+    std::string name;
+    size_t bytes;
+    int count; // Number of TrackedMemory objects with this name.
+};
+// Usage per name, largest first.
+std::vector<MemoryUsage> memoryUsage();
+size_t totalMemoryUsage();
+
+void setMemoryBudget(std::optional<size_t> optBudget);
+std::optional<size_t> memoryBudget();
+// Budget minus the memory that is currently in use (unlimited if there is no budget).
+size_t availableMemory();
+
+// Table of the memory usage + budget, used by the menu and the CLI.
+std::string formatMemoryUsage();
+std::string formatBytes(size_t bytes);
+// Bytes of a size given in MiB on the command line, empty if it is not a whole number or does not fit.
+std::optional<size_t> parseMebibytes(std::string_view text);
+
+}
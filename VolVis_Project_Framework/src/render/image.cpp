@@ -0,0 +1,47 @@
+#include "image.h"
+#include <algorithm>
+#include <cassert>
+#include <fstream>
+#include <glm/common.hpp>
+#include <stb_image_write.h>
+
+namespace render {
+
+std::vector<glm::u8vec4> convertToRGBA8(gsl::span<const glm::vec4> frameBuffer)
+{
+    std::vector<glm::u8vec4> out(frameBuffer.size());
+    std::transform(std::begin(frameBuffer), std::end(frameBuffer), std::begin(out),
+        [](const glm::vec4& color) {
+            return glm::u8vec4(glm::clamp(color, 0.0f, 1.0f) * 255.0f + 0.5f);
+        });
+    return out;
+}
+
+std::vector<uint8_t> encodePNG(gsl::span<const glm::u8vec4> image, const glm::ivec2& resolution)
+{
+    assert(image.size() == size_t(resolution.x) * size_t(resolution.y));
+
+    std::vector<uint8_t> rgb(image.size() * 3);
+    for (size_t i = 0; i < image.size(); i++) {
+        rgb[i * 3 + 0] = image[i].r;
+        rgb[i * 3 + 1] = image[i].g;
+        rgb[i * 3 + 2] = image[i].b;
+    }
+
+    std::vector<uint8_t> out;
+    const auto appendToOutput = [](void* pContext, void* pData, int size) {
+        auto* pOut = static_cast<std::vector<uint8_t>*>(pContext);
+        const auto* pBytes = static_cast<const uint8_t*>(pData);
+        pOut->insert(std::end(*pOut), pBytes, pBytes + size);
+    };
+    stbi_write_png_to_func(appendToOutput, &out, resolution.x, resolution.y, 3, rgb.data(), resolution.x * 3);
+    return out;
+}
+
+void writeFile(const std::filesystem::path& filePath, gsl::span<const uint8_t> data)
+{
+    std::ofstream file { filePath, std::ios::binary };
+    file.write(reinterpret_cast<const char*>(data.data()), std::streamsize(data.size()));
+}
+
+}
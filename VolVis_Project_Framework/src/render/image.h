@@ -0,0 +1,21 @@
+#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <glm/gtc/type_precision.hpp> // glm::u8vec4
+#include <glm/vec2.hpp>
+#include <glm/vec4.hpp>
+#include <gsl/span>
+#include <vector>
+
+namespace render {
+
+// Convert the framebuffer (floating point, premultiplied alpha) to 8 bits per channel.
+std::vector<glm::u8vec4> convertToRGBA8(gsl::span<const glm::vec4> frameBuffer);
+
+// Encode an image as PNG in memory. The color channels are stored as is which (because of the premultiplied
+// alpha) is equal to drawing the image over a black background like the viewer does. Alpha is discarded.
+std::vector<uint8_t> encodePNG(gsl::span<const glm::u8vec4> image, const glm::ivec2& resolution);
+
+void writeFile(const std::filesystem::path& filePath, gsl::span<const uint8_t> data);
+
+}
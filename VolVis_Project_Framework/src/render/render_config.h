@@ -21,6 +21,11 @@ struct RenderConfig {
     bool volumeShading { false };
     float isoValue { 95.0f };
 
+    // Adaptive anti-aliasing: pixels whose color differs by more than the threshold (in any RGB channel) from a
+    // neighbouring pixel are rendered again with four extra rays.
+    bool adaptiveSupersampling { false };
+    float supersamplingThreshold { 0.1f };
+
     // 1D transfer function.
     std::array<glm::vec4, 256> tfColorMap;
     // Used to convert from a value to an index in the color map.
@@ -1,14 +1,41 @@
 #include "renderer.h"
+#include "render/transfer_function.h"
 #include <algorithm>
 #include <algorithm> // std::fill
+#include <array>
 #include <cmath>
 #include <functional>
 #include <glm/common.hpp>
 #include <glm/gtx/component_wise.hpp>
 #include <iostream>
+#include <limits>
+#include <tbb/blocked_range.h>
 #include <tbb/blocked_range2d.h>
 #include <tbb/parallel_for.h>
 #include <tuple>
+#include <utility>
+
+// 0 = sequential (single-core), 1 = TBB (multi-core)
+#ifdef NDEBUG
+// If NOT in debug mode then enable parallelism using the TBB library (Intel Threaded Building Blocks).
+#define PARALLELISM 1
+#else
+// Disable multi threading in debug mode.
+#define PARALLELISM 0
+#endif
+
+// Size of the tiles (in pixels) into which renderBatch subdivides each view.
+static constexpr int batchTileSize = 16;
+// Size of the tiles (in pixels) whose value ranges are recorded for localized re-rendering.
+static constexpr int valueRangeTileSize = 16;
+// Bricks per coarse brick along each axis.
+static constexpr int coarseBrickFactor = 4;
+// Fraction of the color that iso surfaces keep in the shadow (about the ambient term of the Phong shading).
+static constexpr float shadowAttenuation = 0.25f;
+
+static bool overlaps(const volume::BrickRange& lhs, const volume::BrickRange& rhs);
+static int samplesInBox(const glm::vec3& samplePos, const glm::vec3& increment, const glm::vec3& lower, const glm::vec3& upper);
+static std::pair<glm::vec3, glm::vec3> perpendicularAxes(const glm::vec3& axis);
 
 namespace render {
 
@@ -27,6 +54,23 @@ Renderer::Renderer(
     , m_config(initialConfig)
 {
     resizeImage(initialConfig.renderResolution);
+    setChannelTransferFunctions(defaultChannelTransferFunctions(*pVolume));
+}
+
+Renderer::Renderer(const Renderer& renderer, const render::RayTraceCamera* pCamera)
+    : m_pVolume(renderer.m_pVolume)
+    , m_pGradientVolume(renderer.m_pGradientVolume)
+    , m_pCamera(pCamera)
+    , m_config(renderer.m_config)
+    , m_tuning(renderer.m_tuning)
+    , m_channelTransferFunctions(renderer.m_channelTransferFunctions)
+    , m_channelClassification(renderer.m_channelClassification)
+    , m_pBrickOccupancy(renderer.m_pBrickOccupancy)
+    , m_optBlockBounds(renderer.m_optBlockBounds)
+    , m_optShadowLight(renderer.m_optShadowLight)
+    , m_gradientEstimation(renderer.m_gradientEstimation)
+{
+    resizeImage(m_config.renderResolution);
 }
 
 // Set a new render config if the user changed the settings.
@@ -35,13 +79,80 @@ void Renderer::setConfig(const RenderConfig& config)
     if (config.renderResolution != m_config.renderResolution)
         resizeImage(config.renderResolution);
 
+    // Edits of the 1D transfer function only change the colors of the values in the changed entries. The
+    // interval is widened by an entry on both sides to be safe from rounding.
+    RenderConfig configWithoutTF = config;
+    configWithoutTF.tfColorMap = m_config.tfColorMap;
+    const bool localized = m_config.renderMode == RenderMode::RenderComposite && m_pVolume->channelCount() == 1 && !m_config.adaptiveSupersampling;
+    if (localized && configWithoutTF == m_config) {
+        const auto& before = m_config.tfColorMap;
+        const auto& after = config.tfColorMap;
+        for (size_t i = 0; i < before.size(); i++) {
+            if (before[i] == after[i])
+                continue;
+            const float entrySize = m_config.tfColorMapIndexRange / float(before.size());
+            const float lower = i == 0 ? std::numeric_limits<float>::lowest() : m_config.tfColorMapIndexStart + float(i - 1) * entrySize;
+            const float upper = i == before.size() - 1 ? std::numeric_limits<float>::max() : m_config.tfColorMapIndexStart + float(i + 2) * entrySize;
+            if (m_optChangedValueRange)
+                m_optChangedValueRange = volume::BrickRange { std::min(m_optChangedValueRange->minimum, lower), std::max(m_optChangedValueRange->maximum, upper) };
+            else
+                m_optChangedValueRange = volume::BrickRange { lower, upper };
+        }
+    } else {
+        invalidateImage();
+    }
+
     m_config = config;
+    updateBrickOccupancy();
+}
+
+void Renderer::setTuning(const RenderTuning& tuning)
+{
+    m_tuning = tuning;
+}
+
+ChannelTransferFunctions defaultChannelTransferFunctions(const volume::Volume& volume)
+{
+    static constexpr std::array colors { glm::vec3(1, 0, 0), glm::vec3(0, 1, 0), glm::vec3(0, 0, 1), glm::vec3(1, 1, 1) };
+    ChannelTransferFunctions out;
+    for (size_t i = 0; i < out.size(); i++)
+        out[i] = ChannelTransferFunction { colors[i], volume.minimum(), volume.maximum(), 0.1f };
+    return out;
+}
+
+void Renderer::setChannelTransferFunctions(const ChannelTransferFunctions& transferFunctions)
+{
+    m_channelTransferFunctions = transferFunctions;
+    invalidateImage();
+    for (int channel = 0; channel < volume::maxChannelCount; channel++) {
+        const ChannelTransferFunction& transferFunction = transferFunctions[size_t(channel)];
+        m_channelClassification.lower[channel] = transferFunction.lower;
+        m_channelClassification.inverseWidth[channel] = 1.0f / std::max(transferFunction.upper - transferFunction.lower, 1e-6f);
+        m_channelClassification.opacity[channel] = channel < m_pVolume->channelCount() ? transferFunction.opacity : 0.0f;
+        m_channelClassification.colors[size_t(channel)] = transferFunction.color;
+    }
+    updateBrickOccupancy();
+}
+
+void Renderer::setShadowLight(const std::optional<glm::vec3>& optLightDirection)
+{
+    m_optShadowLight.reset();
+    if (optLightDirection)
+        m_optShadowLight = glm::normalize(*optLightDirection);
+    invalidateImage();
+}
+
+void Renderer::setGradientEstimation(GradientEstimation gradientEstimation)
+{
+    m_gradientEstimation = gradientEstimation;
+    invalidateImage();
 }
 
 // Resize the framebuffer and fill it with black pixels.
 void Renderer::resizeImage(const glm::ivec2& resolution)
 {
     m_frameBuffer.resize(size_t(resolution.x) * size_t(resolution.y), glm::vec4(0.0f));
+    m_frameBufferMemory.setSize(m_frameBuffer.size() * sizeof(glm::vec4));
 }
 
 // Clear the framebuffer by setting all pixels to black.
@@ -61,80 +172,396 @@ gsl::span<const glm::vec4> Renderer::frameBuffer() const
 // Multithreading is enabled in Release/RelWithDebInfo modes. In Debug mode multithreading is disabled to make debugging easier.
 void Renderer::render()
 {
+    const CameraRays view = cameraRays();
+    if (m_optImageView != view)
+        invalidateImage();
+    if (hasLocalizedRender()) {
+        renderChangedTiles();
+        m_optChangedValueRange.reset();
+        return;
+    }
+    m_optLocalizedTileCount.reset();
     resetImage();
 
-    static constexpr float sampleStep = 1.0f;
-    const glm::vec3 planeNormal = -glm::normalize(m_pCamera->forward());
-    const glm::vec3 volumeCenter = glm::vec3(m_pVolume->dims()) / 2.0f;
-    const Bounds bounds { glm::vec3(0.0f), glm::vec3(m_pVolume->dims() - glm::ivec3(1)) };
+#if PARALLELISM == 0
+    // Render the whole screen as a single tile.
+    renderTile(glm::ivec2(0), m_config.renderResolution);
+#else
+    // Parallel for loop (in 2 dimensions) that subdivides the screen into tiles.
+    const size_t grain = size_t(std::max(m_tuning.tileSize, 1));
+    const tbb::blocked_range2d<int> screenRange { 0, m_config.renderResolution.y, grain, 0, m_config.renderResolution.x, grain };
+    tbb::parallel_for(screenRange, [&](tbb::blocked_range2d<int> localRange) {
+        // This function is called on multiple threads at the same time.
+        renderTile(
+            glm::ivec2(std::begin(localRange.cols()), std::begin(localRange.rows())),
+            glm::ivec2(std::end(localRange.cols()), std::end(localRange.rows())));
+    });
+#endif
+    if (m_config.adaptiveSupersampling)
+        supersampleEdges(glm::ivec2(0), m_config.renderResolution);
+    m_optImageView = view;
+    m_optChangedValueRange.reset();
+}
 
-    // 0 = sequential (single-core), 1 = TBB (multi-core)
-#ifdef NDEBUG
-    // If NOT in debug mode then enable parallelism using the TBB library (Intel Threaded Building Blocks).
-#define PARALLELISM 1
+bool Renderer::hasLocalizedRender() const
+{
+    return m_optImageView && m_optChangedValueRange;
+}
+
+std::optional<size_t> Renderer::localizedTileCount() const
+{
+    return m_optLocalizedTileCount;
+}
+
+// Origin and corner directions of the camera rays, which change whenever the image does.
+Renderer::CameraRays Renderer::cameraRays() const
+{
+    const Ray center = m_pCamera->generateRay(glm::vec2(0.0f));
+    return CameraRays {
+        center.origin,
+        m_pCamera->generateRay(glm::vec2(-1.0f, -1.0f)).direction,
+        m_pCamera->generateRay(glm::vec2(1.0f, -1.0f)).direction,
+        m_pCamera->generateRay(glm::vec2(-1.0f, 1.0f)).direction
+    };
+}
+
+// The next render() has to render the whole image.
+void Renderer::invalidateImage()
+{
+    m_optImageView.reset();
+    m_optChangedValueRange.reset();
+    m_tileValueRanges.clear();
+}
+
+// Union of the ranges of all bricks that contain samples of the rays of each tile. The bricks are visited like
+// traceRayComposite does (including the ones that it skips), so every value that a ray samples is in the range.
+void Renderer::recordTileValueRanges()
+{
+    static constexpr float sampleStep = 1.0f; // Same as tracePixel.
+    const glm::ivec2 tiles = (m_config.renderResolution + valueRangeTileSize - 1) / valueRangeTileSize;
+    m_tileValueRanges.assign(size_t(tiles.x) * size_t(tiles.y), volume::BrickRange { std::numeric_limits<float>::max(), std::numeric_limits<float>::lowest() });
+
+    const PixelSetup setup = pixelSetup();
+    const volume::MinMaxBricks& bricks = m_pVolume->minMaxBricks();
+    const auto recordTile = [&](size_t tile) {
+        volume::BrickRange& tileRange = m_tileValueRanges[tile];
+        const glm::ivec2 begin = glm::ivec2(int(tile) % tiles.x, int(tile) / tiles.x) * valueRangeTileSize;
+        const glm::ivec2 end = glm::min(begin + valueRangeTileSize, m_config.renderResolution);
+        for (int y = begin.y; y != end.y; y++) {
+            for (int x = begin.x; x != end.x; x++) {
+                const auto optRay = pixelRay(setup, glm::vec2(x, y), sampleStep);
+                if (!optRay)
+                    continue;
+
+                const glm::vec3 increment = sampleStep * optRay->direction;
+                glm::vec3 samplePos = optRay->origin + optRay->tmax * optRay->direction;
+                for (float t = optRay->tmax; t >= optRay->tmin; t -= sampleStep, samplePos -= increment) {
+                    const volume::BrickRange range = bricks.getRange(bricks.brickOf(samplePos));
+                    tileRange.minimum = std::min(tileRange.minimum, range.minimum);
+                    tileRange.maximum = std::max(tileRange.maximum, range.maximum);
+
+                    const int skip = samplesInBrick(samplePos, -increment) - 1;
+                    t -= float(skip) * sampleStep;
+                    samplePos -= float(skip) * increment;
+                }
+            }
+        }
+    };
+
+#if PARALLELISM == 0
+    for (size_t tile = 0; tile < m_tileValueRanges.size(); tile++)
+        recordTile(tile);
 #else
-    // Disable multi threading in debug mode.
-#define PARALLELISM 0
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, m_tileValueRanges.size()), [&](const tbb::blocked_range<size_t>& range) {
+        for (size_t tile = range.begin(); tile != range.end(); tile++)
+            recordTile(tile);
+    });
 #endif
+}
+
+// Render the tiles whose value range overlaps the changed values again.
+void Renderer::renderChangedTiles()
+{
+    if (m_tileValueRanges.empty())
+        recordTileValueRanges();
+
+    const glm::ivec2 tiles = (m_config.renderResolution + valueRangeTileSize - 1) / valueRangeTileSize;
+    std::vector<glm::ivec2> changedTiles;
+    for (size_t tile = 0; tile < m_tileValueRanges.size(); tile++) {
+        if (overlaps(m_tileValueRanges[tile], *m_optChangedValueRange))
+            changedTiles.push_back(glm::ivec2(int(tile) % tiles.x, int(tile) / tiles.x) * valueRangeTileSize);
+    }
+    m_optLocalizedTileCount = changedTiles.size();
 
+    const auto renderChangedTile = [&](size_t i) {
+        const glm::ivec2 begin = changedTiles[i];
+        const glm::ivec2 end = glm::min(begin + valueRangeTileSize, m_config.renderResolution);
+        for (int y = begin.y; y < end.y; y++)
+            std::fill_n(&m_frameBuffer[size_t(begin.x + y * m_config.renderResolution.x)], end.x - begin.x, glm::vec4(0.0f));
+        renderTile(begin, end);
+    };
 #if PARALLELISM == 0
-    // Regular (single threaded) for loops.
-    for (int x = 0; x < m_config.renderResolution.x; x++) {
-        for (int y = 0; y < m_config.renderResolution.y; y++) {
+    for (size_t i = 0; i < changedTiles.size(); i++)
+        renderChangedTile(i);
 #else
-    // Parallel for loop (in 2 dimensions) that subdivides the screen into tiles.
-    const tbb::blocked_range2d<int> screenRange { 0, m_config.renderResolution.y, 0, m_config.renderResolution.x };
-        tbb::parallel_for(screenRange, [&](tbb::blocked_range2d<int> localRange) {
-        // Loop over the pixels in a tile. This function is called on multiple threads at the same time.
-        for (int y = std::begin(localRange.rows()); y != std::end(localRange.rows()); y++) {
-            for (int x = std::begin(localRange.cols()); x != std::end(localRange.cols()); x++) {
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, changedTiles.size()), [&](const tbb::blocked_range<size_t>& range) {
+        for (size_t i = range.begin(); i != range.end(); i++)
+            renderChangedTile(i);
+    });
 #endif
-            // Compute a ray for the current pixel.
-            const glm::vec2 pixelPos = glm::vec2(x, y) / glm::vec2(m_config.renderResolution);
-            Ray ray = m_pCamera->generateRay(pixelPos * 2.0f - 1.0f);
+}
 
-            // Compute where the ray enters and exists the volume.
-            // If the ray misses the volume then we continue to the next pixel.
-            if (!instersectRayVolumeBounds(ray, bounds))
-                continue;
+void Renderer::renderRegion(const glm::ivec2& begin, const glm::ivec2& end)
+{
+    invalidateImage();
+    for (int y = begin.y; y < end.y; y++)
+        std::fill_n(&m_frameBuffer[size_t(begin.x + y * m_config.renderResolution.x)], end.x - begin.x, glm::vec4(0.0f));
 
-            // Get a color for the current pixel according to the current render mode.
-            glm::vec4 color {};
-            switch (m_config.renderMode) {
-            case RenderMode::RenderSlicer: {
-                color = traceRaySlice(ray, volumeCenter, planeNormal);
-                break;
-            }
-            case RenderMode::RenderMIP: {
-                color = traceRayMIP(ray, sampleStep);
-                break;
-            }
-            case RenderMode::RenderComposite: {
-                color = traceRayComposite(ray, sampleStep);
-                break;
-            }
-            case RenderMode::RenderIso: {
-                color = traceRayISO(ray, sampleStep);
-                break;
-            }
-            case RenderMode::RenderTF2D: {
-                color = traceRayTF2D(ray, sampleStep);
-                break;
-            }
-            };
-            // Write the resulting color to the screen.
-            fillColor(x, y, color);
+#if PARALLELISM == 0
+    renderTile(begin, end);
+#else
+    const size_t grain = size_t(std::max(m_tuning.tileSize, 1));
+    const tbb::blocked_range2d<int> regionRange { begin.y, end.y, grain, begin.x, end.x, grain };
+    tbb::parallel_for(regionRange, [&](tbb::blocked_range2d<int> localRange) {
+        renderTile(
+            glm::ivec2(std::begin(localRange.cols()), std::begin(localRange.rows())),
+            glm::ivec2(std::end(localRange.cols()), std::end(localRange.rows())));
+    });
+#endif
+    if (m_config.adaptiveSupersampling)
+        supersampleEdges(begin, end);
+}
+
+std::vector<std::vector<glm::vec4>> Renderer::renderBatch(gsl::span<const render::RayTraceCamera* const> cameras) const
+{
+    // Each view shares the volume and the brick occupancy with this renderer and only has its own camera and framebuffer.
+    std::vector<Renderer> views;
+    views.reserve(cameras.size());
+    for (const render::RayTraceCamera* pCamera : cameras)
+        views.push_back(Renderer(*this, pCamera));
 
-#if PARALLELISM == 1
+    const glm::ivec2 tilesPerView = (m_config.renderResolution + batchTileSize - 1) / batchTileSize;
+    const size_t tileCount = size_t(tilesPerView.x) * size_t(tilesPerView.y);
+    const auto renderViewTile = [&](size_t i) {
+        Renderer& view = views[i / tileCount];
+        const int tile = int(i % tileCount);
+        const glm::ivec2 begin = glm::ivec2(tile % tilesPerView.x, tile / tilesPerView.x) * batchTileSize;
+        view.renderTile(begin, glm::min(begin + batchTileSize, m_config.renderResolution));
+    };
+
+#if PARALLELISM == 0
+    for (size_t i = 0; i < views.size() * tileCount; i++)
+        renderViewTile(i);
+#else
+    // A single parallel loop over the tiles of all views such that no core is left idle at the end of each view.
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, views.size() * tileCount), [&](const tbb::blocked_range<size_t>& range) {
+        for (size_t i = range.begin(); i != range.end(); i++)
+            renderViewTile(i);
+    });
+#endif
+
+    std::vector<std::vector<glm::vec4>> out;
+    for (Renderer& view : views) {
+        if (m_config.adaptiveSupersampling)
+            view.supersampleEdges(glm::ivec2(0), m_config.renderResolution);
+        out.push_back(std::move(view.m_frameBuffer));
+    }
+    return out;
+}
+
+// Render the pixels in the rectangle [begin, end) of the screen.
+void Renderer::renderTile(const glm::ivec2& begin, const glm::ivec2& end)
+{
+    const PixelSetup setup = pixelSetup();
+    for (int y = begin.y; y != end.y; y++) {
+        for (int x = begin.x; x != end.x; x++) {
+            // Write the resulting color to the screen (pixels that miss the volume keep the background).
+            if (const auto optColor = tracePixel(setup, glm::vec2(x, y)))
+                fillColor(x, y, *optColor);
         }
     }
-});
-#else
-            }
+}
+
+Renderer::PixelSetup Renderer::pixelSetup() const
+{
+    // Normals scale inversely to positions when going from world to voxel coordinates.
+    return PixelSetup {
+        glm::normalize(-m_pCamera->forward() * m_pVolume->spacing()),
+        glm::vec3(m_pVolume->dims()) / 2.0f,
+        Bounds { glm::vec3(0.0f), glm::vec3(m_pVolume->dims() - glm::ivec3(1)) }
+    };
+}
+
+// Ray through the pixel (in NDC) in voxel coordinates. The camera lives in world coordinates (see Volume::spacing);
+// the direction is scaled along with the origin such that t is still the distance in world coordinates, so
+// anisotropic volumes are sampled at the same world distance in every direction without resampling the voxels.
+Ray Renderer::generateVoxelRay(const glm::vec2& pixel) const
+{
+    Ray ray = m_pCamera->generateRay(pixel);
+    ray.origin /= m_pVolume->spacing();
+    ray.direction /= m_pVolume->spacing();
+    return ray;
+}
+
+// The part of the ray through the (continuous) pixel position that is inside the volume (and the block, if any).
+std::optional<Ray> Renderer::pixelRay(const PixelSetup& setup, const glm::vec2& pixel, float sampleStep) const
+{
+    // Compute a ray for the current pixel.
+    const glm::vec2 pixelPos = pixel / glm::vec2(m_config.renderResolution);
+    Ray ray = generateVoxelRay(pixelPos * 2.0f - 1.0f);
+
+    // Compute where the ray enters and exists the volume.
+    // If the ray misses the volume then we continue to the next pixel.
+    if (!instersectRayVolumeBounds(ray, setup.bounds))
+        return {};
+    if (m_optBlockBounds && !clipRayToBlock(ray, sampleStep, setup.volumeCenter, setup.planeNormal))
+        return {};
+    return ray;
+}
+
+// Color of the ray through the (continuous) pixel position, or nothing if the ray does not contribute to the image.
+std::optional<glm::vec4> Renderer::tracePixel(const PixelSetup& setup, const glm::vec2& pixel) const
+{
+    static constexpr float sampleStep = 1.0f;
+
+    const auto optRay = pixelRay(setup, pixel, sampleStep);
+    if (!optRay)
+        return {};
+    const Ray& ray = *optRay;
+
+    // Get a color for the current pixel according to the current render mode.
+    glm::vec4 color {};
+    switch (m_config.renderMode) {
+    case RenderMode::RenderSlicer: {
+        color = traceRaySlice(ray, setup.volumeCenter, setup.planeNormal);
+        break;
+    }
+    case RenderMode::RenderMIP: {
+        color = traceRayMIP(ray, sampleStep);
+        break;
+    }
+    case RenderMode::RenderComposite: {
+        color = m_pVolume->channelCount() > 1 ? traceRayChannels(ray, sampleStep) : traceRayComposite(ray, sampleStep);
+        break;
+    }
+    case RenderMode::RenderIso: {
+        color = traceRayISO(ray, sampleStep);
+        break;
+    }
+    case RenderMode::RenderTF2D: {
+        color = traceRayTF2D(ray, sampleStep);
+        break;
+    }
+    };
+    // A miss of the isosurface is opaque black, which would hide the other blocks when compositing.
+    if (m_optBlockBounds && m_config.renderMode == RenderMode::RenderIso && color == glm::vec4(0.0f, 0.0f, 0.0f, 1.0f))
+        return {};
+    return color;
+}
+
+// Adaptive anti-aliasing of the pixels in [begin, end) after they were rendered. Pixels that differ strongly from
+// a neighbour (silhouettes, edges of features) are rendered again as the average of the original ray and four rays
+// on a rotated grid within the pixel. Only neighbours inside the rectangle are compared such that tiles that are
+// rendered separately (e.g. by other processes) never compare against pixels that were not rendered yet.
+void Renderer::supersampleEdges(const glm::ivec2& begin, const glm::ivec2& end)
+{
+    const int width = m_config.renderResolution.x;
+    // Colors are premultiplied by alpha so the RGB difference is what is visible against the black background;
+    // alpha alone differs along the bounds of the volume in iso mode (a miss is opaque black there).
+    const auto differs = [&](int x0, int y0, int x1, int y1) {
+        const glm::vec3 difference = glm::abs(glm::vec3(m_frameBuffer[size_t(x0 + y0 * width)] - m_frameBuffer[size_t(x1 + y1 * width)]));
+        return glm::compMax(difference) > m_config.supersamplingThreshold;
+    };
+
+    // Find all edge pixels first such that the comparisons only see the original image.
+    std::vector<glm::ivec2> edgePixels;
+    for (int y = begin.y; y < end.y; y++) {
+        for (int x = begin.x; x < end.x; x++) {
+            if ((x > begin.x && differs(x, y, x - 1, y)) || (x + 1 < end.x && differs(x, y, x + 1, y))
+                || (y > begin.y && differs(x, y, x, y - 1)) || (y + 1 < end.y && differs(x, y, x, y + 1)))
+                edgePixels.push_back(glm::ivec2(x, y));
         }
+    }
+    m_supersampledPixelCount = edgePixels.size();
+
+    static const std::array<glm::vec2, 4> subpixelOffsets { glm::vec2(-0.125f, -0.375f), glm::vec2(0.375f, -0.125f), glm::vec2(0.125f, 0.375f), glm::vec2(-0.375f, 0.125f) };
+    const PixelSetup setup = pixelSetup();
+    const auto supersample = [&](const glm::ivec2& pixel) {
+        glm::vec4 color = m_frameBuffer[size_t(pixel.x + pixel.y * width)];
+        for (const glm::vec2& offset : subpixelOffsets)
+            color += tracePixel(setup, glm::vec2(pixel) + offset).value_or(glm::vec4(0.0f));
+        fillColor(pixel.x, pixel.y, color / float(subpixelOffsets.size() + 1));
+    };
+#if PARALLELISM == 0
+    for (const glm::ivec2& pixel : edgePixels)
+        supersample(pixel);
+#else
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, edgePixels.size()), [&](const tbb::blocked_range<size_t>& range) {
+        for (size_t i = range.begin(); i != range.end(); i++)
+            supersample(edgePixels[i]);
+    });
 #endif
 }
 
+size_t Renderer::supersampledPixelCount() const
+{
+    return m_supersampledPixelCount;
+}
+
+void Renderer::setBlockBounds(const std::optional<Bounds>& optBlockBounds)
+{
+    m_optBlockBounds = optBlockBounds;
+    invalidateImage();
+}
+
+// Restrict the ray (which spans the whole volume) to the samples that lie inside the block. A sample at distance t
+// belongs to the block if blockEntry <= t < blockExit, except for the block at which the ray exits the volume. Returns
+// false if the block does not contain any samples of the ray.
+bool Renderer::clipRayToBlock(Ray& ray, float sampleStep, const glm::vec3& volumeCenter, const glm::vec3& planeNormal) const
+{
+    const auto& [blockLower, blockUpper] = m_optBlockBounds->IndividualBounds;
+    if (m_config.renderMode == RenderMode::RenderSlicer) {
+        // The slice is a single sample per ray (see traceRaySlice) which may lie outside of the volume. It belongs to
+        // the block that contains the sample position after clamping it to the volume.
+        const float t = glm::dot(volumeCenter - ray.origin, planeNormal) / glm::dot(ray.direction, planeNormal);
+        const glm::vec3 volumeUpper = glm::vec3(m_pVolume->dims() - 1);
+        const glm::vec3 samplePos = glm::clamp(ray.origin + t * ray.direction, glm::vec3(0.0f), volumeUpper);
+        for (int axis = 0; axis < 3; axis++) {
+            if (samplePos[axis] < blockLower[axis] || (samplePos[axis] >= blockUpper[axis] && blockUpper[axis] < volumeUpper[axis]))
+                return false;
+        }
+        return true;
+    }
+
+    Ray blockRay = ray;
+    if (!instersectRayVolumeBounds(blockRay, *m_optBlockBounds))
+        return false;
+    const bool includeExit = blockRay.tmax >= ray.tmax;
+
+    switch (m_config.renderMode) {
+    case RenderMode::RenderComposite: {
+        // Samples are taken back-to-front at ray.tmax - k * sampleStep.
+        const float first = includeExit ? 0.0f : std::floor((ray.tmax - blockRay.tmax) / sampleStep) + 1.0f;
+        const float last = std::floor((ray.tmax - blockRay.tmin) / sampleStep);
+        if (first > last)
+            return false;
+        ray.tmin = ray.tmax - (last + 0.5f) * sampleStep;
+        ray.tmax = ray.tmax - first * sampleStep;
+        return true;
+    }
+    default: {
+        // Samples are taken front-to-back at ray.tmin + k * sampleStep.
+        const float first = std::ceil((blockRay.tmin - ray.tmin) / sampleStep);
+        const float last = includeExit ? std::floor((ray.tmax - ray.tmin) / sampleStep) : std::ceil((blockRay.tmax - ray.tmin) / sampleStep) - 1.0f;
+        if (first > last)
+            return false;
+        ray.tmax = ray.tmin + (last + 0.5f) * sampleStep;
+        ray.tmin = ray.tmin + first * sampleStep;
+        return true;
+    }
+    };
+}
+
 // ======= DO NOT MODIFY THIS FUNCTION ========
 // This function generates a view alongside a plane perpendicular to the camera through the center of the volume
 //  using the slicing technique.
@@ -183,11 +610,19 @@ glm::vec4 Renderer::traceRayISO(const Ray& ray, float sampleStep) const
     const glm::vec3 increment = sampleStep * ray.direction;
 
     for (float t = ray.tmin; t <= ray.tmax; t += sampleStep, samplePos += increment) {
+        // Skip bricks in which no sample can reach the iso value.
+        if (!isBrickOccupied(samplePos)) {
+            const int skip = samplesInBrick(samplePos, increment) - 1;
+            t += float(skip) * sampleStep;
+            samplePos += float(skip) * increment;
+            continue;
+        }
+
         const float val = m_pVolume->getSampleInterpolate(samplePos);
         //isovalue crossed
         if (val >= isoVal) {
             //no shading
-            if (!m_config.volumeShading)
+            if (!m_config.volumeShading && !m_optShadowLight)
                 return glm::vec4(isoColor, 1.0f);
 
             float t_new = t; //use for bisection result
@@ -198,16 +633,46 @@ glm::vec4 Renderer::traceRayISO(const Ray& ray, float sampleStep) const
             //new sampleposition for t_new
             glm::vec3 samplePos_t = ray.origin + t_new * ray.direction;
 
-            const volume::GradientVoxel gradient = m_pGradientVolume->getGradientInterpolate(samplePos_t);
+            glm::vec3 color = isoColor;
+            if (m_config.volumeShading) {
+                const volume::GradientVoxel gradient = m_pGradientVolume->getGradientInterpolate(samplePos_t);
 
-            glm::vec3 shading = computePhongShading(isoColor, gradient, light, ray.direction);
-            return glm::vec4(shading, 1.0f);
+                // The gradients are in world coordinates, so is the view direction.
+                color = computePhongShading(isoColor, gradient, m_optShadowLight.value_or(light), ray.direction * m_pVolume->spacing());
+            }
+            // The shadow ray is in voxel coordinates, like the primary ray.
+            if (m_optShadowLight && isInShadow(samplePos_t, *m_optShadowLight / m_pVolume->spacing(), sampleStep))
+                color *= shadowAttenuation;
+            return glm::vec4(color, 1.0f);
         }
     }
 
     return glm::vec4(glm::vec3(0.0f), 1.0f);
 }
 
+// Whether the iso surface blocks the light at the position (in voxel coordinates). The shadow ray stops at the first
+// occluder and skips empty space coarse to fine: first whole coarse bricks, then bricks, before it takes samples.
+bool Renderer::isInShadow(const glm::vec3& position, const glm::vec3& lightDirection, float sampleStep) const
+{
+    const glm::vec3 upper = glm::vec3(m_pVolume->dims() - 1);
+    const glm::vec3 increment = sampleStep * lightDirection;
+    // Start one step away from the surface such that it does not shadow itself.
+    for (glm::vec3 samplePos = position + increment; glm::all(glm::greaterThanEqual(samplePos, glm::vec3(0.0f))) && glm::all(glm::lessThanEqual(samplePos, upper));) {
+        if (!isCoarseBrickOccupied(samplePos)) {
+            samplePos += float(samplesInCoarseBrick(samplePos, increment)) * increment;
+            continue;
+        }
+        if (!isBrickOccupied(samplePos)) {
+            samplePos += float(samplesInBrick(samplePos, increment)) * increment;
+            continue;
+        }
+        if (m_pVolume->getSampleInterpolate(samplePos) >= m_config.isoValue)
+            return true;
+        samplePos += increment;
+    }
+    return false;
+}
+
 // Given that the iso value lies somewhere between t0 and t1, find a t for which the value
 // closely matches the iso value (less than 0.01 difference). Add a limit to the number of
 // iterations such that it does not get stuck in degerate cases.
@@ -281,23 +746,60 @@ glm::vec4 Renderer::traceRayComposite(const Ray& ray, float sampleStep) const
     glm::vec3 samplePos = ray.origin + ray.tmax * ray.direction;
     const glm::vec3 increment = sampleStep * ray.direction;
 
+    // Gradients from the ray samples: a central difference of the samples one step behind and ahead (the one ahead
+    // is the next sample of the ray) and forward differences towards two taps one voxel away perpendicular to the ray.
+    const bool rayGradients = m_config.volumeShading && m_gradientEstimation == GradientEstimation::RaySamples;
+    const glm::vec3 rayAxis = glm::normalize(ray.direction);
+    const auto [axisU, axisV] = perpendicularAxes(rayAxis);
+    const float stepLength = glm::length(increment);
+    float prevVal = 0.0f, nextVal = 0.0f;
+    bool windowValid = false;
+
     //back-to-front compositing
     for (float t = ray.tmax; t >= ray.tmin; t -= sampleStep, samplePos -= increment) {
-        const float val = m_pVolume->getSampleInterpolate(samplePos);
+        // Skip bricks that are fully transparent (they leave C unchanged).
+        if (!isBrickOccupied(samplePos)) {
+            const int skip = samplesInBrick(samplePos, -increment) - 1;
+            t -= float(skip) * sampleStep;
+            samplePos -= float(skip) * increment;
+            windowValid = false;
+            continue;
+        }
+
+        const float val = windowValid ? nextVal : m_pVolume->getSampleInterpolate(samplePos);
         const glm::vec4 TFval = getTFValue(val);
         glm::vec3 color = glm::vec3(TFval.r, TFval.g, TFval.b);
         const float A = TFval.a; //opacity
         glm::vec4 C_i = glm::vec4(0); //position colour
 
         //if volume shading is applied
-        if (m_config.volumeShading) {
+        if (rayGradients) {
+            if (!windowValid)
+                prevVal = m_pVolume->getSampleInterpolate(samplePos + increment);
+            nextVal = m_pVolume->getSampleInterpolate(samplePos - increment);
+            windowValid = true;
+
+            // Transparent samples do not contribute, so they do not need the taps.
+            if (A > 0.0f) {
+                const glm::vec3 voxelGradient = rayAxis * ((prevVal - nextVal) / (2.0f * stepLength))
+                    + axisU * (m_pVolume->getSampleInterpolate(samplePos + axisU) - val)
+                    + axisV * (m_pVolume->getSampleInterpolate(samplePos + axisV) - val);
+                // Same units as the gradient volume (per unit of world space).
+                const glm::vec3 dir = voxelGradient / m_pVolume->spacing();
+                if (!glm::all(glm::equal(dir, glm::vec3(0)))) {
+                    const glm::vec3 shading = computePhongShading(color, { dir, glm::length(dir) }, m_pCamera->position(), ray.direction * m_pVolume->spacing());
+                    C_i = glm::vec4(shading * A, A);
+                }
+            }
+            prevVal = val;
+        } else if (m_config.volumeShading) {
             const glm::vec3 light = m_pCamera->position();
             const volume::GradientVoxel gradient = m_pGradientVolume->getGradientInterpolate(samplePos);
 
             //check whether the voxel is not 0
             //For some reason I can't implement this check in the computePhongShading function itself
             if (!glm::all(glm::equal(gradient.dir, glm::vec3(0)))) {
-                glm::vec3 shading = computePhongShading(color, gradient, light, ray.direction);
+                glm::vec3 shading = computePhongShading(color, gradient, light, ray.direction * m_pVolume->spacing());
                 C_i = glm::vec4(shading * A, A);
             }
         } else {
@@ -310,6 +812,55 @@ glm::vec4 Renderer::traceRayComposite(const Ray& ray, float sampleStep) const
     return C;
 }
 
+// Compositing of multi-channel volumes: same as traceRayComposite, but every sample fetches all channels at once and
+// classifies them with the channel transfer functions.
+glm::vec4 Renderer::traceRayChannels(const Ray& ray, float sampleStep) const
+{
+    glm::vec4 C = glm::vec4(0);
+    glm::vec3 samplePos = ray.origin + ray.tmax * ray.direction;
+    const glm::vec3 increment = sampleStep * ray.direction;
+
+    for (float t = ray.tmax; t >= ray.tmin; t -= sampleStep, samplePos -= increment) {
+        if (!isBrickOccupied(samplePos)) {
+            const int skip = samplesInBrick(samplePos, -increment) - 1;
+            t -= float(skip) * sampleStep;
+            samplePos -= float(skip) * increment;
+            continue;
+        }
+
+        const glm::vec4 TFval = getChannelTFValue(m_pVolume->getChannelsInterpolate(samplePos));
+        const float A = TFval.a;
+        if (A <= 0.0f)
+            continue;
+
+        const glm::vec3 color = glm::vec3(TFval.r, TFval.g, TFval.b);
+        glm::vec4 C_i = glm::vec4(color * A, A);
+        if (m_config.volumeShading) {
+            // Like traceRayComposite, samples without a gradient only attenuate.
+            const volume::GradientVoxel gradient = m_pGradientVolume->getGradientInterpolate(samplePos);
+            C_i = glm::vec4(0);
+            if (!glm::all(glm::equal(gradient.dir, glm::vec3(0))))
+                C_i = glm::vec4(computePhongShading(color, gradient, m_pCamera->position(), ray.direction * m_pVolume->spacing()) * A, A);
+        }
+        C = C_i + (1 - A) * C;
+    }
+    return C;
+}
+
+// Color (the opacity weighted average of the channel colors) and opacity (the sum of the channel opacities) of a
+// sample of a multi-channel volume.
+glm::vec4 Renderer::getChannelTFValue(const glm::vec4& channels) const
+{
+    const ChannelClassification& classification = m_channelClassification;
+    const glm::vec4 alphas = glm::clamp((channels - classification.lower) * classification.inverseWidth, 0.0f, 1.0f) * classification.opacity;
+    const float alphaSum = alphas.x + alphas.y + alphas.z + alphas.w;
+    if (alphaSum <= 0.0f)
+        return glm::vec4(0.0f);
+
+    const glm::vec3 color = alphas.x * classification.colors[0] + alphas.y * classification.colors[1] + alphas.z * classification.colors[2] + alphas.w * classification.colors[3];
+    return glm::vec4(color / alphaSum, std::min(alphaSum, 1.0f));
+}
+
 // ======= DO NOT MODIFY THIS FUNCTION ========
 // Looks up the color+opacity corresponding to the given volume value from the 1D tranfer function LUT (m_config.tfColorMap).
 // The value will initially range from (m_config.tfColorMapIndexStart) to (m_config.tfColorMapIndexStart + m_config.tfColorMapIndexRange) .
@@ -342,6 +893,14 @@ glm::vec4 Renderer::traceRayTF2D(const Ray& ray, float sampleStep) const
             break;
         }
 
+        // Skip bricks that are fully transparent.
+        if (!isBrickOccupied(samplePos)) {
+            const int skip = samplesInBrick(samplePos, increment) - 1;
+            t += float(skip) * sampleStep;
+            samplePos += float(skip) * increment;
+            continue;
+        }
+
         const float val = m_pVolume->getSampleInterpolate(samplePos);
         const glm::vec4 TFval = getTFValue(val);
         volume::GradientVoxel gradient = m_pGradientVolume->getGradientInterpolate(samplePos);
@@ -420,10 +979,209 @@ bool Renderer::instersectRayVolumeBounds(Ray& ray, const Bounds& bounds) const
     return true;
 }
 
+void Renderer::volumeChanged()
+{
+    invalidateImage();
+    updateBrickOccupancy();
+}
+
+std::optional<PickResult> Renderer::pick(const glm::vec2& pixel) const
+{
+    // Same sampling as renderTile such that the pick matches the image.
+    static constexpr float sampleStep = 1.0f;
+    const PixelSetup setup = pixelSetup();
+    Ray ray = generateVoxelRay(pixel);
+    if (!instersectRayVolumeBounds(ray, setup.bounds))
+        return {};
+
+    const auto result = [&](const glm::vec3& position) {
+        return PickResult { position, m_pVolume->getSampleInterpolate(position), m_pGradientVolume->getGradientInterpolate(position) };
+    };
+    if (m_config.renderMode == RenderMode::RenderSlicer) {
+        // Same plane as traceRaySlice.
+        const float t = glm::dot(setup.volumeCenter - ray.origin, setup.planeNormal) / glm::dot(ray.direction, setup.planeNormal);
+        if (t < ray.tmin || t > ray.tmax)
+            return {};
+        return result(ray.origin + t * ray.direction);
+    }
+
+    const volume::MinMaxBricks& bricks = m_pVolume->minMaxBricks();
+    const bool isMIP = m_config.renderMode == RenderMode::RenderMIP;
+    std::optional<glm::vec3> optMaximumPos;
+    float maximum = std::numeric_limits<float>::lowest();
+
+    glm::vec3 samplePos = ray.origin + ray.tmin * ray.direction;
+    const glm::vec3 increment = sampleStep * ray.direction;
+    for (float t = ray.tmin; t <= ray.tmax; t += sampleStep, samplePos += increment) {
+        // Skip bricks that cannot contain the feature; for MIP those that cannot contain a larger maximum.
+        const bool skipBrick = isMIP ? bricks.getRange(bricks.brickOf(samplePos)).maximum <= maximum : !isBrickOccupied(samplePos);
+        if (skipBrick) {
+            const int skip = samplesInBrick(samplePos, increment) - 1;
+            t += float(skip) * sampleStep;
+            samplePos += float(skip) * increment;
+            continue;
+        }
+
+        const float val = m_pVolume->getSampleInterpolate(samplePos);
+        switch (m_config.renderMode) {
+        case RenderMode::RenderIso: {
+            if (val >= m_config.isoValue) {
+                const float tSurface = val != m_config.isoValue && t > ray.tmin ? bisectionAccuracy(ray, std::max(t - sampleStep, ray.tmin), t, m_config.isoValue) : t;
+                return result(ray.origin + tSurface * ray.direction);
+            }
+            break;
+        }
+        case RenderMode::RenderComposite: {
+            const float opacity = m_pVolume->channelCount() > 1 ? getChannelTFValue(m_pVolume->getChannelsInterpolate(samplePos)).a : getTFValue(val).a;
+            if (opacity > 0.0f)
+                return result(samplePos);
+            break;
+        }
+        case RenderMode::RenderTF2D: {
+            if (getTF2DOpacity(val, m_pGradientVolume->getGradientInterpolate(samplePos).magnitude) > 0.0f)
+                return result(samplePos);
+            break;
+        }
+        default: {
+            if (val > maximum) {
+                maximum = val;
+                optMaximumPos = samplePos;
+            }
+            break;
+        }
+        };
+    }
+    if (optMaximumPos)
+        return result(*optMaximumPos);
+    return {};
+}
+
+// Classify the bricks of the volume for the current config. A brick is empty if no sample inside of it can
+// change the color of a pixel (fully transparent for compositing, below the iso value for iso surfaces).
+void Renderer::updateBrickOccupancy()
+{
+    const volume::MinMaxBricks& bricks = m_pVolume->minMaxBricks();
+    const glm::ivec3 brickDims = bricks.dims();
+    auto pOccupancy = std::make_shared<BrickOccupancy>();
+    std::vector<uint8_t>& brickOccupancy = pOccupancy->bricks;
+    brickOccupancy.resize(size_t(brickDims.x) * size_t(brickDims.y) * size_t(brickDims.z));
+
+    const TFOpacityRanges tfOpacityRanges { m_config };
+    // The bricks store the maximum over the channels, which has to exceed the lower end of a visible channel.
+    float channelThreshold = std::numeric_limits<float>::max();
+    for (int channel = 0; channel < volume::maxChannelCount; channel++) {
+        if (m_channelClassification.opacity[channel] > 0.0f)
+            channelThreshold = std::min(channelThreshold, m_channelClassification.lower[channel]);
+    }
+
+    for (size_t i = 0; i < brickOccupancy.size(); i++) {
+        const volume::BrickRange range = bricks.getRange(i);
+        bool occupied = true;
+        switch (m_config.renderMode) {
+        case RenderMode::RenderIso: {
+            occupied = range.maximum >= m_config.isoValue;
+            break;
+        }
+        case RenderMode::RenderComposite: {
+            if (m_pVolume->channelCount() > 1)
+                occupied = range.maximum > channelThreshold;
+            else
+                occupied = !tfOpacityRanges.isTransparent(range.minimum, range.maximum);
+            break;
+        }
+        case RenderMode::RenderTF2D: {
+            // getTF2DOpacity is zero for intensities that are further than the radius away from the center.
+            occupied = range.maximum >= m_config.TF2DIntensity - m_config.TF2DRadius && range.minimum <= m_config.TF2DIntensity + m_config.TF2DRadius;
+            break;
+        }
+        default: {
+            break;
+        }
+        };
+        brickOccupancy[i] = occupied ? 1 : 0;
+    }
+
+    // A coarse brick is occupied if any of its bricks is.
+    const glm::ivec3 coarseDims = (brickDims + coarseBrickFactor - 1) / coarseBrickFactor;
+    pOccupancy->coarseDims = coarseDims;
+    pOccupancy->coarseBricks.assign(size_t(coarseDims.x) * size_t(coarseDims.y) * size_t(coarseDims.z), 0);
+    for (int z = 0; z < brickDims.z; z++) {
+        for (int y = 0; y < brickDims.y; y++) {
+            for (int x = 0; x < brickDims.x; x++) {
+                const glm::ivec3 coarse = glm::ivec3(x, y, z) / coarseBrickFactor;
+                pOccupancy->coarseBricks[size_t(coarse.x + coarseDims.x * (coarse.y + coarseDims.y * coarse.z))] |= brickOccupancy[size_t(x + brickDims.x * (y + brickDims.y * z))];
+            }
+        }
+    }
+    m_pBrickOccupancy = std::move(pOccupancy);
+}
+
+// Returns whether the brick containing the sample position may contribute to the image.
+bool Renderer::isBrickOccupied(const glm::vec3& samplePos) const
+{
+    const volume::MinMaxBricks& bricks = m_pVolume->minMaxBricks();
+    const glm::ivec3 brick = bricks.brickOf(samplePos);
+    const glm::ivec3 brickDims = bricks.dims();
+    return m_pBrickOccupancy->bricks[size_t(brick.x + brickDims.x * (brick.y + brickDims.y * brick.z))];
+}
+
+// Returns the number of increments after which the sample position has left the brick that currently contains it.
+// Errs on the side of too few increments such that no sample of a neighbouring brick is ever skipped.
+int Renderer::samplesInBrick(const glm::vec3& samplePos, const glm::vec3& increment) const
+{
+    const volume::MinMaxBricks& bricks = m_pVolume->minMaxBricks();
+    const glm::vec3 lower = glm::vec3(bricks.brickOf(samplePos) * bricks.brickSize());
+    return samplesInBox(samplePos, increment, lower, lower + float(bricks.brickSize()));
+}
+
+bool Renderer::isCoarseBrickOccupied(const glm::vec3& samplePos) const
+{
+    const glm::ivec3 coarse = m_pVolume->minMaxBricks().brickOf(samplePos) / coarseBrickFactor;
+    const glm::ivec3& coarseDims = m_pBrickOccupancy->coarseDims;
+    return m_pBrickOccupancy->coarseBricks[size_t(coarse.x + coarseDims.x * (coarse.y + coarseDims.y * coarse.z))];
+}
+
+int Renderer::samplesInCoarseBrick(const glm::vec3& samplePos, const glm::vec3& increment) const
+{
+    const volume::MinMaxBricks& bricks = m_pVolume->minMaxBricks();
+    const int coarseBrickSize = bricks.brickSize() * coarseBrickFactor;
+    const glm::vec3 lower = glm::vec3(bricks.brickOf(samplePos) / coarseBrickFactor * coarseBrickSize);
+    return samplesInBox(samplePos, increment, lower, lower + float(coarseBrickSize));
+}
+
 // This function inserts a color into the framebuffer at position x,y
 void Renderer::fillColor(int x, int y, const glm::vec4& color)
 {
     const size_t index = static_cast<size_t>(m_config.renderResolution.x * y + x);
     m_frameBuffer[index] = color;
 }
-}
\ No newline at end of file
+}
+
+static bool overlaps(const volume::BrickRange& lhs, const volume::BrickRange& rhs)
+{
+    return lhs.minimum <= rhs.maximum && rhs.minimum <= lhs.maximum;
+}
+
+// Returns the number of increments after which the sample position has left the box [lower, upper). Errs on the side
+// of too few increments such that no sample of a neighbouring box is ever skipped.
+static int samplesInBox(const glm::vec3& samplePos, const glm::vec3& increment, const glm::vec3& lower, const glm::vec3& upper)
+{
+    float exit = std::numeric_limits<float>::max();
+    for (int axis = 0; axis < 3; axis++) {
+        if (increment[axis] > 0.0f)
+            exit = std::min(exit, (upper[axis] - samplePos[axis]) / increment[axis]);
+        else if (increment[axis] < 0.0f)
+            exit = std::min(exit, (lower[axis] - samplePos[axis]) / increment[axis]);
+    }
+    return std::max(1, int(std::ceil(exit - 1e-3f)));
+}
+
+// Two unit vectors that form an orthonormal basis with the (unit) axis.
+static std::pair<glm::vec3, glm::vec3> perpendicularAxes(const glm::vec3& axis)
+{
+    // Cross with the coordinate axis that is the least aligned with the axis to avoid degenerate results.
+    const glm::vec3 absAxis = glm::abs(axis);
+    const glm::vec3 other = absAxis.x <= absAxis.y && absAxis.x <= absAxis.z ? glm::vec3(1, 0, 0) : (absAxis.y <= absAxis.z ? glm::vec3(0, 1, 0) : glm::vec3(0, 0, 1));
+    const glm::vec3 u = glm::normalize(glm::cross(axis, other));
+    return { u, glm::cross(axis, u) };
+}
@@ -1,4 +1,5 @@
 #pragma once
+#include "memory/memory_registry.h"
 #include "render/ray.h"
 #include "render/ray_trace_camera.h"
 #include "render/render_config.h"
@@ -10,7 +11,9 @@
 #include <glm/vec3.hpp>
 #include <glm/vec4.hpp>
 #include <gsl/span>
+#include <array>
 #include <memory>
+#include <optional>
 #include <tuple>
 #include <vector>
 
@@ -24,6 +27,37 @@ union Bounds {
     std::array<glm::vec3, 2> lowerUpper;
 };
 
+// Performance parameters that do not change the image (see session/auto_tune.h).
+struct RenderTuning {
+    int tileSize { 0 }; // Smallest tile (in pixels) that the parallel loop over the screen splits into; 0 lets TBB decide.
+};
+
+// Transfer function of one channel of a multi-channel volume: the opacity ramps up linearly from 0 at lower to the
+// given opacity at upper. The channels of a sample are blended by their opacities.
+struct ChannelTransferFunction {
+    glm::vec3 color;
+    float lower, upper;
+    float opacity;
+
+    bool operator==(const ChannelTransferFunction&) const = default;
+};
+using ChannelTransferFunctions = std::array<ChannelTransferFunction, volume::maxChannelCount>;
+// Red, green, blue and white ramps over the range of the volume.
+ChannelTransferFunctions defaultChannelTransferFunctions(const volume::Volume& volume);
+
+// Where shaded compositing gets the gradients of its samples from.
+enum class GradientEstimation {
+    GradientVolume, // Interpolated from the precomputed gradient volume.
+    RaySamples, // Finite differences of the scalar samples along the ray plus two taps perpendicular to it.
+};
+
+// What is visible through a pixel (see Renderer::pick).
+struct PickResult {
+    glm::vec3 position; // Voxel coordinates.
+    float value;
+    volume::GradientVoxel gradient;
+};
+
 class Renderer {
 public:
     Renderer(
@@ -33,8 +67,45 @@ public:
         const RenderConfig& config);
 
     void setConfig(const RenderConfig& config);
+    void setTuning(const RenderTuning& tuning);
+    // Used instead of the 1D transfer function when compositing volumes with multiple channels.
+    void setChannelTransferFunctions(const ChannelTransferFunctions& transferFunctions);
+    // Hard shadows on iso surfaces from a directional light (the world space direction towards the light), which
+    // then also shades them instead of the head light. Empty disables the shadows.
+    void setShadowLight(const std::optional<glm::vec3>& optLightDirection);
+    // Gradients for shaded compositing of scalar volumes. Estimating them from the ray samples reads two extra scalar
+    // samples per visible sample instead of eight gradient voxels, and does not touch the gradient volume at all.
+    void setGradientEstimation(GradientEstimation gradientEstimation);
+    // Renders the whole image, except after edits of the 1D transfer function (compositing, without anti-aliasing)
+    // from an unchanged view: then only the tiles whose rays pass through voxels in the edited value interval are
+    // rendered again. The value range of each tile is recorded on the first edit and reused until the view changes.
     void render();
+    // Whether the next render() only renders the tiles that are affected by transfer function edits.
+    bool hasLocalizedRender() const;
+    // Number of tiles that the last render() rendered again after transfer function edits (empty after a full render).
+    std::optional<size_t> localizedTileCount() const;
+    // Only render the pixels in the rectangle [begin, end) of the screen, the rest of the framebuffer is left as is.
+    void renderRegion(const glm::ivec2& begin, const glm::ivec2& end);
     gsl::span<const glm::vec4> frameBuffer() const;
+    // Number of pixels that the last adaptive anti-aliasing pass rendered again (see RenderConfig).
+    size_t supersampledPixelCount() const;
+
+    // Render the current config from multiple cameras at once (e.g. thumbnail grids) and return one framebuffer
+    // per camera. The views share the acceleration structures and per-config tables, and the tiles of all views
+    // are distributed over the cores by a single parallel loop.
+    std::vector<std::vector<glm::vec4>> renderBatch(gsl::span<const render::RayTraceCamera* const> cameras) const;
+
+    // Only render the part of the volume inside the block (sort-last distributed rendering, see ipc/sort_last.h).
+    // Samples are taken at the same positions as when rendering the whole volume and every sample belongs to
+    // exactly one block, so compositing the images of all blocks in depth order gives the full image.
+    void setBlockBounds(const std::optional<Bounds>& optBlockBounds);
+
+    // Call after the voxels of the volume were edited (see Volume::applyBrush) to update the empty space skipping.
+    void volumeChanged();
+    // The first feature along the ray through the pixel (in NDC) that is visible in the current render mode: the
+    // point on the slice plane, the maximum intensity, the iso surface (refined by bisection) or the first sample
+    // with a non-zero opacity. Skips empty space like rendering does, so it is cheap enough to call on every mouse move.
+    std::optional<PickResult> pick(const glm::vec2& pixel) const;
 
 protected:
     // These functions will be automatically tested.
@@ -43,19 +114,52 @@ protected:
     glm::vec4 traceRayISO(const Ray& ray, float sampleStep) const;
     glm::vec4 traceRayComposite(const Ray& ray, float sampleStep) const;
     glm::vec4 traceRayTF2D(const Ray& ray, float sampleStep) const;
+    glm::vec4 traceRayChannels(const Ray& ray, float sampleStep) const;
 
     float bisectionAccuracy(const Ray& ray, float t0, float t1, float isoValue) const;
+    bool isInShadow(const glm::vec3& position, const glm::vec3& lightDirection, float sampleStep) const;
 
     static glm::vec3 computePhongShading(const glm::vec3& color, const volume::GradientVoxel& gradient, const glm::vec3& lightDirection, const glm::vec3& viewDirection);
 
 private:
+    // Another view of the same volume and config from the camera (see renderBatch): shares the brick occupancy and
+    // copies the per-config tables, but starts with its own empty framebuffer.
+    Renderer(const Renderer& renderer, const render::RayTraceCamera* pCamera);
+
+    // Per-frame values that all rays need.
+    struct PixelSetup {
+        glm::vec3 planeNormal;
+        glm::vec3 volumeCenter;
+        Bounds bounds;
+    };
+
     void resizeImage(const glm::ivec2& resolution);
     void resetImage();
+    void renderTile(const glm::ivec2& begin, const glm::ivec2& end);
+    PixelSetup pixelSetup() const;
+    Ray generateVoxelRay(const glm::vec2& pixel) const;
+    std::optional<Ray> pixelRay(const PixelSetup& setup, const glm::vec2& pixel, float sampleStep) const;
+    std::optional<glm::vec4> tracePixel(const PixelSetup& setup, const glm::vec2& pixel) const;
+    void supersampleEdges(const glm::ivec2& begin, const glm::ivec2& end);
+
+    using CameraRays = std::array<glm::vec3, 4>;
+    CameraRays cameraRays() const;
+    void invalidateImage();
+    void recordTileValueRanges();
+    void renderChangedTiles();
+
+    void updateBrickOccupancy();
+    bool isBrickOccupied(const glm::vec3& samplePos) const;
+    int samplesInBrick(const glm::vec3& samplePos, const glm::vec3& increment) const;
+    bool isCoarseBrickOccupied(const glm::vec3& samplePos) const;
+    int samplesInCoarseBrick(const glm::vec3& samplePos, const glm::vec3& increment) const;
 
     glm::vec4 getTFValue(float val) const;
     float getTF2DOpacity(float val, float gradientMagnitude) const;
+    glm::vec4 getChannelTFValue(const glm::vec4& channels) const;
 
     bool instersectRayVolumeBounds(Ray& ray, const Bounds& volumeBounds) const;
+    bool clipRayToBlock(Ray& ray, float sampleStep, const glm::vec3& volumeCenter, const glm::vec3& planeNormal) const;
     void fillColor(int x, int y, const glm::vec4& color);
 
 protected:
@@ -63,8 +167,41 @@ protected:
     const volume::GradientVolume* m_pGradientVolume;
     const render::RayTraceCamera* m_pCamera;
     RenderConfig m_config;
+    RenderTuning m_tuning;
+
+    // The channel transfer functions as one vector per parameter such that all channels are classified at once.
+    struct ChannelClassification {
+        glm::vec4 lower, inverseWidth, opacity; // Opacity is 0 for channels that the volume does not have.
+        std::array<glm::vec3, volume::maxChannelCount> colors;
+    };
+    ChannelTransferFunctions m_channelTransferFunctions;
+    ChannelClassification m_channelClassification;
 
     std::vector<glm::vec4> m_frameBuffer;
+    memory::TrackedMemory m_frameBufferMemory { "Framebuffer" };
+
+    struct BrickOccupancy {
+        // Whether each brick of the volume's MinMaxBricks may contribute to the image given the current config.
+        std::vector<uint8_t> bricks;
+        // The same for blocks of coarseBrickFactor^3 bricks, which shadow rays test first.
+        std::vector<uint8_t> coarseBricks;
+        glm::ivec3 coarseDims { 0 };
+    };
+    // Replaced (never modified) when the config changes, such that the views of renderBatch can share it.
+    std::shared_ptr<const BrickOccupancy> m_pBrickOccupancy;
+
+    std::optional<Bounds> m_optBlockBounds;
+    size_t m_supersampledPixelCount { 0 };
+    std::optional<glm::vec3> m_optShadowLight;
+    GradientEstimation m_gradientEstimation { GradientEstimation::GradientVolume };
+
+    // The view of the image in the framebuffer, if the image is complete and only the colors of the values in
+    // m_optChangedValueRange are outdated (transfer function edits since the last render).
+    std::optional<CameraRays> m_optImageView;
+    std::optional<volume::BrickRange> m_optChangedValueRange;
+    // Range of the voxel values that the rays of each tile may sample, for m_optImageView (empty until needed).
+    std::vector<volume::BrickRange> m_tileValueRanges;
+    std::optional<size_t> m_optLocalizedTileCount;
 };
 
 }
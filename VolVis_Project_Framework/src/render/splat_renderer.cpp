@@ -0,0 +1,242 @@
+#include "splat_renderer.h"
+#include "render/transfer_function.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+#include <glm/gtx/component_wise.hpp>
+#include <iostream>
+#include <limits>
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+#include <tbb/parallel_sort.h>
+#include <utility>
+
+// Footprints cover up to this many pixels on each side of the center of a splat.
+static constexpr int maxFootprintRadius = 16;
+// Size of the tiles (in pixels) that the splats are binned into and that are composited in parallel.
+static constexpr int splatTileSize = 32;
+// Splats closer to the eye than this (in world coordinates) are culled.
+static constexpr float minSplatDepth = 1e-3f;
+
+// Gaussian kernels for every footprint radius (standard deviation of half the radius), indexed by radius and then by
+// the offset from the center as (dx + radius) + (2 * radius + 1) * (dy + radius). Weights are 1 in the center.
+static const std::array<std::vector<float>, maxFootprintRadius + 1>& footprints();
+
+namespace render {
+
+SplatRenderer::SplatRenderer(const volume::Volume* pVolume, const render::RayTraceCamera* pCamera, const RenderConfig& config)
+    : m_pVolume(pVolume)
+    , m_pCamera(pCamera)
+    , m_config(config)
+{
+    m_frameBuffer.resize(size_t(config.renderResolution.x) * size_t(config.renderResolution.y));
+    m_frameBufferMemory.setSize(m_frameBuffer.size() * sizeof(glm::vec4));
+}
+
+void SplatRenderer::setConfig(const RenderConfig& config)
+{
+    if (config.renderResolution != m_config.renderResolution) {
+        m_frameBuffer.resize(size_t(config.renderResolution.x) * size_t(config.renderResolution.y));
+        m_frameBufferMemory.setSize(m_frameBuffer.size() * sizeof(glm::vec4));
+    }
+    if (config.tfColorMap != m_config.tfColorMap || config.tfColorMapIndexStart != m_config.tfColorMapIndexStart || config.tfColorMapIndexRange != m_config.tfColorMapIndexRange)
+        m_splatsOutdated = true;
+    m_config = config;
+}
+
+void SplatRenderer::volumeChanged()
+{
+    m_splatsOutdated = true;
+}
+
+gsl::span<const glm::vec4> SplatRenderer::frameBuffer() const
+{
+    return m_frameBuffer;
+}
+
+size_t SplatRenderer::splatCount() const
+{
+    return m_splats.size();
+}
+
+// Collect the voxels with a non-zero opacity. Bricks in which the transfer function is transparent for the whole
+// value range are skipped. The visible voxels are counted first such that the list is only allocated if it fits in
+// the memory budget, then every slab of bricks fills its own part of the list (in order, such that the list does not
+// depend on the number of threads).
+void SplatRenderer::extractSplats()
+{
+    const volume::MinMaxBricks& bricks = m_pVolume->minMaxBricks();
+    const glm::ivec3 brickDims = bricks.dims();
+    const glm::ivec3 dim = m_pVolume->dims();
+    const glm::vec3 spacing = m_pVolume->spacing();
+    const auto voxels = m_pVolume->data();
+    const TFOpacityRanges tfOpacityRanges { m_config };
+    const auto forEachVisibleVoxel = [&](int brickZ, auto&& f) {
+        for (int brickY = 0; brickY < brickDims.y; brickY++) {
+            for (int brickX = 0; brickX < brickDims.x; brickX++) {
+                const glm::ivec3 brick { brickX, brickY, brickZ };
+                const volume::BrickRange brickRange = bricks.getRange(brick);
+                if (tfOpacityRanges.isTransparent(brickRange.minimum, brickRange.maximum))
+                    continue;
+
+                const glm::ivec3 lower = brick * bricks.brickSize();
+                const glm::ivec3 upper = glm::min(lower + bricks.brickSize(), dim);
+                for (int z = lower.z; z < upper.z; z++) {
+                    for (int y = lower.y; y < upper.y; y++) {
+                        for (int x = lower.x; x < upper.x; x++) {
+                            const glm::vec4 color = lookupTransferFunction(m_config, float(voxels[size_t(x) + size_t(dim.x) * (size_t(y) + size_t(dim.y) * size_t(z))]));
+                            if (color.a > 0.0f)
+                                f(glm::ivec3(x, y, z), color);
+                        }
+                    }
+                }
+            }
+        }
+    };
+
+    // Release the previous splats such that they are not counted as in use.
+    m_splats = {};
+    m_screenSplats = {};
+    m_order = {};
+    m_splatMemory.setSize(0);
+    m_sortMemory.setSize(0);
+    m_splatsOutdated = false;
+
+    std::vector<size_t> slabOffsets(size_t(brickDims.z) + 1, 0);
+    tbb::parallel_for(tbb::blocked_range<int>(0, brickDims.z), [&](const tbb::blocked_range<int>& range) {
+        for (int brickZ = range.begin(); brickZ != range.end(); brickZ++)
+            forEachVisibleVoxel(brickZ, [&](const glm::ivec3&, const glm::vec4&) { slabOffsets[size_t(brickZ) + 1]++; });
+    });
+    for (size_t i = 1; i < slabOffsets.size(); i++)
+        slabOffsets[i] += slabOffsets[i - 1];
+
+    // The list and the per-frame data of render(): the projected splat, its place in the depth order and (at least)
+    // one entry in the bins of the tiles.
+    const size_t bytesPerSplat = sizeof(Splat) + sizeof(ScreenSplat) + sizeof(std::pair<float, uint32_t>) + sizeof(uint32_t);
+    const size_t splatCount = slabOffsets.back();
+    m_splatsFit = splatCount <= size_t(std::numeric_limits<uint32_t>::max()) && splatCount <= memory::availableMemory() / bytesPerSplat;
+    if (!m_splatsFit) {
+        std::cerr << "The " << splatCount << " visible voxels do not fit in the memory budget, compositing is ray cast instead of splatted" << std::endl;
+        return;
+    }
+
+    m_splats.resize(splatCount);
+    tbb::parallel_for(tbb::blocked_range<int>(0, brickDims.z), [&](const tbb::blocked_range<int>& range) {
+        for (int brickZ = range.begin(); brickZ != range.end(); brickZ++) {
+            size_t i = slabOffsets[size_t(brickZ)];
+            forEachVisibleVoxel(brickZ, [&](const glm::ivec3& voxel, const glm::vec4& color) { m_splats[i++] = { glm::vec3(voxel) * spacing, color }; });
+        }
+    });
+    m_splatMemory.setSize(m_splats.size() * sizeof(Splat));
+}
+
+bool SplatRenderer::render()
+{
+    if (m_splatsOutdated)
+        extractSplats();
+    if (!m_splatsFit)
+        return false;
+    std::fill(std::begin(m_frameBuffer), std::end(m_frameBuffer), glm::vec4(0.0f));
+
+    // The projection is recovered from the camera rays: for a pinhole camera a point at depth z along the forward
+    // direction projects to ndc = (dot(v, right), dot(v, up)) / z, where right and up are scaled such that the
+    // rays through x = 1 and y = 1 (in NDC) are forward + right / |right|^2 and forward + up / |up|^2.
+    const glm::vec3 origin = m_pCamera->generateRay(glm::vec2(0.0f)).origin;
+    const glm::vec3 forward = glm::normalize(m_pCamera->generateRay(glm::vec2(0.0f)).direction);
+    const auto screenAxis = [&](const glm::vec2& ndc) {
+        const glm::vec3 direction = m_pCamera->generateRay(ndc).direction;
+        const glm::vec3 axis = direction / glm::dot(direction, forward) - forward;
+        return axis / glm::dot(axis, axis);
+    };
+    const glm::vec3 right = screenAxis(glm::vec2(1.0f, 0.0f));
+    const glm::vec3 up = screenAxis(glm::vec2(0.0f, 1.0f));
+    const glm::vec2 resolution = glm::vec2(m_config.renderResolution);
+    // Pixels covered by one unit of world space at a depth of 1.
+    const float pixelsPerUnit = 0.5f * resolution.x * glm::length(right);
+    const float voxelSize = glm::compMax(m_pVolume->spacing());
+
+    // Project the splats and sort the visible ones back to front. Splats behind or (almost) at the eye are culled
+    // before they are projected, and splats off screen before their pixel is converted to integers, such that the
+    // conversion cannot overflow.
+    m_screenSplats.resize(m_splats.size());
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, m_splats.size()), [&](const tbb::blocked_range<size_t>& range) {
+        for (size_t i = range.begin(); i != range.end(); i++) {
+            const glm::vec3 v = m_splats[i].position - origin;
+            const float depth = glm::dot(v, forward);
+            if (depth < minSplatDepth) {
+                m_screenSplats[i] = { depth, glm::ivec2(0), 0 };
+                continue;
+            }
+            const glm::vec2 ndc = glm::vec2(glm::dot(v, right), glm::dot(v, up)) / depth;
+            const glm::vec2 pixel = (ndc * 0.5f + 0.5f) * resolution;
+            const int radius = std::clamp(int(std::round(std::min(voxelSize * pixelsPerUnit / depth, float(maxFootprintRadius)))), 1, maxFootprintRadius);
+            const bool onScreen = pixel.x + float(radius) >= 0.0f && pixel.y + float(radius) >= 0.0f && pixel.x - float(radius) < resolution.x && pixel.y - float(radius) < resolution.y;
+            m_screenSplats[i] = { depth, onScreen ? glm::ivec2(glm::floor(pixel)) : glm::ivec2(0), onScreen ? radius : 0 };
+        }
+    });
+    m_order.clear();
+    for (size_t i = 0; i < m_screenSplats.size(); i++) {
+        if (m_screenSplats[i].radius > 0)
+            m_order.emplace_back(-m_screenSplats[i].depth, uint32_t(i));
+    }
+    tbb::parallel_sort(std::begin(m_order), std::end(m_order));
+    m_sortMemory.setSize(m_screenSplats.capacity() * sizeof(ScreenSplat) + m_order.capacity() * sizeof(std::pair<float, uint32_t>));
+
+    // Bin the splats (in depth order) into the tiles that their footprints overlap.
+    const glm::ivec2 tiles = (m_config.renderResolution + splatTileSize - 1) / splatTileSize;
+    std::vector<std::vector<uint32_t>> tileSplats(size_t(tiles.x) * size_t(tiles.y));
+    for (const auto& [negativeDepth, i] : m_order) {
+        const ScreenSplat& screenSplat = m_screenSplats[i];
+        const glm::ivec2 lowerTile = glm::clamp((screenSplat.pixel - screenSplat.radius) / splatTileSize, glm::ivec2(0), tiles - 1);
+        const glm::ivec2 upperTile = glm::clamp((screenSplat.pixel + screenSplat.radius) / splatTileSize, glm::ivec2(0), tiles - 1);
+        for (int tileY = lowerTile.y; tileY <= upperTile.y; tileY++) {
+            for (int tileX = lowerTile.x; tileX <= upperTile.x; tileX++)
+                tileSplats[size_t(tileX + tiles.x * tileY)].push_back(i);
+        }
+    }
+
+    // Composite the splats of every tile back to front with their footprints.
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, tileSplats.size()), [&](const tbb::blocked_range<size_t>& range) {
+        for (size_t tile = range.begin(); tile != range.end(); tile++) {
+            const glm::ivec2 tileBegin = glm::ivec2(int(tile) % tiles.x, int(tile) / tiles.x) * splatTileSize;
+            const glm::ivec2 tileEnd = glm::min(tileBegin + splatTileSize, m_config.renderResolution);
+            for (const uint32_t i : tileSplats[tile]) {
+                const ScreenSplat& screenSplat = m_screenSplats[i];
+                const glm::vec4& color = m_splats[i].color;
+                const int radius = screenSplat.radius;
+                const std::vector<float>& footprint = footprints()[size_t(radius)];
+                const glm::ivec2 begin = glm::max(screenSplat.pixel - radius, tileBegin);
+                const glm::ivec2 end = glm::min(screenSplat.pixel + radius + 1, tileEnd);
+                for (int y = begin.y; y < end.y; y++) {
+                    for (int x = begin.x; x < end.x; x++) {
+                        const glm::ivec2 offset = glm::ivec2(x, y) - screenSplat.pixel + radius;
+                        const float A = std::min(color.a * footprint[size_t(offset.x + (2 * radius + 1) * offset.y)], 1.0f);
+                        glm::vec4& C = m_frameBuffer[size_t(x + m_config.renderResolution.x * y)];
+                        C = glm::vec4(glm::vec3(color) * A, A) + (1 - A) * C;
+                    }
+                }
+            }
+        }
+    });
+    return true;
+}
+
+}
+
+static const std::array<std::vector<float>, maxFootprintRadius + 1>& footprints()
+{
+    static const auto kernels = []() {
+        std::array<std::vector<float>, maxFootprintRadius + 1> out;
+        for (int radius = 1; radius <= maxFootprintRadius; radius++) {
+            const float sigma = 0.5f * float(radius);
+            for (int dy = -radius; dy <= radius; dy++) {
+                for (int dx = -radius; dx <= radius; dx++)
+                    out[size_t(radius)].push_back(std::exp(-float(dx * dx + dy * dy) / (2.0f * sigma * sigma)));
+            }
+        }
+        return out;
+    }();
+    return kernels;
+}
@@ -0,0 +1,66 @@
+#pragma once
+#include "memory/memory_registry.h"
+#include "render/ray_trace_camera.h"
+#include "render/render_config.h"
+#include "volume/volume.h"
+#include <cstdint>
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+#include <gsl/span>
+#include <utility>
+#include <vector>
+
+namespace render {
+
+// Object-order alternative to compositing (RenderMode::RenderComposite) for sparse volumes such as vessel trees.
+// The voxels that are not fully transparent in the 1D transfer function are extracted into a list (once per transfer
+// function), and every frame they are sorted by depth and splatted back to front with precomputed Gaussian
+// footprints. The cost scales with the number of visible voxels instead of the number of pixels times the depth of
+// the volume. Splats are not shaded (RenderConfig::volumeShading is ignored). The splats and the per-frame sorting
+// data count against the memory budget (see memory/memory_registry.h); dense volumes whose visible voxels do not fit
+// are left to the ray caster.
+class SplatRenderer {
+public:
+    SplatRenderer(const volume::Volume* pVolume, const render::RayTraceCamera* pCamera, const RenderConfig& config);
+
+    void setConfig(const RenderConfig& config);
+    // Call after the voxels of the volume were edited (see Volume::applyBrush).
+    void volumeChanged();
+    // Returns false without rendering if the splats do not fit in the memory budget.
+    bool render();
+    gsl::span<const glm::vec4> frameBuffer() const;
+    // Number of voxels that the last render() splatted (before culling).
+    size_t splatCount() const;
+
+private:
+    struct Splat {
+        glm::vec3 position; // World coordinates.
+        glm::vec4 color;
+    };
+    struct ScreenSplat {
+        float depth;
+        glm::ivec2 pixel;
+        int radius; // 0 if culled.
+    };
+    void extractSplats();
+
+private:
+    const volume::Volume* m_pVolume;
+    const render::RayTraceCamera* m_pCamera;
+    RenderConfig m_config;
+
+    std::vector<Splat> m_splats;
+    bool m_splatsOutdated { true };
+    bool m_splatsFit { true };
+    memory::TrackedMemory m_splatMemory { "Splat list" };
+    // Projected splats and their depth order, kept between frames to reuse the memory.
+    std::vector<ScreenSplat> m_screenSplats;
+    std::vector<std::pair<float, uint32_t>> m_order;
+    memory::TrackedMemory m_sortMemory { "Splat sorting" };
+
+    std::vector<glm::vec4> m_frameBuffer;
+    memory::TrackedMemory m_frameBufferMemory { "Splat framebuffer" };
+};
+
+}
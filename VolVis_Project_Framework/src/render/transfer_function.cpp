@@ -0,0 +1,39 @@
+#include "transfer_function.h"
+#include <algorithm>
+
+static size_t colorMapIndex(float indexStart, float indexRange, float value);
+
+namespace render {
+
+size_t tfColorMapIndex(const RenderConfig& config, float value)
+{
+    return colorMapIndex(config.tfColorMapIndexStart, config.tfColorMapIndexRange, value);
+}
+
+glm::vec4 lookupTransferFunction(const RenderConfig& config, float value)
+{
+    return config.tfColorMap[tfColorMapIndex(config, value)];
+}
+
+TFOpacityRanges::TFOpacityRanges(const RenderConfig& config)
+    : m_indexStart(config.tfColorMapIndexStart)
+    , m_indexRange(config.tfColorMapIndexRange)
+{
+    for (size_t i = 0; i < config.tfColorMap.size(); i++)
+        m_opaqueCount[i + 1] = m_opaqueCount[i] + (config.tfColorMap[i].a > 0.0f ? 1 : 0);
+}
+
+bool TFOpacityRanges::isTransparent(float minimum, float maximum) const
+{
+    return m_opaqueCount[colorMapIndex(m_indexStart, m_indexRange, maximum) + 1] == m_opaqueCount[colorMapIndex(m_indexStart, m_indexRange, minimum)];
+}
+
+}
+
+// Map the value from [indexStart, indexStart + indexRange) to the entries of the color map.
+static size_t colorMapIndex(float indexStart, float indexRange, float value)
+{
+    constexpr size_t colorMapSize = std::tuple_size_v<decltype(render::RenderConfig::tfColorMap)>;
+    const float range01 = (value - indexStart) / indexRange;
+    return size_t(std::clamp(range01 * float(colorMapSize), 0.0f, float(colorMapSize - 1)));
+}
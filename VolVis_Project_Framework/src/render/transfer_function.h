@@ -0,0 +1,29 @@
+#pragma once
+#include "render/render_config.h"
+#include <array>
+#include <cstddef>
+#include <glm/vec4.hpp>
+#include <tuple>
+
+// Lookups in the 1D transfer function of a RenderConfig that are shared by the ray caster and the splat renderer.
+namespace render {
+
+// Index of the value in tfColorMap, clamped to the color map (otherwise the same mapping as Renderer::getTFValue).
+size_t tfColorMapIndex(const RenderConfig& config, float value);
+glm::vec4 lookupTransferFunction(const RenderConfig& config, float value);
+
+// Whether the transfer function is transparent over whole ranges of values, such as the range of a brick. The
+// opaque entries of the color map are counted once, after which every range takes two lookups.
+class TFOpacityRanges {
+public:
+    explicit TFOpacityRanges(const RenderConfig& config);
+
+    bool isTransparent(float minimum, float maximum) const;
+
+private:
+    float m_indexStart, m_indexRange;
+    // Number of entries with a non-zero opacity up to (but excluding) each index.
+    std::array<int, std::tuple_size_v<decltype(RenderConfig::tfColorMap)> + 1> m_opaqueCount {};
+};
+
+}
@@ -0,0 +1,285 @@
+#include "animation.h"
+#include "render/image.h"
+#include "render/renderer.h"
+#include "ui/trackball.h"
+#include "volume/gradient_volume.h"
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cmath>
+#include <fmt/format.h>
+#include <fstream>
+#include <glm/common.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <glm/gtx/component_wise.hpp>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <tbb/concurrent_queue.h>
+#include <tbb/parallel_pipeline.h>
+
+static constexpr float fieldOfView = 60.0f; // Same as the viewer (degrees).
+
+static std::array<glm::vec4, 256> computeColorMap(std::vector<session::TransferFunctionPoint> points);
+
+namespace session {
+
+int AnimationScript::frameCount() const
+{
+    float animationDuration = duration;
+    if (animationDuration < 0.0f) {
+        animationDuration = 0.0f;
+        for (const auto& keyframe : keyframes)
+            animationDuration = std::max(animationDuration, keyframe.time);
+    }
+    return std::max(int(std::round(animationDuration * fps)), 1);
+}
+
+AnimationScript loadAnimationScript(const std::filesystem::path& filePath)
+{
+    AnimationScript out {};
+
+    std::ifstream file { filePath };
+    std::string line;
+    while (std::getline(file, line)) {
+        // Remove comments.
+        line = line.substr(0, line.find('#'));
+
+        std::istringstream lineStream { line };
+        std::string command;
+        if (!(lineStream >> command))
+            continue;
+
+        if (command == "volume") {
+            std::string volumeFile;
+            lineStream >> volumeFile;
+            out.volumeFile = filePath.parent_path() / volumeFile;
+        } else if (command == "resolution") {
+            lineStream >> out.resolution.x >> out.resolution.y;
+        } else if (command == "fps") {
+            lineStream >> out.fps;
+        } else if (command == "duration") {
+            lineStream >> out.duration;
+        } else if (command == "interpolation") {
+            std::string mode;
+            lineStream >> mode;
+            if (mode == "nearest")
+                out.interpolationMode = volume::InterpolationMode::NearestNeighbour;
+            else if (mode == "linear")
+                out.interpolationMode = volume::InterpolationMode::Linear;
+            else if (mode == "cubic")
+                out.interpolationMode = volume::InterpolationMode::Cubic;
+            else
+                std::cerr << "Interpolation mode " << mode << " not recognized" << std::endl;
+        } else if (command == "key") {
+            CameraKeyframe keyframe {};
+            lineStream >> keyframe.time >> keyframe.yaw >> keyframe.pitch >> keyframe.zoom;
+            out.keyframes.push_back(keyframe);
+        } else if (command == "set") {
+            ConfigChange change {};
+            lineStream >> change.time >> change.setting;
+            if (change.setting == "mode") {
+                static constexpr std::array modeNames { "slicer", "mip", "iso", "composite", "tf2d" };
+                std::string mode;
+                lineStream >> mode;
+                const auto iter = std::find(std::begin(modeNames), std::end(modeNames), mode);
+                if (iter == std::end(modeNames)) {
+                    std::cerr << "Render mode " << mode << " not recognized" << std::endl;
+                    continue;
+                }
+                change.values.push_back(float(std::distance(std::begin(modeNames), iter)));
+            } else {
+                float value;
+                while (lineStream >> value)
+                    change.values.push_back(value);
+                lineStream.clear();
+            }
+            out.configChanges.push_back(change);
+        } else if (command == "tf") {
+            TransferFunctionPoint point {};
+            lineStream >> point.value >> point.color.r >> point.color.g >> point.color.b >> point.opacity;
+            out.transferFunction.push_back(point);
+        } else {
+            std::cerr << "Invalid animation command " << command << " in file" << std::endl;
+            continue;
+        }
+
+        if (lineStream.fail())
+            std::cerr << "Malformed animation command " << command << " in file" << std::endl;
+    }
+
+    const auto compareTime = [](const auto& lhs, const auto& rhs) { return lhs.time < rhs.time; };
+    std::stable_sort(std::begin(out.keyframes), std::end(out.keyframes), compareTime);
+    std::stable_sort(std::begin(out.configChanges), std::end(out.configChanges), compareTime);
+    return out;
+}
+
+CameraState evaluateCamera(const AnimationScript& script, const glm::vec3& volumeExtent, float time)
+{
+    CameraKeyframe keyframe { time, 0.0f, 0.0f, 1.0f };
+    if (!script.keyframes.empty()) {
+        const auto compareTime = [](float t, const CameraKeyframe& rhs) { return t < rhs.time; };
+        const auto next = std::upper_bound(std::begin(script.keyframes), std::end(script.keyframes), time, compareTime);
+        if (next == std::begin(script.keyframes)) {
+            keyframe = script.keyframes.front();
+        } else if (next == std::end(script.keyframes)) {
+            keyframe = script.keyframes.back();
+        } else {
+            const auto& prev = *(next - 1);
+            const float factor = (time - prev.time) / (next->time - prev.time);
+            keyframe.yaw = glm::mix(prev.yaw, next->yaw, factor);
+            keyframe.pitch = glm::mix(prev.pitch, next->pitch, factor);
+            keyframe.zoom = glm::mix(prev.zoom, next->zoom, factor);
+        }
+    }
+
+    // Same camera setup as the viewer uses after loading a volume (see main.cpp).
+    const float maxDimension = glm::compMax(volumeExtent);
+    const glm::quat rotation = glm::angleAxis(glm::radians(keyframe.yaw), glm::vec3(0, 1, 0)) * glm::angleAxis(glm::radians(keyframe.pitch), glm::vec3(1, 0, 0));
+    const float aspectRatio = float(script.resolution.x) / float(script.resolution.y);
+    return CameraState { volumeExtent / 2.0f, keyframe.zoom * maxDimension, rotation, glm::radians(fieldOfView), aspectRatio };
+}
+
+render::RenderConfig evaluateRenderConfig(const AnimationScript& script, float volumeMaximum, float time)
+{
+    // Defaults match those of the menu and the transfer function widgets.
+    render::RenderConfig config {};
+    config.renderResolution = script.resolution;
+    config.tfColorMap = computeColorMap(script.transferFunction);
+    config.tfColorMapIndexStart = 0.0f;
+    config.tfColorMapIndexRange = volumeMaximum;
+    config.TF2DIntensity = 68.0f;
+    config.TF2DRadius = 38.0f;
+    config.TF2DColor = glm::vec4(0.0f, 0.8f, 0.6f, 0.3f);
+
+    for (const auto& change : script.configChanges) {
+        if (change.time > time)
+            break;
+
+        const auto value = [&](size_t i) { return i < change.values.size() ? change.values[i] : 0.0f; };
+        if (change.setting == "mode")
+            config.renderMode = render::RenderMode(int(value(0)));
+        else if (change.setting == "shading")
+            config.volumeShading = value(0) != 0.0f;
+        else if (change.setting == "iso")
+            config.isoValue = value(0);
+        else if (change.setting == "tf2d_intensity")
+            config.TF2DIntensity = value(0);
+        else if (change.setting == "tf2d_radius")
+            config.TF2DRadius = value(0);
+        else if (change.setting == "tf2d_color")
+            config.TF2DColor = glm::vec4(value(0), value(1), value(2), value(3));
+        else if (change.setting == "antialiasing") {
+            config.adaptiveSupersampling = value(0) > 0.0f;
+            config.supersamplingThreshold = value(0);
+        }
+        else
+            std::cerr << "Render setting " << change.setting << " not recognized" << std::endl;
+    }
+    return config;
+}
+
+void exportAnimation(const AnimationScript& script, const std::filesystem::path& outputDirectory, int framesInFlight)
+{
+    volume::Volume volume { script.volumeFile };
+    volume.interpolationMode = script.interpolationMode;
+    volume::GradientVolume gradientVolume { volume };
+    gradientVolume.interpolationMode = script.interpolationMode;
+    std::filesystem::create_directories(outputDirectory);
+
+    // Every frame in flight needs its own camera and framebuffer.
+    struct FrameSlot {
+        FrameSlot(const volume::Volume* pVolume, const volume::GradientVolume* pGradientVolume, const CameraState& cameraState, const render::RenderConfig& config)
+            : camera(nullptr, cameraState.fovy, cameraState.aspectRatio)
+            , renderer(pVolume, pGradientVolume, &camera, config)
+        {
+        }
+
+        ui::Trackball camera;
+        render::Renderer renderer;
+    };
+    std::vector<std::unique_ptr<FrameSlot>> frameSlots;
+    tbb::concurrent_queue<FrameSlot*> freeFrameSlots;
+    for (int i = 0; i < framesInFlight; i++) {
+        auto pFrameSlot = std::make_unique<FrameSlot>(&volume, &gradientVolume, evaluateCamera(script, volume.extent(), 0.0f), evaluateRenderConfig(script, volume.maximum(), 0.0f));
+        freeFrameSlots.push(pFrameSlot.get());
+        frameSlots.push_back(std::move(pFrameSlot));
+    }
+
+    struct Frame {
+        int index;
+        FrameSlot* pFrameSlot;
+        std::vector<uint8_t> png;
+    };
+    const int frameCount = script.frameCount();
+    int nextFrame = 0;
+    tbb::parallel_pipeline(size_t(framesInFlight),
+        // Set up the camera and render config of the next frame.
+        tbb::make_filter<void, Frame>(tbb::filter_mode::serial_in_order,
+            [&](tbb::flow_control& flowControl) -> Frame {
+                if (nextFrame == frameCount) {
+                    flowControl.stop();
+                    return {};
+                }
+
+                // The pipeline never has more than framesInFlight frames alive so there is always a free slot.
+                FrameSlot* pFrameSlot = nullptr;
+                [[maybe_unused]] const bool success = freeFrameSlots.try_pop(pFrameSlot);
+                assert(success);
+
+                const float time = float(nextFrame) / script.fps;
+                setCameraState(pFrameSlot->camera, evaluateCamera(script, volume.extent(), time));
+                pFrameSlot->renderer.setConfig(evaluateRenderConfig(script, volume.maximum(), time));
+                return Frame { nextFrame++, pFrameSlot, {} };
+            })
+            // Trace the frame (the renderer itself is also multi-threaded).
+            & tbb::make_filter<Frame, Frame>(tbb::filter_mode::parallel,
+                [](Frame frame) {
+                    frame.pFrameSlot->renderer.render();
+                    return frame;
+                })
+            // Encode the frame and release the renderer so that the next frame can start tracing.
+            & tbb::make_filter<Frame, Frame>(tbb::filter_mode::parallel,
+                [&](Frame frame) {
+                    frame.png = render::encodePNG(render::convertToRGBA8(frame.pFrameSlot->renderer.frameBuffer()), script.resolution);
+                    freeFrameSlots.push(frame.pFrameSlot);
+                    frame.pFrameSlot = nullptr;
+                    return frame;
+                })
+            // Write the result to disk.
+            & tbb::make_filter<Frame, void>(tbb::filter_mode::serial_out_of_order,
+                [&](const Frame& frame) {
+                    render::writeFile(outputDirectory / fmt::format("frame_{:05}.png", frame.index), frame.png);
+                    std::cout << "Frame " << frame.index + 1 << " / " << frameCount << std::endl;
+                }));
+}
+
+}
+
+// Piecewise linear interpolation between the transfer function points (see TransferFunctionWidget::updateColormap).
+static std::array<glm::vec4, 256> computeColorMap(std::vector<session::TransferFunctionPoint> points)
+{
+    if (points.empty()) {
+        // Default transfer function of the transfer function widget.
+        points.push_back({ 0.0f, glm::vec3(0.0f), 0.0f });
+        points.push_back({ 0.7f, glm::vec3(0.7f), 0.03f });
+        points.push_back({ 1.0f, glm::vec3(1.0f), 1.0f });
+    }
+    std::stable_sort(std::begin(points), std::end(points), [](const auto& lhs, const auto& rhs) { return lhs.value < rhs.value; });
+
+    std::array<glm::vec4, 256> out;
+    for (size_t i = 0; i < out.size(); i++) {
+        const float value = float(i) / float(out.size());
+        const auto right = std::find_if(std::begin(points), std::end(points), [&](const auto& point) { return point.value > value; });
+        if (right == std::begin(points) || right == std::end(points)) {
+            const auto& point = right == std::end(points) ? points.back() : points.front();
+            out[i] = glm::vec4(point.color, point.opacity);
+            continue;
+        }
+
+        const auto left = right - 1;
+        const float factor = (value - left->value) / (right->value - left->value);
+        out[i] = glm::mix(glm::vec4(left->color, left->opacity), glm::vec4(right->color, right->opacity), factor);
+    }
+    return out;
+}
@@ -0,0 +1,77 @@
+#pragma once
+#include "render/render_config.h"
+#include "session/session.h"
+#include "volume/volume.h"
+#include <filesystem>
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+#include <string>
+#include <vector>
+
+namespace session {
+
+// Camera keyframe in trackball terms: orbit angles (in degrees) around the center of the volume and the
+// distance to it relative to the largest volume dimension (which is what the viewer uses after loading).
+struct CameraKeyframe {
+    float time;
+    float yaw, pitch;
+    float zoom;
+};
+
+// Change of a single render setting (e.g. "iso 120") that takes effect at the given time.
+struct ConfigChange {
+    float time;
+    std::string setting;
+    std::vector<float> values;
+};
+
+// Control point of the 1D transfer function, equivalent to a point in the transfer function widget.
+struct TransferFunctionPoint {
+    float value; // Normalized voxel value (0 to 1).
+    glm::vec3 color;
+    float opacity;
+};
+
+// A camera path + config changes over time that are rendered to an image sequence.
+//
+// Animation scripts are plain text files with one command per line ('#' starts a comment):
+//   volume <fld file>                          (relative to the script)
+//   resolution <width> <height>
+//   fps <frames per second>
+//   duration <seconds>                         (defaults to the time of the last keyframe)
+//   interpolation nearest|linear|cubic
+//   key <time> <yaw> <pitch> <zoom>            (camera keyframe, linearly interpolated)
+//   set <time> mode slicer|mip|iso|composite|tf2d
+//   set <time> shading|iso|tf2d_intensity|tf2d_radius <value>
+//   set <time> tf2d_color <r> <g> <b> <a>
+//   set <time> antialiasing <edge contrast>    (adaptive supersampling, 0 disables it)
+//   tf <value> <r> <g> <b> <opacity>           (1D transfer function point, sorted by value)
+struct AnimationScript {
+    std::filesystem::path volumeFile;
+    glm::ivec2 resolution { 512, 512 };
+    float fps { 25.0f };
+    float duration { -1.0f };
+    volume::InterpolationMode interpolationMode { volume::InterpolationMode::Linear };
+
+    std::vector<CameraKeyframe> keyframes;
+    std::vector<ConfigChange> configChanges;
+    std::vector<TransferFunctionPoint> transferFunction;
+
+    int frameCount() const;
+};
+
+AnimationScript loadAnimationScript(const std::filesystem::path& filePath);
+
+// Evaluate the camera path and config changes at the given time.
+// Only the extent (see volume::Volume::extent) and the maximum value of the volume are needed such that remote clients
+// can evaluate scripts too.
+CameraState evaluateCamera(const AnimationScript& script, const glm::vec3& volumeExtent, float time);
+render::RenderConfig evaluateRenderConfig(const AnimationScript& script, float volumeMaximum, float time);
+
+// Render all frames of the animation and write them as PNG files (frame_00000.png, ...) to the output directory.
+// Up to framesInFlight frames are processed concurrently: while one frame is being traced, previous frames are
+// PNG encoded and written to disk.
+void exportAnimation(const AnimationScript& script, const std::filesystem::path& outputDirectory, int framesInFlight);
+
+}
@@ -0,0 +1,198 @@
+#include "auto_tune.h"
+#include "session/session.h"
+#include "ui/trackball.h"
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <fmt/format.h>
+#include <fstream>
+#include <glm/gtc/quaternion.hpp>
+#include <glm/gtx/component_wise.hpp>
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <vector>
+#ifndef _WIN32
+#include <unistd.h> // gethostname
+#endif
+
+// Candidates that autoTune measures; a tile size of 0 lets TBB decide (see render::RenderTuning).
+static constexpr std::array brickSizes { 4, 8, 16, 32 };
+static constexpr std::array tileSizes { 0, 8, 16, 32, 64 };
+
+static std::string machineName();
+static uint64_t datasetHash(const volume::Volume& volume);
+static std::chrono::duration<double> measureFrames(const volume::Volume& volume, const volume::GradientVolume& gradientVolume,
+    const render::RenderConfig& config, const render::RenderTuning& tuning, int frameCount);
+
+namespace session {
+
+TuningKey makeTuningKey(const volume::Volume& volume, render::RenderMode renderMode)
+{
+    return TuningKey { machineName(), datasetHash(volume), renderMode };
+}
+
+TuningParameters autoTune(volume::Volume& volume, const volume::GradientVolume& gradientVolume, const render::RenderConfig& config, int frameCount)
+{
+    TuningParameters out {};
+    auto bestTime = std::chrono::duration<double>::max();
+    for (const int brickSize : brickSizes) {
+        volume.setBrickSize(brickSize);
+        const auto time = measureFrames(volume, gradientVolume, config, out.renderTuning, frameCount);
+        std::cout << fmt::format("Brick size {}: {:.2f}ms per frame", brickSize, time.count() * 1000.0 / frameCount) << std::endl;
+        if (time < bestTime) {
+            bestTime = time;
+            out.brickSize = brickSize;
+        }
+    }
+
+    volume.setBrickSize(out.brickSize);
+    for (const int tileSize : tileSizes) {
+        if (tileSize == out.renderTuning.tileSize)
+            continue; // Measured above.
+        const auto time = measureFrames(volume, gradientVolume, config, render::RenderTuning { tileSize }, frameCount);
+        std::cout << fmt::format("Tile size {}: {:.2f}ms per frame", tileSize, time.count() * 1000.0 / frameCount) << std::endl;
+        if (time < bestTime) {
+            bestTime = time;
+            out.renderTuning.tileSize = tileSize;
+        }
+    }
+    return out;
+}
+
+std::optional<TuningParameters> loadTuning(const std::filesystem::path& file, const TuningKey& key)
+{
+    std::ifstream stream { file };
+    std::string line;
+    while (std::getline(stream, line)) {
+        std::istringstream lineStream { line };
+        std::string machine;
+        uint64_t datasetHash;
+        int renderMode;
+        TuningParameters parameters {};
+        if (!(lineStream >> machine >> std::hex >> datasetHash >> std::dec >> renderMode >> parameters.brickSize >> parameters.renderTuning.tileSize)) {
+            std::cerr << "Malformed line in tuning file " << file << std::endl;
+            continue;
+        }
+        if (machine != key.machine || datasetHash != key.datasetHash || render::RenderMode(renderMode) != key.renderMode)
+            continue;
+
+        // The file may have been edited by hand, only accept the values that autoTune would choose.
+        const bool isBrickSizeValid = std::find(std::begin(brickSizes), std::end(brickSizes), parameters.brickSize) != std::end(brickSizes);
+        const bool isTileSizeValid = std::find(std::begin(tileSizes), std::end(tileSizes), parameters.renderTuning.tileSize) != std::end(tileSizes);
+        if (!isBrickSizeValid || !isTileSizeValid) {
+            std::cerr << "Invalid brick size " << parameters.brickSize << " or tile size " << parameters.renderTuning.tileSize << " in tuning file " << file << ", using the defaults" << std::endl;
+            return TuningParameters {};
+        }
+        return parameters;
+    }
+    return {};
+}
+
+void saveTuning(const std::filesystem::path& file, const TuningKey& key, const TuningParameters& parameters)
+{
+    // Keep the lines of other machines / datasets / render modes and replace the line of this key.
+    const std::string keyPrefix = fmt::format("{} {:016x} {} ", key.machine, key.datasetHash, int(key.renderMode));
+    std::vector<std::string> lines;
+    {
+        std::ifstream stream { file };
+        std::string line;
+        while (std::getline(stream, line)) {
+            if (line.rfind(keyPrefix, 0) != 0)
+                lines.push_back(line);
+        }
+    }
+    lines.push_back(fmt::format("{}{} {}", keyPrefix, parameters.brickSize, parameters.renderTuning.tileSize));
+
+    std::ofstream stream { file };
+    if (!stream.is_open()) {
+        std::cerr << "Could not open tuning file " << file << std::endl;
+        return;
+    }
+    for (const auto& line : lines)
+        stream << line << std::endl;
+}
+
+TuningParameters loadOrAutoTune(const std::filesystem::path& file, volume::Volume& volume, const volume::GradientVolume& gradientVolume, const render::RenderConfig& config)
+{
+    const TuningKey key = makeTuningKey(volume, config.renderMode);
+    if (const auto optParameters = loadTuning(file, key)) {
+        volume.setBrickSize(optParameters->brickSize);
+        return *optParameters;
+    }
+
+    std::cout << "Tuning the renderer for this machine and dataset..." << std::endl;
+    const TuningParameters parameters = autoTune(volume, gradientVolume, config);
+    saveTuning(file, key, parameters);
+    return parameters;
+}
+
+}
+
+// Host name + number of hardware threads (without spaces, such that it is a single word in the tuning file).
+static std::string machineName()
+{
+    std::string hostName = "unknown";
+#ifdef _WIN32
+    if (const char* pComputerName = std::getenv("COMPUTERNAME"))
+        hostName = pComputerName;
+#else
+    std::array<char, 256> buffer {};
+    if (gethostname(buffer.data(), buffer.size() - 1) == 0 && buffer[0] != '\0')
+        hostName = buffer.data();
+#endif
+    for (char& c : hostName) {
+        if (std::isspace(static_cast<unsigned char>(c)))
+            c = '_';
+    }
+    return fmt::format("{}/{}", hostName, std::thread::hardware_concurrency());
+}
+
+// FNV-1a over the dimensions and the voxels (four at a time).
+static uint64_t datasetHash(const volume::Volume& volume)
+{
+    static constexpr uint64_t prime = 1099511628211ull;
+    uint64_t hash = 14695981039346656037ull;
+    const glm::ivec3 dims = volume.dims();
+    for (int axis = 0; axis < 3; axis++)
+        hash = (hash ^ uint64_t(dims[axis])) * prime;
+
+    const auto voxels = volume.data();
+    size_t i = 0;
+    for (; i + 4 <= voxels.size(); i += 4) {
+        uint64_t word;
+        std::memcpy(&word, &voxels[i], sizeof(word));
+        hash = (hash ^ word) * prime;
+    }
+    for (; i < voxels.size(); i++)
+        hash = (hash ^ voxels[i]) * prime;
+    return hash;
+}
+
+// Total render time of frameCount frames orbiting around the volume (after one frame to warm up the caches).
+static std::chrono::duration<double> measureFrames(const volume::Volume& volume, const volume::GradientVolume& gradientVolume,
+    const render::RenderConfig& config, const render::RenderTuning& tuning, int frameCount)
+{
+    // Same camera setup as the viewer uses after loading a volume (see main.cpp).
+    const float aspectRatio = float(config.renderResolution.x) / float(config.renderResolution.y);
+    ui::Trackball camera { nullptr, glm::radians(60.0f), aspectRatio };
+    render::Renderer renderer { &volume, &gradientVolume, &camera, config };
+    renderer.setTuning(tuning);
+
+    const float maxDimension = glm::compMax(volume.extent());
+    using clock = std::chrono::high_resolution_clock;
+    std::chrono::duration<double> out { 0.0 };
+    for (int frame = -1; frame < frameCount; frame++) {
+        const float yaw = glm::radians(360.0f * float(std::max(frame, 0)) / float(frameCount));
+        const glm::quat rotation = glm::angleAxis(yaw, glm::vec3(0, 1, 0)) * glm::angleAxis(glm::radians(30.0f), glm::vec3(1, 0, 0));
+        session::setCameraState(camera, session::CameraState { volume.extent() / 2.0f, maxDimension, rotation, glm::radians(60.0f), aspectRatio });
+
+        const auto start = clock::now();
+        renderer.render();
+        if (frame >= 0)
+            out += clock::now() - start;
+    }
+    return out;
+}
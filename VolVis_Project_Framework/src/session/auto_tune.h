@@ -0,0 +1,45 @@
+#pragma once
+#include "render/render_config.h"
+#include "render/renderer.h"
+#include "volume/gradient_volume.h"
+#include "volume/volume.h"
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string>
+
+namespace session {
+
+// Performance parameters that do not change the rendered image: the size of the min/max bricks used for empty space
+// skipping and the grain of the parallel loop over the screen. The sample step is not tuned because it trades
+// quality for speed.
+struct TuningParameters {
+    int brickSize { 8 };
+    render::RenderTuning renderTuning {};
+};
+
+// The best parameters depend on the machine (core count, caches), the dataset and the render mode.
+struct TuningKey {
+    std::string machine;
+    uint64_t datasetHash;
+    render::RenderMode renderMode;
+};
+TuningKey makeTuningKey(const volume::Volume& volume, render::RenderMode renderMode);
+
+// Try candidate parameters on the volume and return the fastest. Every candidate renders frameCount frames from
+// viewpoints around the volume. The brick size is optimized first, then the tile size. The volume keeps the best
+// brick size.
+TuningParameters autoTune(volume::Volume& volume, const volume::GradientVolume& gradientVolume, const render::RenderConfig& config, int frameCount = 4);
+
+// Tuning results are stored in a text file with one line per machine, dataset and render mode (saving replaces the
+// line of the same key):
+//   <machine> <dataset hash> <render mode> <brick size> <tile size>
+std::optional<TuningParameters> loadTuning(const std::filesystem::path& file, const TuningKey& key);
+void saveTuning(const std::filesystem::path& file, const TuningKey& key, const TuningParameters& parameters);
+
+// Use the stored parameters for this machine + dataset + render mode, or tune and store them if there are none yet.
+// The brick size is applied to the volume.
+TuningParameters loadOrAutoTune(const std::filesystem::path& file, volume::Volume& volume, const volume::GradientVolume& gradientVolume, const render::RenderConfig& config);
+
+}
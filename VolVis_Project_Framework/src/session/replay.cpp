@@ -0,0 +1,72 @@
+#include "replay.h"
+#include "render/renderer.h"
+#include "ui/trackball.h"
+#include "volume/gradient_volume.h"
+#include "volume/volume.h"
+#include <glm/gtc/quaternion.hpp>
+#include <iostream>
+#include <type_traits>
+#include <variant>
+
+namespace session {
+
+std::vector<FrameTiming> replaySession(const std::vector<Event>& events, const std::optional<std::filesystem::path>& optVolumeOverride)
+{
+    // Mirror the state of the viewer (see main.cpp) and apply the recorded events in order.
+    std::optional<ui::Trackball> optTrackball;
+    std::optional<volume::Volume> optVolume;
+    std::optional<volume::GradientVolume> optGradientVolume;
+    std::optional<render::Renderer> optRenderer;
+    render::RenderConfig renderConfig {};
+    volume::InterpolationMode interpolationMode { volume::InterpolationMode::NearestNeighbour };
+
+    std::vector<FrameTiming> out;
+    for (const Event& event : events) {
+        std::visit([&](const auto& data) {
+            using T = std::decay_t<decltype(data)>;
+            if constexpr (std::is_same_v<T, LoadVolumeEvent>) {
+                optRenderer.reset();
+                optGradientVolume.reset();
+                optVolume.emplace(optVolumeOverride.value_or(data.filePath));
+                optVolume->interpolationMode = interpolationMode;
+                optGradientVolume.emplace(optVolume.value());
+                optGradientVolume->interpolationMode = interpolationMode;
+            } else if constexpr (std::is_same_v<T, CameraEvent>) {
+                // The trackball is created lazily because the field of view cannot be changed after construction.
+                if (!optTrackball || optTrackball->fovy() != data.cameraState.fovy || optTrackball->aspectRatio() != data.cameraState.aspectRatio) {
+                    optRenderer.reset();
+                    optTrackball.emplace(nullptr, data.cameraState.fovy, data.cameraState.aspectRatio);
+                }
+                setCameraState(*optTrackball, data.cameraState);
+            } else if constexpr (std::is_same_v<T, RenderConfigEvent>) {
+                renderConfig = data.renderConfig;
+                if (optRenderer)
+                    optRenderer->setConfig(renderConfig);
+            } else if constexpr (std::is_same_v<T, InterpolationModeEvent>) {
+                interpolationMode = data.interpolationMode;
+                if (optVolume) {
+                    optVolume->interpolationMode = interpolationMode;
+                    optGradientVolume->interpolationMode = interpolationMode;
+                }
+            } else if constexpr (std::is_same_v<T, RenderEvent>) {
+                if (!optVolume || !optTrackball) {
+                    std::cerr << "Session renders a frame before loading a volume or setting the camera" << std::endl;
+                    return;
+                }
+                if (!optRenderer)
+                    optRenderer.emplace(&optVolume.value(), &optGradientVolume.value(), &optTrackball.value(), renderConfig);
+
+                using clock = std::chrono::high_resolution_clock;
+                const auto start = clock::now();
+                optRenderer->render();
+                const auto end = clock::now();
+                out.push_back(FrameTiming { event.timestamp, renderConfig.renderMode, renderConfig.renderResolution, end - start });
+            }
+            // Window resizes only affect rendering through the render resolution which is part of the render config.
+        },
+            event.data);
+    }
+    return out;
+}
+
+}
@@ -0,0 +1,24 @@
+#pragma once
+#include "render/render_config.h"
+#include "session/session.h"
+#include <chrono>
+#include <filesystem>
+#include <glm/vec2.hpp>
+#include <optional>
+#include <vector>
+
+namespace session {
+
+struct FrameTiming {
+    double timestamp; // Time at which the frame was rendered in the original session.
+    render::RenderMode renderMode;
+    glm::ivec2 renderResolution;
+    std::chrono::duration<double> renderTime;
+};
+
+// Re-render every frame of a recorded session without a window and measure how long each frame takes.
+// The volume that was loaded during the recording may be replaced by optVolumeOverride (e.g. when the
+// session was recorded on a different machine).
+std::vector<FrameTiming> replaySession(const std::vector<Event>& events, const std::optional<std::filesystem::path>& optVolumeOverride = {});
+
+}
@@ -0,0 +1,169 @@
+#include "session.h"
+#include "ui/trackball.h"
+#include <iomanip> // std::quoted, std::setprecision
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <type_traits>
+
+static constexpr std::string_view sessionFileHeader = "VolVisSession 1";
+
+static void writeRenderConfig(std::ostream& stream, const render::RenderConfig& config);
+static render::RenderConfig readRenderConfig(std::istream& stream);
+
+namespace session {
+
+CameraState getCameraState(const ui::Trackball& trackball)
+{
+    return CameraState { trackball.lookAt(), trackball.distance(), trackball.rotation(), trackball.fovy(), trackball.aspectRatio() };
+}
+
+// NOTE: the field of view and aspect ratio are fixed at construction of the trackball and are not restored.
+void setCameraState(ui::Trackball& trackball, const CameraState& cameraState)
+{
+    trackball.setLookAt(cameraState.lookAt);
+    trackball.setDistance(cameraState.distance);
+    trackball.setRotation(cameraState.rotation);
+}
+
+void writeEvent(std::ostream& stream, const Event& event)
+{
+    // Print floats with enough digits such that they are read back bit-exact (deterministic replay).
+    stream << std::setprecision(std::numeric_limits<float>::max_digits10) << event.timestamp << " ";
+    std::visit([&](const auto& data) {
+        using T = std::decay_t<decltype(data)>;
+        if constexpr (std::is_same_v<T, LoadVolumeEvent>) {
+            stream << "load " << std::quoted(data.filePath.string());
+        } else if constexpr (std::is_same_v<T, CameraEvent>) {
+            const CameraState& c = data.cameraState;
+            stream << "camera " << c.lookAt.x << " " << c.lookAt.y << " " << c.lookAt.z << " " << c.distance << " "
+                   << c.rotation.w << " " << c.rotation.x << " " << c.rotation.y << " " << c.rotation.z << " "
+                   << c.fovy << " " << c.aspectRatio;
+        } else if constexpr (std::is_same_v<T, RenderConfigEvent>) {
+            stream << "config ";
+            writeRenderConfig(stream, data.renderConfig);
+        } else if constexpr (std::is_same_v<T, InterpolationModeEvent>) {
+            stream << "interpolation " << int(data.interpolationMode);
+        } else if constexpr (std::is_same_v<T, WindowResizeEvent>) {
+            stream << "resize " << data.windowSize.x << " " << data.windowSize.y;
+        } else if constexpr (std::is_same_v<T, RenderEvent>) {
+            stream << "render";
+        }
+    },
+        event.data);
+    stream << "\n";
+}
+
+// Read the next event from the stream. Returns an empty optional at the end of the stream.
+// Lines that cannot be parsed are reported and skipped.
+std::optional<Event> readEvent(std::istream& stream)
+{
+    std::string line;
+    while (std::getline(stream, line)) {
+        std::istringstream lineStream { line };
+        Event event {};
+        std::string name;
+        if (!(lineStream >> event.timestamp >> name))
+            continue;
+
+        if (name == "load") {
+            std::string filePath;
+            lineStream >> std::quoted(filePath);
+            event.data = LoadVolumeEvent { filePath };
+        } else if (name == "camera") {
+            CameraState c {};
+            lineStream >> c.lookAt.x >> c.lookAt.y >> c.lookAt.z >> c.distance
+                >> c.rotation.w >> c.rotation.x >> c.rotation.y >> c.rotation.z
+                >> c.fovy >> c.aspectRatio;
+            event.data = CameraEvent { c };
+        } else if (name == "config") {
+            event.data = RenderConfigEvent { readRenderConfig(lineStream) };
+        } else if (name == "interpolation") {
+            int interpolationMode = 0;
+            lineStream >> interpolationMode;
+            event.data = InterpolationModeEvent { volume::InterpolationMode(interpolationMode) };
+        } else if (name == "resize") {
+            glm::ivec2 windowSize {};
+            lineStream >> windowSize.x >> windowSize.y;
+            event.data = WindowResizeEvent { windowSize };
+        } else if (name == "render") {
+            event.data = RenderEvent {};
+        } else {
+            std::cerr << "Invalid session event " << name << " in file" << std::endl;
+            continue;
+        }
+
+        if (lineStream.fail()) {
+            std::cerr << "Malformed session event " << name << " in file" << std::endl;
+            continue;
+        }
+        return event;
+    }
+    return {};
+}
+
+std::vector<Event> loadSession(const std::filesystem::path& filePath)
+{
+    std::ifstream file { filePath };
+    std::string header;
+    std::getline(file, header);
+    if (header != sessionFileHeader) {
+        std::cerr << "File " << filePath << " is not a VolVis session" << std::endl;
+        return {};
+    }
+
+    std::vector<Event> events;
+    while (auto optEvent = readEvent(file))
+        events.push_back(std::move(*optEvent));
+    return events;
+}
+
+SessionRecorder::SessionRecorder(const std::filesystem::path& filePath)
+    : m_file(filePath)
+    , m_start(clock::now())
+{
+    m_file << sessionFileHeader << "\n";
+}
+
+void SessionRecorder::record(const EventData& eventData)
+{
+    const std::chrono::duration<double> timestamp = clock::now() - m_start;
+    writeEvent(m_file, Event { timestamp.count(), eventData });
+}
+
+}
+
+static void writeRenderConfig(std::ostream& stream, const render::RenderConfig& config)
+{
+    stream << int(config.renderMode) << " " << config.renderResolution.x << " " << config.renderResolution.y << " "
+           << config.volumeShading << " " << config.isoValue << " "
+           << config.tfColorMapIndexStart << " " << config.tfColorMapIndexRange << " "
+           << config.TF2DIntensity << " " << config.TF2DRadius << " "
+           << config.TF2DColor.r << " " << config.TF2DColor.g << " " << config.TF2DColor.b << " " << config.TF2DColor.a;
+    for (const glm::vec4& color : config.tfColorMap)
+        stream << " " << color.r << " " << color.g << " " << color.b << " " << color.a;
+    stream << " " << config.adaptiveSupersampling << " " << config.supersamplingThreshold;
+}
+
+static render::RenderConfig readRenderConfig(std::istream& stream)
+{
+    render::RenderConfig config {};
+
+    int renderMode = 0;
+    stream >> renderMode >> config.renderResolution.x >> config.renderResolution.y
+        >> config.volumeShading >> config.isoValue
+        >> config.tfColorMapIndexStart >> config.tfColorMapIndexRange
+        >> config.TF2DIntensity >> config.TF2DRadius
+        >> config.TF2DColor.r >> config.TF2DColor.g >> config.TF2DColor.b >> config.TF2DColor.a;
+    config.renderMode = render::RenderMode(renderMode);
+    for (glm::vec4& color : config.tfColorMap)
+        stream >> color.r >> color.g >> color.b >> color.a;
+    // Not present in sessions that were recorded before anti-aliasing was added.
+    if (stream && !(stream >> config.adaptiveSupersampling >> config.supersamplingThreshold)) {
+        stream.clear();
+        config.adaptiveSupersampling = false;
+        config.supersamplingThreshold = render::RenderConfig {}.supersamplingThreshold;
+    }
+    return config;
+}
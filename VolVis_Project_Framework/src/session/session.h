@@ -0,0 +1,77 @@
+#pragma once
+#include "render/render_config.h"
+#include "volume/volume.h"
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <glm/gtc/quaternion.hpp>
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+#include <iosfwd>
+#include <optional>
+#include <variant>
+#include <vector>
+
+namespace ui {
+class Trackball;
+}
+
+namespace session {
+
+// Everything that is needed to reconstruct the trackball camera.
+struct CameraState {
+    glm::vec3 lookAt;
+    float distance;
+    glm::quat rotation;
+    float fovy;
+    float aspectRatio;
+};
+
+CameraState getCameraState(const ui::Trackball& trackball);
+void setCameraState(ui::Trackball& trackball, const CameraState& cameraState);
+
+struct LoadVolumeEvent {
+    std::filesystem::path filePath;
+};
+struct CameraEvent {
+    CameraState cameraState;
+};
+struct RenderConfigEvent {
+    render::RenderConfig renderConfig;
+};
+struct InterpolationModeEvent {
+    volume::InterpolationMode interpolationMode;
+};
+struct WindowResizeEvent {
+    glm::ivec2 windowSize;
+};
+// The viewer rendered a frame using the state described by all preceding events.
+struct RenderEvent {
+};
+
+using EventData = std::variant<LoadVolumeEvent, CameraEvent, RenderConfigEvent, InterpolationModeEvent, WindowResizeEvent, RenderEvent>;
+struct Event {
+    double timestamp; // Seconds since the start of the recording.
+    EventData data;
+};
+
+// Session files are plain text with one event per line: "<timestamp> <event name> <payload>".
+void writeEvent(std::ostream& stream, const Event& event);
+std::optional<Event> readEvent(std::istream& stream);
+std::vector<Event> loadSession(const std::filesystem::path& filePath);
+
+// Writes user interaction to a session file as it happens such that it can be replayed later.
+class SessionRecorder {
+public:
+    SessionRecorder(const std::filesystem::path& filePath);
+
+    void record(const EventData& eventData);
+
+private:
+    using clock = std::chrono::steady_clock;
+
+    std::ofstream m_file;
+    clock::time_point m_start;
+};
+
+}
@@ -0,0 +1,4 @@
+// The implementation of the stb_image_write single header library is compiled in a separate library
+// such that the compiler warnings that we set for our own code don't affect this third-party code.
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include <stb_image_write.h>
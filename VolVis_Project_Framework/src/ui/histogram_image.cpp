@@ -0,0 +1,62 @@
+#include "histogram_image.h"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <limits>
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+
+namespace ui {
+
+BinnedHistogram rebinHistogram(gsl::span<const int> histogram, int maxBinCount)
+{
+    assert(maxBinCount > 0);
+    const int binWidth = std::max((int(histogram.size()) + maxBinCount - 1) / maxBinCount, 1);
+    BinnedHistogram out { std::vector<int>((histogram.size() + size_t(binWidth) - 1) / size_t(binWidth), 0), binWidth };
+    for (size_t i = 0; i < histogram.size(); i++)
+        out.bins[i / size_t(binWidth)] += histogram[i];
+    return out;
+}
+
+std::vector<uint8_t> createBarChartImage(gsl::span<const int> bins, int height, uint8_t value, bool logScale)
+{
+    if (bins.empty())
+        return {};
+
+    // Leave some room above the highest bar.
+    const auto scaleCount = [&](int count) { return logScale ? std::log1p(float(count)) : float(count); };
+    const float maxCount = scaleCount(*std::max_element(std::begin(bins), std::end(bins)));
+    const float scale = maxCount > 0.0f ? float(height) / (maxCount * 1.1f) : 0.0f;
+
+    // Row 0 is the top of the image.
+    const size_t width = bins.size();
+    std::vector<uint8_t> out(width * size_t(height), 0);
+    tbb::parallel_for(tbb::blocked_range<int>(0, height), [&](const tbb::blocked_range<int>& range) {
+        for (int y = range.begin(); y != range.end(); y++) {
+            for (size_t x = 0; x < width; x++) {
+                if (float(height - y) < scaleCount(bins[x]) * scale)
+                    out[x + size_t(y) * width] = value;
+            }
+        }
+    });
+    return out;
+}
+
+std::vector<uint16_t> createDensityImage(gsl::span<const int> bins, const glm::ivec2& res, int maxCount, const glm::ivec2& lower, const glm::ivec2& upper)
+{
+    assert(bins.size() == size_t(res.x) * size_t(res.y));
+    const float factor = maxCount > 0 ? float(std::numeric_limits<uint16_t>::max()) / std::log1p(float(maxCount)) : 0.0f;
+
+    const glm::ivec2 size = upper - lower;
+    std::vector<uint16_t> out(size_t(size.x) * size_t(size.y), 0);
+    tbb::parallel_for(tbb::blocked_range<int>(lower.y, upper.y), [&](const tbb::blocked_range<int>& range) {
+        for (int y = range.begin(); y != range.end(); y++) {
+            const auto row = bins.subspan(size_t(lower.x) + size_t(y) * size_t(res.x), size_t(size.x));
+            std::transform(std::begin(row), std::end(row), std::begin(out) + ptrdiff_t(y - lower.y) * size.x,
+                [&](int count) { return uint16_t(std::lround(std::log1p(float(std::max(count, 0))) * factor)); });
+        }
+    });
+    return out;
+}
+
+}
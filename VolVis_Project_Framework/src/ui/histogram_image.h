@@ -0,0 +1,27 @@
+#pragma once
+#include <cstdint>
+#include <glm/vec2.hpp>
+#include <gsl/span>
+#include <vector>
+
+// Images of the histograms that are drawn behind the transfer function widgets. The histograms are re-binned to (at
+// most) the size of the widget such that the images do not grow with the bit depth of the volume, and they are stored
+// as single channel 8/16-bit images that the widgets upload as GL_R8/GL_R16 textures (the channel is used as alpha).
+namespace ui {
+
+struct BinnedHistogram {
+    std::vector<int> bins;
+    int binWidth; // Number of values per bin; the last bin may cover values beyond the end of the input.
+};
+// Sum groups of neighbouring values such that there are at most maxBinCount bins.
+BinnedHistogram rebinHistogram(gsl::span<const int> histogram, int maxBinCount);
+
+// Bar chart with one column per bin. Pixels below the bars have the given value, other pixels are zero. The bars are
+// scaled to the largest count, or to its logarithm if logScale is set (which makes small counts visible).
+std::vector<uint8_t> createBarChartImage(gsl::span<const int> bins, int height, uint8_t value, bool logScale);
+
+// Pixels [lower, upper) of a 2D histogram of resolution res, where every pixel is log(1 + count) normalized by the
+// largest count.
+std::vector<uint16_t> createDensityImage(gsl::span<const int> bins, const glm::ivec2& res, int maxCount, const glm::ivec2& lower, const glm::ivec2& upper);
+
+}
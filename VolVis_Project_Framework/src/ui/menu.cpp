@@ -1,7 +1,10 @@
 #include "menu.h"
+#include "memory/memory_registry.h"
 #include "render/renderer.h"
+#include <cmath>
 #include <filesystem>
 #include <fmt/format.h>
+#include <glm/trigonometric.hpp>
 #include <imgui.h>
 #include <iostream>
 #include <nfd.h>
@@ -29,6 +32,31 @@ void Menu::setInterpolationModeChangedCallback(InterpolationModeChangedCallback&
     m_optInterpolationModeChangedCallback = std::move(callback);
 }
 
+void Menu::setPreprocessCallback(PreprocessCallback&& callback)
+{
+    m_optPreprocessCallback = std::move(callback);
+}
+
+void Menu::setChannelTransferFunctionsChangedCallback(ChannelTransferFunctionsChangedCallback&& callback)
+{
+    m_optChannelTransferFunctionsChangedCallback = std::move(callback);
+}
+
+void Menu::setShadowLightChangedCallback(ShadowLightChangedCallback&& callback)
+{
+    m_optShadowLightChangedCallback = std::move(callback);
+}
+
+void Menu::setSplattingChangedCallback(SplattingChangedCallback&& callback)
+{
+    m_optSplattingChangedCallback = std::move(callback);
+}
+
+void Menu::setGradientEstimationChangedCallback(GradientEstimationChangedCallback&& callback)
+{
+    m_optGradientEstimationChangedCallback = std::move(callback);
+}
+
 render::RenderConfig Menu::renderConfig() const
 {
     return m_renderConfig;
@@ -39,6 +67,29 @@ volume::InterpolationMode Menu::interpolationMode() const
     return m_interpolationMode;
 }
 
+std::optional<glm::vec3> Menu::shadowLight() const
+{
+    if (!m_shadows)
+        return {};
+    const glm::vec2 angles = glm::radians(m_lightAngles);
+    return glm::vec3(std::cos(angles.y) * std::sin(angles.x), std::sin(angles.y), std::cos(angles.y) * std::cos(angles.x));
+}
+
+bool Menu::splatting() const
+{
+    return m_splatting;
+}
+
+render::GradientEstimation Menu::gradientEstimation() const
+{
+    return m_gradientEstimation;
+}
+
+volume::Brush Menu::brush() const
+{
+    return m_brush;
+}
+
 void Menu::setBaseRenderResolution(const glm::ivec2& baseRenderResolution)
 {
     m_baseRenderResolution = baseRenderResolution;
@@ -55,12 +106,64 @@ void Menu::setLoadedVolume(const volume::Volume& volume, const volume::GradientV
 
     m_tfWidget->updateRenderConfig(m_renderConfig);
     m_tf2DWidget->updateRenderConfig(m_renderConfig);
+    // Same defaults as the renderer.
+    m_channelTransferFunctions = render::defaultChannelTransferFunctions(volume);
+
+    updateVolumeInfo(volume, gradientVolume);
+    m_volumeLoaded = true;
+}
 
+// The dimensions and the value range change when slices are appended to the volume.
+void Menu::updateVolumeInfo(const volume::Volume& volume, const volume::GradientVolume& gradientVolume)
+{
     const glm::ivec3 dim = volume.dims();
-    m_volumeInfo = fmt::format("Volume info:\n{}\nDimensions: ({}, {}, {})\nVoxel value range: {} - {}\n",
-        volume.fileName(), dim.x, dim.y, dim.z, volume.minimum(), volume.maximum());
+    const glm::vec3 spacing = volume.spacing();
+    const volume::ValueMapping& mapping = volume.valueMapping();
+    m_valueMapping = mapping;
+    m_channelCount = volume.channelCount();
+    m_volumeInfo = fmt::format("Volume info:\n{}\nDimensions: ({}, {}, {})\nSpacing: ({:.3g}, {:.3g}, {:.3g})\nVoxel type: {} x {}\nVoxel value range: {:.6g} - {:.6g}\nGradient storage: {} ({})\n",
+        volume.fileName(), dim.x, dim.y, dim.z, spacing.x, spacing.y, spacing.z, volume::voxelTypeName(mapping.fileType), m_channelCount,
+        volume::fileValue(mapping, volume.minimum()), volume::fileValue(mapping, volume.maximum()),
+        volume::gradientStorageName(gradientVolume.storage()), volume::gradientOperatorName(gradientVolume.gradientOperator()));
     m_volumeMax = int(volume.maximum());
-    m_volumeLoaded = true;
+}
+
+void Menu::beginVolumeEdit(const volume::Volume& volume, const volume::GradientVolume& gradientVolume, const volume::DirtyRegion& gradientRegion)
+{
+    m_tf2DWidget->beginVolumeEdit(volume, gradientVolume, gradientRegion);
+}
+
+void Menu::endVolumeEdit(const volume::Volume& volume, const volume::GradientVolume& gradientVolume, const volume::DirtyRegion& gradientRegion)
+{
+    m_tfWidget->updateHistogram(volume);
+    m_tf2DWidget->endVolumeEdit(volume, gradientVolume, gradientRegion);
+    updateVolumeInfo(volume, gradientVolume);
+}
+
+void Menu::setPick(const std::optional<render::PickResult>& optPick)
+{
+    m_optPick = optPick;
+}
+
+void Menu::setLineProfile(const glm::vec3& begin, const glm::vec3& end, std::vector<float> profile)
+{
+    m_profileBegin = begin;
+    m_profileEnd = end;
+    m_lineProfile = std::move(profile);
+}
+
+void Menu::updateHistograms(const volume::Volume& volume, const volume::GradientVolume& gradientVolume)
+{
+    m_tfWidget->updateValueRange(volume);
+    m_tf2DWidget->updateHistogram(volume, gradientVolume);
+    updateVolumeInfo(volume, gradientVolume);
+
+    // The transfer functions are mapped to the range of the values, which may have changed.
+    const auto renderConfigBefore = m_renderConfig;
+    m_tfWidget->updateRenderConfig(m_renderConfig);
+    m_tf2DWidget->updateRenderConfig(m_renderConfig);
+    if (m_renderConfig != renderConfigBefore)
+        callRenderConfigChangedCallback();
 }
 
 // This function draws the menu
@@ -76,15 +179,30 @@ void Menu::drawMenu(const glm::ivec2& pos, const glm::ivec2& size, std::chrono::
     if (m_volumeLoaded) {
         const auto renderConfigBefore = m_renderConfig;
         const auto interpolationModeBefore = m_interpolationMode;
+        const auto channelTransferFunctionsBefore = m_channelTransferFunctions;
+        const auto shadowsBefore = m_shadows;
+        const auto lightAnglesBefore = m_lightAngles;
+        const auto splattingBefore = m_splatting;
+        const auto gradientEstimationBefore = m_gradientEstimation;
 
         showRayCastTab(renderTime);
         showTransFuncTab();
         show2DTransFuncTab();
+        showEditTab();
+        showProbeTab();
 
         if (m_renderConfig != renderConfigBefore)
             callRenderConfigChangedCallback();
         if (m_interpolationMode != interpolationModeBefore)
             callInterpolationModeChangedCallback();
+        if (m_channelTransferFunctions != channelTransferFunctionsBefore)
+            callChannelTransferFunctionsChangedCallback();
+        if (m_shadows != shadowsBefore || m_lightAngles != lightAnglesBefore)
+            callShadowLightChangedCallback();
+        if (m_splatting != splattingBefore)
+            callSplattingChangedCallback();
+        if (m_gradientEstimation != gradientEstimationBefore)
+            callGradientEstimationChangedCallback();
     }
 
     ImGui::EndTabBar();
@@ -98,7 +216,7 @@ void Menu::showLoadVolTab()
 
         if (ImGui::Button("Load volume")) {
             nfdchar_t* pOutPath = nullptr;
-            nfdresult_t result = NFD_OpenDialog("fld", nullptr, &pOutPath);
+            nfdresult_t result = NFD_OpenDialog("fld,cvol", nullptr, &pOutPath);
 
             if (result == NFD_OKAY) {
                 // Convert from char* to std::filesystem::path
@@ -108,9 +226,31 @@ void Menu::showLoadVolTab()
             }
         }
 
-        if (m_volumeLoaded)
+        if (m_volumeLoaded) {
             ImGui::Text("%s", m_volumeInfo.c_str());
 
+            ImGui::NewLine();
+            int* pVolumeFilterInt = reinterpret_cast<int*>(&m_volumeFilter);
+            ImGui::Text("Preprocessing:");
+            ImGui::RadioButton("No filter", pVolumeFilterInt, int(volume::VolumeFilter::None));
+            ImGui::RadioButton("Gaussian", pVolumeFilterInt, int(volume::VolumeFilter::Gaussian));
+            ImGui::RadioButton("Box", pVolumeFilterInt, int(volume::VolumeFilter::Box));
+            ImGui::RadioButton("Median", pVolumeFilterInt, int(volume::VolumeFilter::Median));
+            ImGui::DragFloat(m_volumeFilter == volume::VolumeFilter::Gaussian ? "Sigma" : "Radius", &m_filterSize, 0.05f, 0.0f, 5.0f);
+
+            int* pGradientOperatorInt = reinterpret_cast<int*>(&m_gradientOperator);
+            ImGui::Text("Gradients:");
+            ImGui::RadioButton("Central difference", pGradientOperatorInt, int(volume::GradientOperator::CentralDifference));
+            ImGui::RadioButton("Sobel", pGradientOperatorInt, int(volume::GradientOperator::Sobel));
+            ImGui::RadioButton("Gaussian derivative", pGradientOperatorInt, int(volume::GradientOperator::GaussianDerivative));
+
+            if (ImGui::Button("Apply") && m_optPreprocessCallback)
+                (*m_optPreprocessCallback)(m_volumeFilter, m_filterSize, m_gradientOperator);
+        }
+
+        ImGui::NewLine();
+        ImGui::Text("Memory usage:\n%s", memory::formatMemoryUsage().c_str());
+
         ImGui::EndTabItem();
     }
 }
@@ -136,16 +276,37 @@ void Menu::showRayCastTab(std::chrono::duration<double> renderTime)
         ImGui::NewLine();
 
         ImGui::Checkbox("Volume Shading", &m_renderConfig.volumeShading);
+        if (m_renderConfig.volumeShading && m_renderConfig.renderMode == render::RenderMode::RenderComposite) {
+            bool rayGradients = m_gradientEstimation == render::GradientEstimation::RaySamples;
+            ImGui::Checkbox("Gradients from ray samples", &rayGradients);
+            m_gradientEstimation = rayGradients ? render::GradientEstimation::RaySamples : render::GradientEstimation::GradientVolume;
+        }
+        if (m_renderConfig.renderMode == render::RenderMode::RenderComposite && m_channelCount == 1)
+            ImGui::Checkbox("Splatting (sparse volumes)", &m_splatting);
 
         ImGui::NewLine();
 
         ImGui::DragFloat("Iso Value", &m_renderConfig.isoValue, 0.1f, 0.0f, float(m_volumeMax));
+        ImGui::Checkbox("IsoSurface shadows", &m_shadows);
+        if (m_shadows) {
+            ImGui::DragFloat("Light azimuth", &m_lightAngles.x, 1.0f, -180.0f, 180.0f);
+            ImGui::DragFloat("Light elevation", &m_lightAngles.y, 1.0f, -90.0f, 90.0f);
+        }
 
         ImGui::NewLine();
 
+        if (m_channelCount > 1) {
+            showChannels();
+            ImGui::NewLine();
+        }
+
         ImGui::DragFloat("Resolution scale", &m_resolutionScale, 0.0025f, 0.25f, 2.0f);
         m_renderConfig.renderResolution = glm::ivec2(glm::vec2(m_baseRenderResolution) * m_resolutionScale);
 
+        ImGui::Checkbox("Adaptive anti-aliasing", &m_renderConfig.adaptiveSupersampling);
+        if (m_renderConfig.adaptiveSupersampling)
+            ImGui::DragFloat("Edge contrast", &m_renderConfig.supersamplingThreshold, 0.005f, 0.01f, 1.0f);
+
         ImGui::NewLine();
 
         int* pInterpolationModeInt = reinterpret_cast<int*>(&m_interpolationMode);
@@ -158,6 +319,43 @@ void Menu::showRayCastTab(std::chrono::duration<double> renderTime)
     }
 }
 
+// Transfer functions of the channels of a multi-channel volume (used by Compositing instead of the 1D transfer function).
+void Menu::showChannels()
+{
+    ImGui::Text("Channels:");
+    for (int channel = 0; channel < m_channelCount; channel++) {
+        render::ChannelTransferFunction& transferFunction = m_channelTransferFunctions[size_t(channel)];
+        ImGui::PushID(channel);
+        ImGui::ColorEdit3(fmt::format("Channel {}", channel).c_str(), &transferFunction.color.r, ImGuiColorEditFlags_NoInputs);
+        ImGui::DragFloatRange2("Window", &transferFunction.lower, &transferFunction.upper, 1.0f, 0.0f, float(m_volumeMax));
+        ImGui::DragFloat("Opacity", &transferFunction.opacity, 0.005f, 0.0f, 1.0f);
+        ImGui::PopID();
+    }
+}
+
+// This renders the Edit tab with the settings of the brush that edits the voxels.
+void Menu::showEditTab()
+{
+    if (ImGui::BeginTabItem("Edit")) {
+        ImGui::Text("Hold shift and drag with the left mouse button\nto edit the visible surface.");
+        ImGui::NewLine();
+
+        int* pBrushModeInt = reinterpret_cast<int*>(&m_brush.mode);
+        ImGui::Text("Brush:");
+        ImGui::RadioButton("Erase", pBrushModeInt, int(volume::BrushMode::Erase));
+        ImGui::RadioButton("Carve", pBrushModeInt, int(volume::BrushMode::Carve));
+        ImGui::RadioButton("Paint", pBrushModeInt, int(volume::BrushMode::Paint));
+
+        ImGui::NewLine();
+
+        ImGui::DragFloat("Radius", &m_brush.radius, 0.1f, 0.5f, 50.0f);
+        if (m_brush.mode != volume::BrushMode::Erase)
+            ImGui::DragFloat(m_brush.mode == volume::BrushMode::Carve ? "Amount" : "Value", &m_brush.value, 1.0f, 0.0f, float(m_volumeMax));
+
+        ImGui::EndTabItem();
+    }
+}
+
 // This renders the 1D Transfer Function Widget.
 void Menu::showTransFuncTab()
 {
@@ -168,6 +366,36 @@ void Menu::showTransFuncTab()
     }
 }
 
+// This renders the Probe tab with the sample under the cursor and the line profile.
+void Menu::showProbeTab()
+{
+    if (ImGui::BeginTabItem("Probe")) {
+        ImGui::Text("Hover over the volume to probe the visible feature.\nHold ctrl and click two points to plot the profile between them.");
+        ImGui::NewLine();
+
+        if (m_optPick) {
+            const glm::vec3 position = m_optPick->position;
+            const glm::vec3 gradient = m_optPick->gradient.dir;
+            // Values as in the file (e.g. Hounsfield units), gradients in stored units like the 2D transfer function.
+            const std::string pickText = fmt::format("Position: ({:.1f}, {:.1f}, {:.1f})\nValue: {:.6g}\nGradient: ({:.1f}, {:.1f}, {:.1f}), magnitude {:.1f}",
+                position.x, position.y, position.z, volume::fileValue(m_valueMapping, m_optPick->value), gradient.x, gradient.y, gradient.z, m_optPick->gradient.magnitude);
+            ImGui::Text("%s", pickText.c_str());
+        } else {
+            ImGui::Text("Nothing visible under the cursor.");
+        }
+
+        if (!m_lineProfile.empty()) {
+            ImGui::NewLine();
+            const std::string profileText = fmt::format("Profile from ({:.1f}, {:.1f}, {:.1f}) to ({:.1f}, {:.1f}, {:.1f}):",
+                m_profileBegin.x, m_profileBegin.y, m_profileBegin.z, m_profileEnd.x, m_profileEnd.y, m_profileEnd.z);
+            ImGui::Text("%s", profileText.c_str());
+            ImGui::PlotLines("##profile", m_lineProfile.data(), int(m_lineProfile.size()), 0, nullptr, 0.0f, float(m_volumeMax), ImVec2(475, 200));
+        }
+
+        ImGui::EndTabItem();
+    }
+}
+
 // This renders the 2D Transfer Function Widget.
 void Menu::show2DTransFuncTab()
 {
@@ -190,4 +418,28 @@ void Menu::callInterpolationModeChangedCallback() const
         (*m_optInterpolationModeChangedCallback)(m_interpolationMode);
 }
 
+void Menu::callChannelTransferFunctionsChangedCallback() const
+{
+    if (m_optChannelTransferFunctionsChangedCallback)
+        (*m_optChannelTransferFunctionsChangedCallback)(m_channelTransferFunctions);
+}
+
+void Menu::callShadowLightChangedCallback() const
+{
+    if (m_optShadowLightChangedCallback)
+        (*m_optShadowLightChangedCallback)(shadowLight());
+}
+
+void Menu::callSplattingChangedCallback() const
+{
+    if (m_optSplattingChangedCallback)
+        (*m_optSplattingChangedCallback)(m_splatting);
+}
+
+void Menu::callGradientEstimationChangedCallback() const
+{
+    if (m_optGradientEstimationChangedCallback)
+        (*m_optGradientEstimationChangedCallback)(m_gradientEstimation);
+}
+
 }
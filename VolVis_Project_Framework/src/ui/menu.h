@@ -1,19 +1,18 @@
 #pragma once
 #include "render/render_config.h"
+#include "render/renderer.h"
 #include "ui/transfer_func.h"
 #include "ui/transfer_func_2d.h"
 #include "volume/gradient_volume.h"
 #include "volume/volume.h"
+#include "volume/volume_filter.h"
 #include <chrono>
 #include <filesystem>
 #include <functional>
 #include <memory>
 #include <optional>
 #include <string>
-
-namespace render {
-class Renderer;
-}
+#include <vector>
 
 namespace ui {
 class Menu {
@@ -26,28 +25,70 @@ public:
     void setRenderConfigChangedCallback(RenderConfigChangedCallback&& callback);
     using InterpolationModeChangedCallback = std::function<void(volume::InterpolationMode)>;
     void setInterpolationModeChangedCallback(InterpolationModeChangedCallback&& callback);
+    // Replace the loaded volume by a filtered copy and recompute the gradients with the given operator.
+    using PreprocessCallback = std::function<void(volume::VolumeFilter, float, volume::GradientOperator)>;
+    void setPreprocessCallback(PreprocessCallback&& callback);
+    using ChannelTransferFunctionsChangedCallback = std::function<void(const render::ChannelTransferFunctions&)>;
+    void setChannelTransferFunctionsChangedCallback(ChannelTransferFunctionsChangedCallback&& callback);
+    // Direction towards the light that casts shadows on iso surfaces, or empty if shadows are disabled.
+    using ShadowLightChangedCallback = std::function<void(const std::optional<glm::vec3>&)>;
+    void setShadowLightChangedCallback(ShadowLightChangedCallback&& callback);
+    // Render compositing with the splat renderer (see render::SplatRenderer) instead of the ray caster.
+    using SplattingChangedCallback = std::function<void(bool)>;
+    void setSplattingChangedCallback(SplattingChangedCallback&& callback);
+    using GradientEstimationChangedCallback = std::function<void(render::GradientEstimation)>;
+    void setGradientEstimationChangedCallback(GradientEstimationChangedCallback&& callback);
 
     render::RenderConfig renderConfig() const;
     volume::InterpolationMode interpolationMode() const;
+    std::optional<glm::vec3> shadowLight() const;
+    bool splatting() const;
+    render::GradientEstimation gradientEstimation() const;
+    // Brush settings of the Edit tab (the center is set when the brush is applied).
+    volume::Brush brush() const;
 
     void setBaseRenderResolution(const glm::ivec2& baseRenderResolution);
     void setLoadedVolume(const volume::Volume& volume, const volume::GradientVolume& gradientVolume);
+    // Keep the histograms of the transfer function widgets up to date while the volume is edited.
+    void beginVolumeEdit(const volume::Volume& volume, const volume::GradientVolume& gradientVolume, const volume::DirtyRegion& gradientRegion);
+    void endVolumeEdit(const volume::Volume& volume, const volume::GradientVolume& gradientVolume, const volume::DirtyRegion& gradientRegion);
+    // Recompute the histograms from scratch and adopt the (possibly grown) range of the values, without resetting the
+    // transfer functions.
+    void updateHistograms(const volume::Volume& volume, const volume::GradientVolume& gradientVolume);
+    // Shown in the Probe tab: the sample under the cursor and the profile along the last picked line.
+    void setPick(const std::optional<render::PickResult>& optPick);
+    void setLineProfile(const glm::vec3& begin, const glm::vec3& end, std::vector<float> profile);
 
     void drawMenu(const glm::ivec2& pos, const glm::ivec2& size, std::chrono::duration<double> renderTime);
 
 private:
+    void updateVolumeInfo(const volume::Volume& volume, const volume::GradientVolume& gradientVolume);
     void showLoadVolTab();
     void showRayCastTab(std::chrono::duration<double> renderTime);
+    void showChannels();
     void showTransFuncTab();
     void show2DTransFuncTab();
+    void showEditTab();
+    void showProbeTab();
 
     void callRenderConfigChangedCallback() const;
     void callInterpolationModeChangedCallback() const;
+    void callChannelTransferFunctionsChangedCallback() const;
+    void callShadowLightChangedCallback() const;
+    void callSplattingChangedCallback() const;
+    void callGradientEstimationChangedCallback() const;
 
 private:
     bool m_volumeLoaded = false;
     std::string m_volumeInfo;
     int m_volumeMax;
+    volume::ValueMapping m_valueMapping;
+    int m_channelCount { 1 };
+    render::ChannelTransferFunctions m_channelTransferFunctions {};
+    bool m_shadows { false };
+    glm::vec2 m_lightAngles { 30.0f, 60.0f }; // Azimuth and elevation in degrees.
+    bool m_splatting { false };
+    render::GradientEstimation m_gradientEstimation { render::GradientEstimation::GradientVolume };
 
     std::optional<TransferFunctionWidget> m_tfWidget;
     std::optional<TransferFunction2DWidget> m_tf2DWidget;
@@ -56,10 +97,22 @@ private:
     float m_resolutionScale { 1.0f };
     render::RenderConfig m_renderConfig {};
     volume::InterpolationMode m_interpolationMode { volume::InterpolationMode::NearestNeighbour };
+    volume::VolumeFilter m_volumeFilter { volume::VolumeFilter::Gaussian };
+    float m_filterSize { 1.0f };
+    volume::GradientOperator m_gradientOperator { volume::GradientOperator::CentralDifference };
+    volume::Brush m_brush { volume::BrushMode::Erase, glm::vec3(0.0f), 5.0f, 100.0f };
+    std::optional<render::PickResult> m_optPick;
+    glm::vec3 m_profileBegin { 0.0f }, m_profileEnd { 0.0f };
+    std::vector<float> m_lineProfile;
 
     std::optional<LoadVolumeCallback> m_optLoadVolumeCallback;
     std::optional<RenderConfigChangedCallback> m_optRenderConfigChangedCallback;
     std::optional<InterpolationModeChangedCallback> m_optInterpolationModeChangedCallback;
+    std::optional<PreprocessCallback> m_optPreprocessCallback;
+    std::optional<ChannelTransferFunctionsChangedCallback> m_optChannelTransferFunctionsChangedCallback;
+    std::optional<ShadowLightChangedCallback> m_optShadowLightChangedCallback;
+    std::optional<SplattingChangedCallback> m_optSplattingChangedCallback;
+    std::optional<GradientEstimationChangedCallback> m_optGradientEstimationChangedCallback;
 };
 
 }
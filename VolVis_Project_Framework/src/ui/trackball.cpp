@@ -16,6 +16,11 @@ Trackball::Trackball(Window* pWindow, float fovy, float aspectRatio, float dist)
     , m_aspectRatio(aspectRatio)
     , m_distanceFromLookAt(dist)
 {
+    if (!pWindow) {
+        updateCameraPos();
+        return;
+    }
+
     pWindow->registerMouseButtonCallback(
         [this](int key, int action, int mods) {
             mouseButtonCallback(key, action, mods);
@@ -61,6 +66,38 @@ void Trackball::setWorldScale(float scale)
     m_worldScale = scale;
 }
 
+// Set rotation and recompute cameraPos
+void Trackball::setRotation(const glm::quat& rotation)
+{
+    m_rotation = rotation;
+    updateCameraPos();
+}
+
+glm::vec3 Trackball::lookAt() const
+{
+    return m_lookAt;
+}
+
+float Trackball::distance() const
+{
+    return m_distanceFromLookAt;
+}
+
+glm::quat Trackball::rotation() const
+{
+    return m_rotation;
+}
+
+float Trackball::fovy() const
+{
+    return m_fovy;
+}
+
+float Trackball::aspectRatio() const
+{
+    return m_aspectRatio;
+}
+
 glm::vec3 Trackball::position() const
 {
     return m_cameraPos;
@@ -106,6 +143,18 @@ render::Ray Trackball::generateRay(const glm::vec2& pixel) const
     return ray;
 }
 
+// Inverse of generateRay: the pixel (in NDC) whose ray passes through the point, empty if the point is behind the camera.
+std::optional<glm::vec2> Trackball::projectToScreen(const glm::vec3& point) const
+{
+    const glm::vec3 cameraSpacePoint = glm::inverse(m_rotation) * (point - m_cameraPos);
+    if (cameraSpacePoint.z <= 0.0f)
+        return {};
+
+    const float halfScreenPlaceHeight = std::tan(m_fovy / 2.0f);
+    const float halfScreenPlaceWidth = m_aspectRatio * halfScreenPlaceHeight;
+    return glm::vec2(cameraSpacePoint.x, cameraSpacePoint.y) / (cameraSpacePoint.z * glm::vec2(halfScreenPlaceWidth, halfScreenPlaceHeight));
+}
+
 // This function handles mouse button interaction, where the type of movement depends on
 //  the button pressed
 void Trackball::mouseButtonCallback(int button, int action, int /* mods */)
@@ -118,7 +167,9 @@ void Trackball::mouseButtonCallback(int button, int action, int /* mods */)
 // This function computes the new camera position and orientation when the mouse is moved
 void Trackball::mouseMoveCallback(const glm::vec2& pos)
 {
-    const bool rotateXY = m_pWindow->isMouseButtonPressed(GLFW_MOUSE_BUTTON_LEFT);
+    // Holding shift reserves the left mouse button for editing the volume (see main.cpp).
+    const bool editing = m_pWindow->isKeyPressed(GLFW_KEY_LEFT_SHIFT) || m_pWindow->isKeyPressed(GLFW_KEY_RIGHT_SHIFT);
+    const bool rotateXY = m_pWindow->isMouseButtonPressed(GLFW_MOUSE_BUTTON_LEFT) && !editing;
     const bool translateXY = m_pWindow->isMouseButtonPressed(GLFW_MOUSE_BUTTON_RIGHT);
 
     if (rotateXY || translateXY) {
@@ -138,6 +189,8 @@ void Trackball::mouseMoveCallback(const glm::vec2& pos)
         m_prevCursorPos = pos;
 
         updateCameraPos();
+    } else if (editing) {
+        m_prevCursorPos = pos;
     }
 }
 
@@ -6,12 +6,14 @@
 #include <glm/mat4x4.hpp>
 #include <glm/vec2.hpp>
 #include <glm/vec3.hpp>
+#include <optional>
 
 namespace ui {
 class Window;
 
 class Trackball : public render::RayTraceCamera, public ui::RasterizationCamera {
 public:
+    // pWindow may be nullptr to create a camera without mouse interaction (headless rendering).
     Trackball(Window* pWindow, float fovy, float aspectRatio, float dist = 4.0f);
     ~Trackball() override = default;
 
@@ -20,6 +22,13 @@ public:
     void setLookAt(const glm::vec3& lookAt);
     void setDistance(float distance);
     void setWorldScale(float scale);
+    void setRotation(const glm::quat& rotation);
+
+    glm::vec3 lookAt() const;
+    float distance() const;
+    glm::quat rotation() const;
+    float fovy() const;
+    float aspectRatio() const;
 
     glm::vec3 position() const override;
     glm::mat4 viewMatrix() const override;
@@ -31,6 +40,7 @@ public:
 
     // Generate ray given pixel in NDC space (-1 to +1)
     render::Ray generateRay(const glm::vec2& pixel) const override;
+    std::optional<glm::vec2> projectToScreen(const glm::vec3& point) const;
 
 private:
     void mouseButtonCallback(int button, int action, int mods);
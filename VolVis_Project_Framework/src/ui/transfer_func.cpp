@@ -1,16 +1,16 @@
 ﻿#include "ui/transfer_func.h"
+#include "ui/histogram_image.h"
 #include <algorithm>
+#include <array>
 #include <cassert>
 #include <filesystem>
 #include <glm/common.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include <glm/gtx/string_cast.hpp>
-#include <gsl/span>
 #include <imgui.h>
 #include <iostream>
 
 static GLuint createTexture();
-static std::vector<glm::vec4> createHistogramImage(gsl::span<const int> data, float opacity);
 static ImVec2 glmToIm(const glm::vec2& v);
 static glm::vec2 ImToGlm(const ImVec2& v);
 
@@ -35,14 +35,40 @@ TransferFunctionWidget::TransferFunctionWidget(const volume::Volume& volume)
     m_tfPoints.push_back(TFPoint { glm::vec2(0.7f, 0.03f), glm::vec3(0.7f) });
     m_tfPoints.push_back(TFPoint { glm::vec2(1.0f), glm::vec3(1.0f) });
 
+    updateHistogram(volume);
+    updateColormap();
+}
+
+void TransferFunctionWidget::updateHistogram(const volume::Volume& volume)
+{
+    // One bin per pixel (or less) independent of the bit depth of the volume.
     const auto histogram = volume.histogram();
-    const auto imgData = createHistogramImage(histogram, histogramOpacity);
+    auto binned = rebinHistogram(histogram, widgetSize.x);
+    m_histogramCoverage = float(histogram.size()) / float(binned.bins.size() * size_t(binned.binWidth));
+    m_histogramBins = std::move(binned.bins);
+    uploadHistogramImage();
+}
 
+void TransferFunctionWidget::updateValueRange(const volume::Volume& volume)
+{
+    m_minValue = volume.minimum();
+    m_maxValue = volume.maximum();
+    updateHistogram(volume);
+}
+
+void TransferFunctionWidget::uploadHistogramImage()
+{
+    const auto imgData = createBarChartImage(m_histogramBins, widgetSize.y, uint8_t(histogramOpacity * 255.0f), m_logScaleHistogram);
+
+    // Single channel texture that is drawn as white with the channel as alpha.
+    static constexpr std::array<GLint, 4> swizzle { GL_ONE, GL_ONE, GL_ONE, GL_RED };
     glBindTexture(GL_TEXTURE_2D, m_histogramImg);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, GLsizei(histogram.size()), GLsizei(widgetSize.y), 0, GL_RGBA, GL_FLOAT, imgData.data());
+    glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, swizzle.data());
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, GLsizei(m_histogramBins.size()), GLsizei(widgetSize.y), 0, GL_RED, GL_UNSIGNED_BYTE, imgData.data());
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
     glBindTexture(GL_TEXTURE_2D, 0);
-
-    updateColormap();
+    m_histogramMemory = memory::TrackedMemory("Histogram textures (GPU)", imgData.size());
 }
 
 void TransferFunctionWidget::updateRenderConfig(render::RenderConfig& renderConfig) const
@@ -95,7 +121,7 @@ void TransferFunctionWidget::draw()
     // https://en.cppreference.com/w/cpp/language/reinterpret_cast
     ImTextureID imguiTexture;
     std::memcpy(&imguiTexture, &m_histogramImg, sizeof(m_histogramImg));
-    ImGui::Image(imguiTexture, glmToIm(canvasSize - glm::vec2(1)));
+    ImGui::Image(imguiTexture, glmToIm(canvasSize - glm::vec2(1)), ImVec2(0, 0), ImVec2(m_histogramCoverage, 1));
 
     // Detect and handle mouse interaction.
     if (!io.MouseDown[0] && !io.MouseDown[1]) {
@@ -191,6 +217,8 @@ void TransferFunctionWidget::draw()
     // Bottom text
     ImGui::SetCursorPosX(ImGui::GetCursorPosX() + xOffset + canvasSize.x / 2 - 40);
     ImGui::Text("Voxel Value");
+    if (ImGui::Checkbox("Logarithmic histogram", &m_logScaleHistogram))
+        uploadHistogramImage();
 
     if (m_selectedPoint != sentinel) {
         ImGui::NewLine();
@@ -255,23 +283,6 @@ GLuint createTexture()
     return tex;
 }
 
-// Compute a histogram texture from the histogram vector
-static std::vector<glm::vec4> createHistogramImage(gsl::span<const int> data, float opacity)
-{
-    const int maxVal = *std::max_element(std::begin(data), std::end(data));
-    const glm::uvec2 res { data.size(), widgetSize.y };
-
-    const float scale = float(widgetSize.y) / (float(maxVal) * 1.1f);
-    std::vector<glm::vec4> imgData(static_cast<size_t>(res.x * res.y));
-    for (unsigned x = 0; x < res.x; x++) {
-        for (unsigned y = 0; y < res.y; y++) {
-            const size_t index = static_cast<size_t>(x + y * res.x);
-            imgData[index] = (static_cast<float>(res.y - y) < static_cast<float>(data[x]) * scale) ? glm::vec4(1.f, 1.f, 1.f, opacity) : glm::vec4(0.f);
-        }
-    }
-    return imgData;
-}
-
 // Vector conversion functions for glm - Imgui interaction
 static ImVec2 glmToIm(const glm::vec2& v)
 {
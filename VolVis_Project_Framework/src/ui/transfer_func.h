@@ -1,4 +1,5 @@
 #pragma once
+#include "memory/memory_registry.h"
 #include "render/render_config.h"
 #include "volume/volume.h"
 #include <GL/glew.h> // Include before glfw3
@@ -14,10 +15,15 @@ public:
 
     void draw();
     void updateRenderConfig(render::RenderConfig& renderConfig) const;
+    // Upload the histogram of the volume again (e.g. after the voxels were edited).
+    void updateHistogram(const volume::Volume& volume);
+    // Map the transfer function to the current range of the volume (e.g. after it grew while streaming slices).
+    void updateValueRange(const volume::Volume& volume);
 
 private:
     void updateColormap();
     void insertTFPoint(const glm::vec2& pos);
+    void uploadHistogramImage();
 
     struct TFPoint;
     glm::vec4 TFPtoRGBA(const TFPoint& p);
@@ -36,5 +42,12 @@ private:
     size_t m_selectedPoint; // Point that is selected (for which the color picker is shown).
     GLuint m_histogramImg;
     GLuint m_colorMapImg;
+    memory::TrackedMemory m_histogramMemory;
+
+    // Histogram re-binned to the width of the widget. The bins may extend past the maximum of the volume; only the
+    // first m_histogramCoverage (fraction) of the image is drawn.
+    std::vector<int> m_histogramBins;
+    float m_histogramCoverage { 1.0f };
+    bool m_logScaleHistogram { false };
 };
 }
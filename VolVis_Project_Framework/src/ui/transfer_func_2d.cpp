@@ -1,18 +1,26 @@
 #include "transfer_func_2d.h"
+#include "histogram_image.h"
 #include <algorithm>
 #include <array>
+#include <cmath>
 #include <filesystem>
+#include <functional>
 #include <glm/common.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include <glm/gtx/string_cast.hpp>
+#include <glm/vector_relational.hpp>
+#include <gsl/span>
 #include <imgui.h>
 #include <iostream>
+#include <tbb/blocked_range.h>
+#include <tbb/combinable.h>
+#include <tbb/parallel_for.h>
 #include <vector>
 
 static ImVec2 glmToIm(const glm::vec2& v);
 static glm::vec2 ImToGlm(const ImVec2& v);
-static std::vector<glm::vec4> createHistogramImage(
-    const volume::Volume& volume, const volume::GradientVolume& gradient, const glm::ivec2& res);
+static glm::vec2 histogramExtent(const volume::Volume& volume, const volume::GradientVolume& gradient);
+static void uploadHistogramImage(gsl::span<const uint16_t> image, const glm::ivec2& offset, const glm::ivec2& size);
 
 namespace ui {
 
@@ -22,23 +30,127 @@ static constexpr glm::ivec2 widgetSize { 475, 300 };
 
 TransferFunction2DWidget::TransferFunction2DWidget(const volume::Volume& volume, const volume::GradientVolume& gradient)
     : m_intensity(68.0f)
-    , m_maxIntensity(volume.maximum())
+    , m_maxIntensity(1.0f)
     , m_radius(38.0f)
     , m_color(0.0f, 0.8f, 0.6f, 0.3f)
     , m_interactingPoint(-1)
     , m_histogramImg(0)
 {
-    const glm::ivec2 res = glm::ivec2(volume.maximum(), gradient.maxMagnitude() + 1);
-    const auto imgData = createHistogramImage(volume, gradient, res);
-
     glGenTextures(1, &m_histogramImg);
     glBindTexture(GL_TEXTURE_2D, m_histogramImg);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    // Single channel texture that is drawn as white with the channel as alpha.
+    static constexpr std::array<GLint, 4> swizzle { GL_ONE, GL_ONE, GL_ONE, GL_RED };
+    glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, swizzle.data());
+    updateHistogram(volume, gradient);
+}
+
+void TransferFunction2DWidget::beginVolumeEdit(const volume::Volume& volume, const volume::GradientVolume& gradient, const volume::DirtyRegion& region)
+{
+    m_changedLower = m_histogramResolution;
+    m_changedUpper = glm::ivec2(0);
+    m_maxHistogramCountDecreased = false;
+    addToHistogram(volume, gradient, region, -1);
+}
+
+void TransferFunction2DWidget::endVolumeEdit(const volume::Volume& volume, const volume::GradientVolume& gradient, const volume::DirtyRegion& region)
+{
+    const int maxCountBefore = m_maxHistogramCount;
+    addToHistogram(volume, gradient, region, 1);
+    if (m_maxHistogramCountDecreased)
+        m_maxHistogramCount = *std::max_element(std::begin(m_histogramBins), std::end(m_histogramBins));
+
+    // The image is normalized by the maximum count; only upload the changed pixels if it did not change.
+    if (m_maxHistogramCount != maxCountBefore) {
+        m_changedLower = glm::ivec2(0);
+        m_changedUpper = m_histogramResolution;
+    }
+    if (glm::any(glm::greaterThanEqual(m_changedLower, m_changedUpper)))
+        return;
+
+    const glm::ivec2 size = m_changedUpper - m_changedLower;
+    const auto imgData = createDensityImage(m_histogramBins, m_histogramResolution, m_maxHistogramCount, m_changedLower, m_changedUpper);
     glBindTexture(GL_TEXTURE_2D, m_histogramImg);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, res.x, res.y, 0, GL_RGBA, GL_FLOAT, imgData.data());
+    uploadHistogramImage(imgData, m_changedLower, size);
+}
+
+void TransferFunction2DWidget::updateHistogram(const volume::Volume& volume, const volume::GradientVolume& gradient)
+{
+    // The range of the values grows while slices are streamed in, so the binning is derived from it again.
+    m_maxIntensity = std::max(volume.maximum(), 1.0f);
+    const glm::ivec2 previousResolution = m_histogramResolution;
+    const glm::vec2 extent = histogramExtent(volume, gradient);
+    m_histogramResolution = glm::min(glm::ivec2(extent), widgetSize);
+    m_histogramScale = glm::vec2(m_histogramResolution) / extent;
+    m_histogramBins.resize(size_t(m_histogramResolution.x) * size_t(m_histogramResolution.y));
+
+    const glm::ivec2 res = m_histogramResolution;
+    computeHistogram(volume, gradient);
+
+    const auto imgData = createDensityImage(m_histogramBins, res, m_maxHistogramCount, glm::ivec2(0), res);
+    glBindTexture(GL_TEXTURE_2D, m_histogramImg);
+    if (res != previousResolution) {
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_R16, res.x, res.y, 0, GL_RED, GL_UNSIGNED_SHORT, nullptr);
+        m_histogramMemory = memory::TrackedMemory("Histogram textures (GPU)", imgData.size() * sizeof(uint16_t));
+    }
+    uploadHistogramImage(imgData, glm::ivec2(0), res);
+}
+
+void TransferFunction2DWidget::addToHistogram(const volume::Volume& volume, const volume::GradientVolume& gradient, const volume::DirtyRegion& region, int count)
+{
+    const glm::ivec2 res = m_histogramResolution;
+    for (int z = region.lower.z; z < region.upper.z; z++) {
+        for (int y = region.lower.y; y < region.upper.y; y++) {
+            for (int x = region.lower.x; x < region.upper.x; x++) {
+                const glm::ivec2 pixel = histogramPixel(float(volume.getVoxel(x, y, z)), gradient.getGradient(x, y, z).magnitude);
+                int& bin = m_histogramBins[size_t(pixel.x) + size_t(pixel.y) * size_t(res.x)];
+                if (count < 0 && bin == m_maxHistogramCount)
+                    m_maxHistogramCountDecreased = true;
+                bin += count;
+                m_maxHistogramCount = std::max(m_maxHistogramCount, bin);
+
+                m_changedLower = glm::min(m_changedLower, pixel);
+                m_changedUpper = glm::max(m_changedUpper, pixel + 1);
+            }
+        }
+    }
+}
+
+// Histogram of the whole volume, one slice per task.
+void TransferFunction2DWidget::computeHistogram(const volume::Volume& volume, const volume::GradientVolume& gradient)
+{
+    const glm::ivec3 dims = volume.dims();
+    tbb::combinable<std::vector<int>> localBins { [&]() { return std::vector<int>(m_histogramBins.size(), 0); } };
+    tbb::parallel_for(tbb::blocked_range<int>(0, dims.z), [&](const tbb::blocked_range<int>& range) {
+        auto& bins = localBins.local();
+        for (int z = range.begin(); z != range.end(); z++) {
+            for (int y = 0; y < dims.y; y++) {
+                for (int x = 0; x < dims.x; x++) {
+                    const glm::ivec2 pixel = histogramPixel(float(volume.getVoxel(x, y, z)), gradient.getGradient(x, y, z).magnitude);
+                    bins[size_t(pixel.x) + size_t(pixel.y) * size_t(m_histogramResolution.x)]++;
+                }
+            }
+        }
+    });
+
+    std::fill(std::begin(m_histogramBins), std::end(m_histogramBins), 0);
+    localBins.combine_each([&](const std::vector<int>& bins) {
+        std::transform(std::begin(bins), std::end(bins), std::begin(m_histogramBins), std::begin(m_histogramBins), std::plus<int>());
+    });
+    m_maxHistogramCount = *std::max_element(std::begin(m_histogramBins), std::end(m_histogramBins));
+}
+
+// Pixel of the histogram image (magnitude from bottom to top) that the intensity / gradient magnitude falls in.
+glm::ivec2 TransferFunction2DWidget::histogramPixel(float intensity, float gradientMagnitude) const
+{
+    // Edited gradients may be larger than the maximum magnitude at load time.
+    const glm::ivec2 res = m_histogramResolution;
+    return glm::ivec2(
+        std::min(int(intensity * m_histogramScale.x), res.x - 1),
+        std::max(res.y - 1 - int(gradientMagnitude * m_histogramScale.y), 0));
 }
 
 // Draw the widget and handle interactions
@@ -211,30 +323,17 @@ static glm::vec2 ImToGlm(const ImVec2& v)
     return glm::vec2(v.x, v.y);
 }
 
-// Compute a histogram texture from the volume and gradient data
-static std::vector<glm::vec4> createHistogramImage(
-    const volume::Volume& volume, const volume::GradientVolume& gradient, const glm::ivec2& res)
+// Values along both axes of the histogram: intensities up to the maximum and gradient magnitudes up to the maximum.
+static glm::vec2 histogramExtent(const volume::Volume& volume, const volume::GradientVolume& gradient)
 {
-    const size_t numPixels = static_cast<size_t>(res.x * res.y);
-    std::vector<int> bins(numPixels, 0);
-    for (int z = 0; z < volume.dims().z; z++) {
-        for (int y = 0; y < volume.dims().y; y++) {
-            for (int x = 0; x < volume.dims().x; x++) {
-                const size_t imgX = static_cast<size_t>(volume.getVoxel(x, y, z));
-                const size_t imgY = static_cast<size_t>(res.y - 1) - static_cast<size_t>(gradient.getGradient(x, y, z).magnitude);
-                const size_t index = imgX + imgY * static_cast<size_t>(res.x);
-                bins[index]++;
-            }
-        }
-    }
-
-    const int maxCount = *std::max_element(std::begin(bins), std::end(bins));
-    const float factor = 1.0f / std::log(float(maxCount));
+    return glm::max(glm::vec2(volume.maximum(), gradient.maxMagnitude() + 1.0f), 1.0f);
+}
 
-    std::vector<glm::vec4> imageData(numPixels, glm::vec4(0.0f));
-    std::transform(std::begin(bins), std::end(bins), std::begin(imageData),
-        [&](int count) {
-            return glm::vec4(1.0f, 1.0f, 1.0f, std::log(float(count)) * factor);
-        });
-    return imageData;
+// Upload a block of the (bound) R16 histogram texture.
+static void uploadHistogramImage(gsl::span<const uint16_t> image, const glm::ivec2& offset, const glm::ivec2& size)
+{
+    // Rows of 16-bit pixels are not necessarily a multiple of 4 bytes.
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 2);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, offset.x, offset.y, size.x, size.y, GL_RED, GL_UNSIGNED_SHORT, image.data());
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
 }
@@ -1,10 +1,12 @@
 #pragma once
+#include "memory/memory_registry.h"
 #include "render/render_config.h"
 #include "volume/gradient_volume.h"
 #include "volume/volume.h"
 #include <GL/glew.h> // Include before glfw3
 #include <glm/vec2.hpp>
 #include <glm/vec4.hpp>
+#include <vector>
 
 namespace ui {
 
@@ -15,6 +17,18 @@ public:
     void draw();
     void updateRenderConfig(render::RenderConfig& renderConfig);
 
+    // Update the histogram image incrementally when the voxels are edited: call before and after the edit with the
+    // gradients that depend on the edited voxels (see GradientVolume::dependentRegion).
+    void beginVolumeEdit(const volume::Volume& volume, const volume::GradientVolume& gradient, const volume::DirtyRegion& region);
+    void endVolumeEdit(const volume::Volume& volume, const volume::GradientVolume& gradient, const volume::DirtyRegion& region);
+    // Recompute the histogram image from scratch (e.g. after all gradients changed or the range of the values grew).
+    void updateHistogram(const volume::Volume& volume, const volume::GradientVolume& gradient);
+
+private:
+    void addToHistogram(const volume::Volume& volume, const volume::GradientVolume& gradient, const volume::DirtyRegion& region, int count);
+    void computeHistogram(const volume::Volume& volume, const volume::GradientVolume& gradient);
+    glm::ivec2 histogramPixel(float intensity, float gradientMagnitude) const;
+
 private:
     float m_intensity, m_maxIntensity;
     float m_radius;
@@ -22,5 +36,16 @@ private:
 
     int m_interactingPoint;
     GLuint m_histogramImg;
+    memory::TrackedMemory m_histogramMemory;
+
+    // Number of voxels per pixel of the histogram image (intensity along x, gradient magnitude along y). The values are
+    // binned to at most the size of the widget; m_histogramScale converts from values to pixels.
+    glm::ivec2 m_histogramResolution { 0 };
+    glm::vec2 m_histogramScale;
+    std::vector<int> m_histogramBins;
+    int m_maxHistogramCount { 0 };
+    // Pixels [lower, upper) that changed since the last upload and whether the maximum count may have decreased.
+    glm::ivec2 m_changedLower { 0 }, m_changedUpper { 0 };
+    bool m_maxHistogramCountDecreased { false };
 };
 }
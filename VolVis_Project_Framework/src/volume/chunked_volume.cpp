@@ -0,0 +1,409 @@
+#include "chunked_volume.h"
+#include <algorithm>
+#include <atomic>
+#include <glm/common.hpp>
+#include <glm/gtx/component_wise.hpp>
+#include <iostream>
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+
+static constexpr uint32_t chunkedVolumeMagic = 0x43565656; // "VVVC"
+static constexpr uint32_t chunkedVolumeVersion = 3;
+static constexpr int maxLevelCount = 16;
+
+// Start of the file, followed by the chunk index of every level (see ChunkLocation) and the chunks.
+// Files are written in the byte order of the machine (little endian on all supported platforms).
+struct ChunkedVolumeHeader {
+    uint32_t magic;
+    uint32_t version;
+    glm::ivec3 dims;
+    glm::vec3 spacing;
+    volume::ValueMapping valueMapping;
+    int32_t chunkSize;
+    int32_t levelCount;
+};
+
+static std::vector<glm::ivec3> computeLevelDims(const glm::ivec3& dims, int levelCount);
+static glm::ivec3 computeChunkCount(const glm::ivec3& dims, int chunkSize);
+static size_t voxelCount(const glm::ivec3& dims);
+static bool indexFits(const std::vector<glm::ivec3>& levelDims, int chunkSize, size_t maxEntries);
+static std::vector<uint16_t> downsample(gsl::span<const uint16_t> voxels, const glm::ivec3& dims);
+static void copyChunk(gsl::span<const uint16_t> voxels, const glm::ivec3& dims, const glm::ivec3& lower, const glm::ivec3& upper, gsl::span<uint16_t> chunk);
+static void writeVarint(uint32_t value, std::vector<uint8_t>& out);
+static bool readVarint(gsl::span<const uint8_t> data, size_t& offset, uint32_t& value);
+
+namespace volume {
+
+bool writeChunkedVolume(const std::filesystem::path& file, const Volume& volume, int chunkSize, int levelCount)
+{
+    chunkSize = std::max(chunkSize, 1);
+    levelCount = std::clamp(levelCount, 1, maxLevelCount);
+    const auto levelDims = computeLevelDims(volume.dims(), levelCount);
+
+    // Compress the chunks of all levels in parallel.
+    std::vector<std::vector<uint16_t>> downsampledLevels;
+    std::vector<std::vector<std::vector<uint8_t>>> levelChunks;
+    for (int level = 0; level < levelCount; level++) {
+        if (level > 0)
+            downsampledLevels.push_back(downsample(level == 1 ? volume.data() : gsl::span<const uint16_t>(downsampledLevels.back()), levelDims[size_t(level - 1)]));
+        const gsl::span<const uint16_t> voxels = level == 0 ? volume.data() : gsl::span<const uint16_t>(downsampledLevels.back());
+        const glm::ivec3 dims = levelDims[size_t(level)];
+        const glm::ivec3 chunkCount = computeChunkCount(dims, chunkSize);
+
+        auto& chunks = levelChunks.emplace_back(voxelCount(chunkCount));
+        tbb::parallel_for(size_t(0), chunks.size(), [&](size_t chunkIndex) {
+            const glm::ivec3 chunk { int(chunkIndex % size_t(chunkCount.x)), int(chunkIndex / size_t(chunkCount.x) % size_t(chunkCount.y)), int(chunkIndex / size_t(chunkCount.x) / size_t(chunkCount.y)) };
+            const glm::ivec3 lower = chunk * chunkSize;
+            const glm::ivec3 upper = glm::min(lower + chunkSize, dims);
+            std::vector<uint16_t> chunkVoxels(voxelCount(upper - lower));
+            copyChunk(voxels, dims, lower, upper, chunkVoxels);
+            chunks[chunkIndex] = compressVoxels(chunkVoxels);
+        });
+    }
+
+    // The chunks follow the header and the index tables.
+    const ChunkedVolumeHeader header { chunkedVolumeMagic, chunkedVolumeVersion, volume.dims(), volume.spacing(), volume.valueMapping(), chunkSize, levelCount };
+    std::vector<ChunkLocation> index;
+    for (const auto& chunks : levelChunks)
+        index.resize(index.size() + chunks.size());
+    uint64_t offset = sizeof(header) + index.size() * sizeof(ChunkLocation);
+    size_t i = 0;
+    for (const auto& chunks : levelChunks) {
+        for (const auto& chunk : chunks) {
+            index[i++] = { offset, uint64_t(chunk.size()) };
+            offset += chunk.size();
+        }
+    }
+
+    std::ofstream stream { file, std::ios::binary };
+    if (!stream.is_open()) {
+        std::cerr << "Could not open " << file << " for writing" << std::endl;
+        return false;
+    }
+    stream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    stream.write(reinterpret_cast<const char*>(index.data()), std::streamsize(index.size() * sizeof(ChunkLocation)));
+    for (const auto& chunks : levelChunks) {
+        for (const auto& chunk : chunks)
+            stream.write(reinterpret_cast<const char*>(chunk.data()), std::streamsize(chunk.size()));
+    }
+    return stream.good();
+}
+
+ChunkedVolumeReader::ChunkedVolumeReader(const std::filesystem::path& file)
+    : m_file(file, std::ios::binary)
+{
+    if (!m_file.is_open()) {
+        std::cerr << "Could not open " << file << std::endl;
+        return;
+    }
+    std::error_code error;
+    m_compressedSize = size_t(std::filesystem::file_size(file, error));
+    if (error) {
+        std::cerr << "Could not determine the size of " << file << std::endl;
+        return;
+    }
+
+    ChunkedVolumeHeader header;
+    if (!m_file.read(reinterpret_cast<char*>(&header), sizeof(header)) || header.magic != chunkedVolumeMagic || header.version != chunkedVolumeVersion
+        || glm::any(glm::lessThanEqual(header.dims, glm::ivec3(0))) || glm::any(glm::lessThanEqual(header.spacing, glm::vec3(0.0f))) || header.chunkSize <= 0 || header.levelCount < 1 || header.levelCount > maxLevelCount) {
+        std::cerr << file << " is not a chunked volume file" << std::endl;
+        return;
+    }
+    // Chunks larger than the volume cover all of it either way; clamping them keeps the chunk bounds from overflowing.
+    m_chunkSize = std::min(header.chunkSize, glm::compMax(header.dims));
+    m_spacing = header.spacing;
+    m_valueMapping = header.valueMapping;
+    m_levelDims = computeLevelDims(header.dims, header.levelCount);
+    // The index tables have to fit in the file, check that before allocating them.
+    if (!indexFits(m_levelDims, m_chunkSize, (m_compressedSize - sizeof(header)) / sizeof(ChunkLocation))) {
+        std::cerr << "Chunk index of " << file << " is truncated" << std::endl;
+        return;
+    }
+
+    for (const auto& dims : m_levelDims) {
+        auto& chunks = m_chunks.emplace_back(voxelCount(computeChunkCount(dims, m_chunkSize)));
+        if (!m_file.read(reinterpret_cast<char*>(chunks.data()), std::streamsize(chunks.size() * sizeof(ChunkLocation)))) {
+            std::cerr << "Chunk index of " << file << " is truncated" << std::endl;
+            return;
+        }
+        const bool inFile = std::all_of(std::begin(chunks), std::end(chunks),
+            [&](const ChunkLocation& chunk) { return chunk.offset <= m_compressedSize && chunk.size <= m_compressedSize - chunk.offset; });
+        if (!inFile) {
+            std::cerr << "Chunk index of " << file << " points outside of the file" << std::endl;
+            return;
+        }
+    }
+    m_isValid = true;
+}
+
+bool ChunkedVolumeReader::isValid() const
+{
+    return m_isValid;
+}
+
+int ChunkedVolumeReader::levelCount() const
+{
+    return int(m_levelDims.size());
+}
+
+int ChunkedVolumeReader::chunkSize() const
+{
+    return m_chunkSize;
+}
+
+glm::ivec3 ChunkedVolumeReader::dims(int level) const
+{
+    return m_levelDims[size_t(level)];
+}
+
+glm::vec3 ChunkedVolumeReader::spacing() const
+{
+    return m_spacing;
+}
+
+const ValueMapping& ChunkedVolumeReader::valueMapping() const
+{
+    return m_valueMapping;
+}
+
+glm::ivec3 ChunkedVolumeReader::chunkCount(int level) const
+{
+    return computeChunkCount(dims(level), m_chunkSize);
+}
+
+size_t ChunkedVolumeReader::compressedSize() const
+{
+    return m_compressedSize;
+}
+
+size_t ChunkedVolumeReader::uncompressedSize() const
+{
+    size_t out = 0;
+    for (const auto& dims : m_levelDims)
+        out += voxelCount(dims) * sizeof(uint16_t);
+    return out;
+}
+
+std::vector<uint16_t> ChunkedVolumeReader::readLevel(int level)
+{
+    return readRegion(level, DirtyRegion { glm::ivec3(0), dims(level) });
+}
+
+std::vector<uint16_t> ChunkedVolumeReader::readRegion(int level, const DirtyRegion& region)
+{
+    if (!m_isValid || level < 0 || level >= levelCount())
+        return {};
+
+    const glm::ivec3 levelDims = dims(level);
+    std::vector<uint16_t> out(voxelCount(levelDims), 0);
+    const DirtyRegion clampedRegion { glm::clamp(region.lower, glm::ivec3(0), levelDims), glm::clamp(region.upper, glm::ivec3(0), levelDims) };
+    if (isEmpty(clampedRegion))
+        return out;
+
+    const glm::ivec3 lowerChunk = clampedRegion.lower / m_chunkSize;
+    const glm::ivec3 upperChunk = computeChunkCount(clampedRegion.upper, m_chunkSize);
+    if (!readChunks(level, lowerChunk, upperChunk, out)) {
+        std::cerr << "Chunked volume file is corrupt" << std::endl;
+        return {};
+    }
+    return out;
+}
+
+// Read the compressed chunks [lowerChunk, upperChunk) from disk one after the other and decompress them in parallel.
+bool ChunkedVolumeReader::readChunks(int level, const glm::ivec3& lowerChunk, const glm::ivec3& upperChunk, gsl::span<uint16_t> out)
+{
+    const glm::ivec3 levelDims = dims(level);
+    const glm::ivec3 levelChunkCount = chunkCount(level);
+
+    struct CompressedChunk {
+        glm::ivec3 chunk;
+        std::vector<uint8_t> data;
+    };
+    std::vector<CompressedChunk> compressedChunks;
+    for (int z = lowerChunk.z; z < upperChunk.z; z++) {
+        for (int y = lowerChunk.y; y < upperChunk.y; y++) {
+            for (int x = lowerChunk.x; x < upperChunk.x; x++) {
+                const ChunkLocation& index = m_chunks[size_t(level)][size_t(x) + size_t(levelChunkCount.x) * (size_t(y) + size_t(levelChunkCount.y) * size_t(z))];
+                auto& compressedChunk = compressedChunks.emplace_back(CompressedChunk { glm::ivec3(x, y, z), std::vector<uint8_t>(index.size) });
+                m_file.seekg(std::streamoff(index.offset));
+                if (!m_file.read(reinterpret_cast<char*>(compressedChunk.data.data()), std::streamsize(index.size))) {
+                    m_file.clear();
+                    return false;
+                }
+            }
+        }
+    }
+
+    std::atomic_bool success { true };
+    tbb::parallel_for(size_t(0), compressedChunks.size(), [&](size_t i) {
+        const glm::ivec3 lower = compressedChunks[i].chunk * m_chunkSize;
+        const glm::ivec3 upper = glm::min(lower + m_chunkSize, levelDims);
+        std::vector<uint16_t> chunkVoxels(voxelCount(upper - lower));
+        if (!decompressVoxels(compressedChunks[i].data, chunkVoxels)) {
+            success = false;
+            return;
+        }
+
+        // Scatter the rows of the chunk into the volume.
+        const int rowSize = upper.x - lower.x;
+        auto pChunkRow = std::begin(chunkVoxels);
+        for (int z = lower.z; z < upper.z; z++) {
+            for (int y = lower.y; y < upper.y; y++) {
+                std::copy_n(pChunkRow, rowSize, std::begin(out) + ptrdiff_t(size_t(lower.x) + size_t(levelDims.x) * (size_t(y) + size_t(levelDims.y) * size_t(z))));
+                pChunkRow += rowSize;
+            }
+        }
+    });
+    return success;
+}
+
+std::vector<uint8_t> compressVoxels(gsl::span<const uint16_t> voxels)
+{
+    // Tokens have the run flag in the lowest bit: either a run of voxels equal to the previous voxel (count - 1) or the
+    // zigzag encoded difference with the previous voxel.
+    static constexpr size_t maxRunLength = size_t(1) << 30;
+    std::vector<uint8_t> out;
+    out.reserve(voxels.size());
+    uint16_t previous = 0;
+    for (size_t i = 0; i < voxels.size();) {
+        if (voxels[i] == previous) {
+            size_t runLength = 1;
+            while (i + runLength < voxels.size() && voxels[i + runLength] == previous && runLength < maxRunLength)
+                runLength++;
+            writeVarint(uint32_t((runLength - 1) << 1) | 1u, out);
+            i += runLength;
+        } else {
+            const int32_t delta = int32_t(voxels[i]) - int32_t(previous);
+            const uint32_t zigzag = (uint32_t(delta) << 1) ^ uint32_t(delta >> 31);
+            writeVarint(zigzag << 1, out);
+            previous = voxels[i++];
+        }
+    }
+    return out;
+}
+
+bool decompressVoxels(gsl::span<const uint8_t> data, gsl::span<uint16_t> out)
+{
+    size_t offset = 0, i = 0;
+    uint16_t previous = 0;
+    while (offset < data.size()) {
+        uint32_t token;
+        if (!readVarint(data, offset, token))
+            return false;
+
+        if (token & 1u) {
+            const size_t runLength = size_t(token >> 1) + 1;
+            if (runLength > out.size() - i)
+                return false;
+            std::fill_n(std::begin(out) + ptrdiff_t(i), runLength, previous);
+            i += runLength;
+        } else {
+            const uint32_t zigzag = token >> 1;
+            const int32_t delta = int32_t(zigzag >> 1) ^ -int32_t(zigzag & 1u);
+            if (i == out.size())
+                return false;
+            previous = uint16_t(int32_t(previous) + delta);
+            out[i++] = previous;
+        }
+    }
+    return i == out.size();
+}
+
+}
+
+static std::vector<glm::ivec3> computeLevelDims(const glm::ivec3& dims, int levelCount)
+{
+    std::vector<glm::ivec3> out { dims };
+    for (int level = 1; level < levelCount; level++)
+        out.push_back((out.back() - 1) / 2 + 1);
+    return out;
+}
+
+// Rounds up without overflowing, dims has to be positive.
+static glm::ivec3 computeChunkCount(const glm::ivec3& dims, int chunkSize)
+{
+    return (dims - 1) / chunkSize + 1;
+}
+
+static size_t voxelCount(const glm::ivec3& dims)
+{
+    return size_t(dims.x) * size_t(dims.y) * size_t(dims.z);
+}
+
+// Whether the index tables of all levels have at most maxEntries entries together (without overflowing).
+static bool indexFits(const std::vector<glm::ivec3>& levelDims, int chunkSize, size_t maxEntries)
+{
+    for (const auto& dims : levelDims) {
+        const glm::ivec3 chunkCount = computeChunkCount(dims, chunkSize);
+        const size_t x = size_t(chunkCount.x), y = size_t(chunkCount.y), z = size_t(chunkCount.z);
+        if (x > maxEntries || y > maxEntries / x || z > maxEntries / (x * y))
+            return false;
+        maxEntries -= x * y * z;
+    }
+    return true;
+}
+
+// Average of (up to) 2x2x2 voxels, one slice per task.
+static std::vector<uint16_t> downsample(gsl::span<const uint16_t> voxels, const glm::ivec3& dims)
+{
+    const glm::ivec3 outDims = (dims + 1) / 2;
+    std::vector<uint16_t> out(voxelCount(outDims));
+    tbb::parallel_for(tbb::blocked_range<int>(0, outDims.z), [&](const tbb::blocked_range<int>& range) {
+        for (int z = range.begin(); z != range.end(); z++) {
+            for (int y = 0; y < outDims.y; y++) {
+                for (int x = 0; x < outDims.x; x++) {
+                    const glm::ivec3 lower = glm::ivec3(x, y, z) * 2;
+                    const glm::ivec3 upper = glm::min(lower + 2, dims);
+                    uint32_t sum = 0, count = 0;
+                    for (int vz = lower.z; vz < upper.z; vz++) {
+                        for (int vy = lower.y; vy < upper.y; vy++) {
+                            for (int vx = lower.x; vx < upper.x; vx++) {
+                                sum += voxels[size_t(vx) + size_t(dims.x) * (size_t(vy) + size_t(dims.y) * size_t(vz))];
+                                count++;
+                            }
+                        }
+                    }
+                    out[size_t(x) + size_t(outDims.x) * (size_t(y) + size_t(outDims.y) * size_t(z))] = uint16_t((sum + count / 2) / count);
+                }
+            }
+        }
+    });
+    return out;
+}
+
+// Gather the voxels [lower, upper) into a contiguous array (x fastest).
+static void copyChunk(gsl::span<const uint16_t> voxels, const glm::ivec3& dims, const glm::ivec3& lower, const glm::ivec3& upper, gsl::span<uint16_t> chunk)
+{
+    const int rowSize = upper.x - lower.x;
+    auto pChunkRow = std::begin(chunk);
+    for (int z = lower.z; z < upper.z; z++) {
+        for (int y = lower.y; y < upper.y; y++) {
+            std::copy_n(std::begin(voxels) + ptrdiff_t(size_t(lower.x) + size_t(dims.x) * (size_t(y) + size_t(dims.y) * size_t(z))), rowSize, pChunkRow);
+            pChunkRow += rowSize;
+        }
+    }
+}
+
+// LEB128: 7 bits per byte, the highest bit indicates that more bytes follow.
+static void writeVarint(uint32_t value, std::vector<uint8_t>& out)
+{
+    while (value >= 0x80) {
+        out.push_back(uint8_t(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(uint8_t(value));
+}
+
+static bool readVarint(gsl::span<const uint8_t> data, size_t& offset, uint32_t& value)
+{
+    value = 0;
+    for (int shift = 0; shift < 32; shift += 7) {
+        if (offset == data.size())
+            return false;
+        const uint8_t byte = data[offset++];
+        value |= uint32_t(byte & 0x7F) << shift;
+        if (!(byte & 0x80))
+            return true;
+    }
+    return false;
+}
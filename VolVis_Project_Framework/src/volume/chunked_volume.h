@@ -0,0 +1,73 @@
+#pragma once
+#include "volume/volume.h"
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <glm/vec3.hpp>
+#include <gsl/span>
+#include <vector>
+
+// Chunked volume files (.cvol): the volume is divided into chunks of chunkSize^3 voxels that are compressed
+// independently, with an index table of the chunks at the start of the file. Chunks can be read and decompressed in
+// any order (and in parallel), so loaders can fetch only the chunks that they need.
+//
+// A file may contain multiple resolution levels: level 0 is the full volume and every next level has half the
+// resolution along all axes (rounded up, voxels are the average of 2x2x2 voxels of the previous level).
+//
+// Chunks are compressed with a lossless delta + run length coding: every voxel is predicted by the previous voxel
+// of the chunk and the difference is written as a variable length integer, runs of equal voxels as a single count.
+namespace volume {
+
+// Convert a volume (e.g. loaded from a .fld file) to a chunked volume file. Returns false if the file cannot be written.
+bool writeChunkedVolume(const std::filesystem::path& file, const Volume& volume, int chunkSize = 64, int levelCount = 1);
+
+// Entry of the chunk index.
+struct ChunkLocation {
+    uint64_t offset; // From the start of the file.
+    uint64_t size;
+};
+
+class ChunkedVolumeReader {
+public:
+    ChunkedVolumeReader(const std::filesystem::path& file);
+
+    // False if the file could not be opened or is not a chunked volume file.
+    bool isValid() const;
+
+    int levelCount() const;
+    int chunkSize() const;
+    glm::ivec3 dims(int level = 0) const;
+    // Voxel spacing of level 0 (see Volume::spacing), every next level doubles it.
+    glm::vec3 spacing() const;
+    // Voxel type of the original file (see Volume::valueMapping).
+    const ValueMapping& valueMapping() const;
+    glm::ivec3 chunkCount(int level = 0) const;
+    // Size of the file and the size of the voxels after decompression (all levels, in bytes).
+    size_t compressedSize() const;
+    size_t uncompressedSize() const;
+
+    // Decompress all chunks of a level in parallel. Returns an empty vector if the file is corrupt.
+    std::vector<uint16_t> readLevel(int level = 0);
+    // Only decompress the chunks that overlap the region; voxels outside of those chunks are zero.
+    std::vector<uint16_t> readRegion(int level, const DirtyRegion& region);
+
+private:
+    bool readChunks(int level, const glm::ivec3& lowerChunk, const glm::ivec3& upperChunk, gsl::span<uint16_t> out);
+
+private:
+    std::ifstream m_file;
+    bool m_isValid { false };
+    int m_chunkSize { 0 };
+    glm::vec3 m_spacing { 1.0f };
+    ValueMapping m_valueMapping;
+    std::vector<glm::ivec3> m_levelDims;
+    std::vector<std::vector<ChunkLocation>> m_chunks; // Per level, x fastest.
+    size_t m_compressedSize { 0 };
+};
+
+// Lossless compression of a (chunk of) voxels, exposed for the tests.
+std::vector<uint8_t> compressVoxels(gsl::span<const uint16_t> voxels);
+// Returns false if the data does not decode to exactly out.size() voxels.
+bool decompressVoxels(gsl::span<const uint8_t> data, gsl::span<uint16_t> out);
+
+}
@@ -1,65 +1,299 @@
 #include "gradient_volume.h"
+#include "volume_filter.h"
 #include <algorithm>
+#include <array>
+#include <cstdint>
 #include <exception>
+#include <iostream>
+#include <limits>
 #include <math.h>
+#include <glm/common.hpp>
 #include <glm/geometric.hpp>
 #include <glm/vector_relational.hpp>
 #include <gsl/span>
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+#include <tbb/parallel_reduce.h>
+#include <utility>
+
+// Voxels per slab of slices that the separable gradient operators filter at once. Filtering takes about 24 bytes per
+// voxel (the float copy, the three components and the temporaries of the convolution).
+static constexpr size_t gradientSlabVoxels = size_t(1) << 22;
 
 namespace volume {
 
-// Compute the maximum magnitude from all gradient voxels
-static float computeMaxMagnitude(gsl::span<const GradientVoxel> data)
+static size_t voxelCount(const glm::ivec3& dim)
 {
-    return std::max_element(
-        std::begin(data),
-        std::end(data),
-        [](const GradientVoxel& lhs, const GradientVoxel& rhs) {
-            return lhs.magnitude < rhs.magnitude;
-        })
-        ->magnitude;
+    return static_cast<size_t>(dim.x) * static_cast<size_t>(dim.y) * static_cast<size_t>(dim.z);
 }
 
-// Compute the minimum magnitude from all gradient voxels
-static float computeMinMagnitude(gsl::span<const GradientVoxel> data)
+// Central difference at an inner voxel (the gradients at the border of the volume are zero).
+static glm::vec3 computeGradient(const Volume& volume, int x, int y, int z)
 {
-    return std::min_element(
-        std::begin(data),
-        std::end(data),
-        [](const GradientVoxel& lhs, const GradientVoxel& rhs) {
-            return lhs.magnitude < rhs.magnitude;
-        })
-        ->magnitude;
+    const float gx = (volume.getVoxel(x + 1, y, z) - volume.getVoxel(x - 1, y, z)) / 2.0f;
+    const float gy = (volume.getVoxel(x, y + 1, z) - volume.getVoxel(x, y - 1, z)) / 2.0f;
+    const float gz = (volume.getVoxel(x, y, z + 1) - volume.getVoxel(x, y, z - 1)) / 2.0f;
+    return glm::vec3 { gx, gy, gz };
 }
 
-// Compute a gradient volume from a volume
-static std::vector<GradientVoxel> computeGradientVolume(const Volume& volume)
+// Gradient at a voxel using separable derivative/smoothing kernels (of equal size), clamping at the border.
+static glm::vec3 computeGradient(const Volume& volume, int x, int y, int z, const Kernel& derivativeKernel, const Kernel& smoothingKernel)
 {
-    const auto dim = volume.dims();
-
-    std::vector<GradientVoxel> out(static_cast<size_t>(dim.x * dim.y * dim.z));
-    for (int z = 1; z < dim.z - 1; z++) {
-        for (int y = 1; y < dim.y - 1; y++) {
-            for (int x = 1; x < dim.x - 1; x++) {
-                const float gx = (volume.getVoxel(x + 1, y, z) - volume.getVoxel(x - 1, y, z)) / 2.0f;
-                const float gy = (volume.getVoxel(x, y + 1, z) - volume.getVoxel(x, y - 1, z)) / 2.0f;
-                const float gz = (volume.getVoxel(x, y, z + 1) - volume.getVoxel(x, y, z - 1)) / 2.0f;
-
-                const glm::vec3 v { gx, gy, gz };
-                const size_t index = static_cast<size_t>(x + dim.x * (y + dim.y * z));
-                out[index] = GradientVoxel { v, glm::length(v) };
+    const glm::ivec3 dim = volume.dims();
+    const int radius = int(derivativeKernel.size()) / 2;
+    glm::vec3 out { 0.0f };
+    for (int k = 0; k < int(derivativeKernel.size()); k++) {
+        const int vz = std::clamp(z + k - radius, 0, dim.z - 1);
+        for (int j = 0; j < int(derivativeKernel.size()); j++) {
+            const int vy = std::clamp(y + j - radius, 0, dim.y - 1);
+            for (int i = 0; i < int(derivativeKernel.size()); i++) {
+                const float voxel = volume.getVoxel(std::clamp(x + i - radius, 0, dim.x - 1), vy, vz);
+                const glm::vec3 derivative { derivativeKernel[size_t(i)], derivativeKernel[size_t(j)], derivativeKernel[size_t(k)] };
+                const glm::vec3 smoothing { smoothingKernel[size_t(i)], smoothingKernel[size_t(j)], smoothingKernel[size_t(k)] };
+                out += voxel * derivative * glm::vec3(smoothing.y * smoothing.z, smoothing.x * smoothing.z, smoothing.x * smoothing.y);
             }
         }
     }
     return out;
 }
 
+static std::pair<Kernel, Kernel> getGradientKernels(GradientOperator gradientOperator)
+{
+    switch (gradientOperator) {
+    case GradientOperator::CentralDifference:
+        return { { -0.5f, 0.0f, 0.5f }, { 0.0f, 1.0f, 0.0f } };
+    case GradientOperator::Sobel:
+        return { { -0.5f, 0.0f, 0.5f }, { 0.25f, 0.5f, 0.25f } };
+    case GradientOperator::GaussianDerivative:
+        return { gaussianDerivativeKernel(1.0f), gaussianKernel(1.0f) };
+    default:
+        throw std::exception();
+    };
+}
+
+// Calls f(voxelIndex, gradient) for all voxels, in parallel. The gradients are in world coordinates: the differences
+// between voxels are divided by the voxel spacing.
+template <typename F>
+static void forEachGradient(const Volume& volume, GradientOperator gradientOperator, F&& f)
+{
+    const auto dim = volume.dims();
+    const glm::vec3 inverseSpacing = 1.0f / volume.spacing();
+    if (gradientOperator == GradientOperator::CentralDifference) {
+        tbb::parallel_for(tbb::blocked_range<int>(0, dim.z), [&](const tbb::blocked_range<int>& range) {
+            for (int z = range.begin(); z != range.end(); z++) {
+                for (int y = 0; y < dim.y; y++) {
+                    for (int x = 0; x < dim.x; x++) {
+                        const bool inner = x > 0 && y > 0 && z > 0 && x < dim.x - 1 && y < dim.y - 1 && z < dim.z - 1;
+                        const size_t index = static_cast<size_t>(x + dim.x * (y + dim.y * z));
+                        f(index, inner ? computeGradient(volume, x, y, z) * inverseSpacing : glm::vec3(0.0f));
+                    }
+                }
+            }
+        });
+        return;
+    }
+
+    // Larger kernels are applied as separable convolutions (one per gradient component). To bound the memory use the
+    // volume is filtered in slabs of slices. Each slab is extended by the kernel radius (clamped to the volume like the
+    // convolution itself), so the results are the same as when filtering the whole volume at once.
+    const auto [derivativeKernel, smoothingKernel] = getGradientKernels(gradientOperator);
+    const int radius = int(derivativeKernel.size()) / 2;
+    const size_t sliceSize = size_t(dim.x) * size_t(dim.y);
+    const int slabDepth = int(std::max(gradientSlabVoxels / std::max(sliceSize, size_t(1)), size_t(1)));
+    const auto voxels = volume.data();
+    for (int slabBegin = 0; slabBegin < dim.z; slabBegin += slabDepth) {
+        const int slabEnd = std::min(slabBegin + slabDepth, dim.z);
+        const int haloBegin = std::max(slabBegin - radius, 0);
+        const int haloEnd = std::min(slabEnd + radius, dim.z);
+        const glm::ivec3 haloDim { dim.x, dim.y, haloEnd - haloBegin };
+
+        std::vector<float> slab(sliceSize * size_t(haloDim.z));
+        const size_t haloOffset = sliceSize * size_t(haloBegin);
+        for (size_t i = 0; i < slab.size(); i++)
+            slab[i] = float(voxels[haloOffset + i]);
+        const std::vector<float> gx = convolveSeparable(slab, haloDim, derivativeKernel, smoothingKernel, smoothingKernel);
+        const std::vector<float> gy = convolveSeparable(slab, haloDim, smoothingKernel, derivativeKernel, smoothingKernel);
+        const std::vector<float> gz = convolveSeparable(slab, haloDim, smoothingKernel, smoothingKernel, derivativeKernel);
+
+        const size_t slabOffset = sliceSize * size_t(slabBegin - haloBegin);
+        const size_t volumeOffset = sliceSize * size_t(slabBegin);
+        tbb::parallel_for(tbb::blocked_range<size_t>(0, sliceSize * size_t(slabEnd - slabBegin)), [&](const tbb::blocked_range<size_t>& range) {
+            for (size_t i = range.begin(); i != range.end(); i++)
+                f(volumeOffset + i, glm::vec3(gx[slabOffset + i], gy[slabOffset + i], gz[slabOffset + i]) * inverseSpacing);
+        });
+    }
+}
+
+// Compute a gradient volume from a volume
+static std::vector<GradientVoxel> computeGradientVolume(const Volume& volume, GradientOperator gradientOperator)
+{
+    std::vector<GradientVoxel> out(voxelCount(volume.dims()));
+    forEachGradient(volume, gradientOperator, [&](size_t index, const glm::vec3& v) {
+        out[index] = GradientVoxel { v, glm::length(v) };
+    });
+    return out;
+}
+
+// A gradient component is at most half the range of the voxel values (the positive weights of the derivative
+// kernels add up to at most 1/2 and the smoothing kernels are normalized).
+static float computeQuantizationStep(const Volume& volume)
+{
+    const float maxComponent = std::max((volume.maximum() - volume.minimum()) / 2.0f, 1.0f);
+    return maxComponent / float(std::numeric_limits<int16_t>::max());
+}
+
+static std::vector<glm::i16vec3> computeQuantizedGradientVolume(const Volume& volume, GradientOperator gradientOperator, float quantizationStep)
+{
+    std::vector<glm::i16vec3> out(voxelCount(volume.dims()));
+    forEachGradient(volume, gradientOperator, [&](size_t index, const glm::vec3& v) {
+        out[index] = glm::i16vec3(glm::round(v / quantizationStep));
+    });
+    return out;
+}
+
+GradientStorage chooseGradientStorage(const glm::ivec3& dims)
+{
+    const size_t available = memory::availableMemory();
+    if (voxelCount(dims) * sizeof(GradientVoxel) <= available)
+        return GradientStorage::Full;
+    if (voxelCount(dims) * sizeof(glm::i16vec3) <= available)
+        return GradientStorage::Quantized;
+    return GradientStorage::OnTheFly;
+}
+
+std::string_view gradientStorageName(GradientStorage storage)
+{
+    static constexpr std::array names { "full", "quantized", "on the fly" };
+    return names[size_t(storage)];
+}
+
+std::string_view gradientOperatorName(GradientOperator gradientOperator)
+{
+    static constexpr std::array names { "central", "sobel", "gaussian" };
+    return names[size_t(gradientOperator)];
+}
+
 GradientVolume::GradientVolume(const Volume& volume)
+    : GradientVolume(volume, chooseGradientStorage(volume.dims()))
+{
+}
+
+GradientVolume::GradientVolume(const Volume& volume, GradientStorage storage, GradientOperator gradientOperator)
     : m_dim(volume.dims())
-    , m_data(computeGradientVolume(volume))
-    , m_minMagnitude(computeMinMagnitude(m_data))
-    , m_maxMagnitude(computeMaxMagnitude(m_data))
+    , m_storage(storage)
+    , m_fetchGradient(gradientFetch(storage))
+    , m_gradientOperator(gradientOperator)
+    , m_pVolume(&volume)
+    , m_derivativeKernel(getGradientKernels(gradientOperator).first)
+    , m_smoothingKernel(getGradientKernels(gradientOperator).second)
+    , m_data(storage == GradientStorage::Full ? computeGradientVolume(volume, gradientOperator) : std::vector<GradientVoxel> {})
+    , m_quantizationStep(computeQuantizationStep(volume))
+    , m_quantizedData(storage == GradientStorage::Quantized ? computeQuantizedGradientVolume(volume, gradientOperator, m_quantizationStep) : std::vector<glm::i16vec3> {})
+    , m_gradients(m_data)
+    , m_memory("Gradients", m_data.size() * sizeof(GradientVoxel) + m_quantizedData.size() * sizeof(glm::i16vec3))
+{
+    std::tie(m_minMagnitude, m_maxMagnitude) = computeMagnitudeRange();
+}
+
+GradientVolume::GradientVolume(std::shared_ptr<const void> pStorage, gsl::span<const GradientVoxel> data, const glm::ivec3& dim, float minMagnitude, float maxMagnitude)
+    : m_dim(dim)
+    , m_pExternalStorage(std::move(pStorage))
+    , m_gradients(data)
+    , m_minMagnitude(minMagnitude)
+    , m_maxMagnitude(maxMagnitude)
+{
+}
+
+// Reduced over slabs of slices in parallel, because with on the fly storage every gradient is computed here.
+std::pair<float, float> GradientVolume::computeMagnitudeRange() const
 {
+    using MagnitudeRange = std::pair<float, float>;
+    return tbb::parallel_reduce(
+        tbb::blocked_range<int>(0, m_dim.z), MagnitudeRange { std::numeric_limits<float>::max(), 0.0f },
+        [&](const tbb::blocked_range<int>& slabs, MagnitudeRange range) {
+            for (int z = slabs.begin(); z != slabs.end(); z++) {
+                for (int y = 0; y < m_dim.y; y++) {
+                    for (int x = 0; x < m_dim.x; x++) {
+                        const float magnitude = getGradient(x, y, z).magnitude;
+                        range.first = std::min(range.first, magnitude);
+                        range.second = std::max(range.second, magnitude);
+                    }
+                }
+            }
+            return range;
+        },
+        [](const MagnitudeRange& lhs, const MagnitudeRange& rhs) {
+            return MagnitudeRange { std::min(lhs.first, rhs.first), std::max(lhs.second, rhs.second) };
+        });
+}
+
+// Same result as computeGradientVolume for a single voxel.
+glm::vec3 GradientVolume::computeGradientDirection(int x, int y, int z) const
+{
+    if (m_gradientOperator != GradientOperator::CentralDifference)
+        return computeGradient(*m_pVolume, x, y, z, m_derivativeKernel, m_smoothingKernel) / m_pVolume->spacing();
+    if (x > 0 && y > 0 && z > 0 && x < m_dim.x - 1 && y < m_dim.y - 1 && z < m_dim.z - 1)
+        return computeGradient(*m_pVolume, x, y, z) / m_pVolume->spacing();
+    return glm::vec3(0.0f);
+}
+
+DirtyRegion GradientVolume::dependentRegion(const DirtyRegion& voxelRegion) const
+{
+    return expandRegion(voxelRegion, std::max(int(m_derivativeKernel.size()) / 2, 1), m_dim);
+}
+
+DirtyRegion GradientVolume::update(const DirtyRegion& voxelRegion)
+{
+    if (m_pExternalStorage) {
+        std::cerr << "Cannot update gradients that are owned by another process" << std::endl;
+        return {};
+    }
+
+    const DirtyRegion region = dependentRegion(voxelRegion);
+    for (int z = region.lower.z; z < region.upper.z; z++) {
+        for (int y = region.lower.y; y < region.upper.y; y++) {
+            for (int x = region.lower.x; x < region.upper.x; x++) {
+                const glm::vec3 dir = computeGradientDirection(x, y, z);
+                const size_t i = static_cast<size_t>(x + m_dim.x * (y + m_dim.y * z));
+                if (m_storage == GradientStorage::Full)
+                    m_data[i] = GradientVoxel { dir, glm::length(dir) };
+                else if (m_storage == GradientStorage::Quantized)
+                    m_quantizedData[i] = glm::i16vec3(glm::round(dir / m_quantizationStep));
+                m_minMagnitude = std::min(m_minMagnitude, glm::length(dir));
+                m_maxMagnitude = std::max(m_maxMagnitude, glm::length(dir));
+            }
+        }
+    }
+    return region;
+}
+
+DirtyRegion GradientVolume::grow()
+{
+    if (m_pExternalStorage || !m_pVolume) {
+        std::cerr << "Cannot grow gradients that are not computed from a volume" << std::endl;
+        return {};
+    }
+
+    const int oldDepth = m_dim.z;
+    m_dim = m_pVolume->dims();
+    const DirtyRegion everything { glm::ivec3(0), m_dim };
+    if (m_storage == GradientStorage::Full) {
+        m_data.resize(voxelCount(m_dim));
+        m_gradients = m_data;
+    } else if (m_storage == GradientStorage::Quantized) {
+        const float quantizationStep = computeQuantizationStep(*m_pVolume);
+        if (quantizationStep != m_quantizationStep) {
+            // The range of the volume grew so all gradients have to be quantized again.
+            m_quantizationStep = quantizationStep;
+            m_quantizedData = computeQuantizedGradientVolume(*m_pVolume, m_gradientOperator, m_quantizationStep);
+            std::tie(m_minMagnitude, m_maxMagnitude) = computeMagnitudeRange();
+            m_memory = memory::TrackedMemory("Gradients", m_quantizedData.size() * sizeof(glm::i16vec3));
+            return everything;
+        }
+        m_quantizedData.resize(voxelCount(m_dim));
+    }
+    m_memory = memory::TrackedMemory("Gradients", m_data.size() * sizeof(GradientVoxel) + m_quantizedData.size() * sizeof(glm::i16vec3));
+    return update({ glm::ivec3(0, 0, oldDepth), m_dim });
 }
 
 float GradientVolume::maxMagnitude() const
@@ -77,6 +311,21 @@ glm::ivec3 GradientVolume::dims() const
     return m_dim;
 }
 
+GradientStorage GradientVolume::storage() const
+{
+    return m_storage;
+}
+
+GradientOperator GradientVolume::gradientOperator() const
+{
+    return m_gradientOperator;
+}
+
+gsl::span<const GradientVoxel> GradientVolume::data() const
+{
+    return m_gradients;
+}
+
 // This function returns a gradientVoxel at coord based on the current interpolation mode.
 GradientVoxel GradientVolume::getGradientInterpolate(const glm::vec3& coord) const
 {
@@ -175,7 +424,41 @@ GradientVoxel GradientVolume::linearInterpolate(const GradientVoxel& g0, const G
 // This function returns a gradientVoxel without using interpolation
 GradientVoxel GradientVolume::getGradient(int x, int y, int z) const
 {
-    const size_t i = static_cast<size_t>(x + m_dim.x * (y + m_dim.y * z));
-    return m_data[i];
+    return (this->*m_fetchGradient)(x, y, z);
+}
+
+GradientVolume::GradientFetch GradientVolume::gradientFetch(GradientStorage storage)
+{
+    switch (storage) {
+    case GradientStorage::Full: {
+        return &GradientVolume::getStoredGradient;
+    }
+    case GradientStorage::Quantized: {
+        return &GradientVolume::getQuantizedGradient;
+    }
+    case GradientStorage::OnTheFly: {
+        return &GradientVolume::getComputedGradient;
+    }
+    default: {
+        throw std::exception();
+    }
+    };
+}
+
+GradientVoxel GradientVolume::getStoredGradient(int x, int y, int z) const
+{
+    return m_gradients[static_cast<size_t>(x + m_dim.x * (y + m_dim.y * z))];
+}
+
+GradientVoxel GradientVolume::getQuantizedGradient(int x, int y, int z) const
+{
+    const glm::vec3 dir = glm::vec3(m_quantizedData[static_cast<size_t>(x + m_dim.x * (y + m_dim.y * z))]) * m_quantizationStep;
+    return { dir, glm::length(dir) };
+}
+
+GradientVoxel GradientVolume::getComputedGradient(int x, int y, int z) const
+{
+    const glm::vec3 dir = computeGradientDirection(x, y, z);
+    return { dir, glm::length(dir) };
 }
 }
\ No newline at end of file
@@ -1,8 +1,14 @@
 #pragma once
+#include "memory/memory_registry.h"
 #include "volume.h"
+#include <glm/gtc/type_precision.hpp>
 #include <glm/vec3.hpp>
 #include <glm/vec4.hpp>
+#include <gsl/span>
+#include <memory>
 #include <string>
+#include <string_view>
+#include <utility>
 #include <vector>
 
 namespace volume {
@@ -11,13 +17,39 @@ struct GradientVoxel {
     float magnitude;
 };
 
+// How the gradients are stored, from most accurate to smallest.
+enum class GradientStorage {
+    Full = 0, // GradientVoxel per voxel (16 bytes).
+    Quantized, // 16-bit fixed point direction per voxel (6 bytes), the magnitude is the length of the direction.
+    OnTheFly // Nothing is stored, gradients are computed from the voxels when they are accessed.
+};
+
+// Filter that computes the gradients from the voxels. Larger kernels are less sensitive to noise.
+enum class GradientOperator {
+    CentralDifference = 0,
+    Sobel, // Central difference smoothed with [1 2 1] / 4 along the other two axes (3x3x3 kernel).
+    GaussianDerivative // Derivative of a Gaussian with a standard deviation of 1 voxel (7x7x7 kernel).
+};
+std::string_view gradientOperatorName(GradientOperator gradientOperator);
+
+// Most accurate storage whose memory fits in the available memory budget (see memory/memory_registry.h).
+GradientStorage chooseGradientStorage(const glm::ivec3& dims);
+std::string_view gradientStorageName(GradientStorage storage);
+
 class GradientVolume {
 public:
     // DO NOT REMOVE
     InterpolationMode interpolationMode { InterpolationMode::NearestNeighbour };
 
 public:
+    // The volume has to outlive the gradient volume if the gradients are computed on the fly.
     GradientVolume(const Volume& volume);
+    GradientVolume(const Volume& volume, GradientStorage storage, GradientOperator gradientOperator = GradientOperator::CentralDifference);
+    // Read-only view of gradients that live in memory owned by pStorage (see Volume).
+    GradientVolume(std::shared_ptr<const void> pStorage, gsl::span<const GradientVoxel> data, const glm::ivec3& dim, float minMagnitude, float maxMagnitude);
+    // Copies would point at the gradients of the original (see m_gradients).
+    GradientVolume(const GradientVolume&) = delete;
+    GradientVolume(GradientVolume&&) = default;
 
     GradientVoxel getGradientInterpolate(const glm::vec3& coord) const;
     GradientVoxel getGradient(int x, int y, int z) const;
@@ -25,6 +57,19 @@ public:
     float minMagnitude() const;
     float maxMagnitude() const;
     glm::ivec3 dims() const;
+    GradientStorage storage() const;
+    GradientOperator gradientOperator() const;
+    // Only available for the Full storage (empty otherwise).
+    gsl::span<const GradientVoxel> data() const;
+
+    // Gradients that depend on the voxels in the region.
+    DirtyRegion dependentRegion(const DirtyRegion& voxelRegion) const;
+    // Recompute the gradients after the voxels in the region were edited. The magnitude range only grows such
+    // that it remains a bound on all gradients. Returns the gradients that may have changed.
+    DirtyRegion update(const DirtyRegion& voxelRegion);
+    // Add the gradients of the slices that were appended to the volume (see Volume::appendSlices) and recompute
+    // the existing gradients next to them. Returns the gradients that may have changed.
+    DirtyRegion grow();
 
 protected:
     GradientVoxel getGradientNearestNeighbor(const glm::vec3& coord) const;
@@ -32,9 +77,32 @@ protected:
     GradientVoxel biLinearInterpolate(const glm::vec2& xyCoord, int z) const;
     static GradientVoxel linearInterpolate(const GradientVoxel& g0, const GradientVoxel& g1, float factor);
 
+private:
+    std::pair<float, float> computeMagnitudeRange() const;
+    glm::vec3 computeGradientDirection(int x, int y, int z) const;
+
+    // getGradient for each storage, chosen once at construction such that fetches do not switch on the storage.
+    using GradientFetch = GradientVoxel (GradientVolume::*)(int x, int y, int z) const;
+    static GradientFetch gradientFetch(GradientStorage storage);
+    GradientVoxel getStoredGradient(int x, int y, int z) const;
+    GradientVoxel getQuantizedGradient(int x, int y, int z) const;
+    GradientVoxel getComputedGradient(int x, int y, int z) const;
+
 protected:
-    const glm::ivec3 m_dim;
-    const std::vector<GradientVoxel> m_data;
-    const float m_minMagnitude, m_maxMagnitude;
+    glm::ivec3 m_dim;
+    const GradientStorage m_storage { GradientStorage::Full };
+    const GradientFetch m_fetchGradient { &GradientVolume::getStoredGradient };
+    const GradientOperator m_gradientOperator { GradientOperator::CentralDifference };
+    const Volume* const m_pVolume { nullptr };
+    // Separable kernels of the gradient operator (see volume_filter.h), used to compute gradients on the fly.
+    const std::vector<float> m_derivativeKernel, m_smoothingKernel;
+    std::vector<GradientVoxel> m_data;
+    float m_quantizationStep { 1.0f };
+    std::vector<glm::i16vec3> m_quantizedData;
+    const std::shared_ptr<const void> m_pExternalStorage;
+    // The Full gradients that are read: either m_data or the external storage.
+    gsl::span<const GradientVoxel> m_gradients;
+    float m_minMagnitude, m_maxMagnitude;
+    memory::TrackedMemory m_memory;
 };
 }
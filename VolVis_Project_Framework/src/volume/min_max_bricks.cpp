@@ -0,0 +1,126 @@
+#include "min_max_bricks.h"
+#include <algorithm>
+#include <cassert>
+#include <glm/common.hpp>
+#include <glm/vector_relational.hpp>
+#include <limits>
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+#include <utility>
+
+// Number of voxels that interpolation may read outside of the range of sample positions (cubic interpolation
+// reads from floor(coord) - 1 up to floor(coord) + 2).
+static constexpr int interpolationApron = 1;
+// Samples close to the border of the volume evaluate to 0 (see Volume::getSampleTriLinearInterpolation).
+static constexpr int borderMargin = 5;
+
+static volume::BrickRange computeBrickRange(gsl::span<const uint16_t> data, const glm::ivec3& volumeDims, const glm::ivec3& brick, int brickSize);
+
+namespace volume {
+
+MinMaxBricks::MinMaxBricks(gsl::span<const uint16_t> data, const glm::ivec3& volumeDims, int brickSize)
+    : m_brickSize(brickSize)
+    , m_dims((volumeDims + brickSize - 1) / brickSize)
+    , m_ranges(size_t(m_dims.x) * size_t(m_dims.y) * size_t(m_dims.z))
+{
+    // Bricks are independent so compute them in parallel (one slice of bricks per task).
+    tbb::parallel_for(tbb::blocked_range<int>(0, m_dims.z), [&](const tbb::blocked_range<int>& range) {
+        for (int bz = range.begin(); bz != range.end(); bz++) {
+            for (int by = 0; by < m_dims.y; by++) {
+                for (int bx = 0; bx < m_dims.x; bx++)
+                    m_ranges[size_t(bx + m_dims.x * (by + m_dims.y * bz))] = computeBrickRange(data, volumeDims, glm::ivec3(bx, by, bz), brickSize);
+            }
+        }
+    });
+}
+
+MinMaxBricks::MinMaxBricks(int brickSize, const glm::ivec3& dims, std::vector<BrickRange> ranges)
+    : m_brickSize(brickSize)
+    , m_dims(dims)
+    , m_ranges(std::move(ranges))
+{
+    assert(m_ranges.size() == size_t(m_dims.x) * size_t(m_dims.y) * size_t(m_dims.z));
+}
+
+void MinMaxBricks::update(gsl::span<const uint16_t> data, const glm::ivec3& volumeDims, const glm::ivec3& lower, const glm::ivec3& upper)
+{
+    if (glm::any(glm::greaterThanEqual(lower, upper)))
+        return;
+
+    // Bricks read the voxels up to interpolationApron outside of their sample positions.
+    const glm::ivec3 lowerBrick = glm::max((lower - interpolationApron) / m_brickSize - 1, glm::ivec3(0));
+    const glm::ivec3 upperBrick = glm::min((upper - 1 + interpolationApron) / m_brickSize, m_dims - 1);
+    for (int bz = lowerBrick.z; bz <= upperBrick.z; bz++) {
+        for (int by = lowerBrick.y; by <= upperBrick.y; by++) {
+            for (int bx = lowerBrick.x; bx <= upperBrick.x; bx++)
+                m_ranges[size_t(bx + m_dims.x * (by + m_dims.y * bz))] = computeBrickRange(data, volumeDims, glm::ivec3(bx, by, bz), m_brickSize);
+        }
+    }
+}
+
+void MinMaxBricks::grow(gsl::span<const uint16_t> data, const glm::ivec3& volumeDims, int oldDepth)
+{
+    // Bricks are stored slice after slice so existing bricks keep their index.
+    m_dims = (volumeDims + m_brickSize - 1) / m_brickSize;
+    m_ranges.resize(size_t(m_dims.x) * size_t(m_dims.y) * size_t(m_dims.z));
+    // Bricks near the previous last slice were clamped to it and included its border margin.
+    update(data, volumeDims, glm::ivec3(0, 0, std::max(oldDepth - borderMargin, 0)), volumeDims);
+}
+
+int MinMaxBricks::brickSize() const
+{
+    return m_brickSize;
+}
+
+glm::ivec3 MinMaxBricks::dims() const
+{
+    return m_dims;
+}
+
+// Returns the brick that contains the given sample position (clamped to the grid).
+glm::ivec3 MinMaxBricks::brickOf(const glm::vec3& coord) const
+{
+    return glm::clamp(glm::ivec3(coord) / m_brickSize, glm::ivec3(0), m_dims - 1);
+}
+
+BrickRange MinMaxBricks::getRange(const glm::ivec3& brick) const
+{
+    return m_ranges[size_t(brick.x + m_dims.x * (brick.y + m_dims.y * brick.z))];
+}
+
+BrickRange MinMaxBricks::getRange(size_t brickIndex) const
+{
+    return m_ranges[brickIndex];
+}
+
+gsl::span<const BrickRange> MinMaxBricks::ranges() const
+{
+    return m_ranges;
+}
+
+}
+
+static volume::BrickRange computeBrickRange(gsl::span<const uint16_t> data, const glm::ivec3& volumeDims, const glm::ivec3& brick, int brickSize)
+{
+    const glm::ivec3 lower = glm::max(brick * brickSize - interpolationApron, glm::ivec3(0));
+    const glm::ivec3 upper = glm::min((brick + 1) * brickSize + interpolationApron, volumeDims - 1);
+
+    float minimum = std::numeric_limits<float>::max();
+    float maximum = std::numeric_limits<float>::lowest();
+    for (int z = lower.z; z <= upper.z; z++) {
+        for (int y = lower.y; y <= upper.y; y++) {
+            const size_t rowStart = size_t(lower.x + volumeDims.x * (y + volumeDims.y * z));
+            const auto [rowMin, rowMax] = std::minmax_element(&data[rowStart], &data[rowStart] + (upper.x - lower.x + 1));
+            minimum = std::min(minimum, float(*rowMin));
+            maximum = std::max(maximum, float(*rowMax));
+        }
+    }
+
+    // Samples near the border of the volume may evaluate to 0 regardless of the voxel values.
+    const glm::ivec3 sampleLower = brick * brickSize;
+    const glm::ivec3 sampleUpper = (brick + 1) * brickSize;
+    if (glm::any(glm::lessThan(sampleLower, glm::ivec3(borderMargin))) || glm::any(glm::greaterThan(sampleUpper, volumeDims - borderMargin)))
+        minimum = std::min(minimum, 0.0f);
+
+    return volume::BrickRange { minimum, maximum };
+}
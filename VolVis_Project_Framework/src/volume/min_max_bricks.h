@@ -0,0 +1,43 @@
+#pragma once
+#include <glm/vec3.hpp>
+#include <gsl/span>
+#include <vector>
+
+namespace volume {
+
+struct BrickRange {
+    float minimum, maximum;
+};
+
+// Coarse grid over the volume that stores the range of voxel values in each brick of brickSize^3 voxels. The
+// renderer uses it to skip bricks that cannot contribute to the image (empty space skipping).
+//
+// A brick covers the sample positions [brick * brickSize, (brick + 1) * brickSize) and its range includes all
+// voxels that any of the interpolation modes may read when sampling inside the brick.
+class MinMaxBricks {
+public:
+    MinMaxBricks() = default;
+    MinMaxBricks(gsl::span<const uint16_t> data, const glm::ivec3& volumeDims, int brickSize = 8);
+    // Use ranges that were computed before (e.g. by another process).
+    MinMaxBricks(int brickSize, const glm::ivec3& dims, std::vector<BrickRange> ranges);
+
+    // Recompute the bricks that read any of the voxels in [lower, upper) after those voxels changed.
+    void update(gsl::span<const uint16_t> data, const glm::ivec3& volumeDims, const glm::ivec3& lower, const glm::ivec3& upper);
+    // Add the bricks of slices that were appended to the volume (which had oldDepth slices before).
+    void grow(gsl::span<const uint16_t> data, const glm::ivec3& volumeDims, int oldDepth);
+
+    int brickSize() const;
+    glm::ivec3 dims() const;
+
+    glm::ivec3 brickOf(const glm::vec3& coord) const;
+    BrickRange getRange(const glm::ivec3& brick) const;
+    BrickRange getRange(size_t brickIndex) const;
+    gsl::span<const BrickRange> ranges() const;
+
+private:
+    int m_brickSize { 1 };
+    glm::ivec3 m_dims { 0 };
+    std::vector<BrickRange> m_ranges;
+};
+
+}
@@ -0,0 +1,228 @@
+#include "slice_stream.h"
+#include "volume.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <glm/vector_relational.hpp>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <utility>
+#ifdef _WIN32
+#include <fstream>
+#else
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+// How long to wait for the writer before checking whether the stream was closed.
+static constexpr auto pollInterval = std::chrono::milliseconds(20);
+// Field headers are a few lines of text, anything longer is not a field file.
+static constexpr size_t maxHeaderSize = 64 * 1024;
+
+enum class ReadStatus {
+    Data,
+    Waiting, // Nothing arrived within the poll interval.
+    EndOfFile, // The end of a regular file, or the writer of the pipe closed it.
+    Error
+};
+
+// A file that is still being written, or a named pipe. Opening and reading never block for longer than the poll
+// interval. Named pipes are opened without waiting for a writer (Windows has no named pipes in the file system).
+class GrowingFile {
+public:
+    GrowingFile(const std::filesystem::path& filePath)
+#ifdef _WIN32
+        : m_file(filePath, std::ios::binary)
+#else
+        : m_fd(::open(filePath.c_str(), O_RDONLY | O_NONBLOCK))
+#endif
+    {
+    }
+    GrowingFile(const GrowingFile&) = delete;
+    ~GrowingFile()
+    {
+#ifndef _WIN32
+        if (m_fd >= 0)
+            ::close(m_fd);
+#endif
+    }
+
+    GrowingFile& operator=(const GrowingFile&) = delete;
+
+    bool isOpen() const
+    {
+#ifdef _WIN32
+        return m_file.is_open();
+#else
+        return m_fd >= 0;
+#endif
+    }
+
+    // Read at most size bytes of what is available.
+    ReadStatus read(char* pBuffer, size_t size, size_t& bytesRead)
+    {
+        bytesRead = 0;
+#ifdef _WIN32
+        m_file.read(pBuffer, std::streamsize(size));
+        bytesRead = size_t(m_file.gcount());
+        if (m_file.bad())
+            return ReadStatus::Error;
+        m_file.clear();
+        return bytesRead > 0 ? ReadStatus::Data : ReadStatus::EndOfFile;
+#else
+        // Pipes without a writer (yet) are not readable, so this also waits for a writer to connect.
+        pollfd pollFd { m_fd, POLLIN, 0 };
+        if (::poll(&pollFd, 1, int(pollInterval.count())) <= 0)
+            return ReadStatus::Waiting;
+        const ssize_t result = ::read(m_fd, pBuffer, size);
+        if (result > 0) {
+            bytesRead = size_t(result);
+            return ReadStatus::Data;
+        }
+        if (result == 0)
+            return ReadStatus::EndOfFile;
+        return errno == EAGAIN || errno == EINTR ? ReadStatus::Waiting : ReadStatus::Error;
+#endif
+    }
+
+private:
+#ifdef _WIN32
+    std::ifstream m_file;
+#else
+    int m_fd;
+#endif
+};
+
+namespace volume {
+
+SliceStream::SliceStream(const std::filesystem::path& filePath, bool follow)
+    : m_follow(follow)
+    , m_thread([this, filePath]() { readSlices(filePath); })
+{
+}
+
+SliceStream::~SliceStream()
+{
+    // The reader checks the flag at least every poll interval.
+    m_stop = true;
+    m_thread.join();
+}
+
+std::optional<glm::ivec3> SliceStream::dims() const
+{
+    std::scoped_lock lock { m_mutex };
+    return m_optDims;
+}
+
+glm::vec3 SliceStream::spacing() const
+{
+    std::scoped_lock lock { m_mutex };
+    return m_spacing;
+}
+
+ValueMapping SliceStream::valueMapping() const
+{
+    std::scoped_lock lock { m_mutex };
+    return m_valueMapping;
+}
+
+std::vector<uint16_t> SliceStream::takeSlices()
+{
+    std::scoped_lock lock { m_mutex };
+    return std::exchange(m_slices, {});
+}
+
+bool SliceStream::isFinished() const
+{
+    return m_finished;
+}
+
+void SliceStream::readSlices(const std::filesystem::path& filePath)
+{
+    GrowingFile file { filePath };
+    if (!file.isOpen()) {
+        std::cerr << "Could not open slice stream " << filePath << std::endl;
+        m_finished = true;
+        return;
+    }
+
+    // Wait for the complete header (up to and including the two '\f' characters after it). Whatever was read past
+    // it belongs to the first slice.
+    std::string received;
+    std::vector<char> chunk(4096);
+    size_t headerEnd;
+    while ((headerEnd = received.find("\f\f")) == std::string::npos) {
+        size_t bytesRead;
+        const ReadStatus status = file.read(chunk.data(), chunk.size(), bytesRead);
+        if (m_stop || status == ReadStatus::Error || (status == ReadStatus::EndOfFile && !m_follow) || received.size() > maxHeaderSize) {
+            if (!m_stop)
+                std::cerr << "Incomplete header in slice stream " << filePath << std::endl;
+            m_finished = true;
+            return;
+        }
+        if (status == ReadStatus::EndOfFile)
+            std::this_thread::sleep_for(pollInterval);
+        received.append(chunk.data(), bytesRead);
+    }
+    std::istringstream headerStream { received.substr(0, headerEnd) };
+    const FieldHeader header = readFieldHeader(headerStream);
+    if (glm::any(glm::lessThanEqual(header.dim, glm::ivec3(0))) || !header.optVoxelType) {
+        std::cerr << "Invalid header in slice stream " << filePath << std::endl;
+        m_finished = true;
+        return;
+    }
+    if (header.channelCount != 1) {
+        std::cerr << "Slice stream " << filePath << " has multiple channels, only scalar streams are supported" << std::endl;
+        m_finished = true;
+        return;
+    }
+    // The range of the voxels is not known until all slices arrived.
+    const ValueMapping valueMapping = defaultValueMapping(*header.optVoxelType);
+    {
+        std::scoped_lock lock { m_mutex };
+        m_optDims = header.dim;
+        m_spacing = header.spacing;
+        m_valueMapping = valueMapping;
+    }
+
+    const size_t sliceSize = size_t(header.dim.x) * size_t(header.dim.y);
+    std::vector<char> buffer(sliceSize * voxelTypeSize(*header.optVoxelType));
+    std::vector<uint16_t> slice(sliceSize);
+    size_t bufferSize = 0;
+    size_t receivedOffset = headerEnd + 2;
+    for (int z = 0; z < header.dim.z && !m_stop;) {
+        size_t bytesRead;
+        ReadStatus status = ReadStatus::Data;
+        if (receivedOffset < received.size()) {
+            bytesRead = std::min(received.size() - receivedOffset, buffer.size() - bufferSize);
+            std::memcpy(buffer.data() + bufferSize, received.data() + receivedOffset, bytesRead);
+            receivedOffset += bytesRead;
+        } else {
+            status = file.read(buffer.data() + bufferSize, buffer.size() - bufferSize, bytesRead);
+        }
+        if (status == ReadStatus::Error || (status == ReadStatus::EndOfFile && !m_follow))
+            break;
+        if (status == ReadStatus::EndOfFile) {
+            // Reached the end of what was written so far: wait for the writer to append more.
+            std::this_thread::sleep_for(pollInterval);
+            continue;
+        }
+
+        bufferSize += bytesRead;
+        if (bufferSize < buffer.size())
+            continue;
+        decodeVoxels(buffer, valueMapping, slice);
+        {
+            std::scoped_lock lock { m_mutex };
+            m_slices.insert(std::end(m_slices), std::begin(slice), std::end(slice));
+        }
+        bufferSize = 0;
+        z++;
+    }
+    m_finished = true;
+}
+
+}
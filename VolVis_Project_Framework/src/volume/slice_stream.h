@@ -0,0 +1,54 @@
+#pragma once
+#include "volume/volume.h"
+#include <atomic>
+#include <filesystem>
+#include <glm/vec3.hpp>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+// Reads the slices of an AVS field file (.fld) while it is being written, e.g. by a scanner during acquisition. The
+// file may also be a named pipe. dim3 of the header is the number of slices that the acquisition will produce and
+// slices are appended one after another. Reading happens on a background thread such that the viewer never waits for
+// the writer, and the thread never blocks for long (not even on a pipe without writer) such that closing the stream
+// does not wait for the writer either.
+namespace volume {
+
+class SliceStream {
+public:
+    // Reading stops at the end of the file (or when the writer closes the pipe) unless follow is set, in which case
+    // the stream waits for the writer to append more until all slices arrived.
+    SliceStream(const std::filesystem::path& filePath, bool follow = false);
+    SliceStream(const SliceStream&) = delete;
+    ~SliceStream();
+
+    SliceStream& operator=(const SliceStream&) = delete;
+
+    // Dimensions of the complete volume, empty until the header was read.
+    std::optional<glm::ivec3> dims() const;
+    // Voxel spacing from the header (see FieldHeader), valid once dims() is.
+    glm::vec3 spacing() const;
+    // Mapping of the voxel type of the stream (see defaultValueMapping), valid once dims() is.
+    ValueMapping valueMapping() const;
+    // Slices that arrived since the previous call (dims().x * dims().y voxels each).
+    std::vector<uint16_t> takeSlices();
+    // True once all slices were read (or reading failed).
+    bool isFinished() const;
+
+private:
+    void readSlices(const std::filesystem::path& filePath);
+
+private:
+    mutable std::mutex m_mutex;
+    std::optional<glm::ivec3> m_optDims;
+    glm::vec3 m_spacing { 1.0f };
+    ValueMapping m_valueMapping;
+    std::vector<uint16_t> m_slices;
+    bool m_follow;
+    std::atomic_bool m_stop { false };
+    std::atomic_bool m_finished { false };
+    std::thread m_thread;
+};
+
+}
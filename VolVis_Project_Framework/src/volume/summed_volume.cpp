@@ -0,0 +1,175 @@
+#include "summed_volume.h"
+#include <algorithm>
+#include <cmath>
+#include <glm/common.hpp>
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+
+template <typename T>
+static void computePrefixSums(std::vector<T>& table, const glm::ivec3& tableDim, size_t channels);
+template <typename T>
+static T sumBox(const std::vector<T>& table, const glm::ivec3& tableDim, size_t channels, size_t channel, const glm::ivec3& lower, const glm::ivec3& upper);
+static size_t tableSize(const glm::ivec3& tableDim);
+
+namespace volume {
+
+SummedVolumeTable::SummedVolumeTable(const Volume& volume)
+    : m_dim(volume.dims())
+    , m_sums(tableSize(m_dim + 1))
+    , m_squaredSums(tableSize(m_dim + 1))
+    , m_memory("Summed volume table", 2 * m_sums.size() * sizeof(uint64_t))
+{
+    // Copy the voxels into the table (behind the planes of zeros), one slice per task.
+    const glm::ivec3 tableDim = m_dim + 1;
+    const auto voxels = volume.data();
+    tbb::parallel_for(tbb::blocked_range<int>(0, m_dim.z), [&](const tbb::blocked_range<int>& range) {
+        for (int z = range.begin(); z != range.end(); z++) {
+            for (int y = 0; y < m_dim.y; y++) {
+                const size_t voxelRow = size_t(m_dim.x) * (size_t(y) + size_t(m_dim.y) * size_t(z));
+                const size_t tableRow = 1 + size_t(tableDim.x) * (size_t(y + 1) + size_t(tableDim.y) * size_t(z + 1));
+                for (int x = 0; x < m_dim.x; x++) {
+                    const uint64_t voxel = voxels[voxelRow + size_t(x)];
+                    m_sums[tableRow + size_t(x)] = voxel;
+                    m_squaredSums[tableRow + size_t(x)] = voxel * voxel;
+                }
+            }
+        }
+    });
+    computePrefixSums(m_sums, tableDim, 1);
+    computePrefixSums(m_squaredSums, tableDim, 1);
+}
+
+RegionStatistics SummedVolumeTable::statistics(const glm::ivec3& lower, const glm::ivec3& upper) const
+{
+    const glm::ivec3 clampedLower = glm::clamp(lower, glm::ivec3(0), m_dim);
+    const glm::ivec3 clampedUpper = glm::clamp(upper, clampedLower, m_dim);
+    const glm::ivec3 extent = clampedUpper - clampedLower;
+    const size_t count = size_t(extent.x) * size_t(extent.y) * size_t(extent.z);
+    if (count == 0)
+        return { 0, 0.0, 0.0 };
+
+    const double sum = double(sumBox(m_sums, m_dim + 1, 1, 0, clampedLower, clampedUpper));
+    const double squaredSum = double(sumBox(m_squaredSums, m_dim + 1, 1, 0, clampedLower, clampedUpper));
+    const double mean = sum / double(count);
+    return { count, mean, std::max(squaredSum / double(count) - mean * mean, 0.0) };
+}
+
+IntegralHistogram::IntegralHistogram(const Volume& volume, int binCount, int cellSize)
+    : m_dim(volume.dims())
+    , m_binCount(binCount)
+    , m_binWidth(std::max((int(volume.maximum()) + binCount) / binCount, 1))
+    , m_cellSize(cellSize)
+    , m_cellDim((m_dim + cellSize - 1) / cellSize)
+    , m_counts(tableSize(m_cellDim + 1) * size_t(binCount))
+    , m_memory("Integral histogram", m_counts.size() * sizeof(uint32_t))
+{
+    // Histogram of every cell, one slice of cells per task.
+    const glm::ivec3 tableDim = m_cellDim + 1;
+    const auto voxels = volume.data();
+    tbb::parallel_for(tbb::blocked_range<int>(0, m_cellDim.z), [&](const tbb::blocked_range<int>& range) {
+        for (int z = range.begin() * m_cellSize; z < std::min(range.end() * m_cellSize, m_dim.z); z++) {
+            for (int y = 0; y < m_dim.y; y++) {
+                const size_t voxelRow = size_t(m_dim.x) * (size_t(y) + size_t(m_dim.y) * size_t(z));
+                const size_t tableRow = size_t(tableDim.x) * (size_t(y / m_cellSize + 1) + size_t(tableDim.y) * size_t(z / m_cellSize + 1));
+                for (int x = 0; x < m_dim.x; x++) {
+                    const size_t bin = std::min(size_t(voxels[voxelRow + size_t(x)] / m_binWidth), size_t(m_binCount - 1));
+                    m_counts[(tableRow + size_t(x / m_cellSize + 1)) * size_t(m_binCount) + bin]++;
+                }
+            }
+        }
+    });
+    computePrefixSums(m_counts, tableDim, size_t(m_binCount));
+}
+
+int IntegralHistogram::binCount() const
+{
+    return m_binCount;
+}
+
+int IntegralHistogram::binWidth() const
+{
+    return m_binWidth;
+}
+
+int IntegralHistogram::cellSize() const
+{
+    return m_cellSize;
+}
+
+std::vector<uint32_t> IntegralHistogram::histogram(const glm::ivec3& lower, const glm::ivec3& upper) const
+{
+    // Round outwards to whole cells.
+    const glm::ivec3 lowerCell = glm::clamp(lower, glm::ivec3(0), m_dim) / m_cellSize;
+    const glm::ivec3 upperCell = glm::max((glm::clamp(upper, glm::ivec3(0), m_dim) + m_cellSize - 1) / m_cellSize, lowerCell);
+
+    std::vector<uint32_t> out(static_cast<size_t>(m_binCount));
+    for (size_t bin = 0; bin < out.size(); bin++)
+        out[bin] = sumBox(m_counts, m_cellDim + 1, size_t(m_binCount), bin, lowerCell, upperCell);
+    return out;
+}
+
+size_t IntegralHistogram::countAbove(const glm::ivec3& lower, const glm::ivec3& upper, float threshold) const
+{
+    const int firstBin = int(std::ceil(std::max(threshold, 0.0f))) / m_binWidth;
+    const auto bins = histogram(lower, upper);
+    size_t out = 0;
+    for (int bin = firstBin; bin < m_binCount; bin++)
+        out += bins[size_t(bin)];
+    return out;
+}
+
+}
+
+static size_t tableSize(const glm::ivec3& tableDim)
+{
+    return size_t(tableDim.x) * size_t(tableDim.y) * size_t(tableDim.z);
+}
+
+// In-place inclusive prefix sums along the three axes. Every entry of the table holds the given number of channels.
+// Each pass adds whole rows (or slices) to their successor such that the inner loops are contiguous.
+template <typename T>
+static void computePrefixSums(std::vector<T>& table, const glm::ivec3& tableDim, size_t channels)
+{
+    const size_t rowSize = size_t(tableDim.x) * channels;
+    const size_t sliceSize = rowSize * size_t(tableDim.y);
+
+    // Along x: all rows are independent.
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, size_t(tableDim.y) * size_t(tableDim.z)), [&](const tbb::blocked_range<size_t>& range) {
+        for (size_t row = range.begin(); row != range.end(); row++) {
+            T* pRow = &table[row * rowSize];
+            for (size_t i = channels; i < rowSize; i++)
+                pRow[i] += pRow[i - channels];
+        }
+    });
+    // Along y: all slices are independent.
+    tbb::parallel_for(tbb::blocked_range<int>(0, tableDim.z), [&](const tbb::blocked_range<int>& range) {
+        for (int z = range.begin(); z != range.end(); z++) {
+            T* pSlice = &table[size_t(z) * sliceSize];
+            for (size_t i = rowSize; i < sliceSize; i++)
+                pSlice[i] += pSlice[i - rowSize];
+        }
+    });
+    // Along z: all rows within a slice are independent.
+    tbb::parallel_for(tbb::blocked_range<int>(0, tableDim.y), [&](const tbb::blocked_range<int>& range) {
+        for (int z = 1; z < tableDim.z; z++) {
+            for (int y = range.begin(); y != range.end(); y++) {
+                T* pRow = &table[size_t(z) * sliceSize + size_t(y) * rowSize];
+                const T* pPrevRow = pRow - sliceSize;
+                for (size_t i = 0; i < rowSize; i++)
+                    pRow[i] += pPrevRow[i];
+            }
+        }
+    });
+}
+
+// Sum over the entries in [lower, upper) by inclusion-exclusion of the eight corners. Unsigned wrap-around of the
+// intermediate results cancels out.
+template <typename T>
+static T sumBox(const std::vector<T>& table, const glm::ivec3& tableDim, size_t channels, size_t channel, const glm::ivec3& lower, const glm::ivec3& upper)
+{
+    const auto at = [&](int x, int y, int z) {
+        return table[(size_t(x) + size_t(tableDim.x) * (size_t(y) + size_t(tableDim.y) * size_t(z))) * channels + channel];
+    };
+    return T(at(upper.x, upper.y, upper.z) - at(lower.x, upper.y, upper.z) - at(upper.x, lower.y, upper.z) - at(upper.x, upper.y, lower.z)
+        + at(lower.x, lower.y, upper.z) + at(lower.x, upper.y, lower.z) + at(upper.x, lower.y, lower.z) - at(lower.x, lower.y, lower.z));
+}
@@ -0,0 +1,63 @@
+#pragma once
+#include "memory/memory_registry.h"
+#include "volume/volume.h"
+#include <cstdint>
+#include <glm/vec3.hpp>
+#include <vector>
+
+// Indices that answer statistics queries over axis-aligned boxes of a volume in constant time (or linear in the
+// number of histogram bins) instead of visiting all voxels. Both are optional: build them when they are needed.
+//
+// Boxes are given in voxel coordinates as [lower, upper) and are clamped to the volume.
+namespace volume {
+
+struct RegionStatistics {
+    size_t count;
+    double mean;
+    double variance;
+};
+
+// Summed-volume table (3D summed-area table) of the voxel values and of their squares.
+class SummedVolumeTable {
+public:
+    SummedVolumeTable(const Volume& volume);
+
+    RegionStatistics statistics(const glm::ivec3& lower, const glm::ivec3& upper) const;
+
+private:
+    glm::ivec3 m_dim;
+    // Sums of all voxels in [0, corner), with a leading plane of zeros along every axis (dimensions m_dim + 1).
+    // The sums are exact for volumes with up to 2^32 voxels.
+    std::vector<uint64_t> m_sums, m_squaredSums;
+
+    memory::TrackedMemory m_memory;
+};
+
+// Integral histogram: a summed-volume table of per-bin voxel counts. The bins evenly divide the values from 0 up to
+// and including the maximum of the volume, each bin covers binWidth() integer values.
+//
+// To limit the memory use the table has one entry per cell of cellSize^3 voxels. Queries are rounded outwards to
+// cells, so they are exact for boxes that are aligned to cells and conservative (a superset) otherwise.
+class IntegralHistogram {
+public:
+    IntegralHistogram(const Volume& volume, int binCount = 32, int cellSize = 4);
+
+    int binCount() const;
+    int binWidth() const;
+    int cellSize() const;
+
+    std::vector<uint32_t> histogram(const glm::ivec3& lower, const glm::ivec3& upper) const;
+    // Number of voxels in bins that contain values of at least the threshold (exact if the threshold is a multiple of binWidth()).
+    size_t countAbove(const glm::ivec3& lower, const glm::ivec3& upper, float threshold) const;
+
+private:
+    glm::ivec3 m_dim;
+    int m_binCount, m_binWidth, m_cellSize;
+    glm::ivec3 m_cellDim;
+    // binCount counts per corner of the cell grid (dimensions m_cellDim + 1).
+    std::vector<uint32_t> m_counts;
+
+    memory::TrackedMemory m_memory;
+};
+
+}
@@ -1,6 +1,8 @@
 #include "volume.h"
+#include "chunked_volume.h"
 #include <algorithm>
 #include <array>
+#include <bit>
 #include <cassert>
 #include <cctype> // isspace
 #include <chrono>
@@ -9,17 +11,27 @@
 #include <glm/glm.hpp>
 #include <gsl/span>
 #include <iostream>
+#include <limits>
+#include <optional>
+#include <sstream>
 #include <string>
+#include <type_traits>
 #include <math.h> 
 
-struct Header {
-    glm::ivec3 dim;
-    size_t elementSize;
-};
-static Header readHeader(std::ifstream& ifs);
 static float computeMinimum(gsl::span<const uint16_t> data);
 static float computeMaximum(gsl::span<const uint16_t> data);
 static std::vector<int> computeHistogram(gsl::span<const uint16_t> data);
+static glm::vec3 normalizeSpacing(const glm::vec3& spacing);
+template <typename T>
+static T readLittleEndian(const char* pBytes);
+template <typename T>
+static volume::ValueMapping computeValueMapping(gsl::span<const char> bytes, volume::VoxelType type);
+template <typename T>
+static void decodeTypedVoxels(gsl::span<const char> bytes, const volume::ValueMapping& mapping, gsl::span<uint16_t> out);
+template <typename T>
+static void writeLittleEndian(T value, char* pBytes);
+template <typename T>
+static void encodeTypedVoxels(gsl::span<const uint16_t> voxels, const volume::ValueMapping& mapping, gsl::span<char> out);
 
 namespace volume {
 
@@ -36,18 +48,70 @@ Volume::Volume(const std::filesystem::path& file)
         m_minimum = computeMinimum(m_data);
         m_maximum = computeMaximum(m_data);
         m_histogram = computeHistogram(m_data);
+        m_minMaxBricks = MinMaxBricks(m_data, m_dim);
     }
+    m_voxels = m_data;
+    trackMemory();
 }
 
-Volume::Volume(std::vector<uint16_t> data, const glm::ivec3& dim)
+Volume::Volume(std::vector<uint16_t> data, const glm::ivec3& dim, const glm::vec3& spacing, const ValueMapping& valueMapping)
     : m_fileName()
-    , m_elementSize(2)
     , m_dim(dim)
+    , m_spacing(normalizeSpacing(spacing))
+    , m_valueMapping(valueMapping)
     , m_data(std::move(data))
     , m_minimum(computeMinimum(m_data))
     , m_maximum(computeMaximum(m_data))
     , m_histogram(computeHistogram(m_data))
+    , m_minMaxBricks(m_data, m_dim)
 {
+    m_voxels = m_data;
+    trackMemory();
+}
+
+Volume::Volume(std::shared_ptr<const void> pStorage, gsl::span<const uint16_t> data, const glm::ivec3& dim, std::string_view fileName,
+    float minimum, float maximum, std::vector<int> histogram, MinMaxBricks minMaxBricks, const glm::vec3& spacing, const ValueMapping& valueMapping)
+    : m_fileName(fileName)
+    , m_dim(dim)
+    , m_spacing(normalizeSpacing(spacing))
+    , m_valueMapping(valueMapping)
+    , m_pExternalStorage(std::move(pStorage))
+    , m_voxels(data)
+    , m_minimum(minimum)
+    , m_maximum(maximum)
+    , m_histogram(std::move(histogram))
+    , m_minMaxBricks(std::move(minMaxBricks))
+{
+    assert(m_voxels.size() == size_t(m_dim.x) * size_t(m_dim.y) * size_t(m_dim.z));
+    trackMemory();
+}
+
+bool isEmpty(const DirtyRegion& region)
+{
+    return glm::any(glm::greaterThanEqual(region.lower, region.upper));
+}
+
+DirtyRegion expandRegion(const DirtyRegion& region, int margin, const glm::ivec3& dims)
+{
+    if (isEmpty(region))
+        return region;
+    return { glm::max(region.lower - margin, glm::ivec3(0)), glm::min(region.upper + margin, dims) };
+}
+
+// Bounding box of the voxels inside the brush.
+DirtyRegion brushRegion(const Brush& brush, const glm::ivec3& dims)
+{
+    const glm::ivec3 lower = glm::ivec3(glm::ceil(brush.center - brush.radius));
+    const glm::ivec3 upper = glm::ivec3(glm::floor(brush.center + brush.radius)) + 1;
+    return { glm::clamp(lower, glm::ivec3(0), dims), glm::clamp(upper, glm::ivec3(0), dims) };
+}
+
+// External voxels are accounted by their owner (e.g. ipc::SharedMemory).
+void Volume::trackMemory()
+{
+    m_voxelMemory = memory::TrackedMemory("Volume voxels", m_data.size() * sizeof(uint16_t));
+    m_channelMemory = memory::TrackedMemory("Volume channels", m_channels.size() * sizeof(glm::u16vec4));
+    m_metadataMemory = memory::TrackedMemory("Histogram + min-max bricks", m_histogram.size() * sizeof(int) + m_minMaxBricks.ranges().size_bytes());
 }
 
 float Volume::minimum() const
@@ -65,23 +129,183 @@ std::vector<int> Volume::histogram() const
     return m_histogram;
 }
 
+void Volume::setBrickSize(int brickSize)
+{
+    if (brickSize == m_minMaxBricks.brickSize() || m_dim == glm::ivec3(0))
+        return;
+    m_minMaxBricks = MinMaxBricks(data(), m_dim, brickSize);
+    trackMemory();
+}
+
+const MinMaxBricks& Volume::minMaxBricks() const
+{
+    return m_minMaxBricks;
+}
+
 glm::ivec3 Volume::dims() const
 {
     return m_dim;
 }
 
+glm::vec3 Volume::spacing() const
+{
+    return m_spacing;
+}
+
+glm::vec3 Volume::extent() const
+{
+    return glm::vec3(m_dim) * m_spacing;
+}
+
+const ValueMapping& Volume::valueMapping() const
+{
+    return m_valueMapping;
+}
+
 std::string_view Volume::fileName() const
 {
     return m_fileName;
 }
 
+gsl::span<const uint16_t> Volume::data() const
+{
+    return m_voxels;
+}
+
+int Volume::channelCount() const
+{
+    return m_channelCount;
+}
+
+gsl::span<const glm::u16vec4> Volume::channelData() const
+{
+    return m_channels;
+}
+
+DirtyRegion Volume::applyBrush(const Brush& brush)
+{
+    if (m_pExternalStorage) {
+        std::cerr << "Cannot edit volume " << m_fileName << " because it is owned by another process" << std::endl;
+        return {};
+    }
+    if (m_channelCount > 1) {
+        std::cerr << "Cannot edit volume " << m_fileName << " because it has multiple channels" << std::endl;
+        return {};
+    }
+
+    const DirtyRegion region = brushRegion(brush, m_dim);
+    for (int z = region.lower.z; z < region.upper.z; z++) {
+        for (int y = region.lower.y; y < region.upper.y; y++) {
+            for (int x = region.lower.x; x < region.upper.x; x++) {
+                const glm::vec3 offset = glm::vec3(x, y, z) - brush.center;
+                if (glm::dot(offset, offset) > brush.radius * brush.radius)
+                    continue;
+
+                uint16_t& voxel = m_data[size_t(x + m_dim.x * (y + m_dim.y * z))];
+                float value = brush.value;
+                if (brush.mode == BrushMode::Erase)
+                    value = m_minimum;
+                else if (brush.mode == BrushMode::Carve)
+                    value = float(voxel) - brush.value;
+
+                m_histogram[voxel]--;
+                voxel = uint16_t(std::round(std::clamp(value, m_minimum, m_maximum)));
+                m_histogram[voxel]++;
+            }
+        }
+    }
+    m_minMaxBricks.update(m_data, m_dim, region.lower, region.upper);
+    return region;
+}
+
+DirtyRegion Volume::appendSlices(gsl::span<const uint16_t> slices)
+{
+    if (m_pExternalStorage) {
+        std::cerr << "Cannot append to volume " << m_fileName << " because it is owned by another process" << std::endl;
+        return {};
+    }
+    if (m_channelCount > 1) {
+        std::cerr << "Cannot append to volume " << m_fileName << " because it has multiple channels" << std::endl;
+        return {};
+    }
+    const size_t sliceSize = size_t(m_dim.x) * size_t(m_dim.y);
+    if (slices.empty() || slices.size() % sliceSize != 0) {
+        std::cerr << "Cannot append " << slices.size() << " voxels to volume " << m_fileName << " with slices of " << sliceSize << " voxels" << std::endl;
+        return {};
+    }
+
+    const int oldDepth = m_dim.z;
+    m_data.insert(std::end(m_data), std::begin(slices), std::end(slices));
+    m_voxels = m_data;
+    m_dim.z += int(slices.size() / sliceSize);
+
+    m_minimum = std::min(m_minimum, computeMinimum(slices));
+    m_maximum = std::max(m_maximum, computeMaximum(slices));
+    m_histogram.resize(std::max(m_histogram.size(), size_t(m_maximum) + 1), 0);
+    for (const auto v : slices)
+        m_histogram[v]++;
+    m_minMaxBricks.grow(m_data, m_dim, oldDepth);
+    trackMemory();
+    return { glm::ivec3(0, 0, oldDepth), m_dim };
+}
+
 float Volume::getVoxel(int x, int y, int z) const
 {
     const size_t i = size_t(x + m_dim.x * (y + m_dim.y * z));
-    if (m_data.size() < i) {
+    if (m_voxels.size() < i) {
         throw std::exception();
     }
-    return static_cast<float>(m_data[i]);
+    return static_cast<float>(m_voxels[i]);
+}
+
+void Volume::sampleLine(const glm::vec3& begin, const glm::vec3& end, gsl::span<float> out) const
+{
+    const glm::vec3 increment = out.size() > 1 ? (end - begin) / float(out.size() - 1) : glm::vec3(0.0f);
+    if (interpolationMode != InterpolationMode::Linear || glm::any(glm::lessThan(m_dim, glm::ivec3(2)))) {
+        for (size_t i = 0; i < out.size(); i++)
+            out[i] = getSampleInterpolate(begin + float(i) * increment);
+        return;
+    }
+
+    // Samples are processed in blocks, stored as structure of arrays: first the weights and the index of the lower
+    // corner (vectorized), then the eight corner voxels are gathered, and finally they are blended (vectorized).
+    static constexpr size_t blockSize = 16;
+    const auto voxels = data();
+    const glm::vec3 maxLower = glm::vec3(m_dim - 2);
+    const size_t strideY = size_t(m_dim.x), strideZ = size_t(m_dim.x) * size_t(m_dim.y);
+    const std::array<size_t, 8> cornerOffsets { 0, 1, strideY, strideY + 1, strideZ, strideZ + 1, strideZ + strideY, strideZ + strideY + 1 };
+    for (size_t blockStart = 0; blockStart < out.size(); blockStart += blockSize) {
+        const size_t count = std::min(blockSize, out.size() - blockStart);
+        std::array<float, blockSize> fx, fy, fz, inside;
+        std::array<size_t, blockSize> lowerIndex;
+        for (size_t i = 0; i < count; i++) {
+            const glm::vec3 coord = begin + float(blockStart + i) * increment;
+            // Same border as getSampleTriLinearInterpolation.
+            inside[i] = glm::all(glm::greaterThanEqual(coord - 5.0f, glm::vec3(0))) && glm::all(glm::lessThan(coord + 5.0f, glm::vec3(m_dim))) ? 1.0f : 0.0f;
+            const glm::vec3 lower = glm::floor(glm::clamp(coord, glm::vec3(0.0f), maxLower));
+            const glm::vec3 factor = glm::clamp(coord - lower, 0.0f, 1.0f);
+            fx[i] = factor.x;
+            fy[i] = factor.y;
+            fz[i] = factor.z;
+            lowerIndex[i] = size_t(lower.x) + strideY * size_t(lower.y) + strideZ * size_t(lower.z);
+        }
+
+        std::array<std::array<float, blockSize>, 8> corners;
+        for (size_t corner = 0; corner < 8; corner++) {
+            for (size_t i = 0; i < count; i++)
+                corners[corner][i] = float(voxels[lowerIndex[i] + cornerOffsets[corner]]);
+        }
+
+        for (size_t i = 0; i < count; i++) {
+            const float c00 = corners[0][i] + (corners[1][i] - corners[0][i]) * fx[i];
+            const float c10 = corners[2][i] + (corners[3][i] - corners[2][i]) * fx[i];
+            const float c01 = corners[4][i] + (corners[5][i] - corners[4][i]) * fx[i];
+            const float c11 = corners[6][i] + (corners[7][i] - corners[6][i]) * fx[i];
+            const float c0 = c00 + (c10 - c00) * fy[i];
+            const float c1 = c01 + (c11 - c01) * fy[i];
+            out[blockStart + i] = inside[i] * (c0 + (c1 - c0) * fz[i]);
+        }
+    }
 }
 
 // This function returns a value based on the current interpolation mode
@@ -103,6 +327,44 @@ float Volume::getSampleInterpolate(const glm::vec3& coord) const
     }
 }
 
+glm::vec4 Volume::getChannelsInterpolate(const glm::vec3& coord) const
+{
+    if (m_channels.empty())
+        return glm::vec4(getSampleInterpolate(coord), 0.0f, 0.0f, 0.0f);
+    if (interpolationMode == InterpolationMode::NearestNeighbour || glm::any(glm::lessThan(m_dim, glm::ivec3(2))))
+        return getChannelsNearestNeighbourInterpolation(coord);
+    return getChannelsTriLinearInterpolation(coord);
+}
+
+glm::vec4 Volume::getChannelsNearestNeighbourInterpolation(const glm::vec3& coord) const
+{
+    if (glm::any(glm::lessThan(coord + 0.5f, glm::vec3(0))) || glm::any(glm::greaterThanEqual(coord + 0.5f, glm::vec3(m_dim))))
+        return glm::vec4(0.0f);
+
+    const glm::ivec3 voxel = glm::ivec3(coord + 0.5f);
+    return glm::vec4(m_channels[size_t(voxel.x) + size_t(m_dim.x) * (size_t(voxel.y) + size_t(m_dim.y) * size_t(voxel.z))]);
+}
+
+glm::vec4 Volume::getChannelsTriLinearInterpolation(const glm::vec3& coord) const
+{
+    if (glm::any(glm::lessThan(coord, glm::vec3(0))) || glm::any(glm::greaterThan(coord, glm::vec3(m_dim - 1))))
+        return glm::vec4(0.0f);
+
+    // Same blending order as sampleLine, with a vec4 of channels in place of a float.
+    const glm::vec3 lower = glm::min(glm::floor(coord), glm::vec3(m_dim - 2));
+    const glm::vec3 factor = coord - lower;
+    const size_t strideY = size_t(m_dim.x), strideZ = size_t(m_dim.x) * size_t(m_dim.y);
+    const glm::u16vec4* pLower = &m_channels[size_t(lower.x) + strideY * size_t(lower.y) + strideZ * size_t(lower.z)];
+    const auto lerpX = [&](size_t offset) {
+        const glm::vec4 c0 { pLower[offset] }, c1 { pLower[offset + 1] };
+        return c0 + (c1 - c0) * factor.x;
+    };
+    const glm::vec4 c00 = lerpX(0), c10 = lerpX(strideY), c01 = lerpX(strideZ), c11 = lerpX(strideZ + strideY);
+    const glm::vec4 c0 = c00 + (c10 - c00) * factor.y;
+    const glm::vec4 c1 = c01 + (c11 - c01) * factor.y;
+    return c0 + (c1 - c0) * factor.z;
+}
+
 // This function returns the nearest neighbour value at the continuous 3D position given by coord.
 // Notice that in this framework we assume that the distance between neighbouring voxels is 1 in all directions
 float Volume::getSampleNearestNeighbourInterpolation(const glm::vec3& coord) const
@@ -217,36 +479,165 @@ float Volume::getSampleTriCubicInterpolation(const glm::vec3& coord) const
 void Volume::loadFile(const std::filesystem::path& file)
 {
     assert(std::filesystem::exists(file));
+    if (file.extension() == ".cvol") {
+        // Chunks are decompressed in parallel.
+        ChunkedVolumeReader reader { file };
+        m_dim = glm::ivec3(0);
+        if (reader.isValid()) {
+            m_data = reader.readLevel(0);
+            if (!m_data.empty()) {
+                m_dim = reader.dims(0);
+                m_spacing = normalizeSpacing(reader.spacing());
+                m_valueMapping = reader.valueMapping();
+            }
+        }
+        return;
+    }
+
     std::ifstream ifs(file, std::ios::binary);
     assert(ifs.is_open());
 
-    const auto header = readHeader(ifs);
+    const auto header = readFieldHeader(ifs);
+    if (!header.optVoxelType) {
+        m_dim = glm::ivec3(0);
+        return;
+    }
     m_dim = header.dim;
-    m_elementSize = header.elementSize;
+    m_spacing = normalizeSpacing(header.spacing);
 
     const size_t voxelCount = static_cast<size_t>(header.dim.x * header.dim.y * header.dim.z);
-    const size_t byteCount = voxelCount * header.elementSize;
+    const size_t valueCount = voxelCount * size_t(header.channelCount);
+    const size_t byteCount = valueCount * voxelTypeSize(*header.optVoxelType);
     std::vector<char> buffer(byteCount);
     // Data section is separated from header by two /f characters.
     ifs.seekg(2, std::ios::cur);
     ifs.read(buffer.data(), std::streamsize(byteCount));
 
+    // All channels share one mapping such that they can be compared (and share a transfer function range).
+    m_valueMapping = chooseValueMapping(buffer, *header.optVoxelType);
+    if (header.channelCount == 1) {
+        m_data.resize(voxelCount);
+        decodeVoxels(buffer, m_valueMapping, m_data);
+        return;
+    }
+
+    std::vector<uint16_t> values(valueCount);
+    decodeVoxels(buffer, m_valueMapping, values);
+    m_channelCount = header.channelCount;
+    m_channels.resize(voxelCount, glm::u16vec4(0));
     m_data.resize(voxelCount);
-    if (header.elementSize == 1) { // Bytes.
-        for (size_t i = 0; i < byteCount; i++) {
-            m_data[i] = static_cast<uint16_t>(buffer[i] & 0xFF);
-        }
-    } else if (header.elementSize == 2) { // uint16_ts.
-        for (size_t i = 0; i < byteCount; i += 2) {
-            m_data[i / 2] = static_cast<uint16_t>((buffer[i] & 0xFF) + (buffer[i + 1] & 0xFF) * 256);
+    for (size_t i = 0; i < voxelCount; i++) {
+        uint16_t maximum = 0;
+        for (int channel = 0; channel < m_channelCount; channel++) {
+            const uint16_t value = values[i * size_t(m_channelCount) + size_t(channel)];
+            m_channels[i][channel] = value;
+            maximum = std::max(maximum, value);
         }
+        m_data[i] = maximum;
     }
 }
+
+size_t voxelTypeSize(VoxelType type)
+{
+    static constexpr std::array sizes { sizeof(uint8_t), sizeof(int8_t), sizeof(uint16_t), sizeof(int16_t), sizeof(float) };
+    return sizes[size_t(type)];
+}
+
+std::string_view voxelTypeName(VoxelType type)
+{
+    static constexpr std::array names { "uint8", "int8", "uint16", "int16", "float32" };
+    return names[size_t(type)];
+}
+
+float fileValue(const ValueMapping& mapping, float storedValue)
+{
+    return mapping.offset + mapping.scale * storedValue;
+}
+
+ValueMapping chooseValueMapping(gsl::span<const char> bytes, VoxelType type)
+{
+    switch (type) {
+    case VoxelType::Int8:
+        return computeValueMapping<int8_t>(bytes, type);
+    case VoxelType::Int16:
+        return computeValueMapping<int16_t>(bytes, type);
+    case VoxelType::Float32:
+        return computeValueMapping<float>(bytes, type);
+    default:
+        // Unsigned integers are stored as is.
+        return ValueMapping { type, 0.0f, 1.0f };
+    };
+}
+
+ValueMapping defaultValueMapping(VoxelType type)
+{
+    switch (type) {
+    case VoxelType::Int8:
+        return ValueMapping { type, float(std::numeric_limits<int8_t>::lowest()), 1.0f };
+    case VoxelType::Int16:
+        return ValueMapping { type, float(std::numeric_limits<int16_t>::lowest()), 1.0f };
+    default:
+        return ValueMapping { type, 0.0f, 1.0f };
+    };
 }
 
-static Header readHeader(std::ifstream& ifs)
+// One loop per voxel type such that the common 8 and 16 bit unsigned files are a plain conversion.
+void decodeVoxels(gsl::span<const char> bytes, const ValueMapping& mapping, gsl::span<uint16_t> out)
 {
-    Header out {};
+    switch (mapping.fileType) {
+    case VoxelType::UInt8:
+        decodeTypedVoxels<uint8_t>(bytes, mapping, out);
+        break;
+    case VoxelType::Int8:
+        decodeTypedVoxels<int8_t>(bytes, mapping, out);
+        break;
+    case VoxelType::UInt16:
+        decodeTypedVoxels<uint16_t>(bytes, mapping, out);
+        break;
+    case VoxelType::Int16:
+        decodeTypedVoxels<int16_t>(bytes, mapping, out);
+        break;
+    case VoxelType::Float32:
+        decodeTypedVoxels<float>(bytes, mapping, out);
+        break;
+    };
+}
+
+void encodeVoxels(gsl::span<const uint16_t> voxels, const ValueMapping& mapping, gsl::span<char> out)
+{
+    switch (mapping.fileType) {
+    case VoxelType::UInt8:
+        encodeTypedVoxels<uint8_t>(voxels, mapping, out);
+        break;
+    case VoxelType::Int8:
+        encodeTypedVoxels<int8_t>(voxels, mapping, out);
+        break;
+    case VoxelType::UInt16:
+        encodeTypedVoxels<uint16_t>(voxels, mapping, out);
+        break;
+    case VoxelType::Int16:
+        encodeTypedVoxels<int16_t>(voxels, mapping, out);
+        break;
+    case VoxelType::Float32:
+        encodeTypedVoxels<float>(voxels, mapping, out);
+        break;
+    };
+}
+
+void writeFieldHeader(std::ostream& stream, const FieldHeader& header)
+{
+    static constexpr std::array dataNames { "byte", "signed_byte", "short", "signed_short", "float" };
+    // The extent spans from the center of the first to the center of the last voxel (see readFieldHeader).
+    const glm::vec3 maxExtent = glm::vec3(glm::max(header.dim - 1, glm::ivec3(1))) * header.spacing;
+    stream << "# AVS field file\nndim=3\ndim1=" << header.dim.x << "\ndim2=" << header.dim.y << "\ndim3=" << header.dim.z
+           << "\nnspace=3\nveclen=" << header.channelCount << "\ndata=" << dataNames[size_t(header.optVoxelType.value_or(VoxelType::UInt16))]
+           << "\nfield=uniform\nmin_ext=0 0 0\nmax_ext=" << maxExtent.x << " " << maxExtent.y << " " << maxExtent.z << "\n\f\f";
+}
+
+FieldHeader readFieldHeader(std::istream& ifs)
+{
+    FieldHeader out {};
+    std::optional<glm::vec3> optMinExtent, optMaxExtent;
 
     // Read input until the data section starts.
     std::string line;
@@ -254,6 +645,12 @@ static Header readHeader(std::ifstream& ifs)
         std::getline(ifs, line);
         // Remove comments.
         line = line.substr(0, line.find('#'));
+        // Vector values are separated by spaces so they are parsed before the spaces are removed.
+        const auto readVector = [value = line.substr(line.find('=') + 1)]() {
+            glm::vec3 out { 0.0f };
+            std::istringstream { value } >> out.x >> out.y >> out.z;
+            return out;
+        };
         // Remove any spaces from the string.
         // https://stackoverflow.com/questions/83439/remove-spaces-from-stdstring-in-c
         line.erase(std::remove_if(std::begin(line), std::end(line), ::isspace), std::end(line));
@@ -276,27 +673,51 @@ static Header readHeader(std::ifstream& ifs)
             out.dim.z = std::stoi(value);
         } else if (key == "nspace") {
         } else if (key == "veclen") {
-            if (std::stoi(value) != 1)
-                std::cerr << "Only scalar m_data are supported" << std::endl;
+            out.channelCount = std::stoi(value);
         } else if (key == "data") {
             if (value == "byte") {
-                out.elementSize = 1;
+                out.optVoxelType = VoxelType::UInt8;
             } else if (value == "short") {
-                out.elementSize = 2;
+                out.optVoxelType = VoxelType::UInt16;
+            } else if (value == "signed_byte") {
+                out.optVoxelType = VoxelType::Int8;
+            } else if (value == "signed_short") {
+                out.optVoxelType = VoxelType::Int16;
+            } else if (value == "float") {
+                out.optVoxelType = VoxelType::Float32;
             } else {
                 std::cerr << "Data type " << value << " not recognized" << std::endl;
             }
         } else if (key == "field") {
             if (value != "uniform")
                 std::cerr << "Only uniform m_data are supported" << std::endl;
+        } else if (key == "min_ext") {
+            optMinExtent = readVector();
+        } else if (key == "max_ext") {
+            optMaxExtent = readVector();
         } else if (key == "#") {
             // Comment.
         } else {
             std::cerr << "Invalid AVS keyword " << key << " in file" << std::endl;
         }
     }
+
+    if (out.channelCount < 1 || out.channelCount > maxChannelCount) {
+        std::cerr << "Only volumes with 1 to " << maxChannelCount << " channels are supported" << std::endl;
+        out.optVoxelType.reset();
+    }
+
+    // The extent spans from the center of the first to the center of the last voxel.
+    if (optMinExtent && optMaxExtent) {
+        const glm::vec3 spacing = (*optMaxExtent - *optMinExtent) / glm::vec3(glm::max(out.dim - 1, glm::ivec3(1)));
+        if (glm::all(glm::greaterThan(spacing, glm::vec3(0.0f))))
+            out.spacing = spacing;
+        else
+            std::cerr << "Invalid coordinate space extent in file" << std::endl;
+    }
     return out;
 }
+}
 
 static float computeMinimum(gsl::span<const uint16_t> data)
 {
@@ -315,3 +736,85 @@ static std::vector<int> computeHistogram(gsl::span<const uint16_t> data)
         histogram[v]++;
     return histogram;
 }
+
+// Relative to the smallest spacing such that one unit in world coordinates is one voxel along the finest axis.
+static glm::vec3 normalizeSpacing(const glm::vec3& spacing)
+{
+    return spacing / std::min({ spacing.x, spacing.y, spacing.z });
+}
+
+// Independent of the byte order of the machine.
+template <typename T>
+static T readLittleEndian(const char* pBytes)
+{
+    using Bits = std::conditional_t<sizeof(T) == 1, uint8_t, std::conditional_t<sizeof(T) == 2, uint16_t, uint32_t>>;
+    Bits bits = 0;
+    for (size_t i = 0; i < sizeof(T); i++)
+        bits = Bits(bits | Bits(uint8_t(pBytes[i])) << (8 * i));
+    return std::bit_cast<T>(bits);
+}
+
+template <typename T>
+static void writeLittleEndian(T value, char* pBytes)
+{
+    using Bits = std::conditional_t<sizeof(T) == 1, uint8_t, std::conditional_t<sizeof(T) == 2, uint16_t, uint32_t>>;
+    const Bits bits = std::bit_cast<Bits>(value);
+    for (size_t i = 0; i < sizeof(T); i++)
+        pBytes[i] = char(uint8_t(bits >> (8 * i)));
+}
+
+// Signed integers start at the smallest voxel, float32 voxels are spread over all 16 bits.
+template <typename T>
+static volume::ValueMapping computeValueMapping(gsl::span<const char> bytes, volume::VoxelType type)
+{
+    float minimum = std::numeric_limits<float>::max(), maximum = std::numeric_limits<float>::lowest();
+    for (size_t i = 0; i + sizeof(T) <= bytes.size(); i += sizeof(T)) {
+        const float value = float(readLittleEndian<T>(&bytes[i]));
+        if (std::isfinite(value)) {
+            minimum = std::min(minimum, value);
+            maximum = std::max(maximum, value);
+        }
+    }
+    if (minimum > maximum)
+        return volume::ValueMapping { type, 0.0f, 1.0f };
+    if constexpr (std::is_integral_v<T>)
+        return volume::ValueMapping { type, minimum, 1.0f };
+    else
+        return volume::ValueMapping { type, minimum, maximum > minimum ? (maximum - minimum) / float(std::numeric_limits<uint16_t>::max()) : 1.0f };
+}
+
+template <typename T>
+static void decodeTypedVoxels(gsl::span<const char> bytes, const volume::ValueMapping& mapping, gsl::span<uint16_t> out)
+{
+    const size_t count = std::min(bytes.size() / sizeof(T), out.size());
+    if constexpr (std::is_same_v<T, uint8_t> || std::is_same_v<T, uint16_t>) {
+        for (size_t i = 0; i < count; i++)
+            out[i] = readLittleEndian<T>(&bytes[i * sizeof(T)]);
+    } else if constexpr (std::is_integral_v<T>) {
+        const int offset = int(mapping.offset);
+        for (size_t i = 0; i < count; i++)
+            out[i] = uint16_t(std::clamp(int(readLittleEndian<T>(&bytes[i * sizeof(T)])) - offset, 0, int(std::numeric_limits<uint16_t>::max())));
+    } else {
+        // NaNs become the smallest value.
+        const float inverseScale = 1.0f / mapping.scale;
+        for (size_t i = 0; i < count; i++) {
+            const float value = std::round((readLittleEndian<T>(&bytes[i * sizeof(T)]) - mapping.offset) * inverseScale);
+            out[i] = std::isnan(value) ? 0 : uint16_t(std::clamp(value, 0.0f, float(std::numeric_limits<uint16_t>::max())));
+        }
+    }
+}
+
+template <typename T>
+static void encodeTypedVoxels(gsl::span<const uint16_t> voxels, const volume::ValueMapping& mapping, gsl::span<char> out)
+{
+    const size_t count = std::min(out.size() / sizeof(T), voxels.size());
+    if constexpr (std::is_integral_v<T>) {
+        // Edits may have created values outside of the range of the type.
+        const int offset = int(mapping.offset);
+        for (size_t i = 0; i < count; i++)
+            writeLittleEndian(T(std::clamp(int(voxels[i]) + offset, int(std::numeric_limits<T>::lowest()), int(std::numeric_limits<T>::max()))), &out[i * sizeof(T)]);
+    } else {
+        for (size_t i = 0; i < count; i++)
+            writeLittleEndian(T(volume::fileValue(mapping, float(voxels[i]))), &out[i * sizeof(T)]);
+    }
+}
@@ -1,8 +1,17 @@
 #pragma once
+#include "memory/memory_registry.h"
+#include "volume/min_max_bricks.h"
 #include <filesystem>
+#include <glm/gtc/type_precision.hpp> // glm::u16vec4
 #include <glm/vec2.hpp>
 #include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+#include <gsl/span>
+#include <iosfwd>
+#include <memory>
+#include <optional>
 #include <string>
+#include <string_view>
 #include <vector>
 
 namespace volume {
@@ -13,6 +22,75 @@ enum class InterpolationMode {
     Cubic
 };
 
+// Box of voxels [lower, upper) that changed, used to update derived data incrementally.
+struct DirtyRegion {
+    glm::ivec3 lower { 0 };
+    glm::ivec3 upper { 0 };
+};
+bool isEmpty(const DirtyRegion& region);
+// Grow the region by the margin on all sides (clamped to the volume).
+DirtyRegion expandRegion(const DirtyRegion& region, int margin, const glm::ivec3& dims);
+
+enum class BrushMode {
+    Erase = 0, // Set the voxels to the minimum of the volume.
+    Carve, // Subtract the value from the voxels.
+    Paint // Set the voxels to the value.
+};
+// Sphere (in voxel coordinates) that edits all voxels inside of it.
+struct Brush {
+    BrushMode mode;
+    glm::vec3 center;
+    float radius;
+    float value;
+};
+DirtyRegion brushRegion(const Brush& brush, const glm::ivec3& dims);
+
+// Voxel types of field files (data=byte|short|signed_byte|signed_short|float, little endian). Unlike in AVS itself,
+// short is unsigned for compatibility with the files of this framework.
+enum class VoxelType {
+    UInt8 = 0,
+    Int8,
+    UInt16,
+    Int16,
+    Float32
+};
+size_t voxelTypeSize(VoxelType type);
+std::string_view voxelTypeName(VoxelType type);
+
+// Voxels of all types are stored as uint16_t such that the sampling, the histograms and the acceleration structures
+// have a single (fast) path. Other types are mapped linearly: file value = offset + scale * stored value. The mapping
+// is lossless for all integer types; float32 voxels are quantized to 16 bits over their range.
+struct ValueMapping {
+    VoxelType fileType { VoxelType::UInt16 };
+    float offset { 0.0f };
+    float scale { 1.0f };
+};
+float fileValue(const ValueMapping& mapping, float storedValue);
+// Tightest mapping for the voxels (e.g. signed CT data starts at 0 instead of at 32768).
+ValueMapping chooseValueMapping(gsl::span<const char> bytes, VoxelType type);
+// Mapping that does not depend on the voxels, for when they are not known in advance (see SliceStream): signed
+// integers are offset by the smallest value of their type, float32 voxels are clamped to [0, 65535].
+ValueMapping defaultValueMapping(VoxelType type);
+
+// Vector-valued volumes (e.g. RGB microscopy or multi-channel fluorescence) have up to this many channels.
+static constexpr int maxChannelCount = 4;
+
+// Header of an AVS field file (.fld). The voxels follow after two '\f' characters.
+struct FieldHeader {
+    glm::ivec3 dim;
+    std::optional<VoxelType> optVoxelType; // Empty if the data type or the number of channels is not supported.
+    int channelCount { 1 }; // Values per voxel (veclen), stored interleaved.
+    // Distance between voxels along each axis, from the coordinate space extent (min_ext/max_ext) if present.
+    glm::vec3 spacing { 1.0f };
+};
+FieldHeader readFieldHeader(std::istream& stream);
+// Convert the voxels as stored in a field file to uint16_ts.
+void decodeVoxels(gsl::span<const char> bytes, const ValueMapping& mapping, gsl::span<uint16_t> out);
+// Header that readFieldHeader reads back as the same dims, voxel type, channel count and spacing.
+void writeFieldHeader(std::ostream& stream, const FieldHeader& header);
+// Convert uint16_ts back to the voxels of a field file of the mapping's type (the inverse of decodeVoxels).
+void encodeVoxels(gsl::span<const uint16_t> voxels, const ValueMapping& mapping, gsl::span<char> out);
+
 class Volume {
 public:
     // DO NOT REMOVE
@@ -20,16 +98,54 @@ public:
 
 public:
     Volume(const std::filesystem::path& file);
-    Volume(std::vector<uint16_t> data, const glm::ivec3& dim);
+    Volume(std::vector<uint16_t> data, const glm::ivec3& dim, const glm::vec3& spacing = glm::vec3(1.0f), const ValueMapping& valueMapping = {});
+    // Read-only view of voxels (and derived data) that live in memory owned by pStorage, e.g. a shared memory
+    // mapping (see ipc/shared_volume.h). The storage is kept alive for as long as the volume exists.
+    Volume(std::shared_ptr<const void> pStorage, gsl::span<const uint16_t> data, const glm::ivec3& dim, std::string_view fileName,
+        float minimum, float maximum, std::vector<int> histogram, MinMaxBricks minMaxBricks, const glm::vec3& spacing = glm::vec3(1.0f), const ValueMapping& valueMapping = {});
+    // Copies would point at the voxels of the original (see m_voxels).
+    Volume(const Volume&) = delete;
+    Volume(Volume&&) = default;
 
     float minimum() const;
     float maximum() const;
     std::vector<int> histogram() const;
+    const MinMaxBricks& minMaxBricks() const;
     glm::ivec3 dims() const;
+    // Distance between voxels along each axis, relative to the smallest one (so isotropic volumes have a spacing
+    // of 1). Renderers work in world coordinates, which are voxel coordinates multiplied by the spacing.
+    glm::vec3 spacing() const;
+    // Size of the volume in world coordinates (dims() * spacing()).
+    glm::vec3 extent() const;
+    // The type of the voxels in the file and how to convert the (stored) voxel values back to it.
+    const ValueMapping& valueMapping() const;
     std::string_view fileName() const;
+    gsl::span<const uint16_t> data() const;
+    // Multi-channel volumes keep all channels of a voxel next to each other (unused channels are 0). data() then holds
+    // the maximum over the channels, such that the histograms, gradients, empty space skipping and the scalar render
+    // modes work on them as well.
+    int channelCount() const;
+    gsl::span<const glm::u16vec4> channelData() const;
 
     float getSampleInterpolate(const glm::vec3& coord) const;
+    // All channels at once: every corner is a single 8 byte load and the blending is four wide, so a sample of four
+    // channels costs about as much as a scalar sample. Cubic interpolation falls back to linear.
+    glm::vec4 getChannelsInterpolate(const glm::vec3& coord) const;
     float getVoxel(int x, int y, int z) const;
+    // Line profile: out.size() evenly spaced samples from begin up to and including end. Linear interpolation is
+    // batched such that the weights and blending are vectorized (the same values as getSampleInterpolate, except
+    // that samples at integer coordinates are the voxel values).
+    void sampleLine(const glm::vec3& begin, const glm::vec3& end, gsl::span<float> out) const;
+
+    // Edit the voxels and update the histogram and the min/max bricks of the edited region. The values stay within
+    // the range of the volume at load time. Returns the voxels that may have changed.
+    DirtyRegion applyBrush(const Brush& brush);
+    // Add slices (dims().x * dims().y voxels each) to the end of the volume along z and update the range, the
+    // histogram and the min/max bricks. Returns the new voxels.
+    DirtyRegion appendSlices(gsl::span<const uint16_t> slices);
+    // Rebuild the min/max bricks with a different brick size (see session/auto_tune.h). Renderers of the volume have
+    // to be notified with Renderer::volumeChanged().
+    void setBrickSize(int brickSize);
 
 protected:
     float getSampleNearestNeighbourInterpolation(const glm::vec3& coord) const;
@@ -43,17 +159,31 @@ protected:
     static float cubicInterpolate(float g0, float g1, float g2, float g3, float factor);
     static float weight(float x);
 
+    glm::vec4 getChannelsNearestNeighbourInterpolation(const glm::vec3& coord) const;
+    glm::vec4 getChannelsTriLinearInterpolation(const glm::vec3& coord) const;
+
 private:
     void loadFile(const std::filesystem::path& file);
+    void trackMemory();
 
 protected:
     const std::string m_fileName;
-    size_t m_elementSize;
     glm::ivec3 m_dim;
+    glm::vec3 m_spacing { 1.0f };
+    ValueMapping m_valueMapping;
 
     std::vector<uint16_t> m_data;
+    int m_channelCount { 1 };
+    std::vector<glm::u16vec4> m_channels; // Empty for scalar volumes.
+    // Voxels that are not owned by the volume (m_data is empty in that case).
+    std::shared_ptr<const void> m_pExternalStorage;
+    // The voxels that are read: either m_data or the external storage, such that reads do not check which one.
+    gsl::span<const uint16_t> m_voxels;
 
     float m_minimum, m_maximum;
     std::vector<int> m_histogram;
+    MinMaxBricks m_minMaxBricks;
+
+    memory::TrackedMemory m_voxelMemory, m_channelMemory, m_metadataMemory;
 };
 }
@@ -0,0 +1,210 @@
+#include "volume_filter.h"
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cmath>
+#include <limits>
+#include <tbb/blocked_range.h>
+#include <tbb/blocked_range2d.h>
+#include <tbb/parallel_for.h>
+
+static void convolveX(gsl::span<const float> in, gsl::span<float> out, const glm::ivec3& dim, const volume::Kernel& kernel);
+static void convolveRows(gsl::span<const float> in, gsl::span<float> out, const glm::ivec3& dim, const volume::Kernel& kernel, int axis);
+template <typename F>
+static void forEachRow(const glm::ivec3& dim, F&& f);
+static std::vector<uint16_t> convertToVoxels(gsl::span<const float> data);
+static std::vector<uint16_t> computeMedian(gsl::span<const uint16_t> data, const glm::ivec3& dim, int radius);
+
+namespace volume {
+
+std::string_view volumeFilterName(VolumeFilter filter)
+{
+    static constexpr std::array names { "none", "gaussian", "box", "median" };
+    return names[size_t(filter)];
+}
+
+Volume filterVolume(const Volume& volume, VolumeFilter filter, float size)
+{
+    const glm::ivec3 dim = volume.dims();
+    switch (filter) {
+    case VolumeFilter::None: {
+        return Volume(std::vector<uint16_t>(std::begin(volume.data()), std::end(volume.data())), dim, volume.spacing(), volume.valueMapping());
+    }
+    case VolumeFilter::Gaussian: {
+        const Kernel kernel = gaussianKernel(size);
+        return Volume(convertToVoxels(convolveSeparable(convertToFloat(volume), dim, kernel, kernel, kernel)), dim, volume.spacing(), volume.valueMapping());
+    }
+    case VolumeFilter::Box: {
+        const Kernel kernel = boxKernel(int(std::round(size)));
+        return Volume(convertToVoxels(convolveSeparable(convertToFloat(volume), dim, kernel, kernel, kernel)), dim, volume.spacing(), volume.valueMapping());
+    }
+    case VolumeFilter::Median: {
+        return Volume(computeMedian(volume.data(), dim, std::max(int(std::round(size)), 0)), dim, volume.spacing(), volume.valueMapping());
+    }
+    default: {
+        throw std::exception();
+    }
+    };
+}
+
+Kernel gaussianKernel(float sigma)
+{
+    if (sigma <= 0.0f)
+        return { 1.0f };
+
+    const int radius = int(std::ceil(3.0f * sigma));
+    Kernel out;
+    for (int i = -radius; i <= radius; i++)
+        out.push_back(std::exp(-float(i * i) / (2.0f * sigma * sigma)));
+    float sum = 0.0f;
+    for (const float weight : out)
+        sum += weight;
+    for (float& weight : out)
+        weight /= sum;
+    return out;
+}
+
+Kernel gaussianDerivativeKernel(float sigma)
+{
+    const Kernel gaussian = gaussianKernel(std::max(sigma, 0.5f));
+    const int radius = int(gaussian.size()) / 2;
+    Kernel out(gaussian.size());
+    float scale = 0.0f;
+    for (int i = -radius; i <= radius; i++) {
+        out[size_t(i + radius)] = float(i) * gaussian[size_t(i + radius)];
+        scale += float(i) * out[size_t(i + radius)];
+    }
+    for (float& weight : out)
+        weight /= scale;
+    return out;
+}
+
+Kernel boxKernel(int radius)
+{
+    radius = std::max(radius, 0);
+    return Kernel(size_t(2 * radius + 1), 1.0f / float(2 * radius + 1));
+}
+
+std::vector<float> convolveSeparable(gsl::span<const float> data, const glm::ivec3& dim, const Kernel& kernelX, const Kernel& kernelY, const Kernel& kernelZ)
+{
+    std::vector<float> tmp(data.size()), out(data.size());
+    convolveX(data, out, dim, kernelX);
+    convolveRows(out, tmp, dim, kernelY, 1);
+    convolveRows(tmp, out, dim, kernelZ, 2);
+    return out;
+}
+
+std::vector<float> convertToFloat(const Volume& volume)
+{
+    const auto voxels = volume.data();
+    std::vector<float> out(voxels.size());
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, voxels.size()), [&](const tbb::blocked_range<size_t>& range) {
+        for (size_t i = range.begin(); i != range.end(); i++)
+            out[i] = float(voxels[i]);
+    });
+    return out;
+}
+
+}
+
+// Calls f(y, z) for every row of voxels along the x axis. Rows are distributed over the cores in blocks of
+// neighbouring rows such that rows that are read by multiple tasks are likely still in the cache.
+template <typename F>
+static void forEachRow(const glm::ivec3& dim, F&& f)
+{
+    tbb::parallel_for(tbb::blocked_range2d<int>(0, dim.z, 0, dim.y), [&](const tbb::blocked_range2d<int>& range) {
+        for (int z = range.rows().begin(); z != range.rows().end(); z++) {
+            for (int y = range.cols().begin(); y != range.cols().end(); y++)
+                f(y, z);
+        }
+    });
+}
+
+static void convolveX(gsl::span<const float> in, gsl::span<float> out, const glm::ivec3& dim, const volume::Kernel& kernel)
+{
+    const int radius = int(kernel.size()) / 2;
+    forEachRow(dim, [&](int y, int z) {
+        const size_t rowStart = size_t(dim.x) * (size_t(y) + size_t(dim.y) * size_t(z));
+        const float* pIn = &in[rowStart];
+        float* pOut = &out[rowStart];
+
+        // Voxels whose neighbourhood lies inside the row (the loop over x vectorizes).
+        const int innerBegin = std::min(radius, dim.x), innerEnd = std::max(dim.x - radius, innerBegin);
+        std::fill(pOut + innerBegin, pOut + innerEnd, 0.0f);
+        for (int k = 0; k < int(kernel.size()); k++) {
+            const float weight = kernel[size_t(k)];
+            const float* pShiftedIn = pIn + (k - radius);
+            for (int x = innerBegin; x < innerEnd; x++)
+                pOut[x] += weight * pShiftedIn[x];
+        }
+
+        // Voxels near the start/end of the row clamp their neighbours.
+        const auto convolveClamped = [&](int x) {
+            float sum = 0.0f;
+            for (int k = 0; k < int(kernel.size()); k++)
+                sum += kernel[size_t(k)] * pIn[std::clamp(x + k - radius, 0, dim.x - 1)];
+            pOut[x] = sum;
+        };
+        for (int x = 0; x < innerBegin; x++)
+            convolveClamped(x);
+        for (int x = innerEnd; x < dim.x; x++)
+            convolveClamped(x);
+    });
+}
+
+// Convolution along y (axis 1) or z (axis 2): every output row is a weighted sum of whole input rows.
+static void convolveRows(gsl::span<const float> in, gsl::span<float> out, const glm::ivec3& dim, const volume::Kernel& kernel, int axis)
+{
+    assert(axis == 1 || axis == 2);
+    const int radius = int(kernel.size()) / 2;
+    forEachRow(dim, [&](int y, int z) {
+        float* pOut = &out[size_t(dim.x) * (size_t(y) + size_t(dim.y) * size_t(z))];
+        std::fill(pOut, pOut + dim.x, 0.0f);
+        for (int k = 0; k < int(kernel.size()); k++) {
+            const int ky = axis == 1 ? std::clamp(y + k - radius, 0, dim.y - 1) : y;
+            const int kz = axis == 2 ? std::clamp(z + k - radius, 0, dim.z - 1) : z;
+            const float weight = kernel[size_t(k)];
+            const float* pIn = &in[size_t(dim.x) * (size_t(ky) + size_t(dim.y) * size_t(kz))];
+            for (int x = 0; x < dim.x; x++)
+                pOut[x] += weight * pIn[x];
+        }
+    });
+}
+
+static std::vector<uint16_t> convertToVoxels(gsl::span<const float> data)
+{
+    std::vector<uint16_t> out(data.size());
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, data.size()), [&](const tbb::blocked_range<size_t>& range) {
+        for (size_t i = range.begin(); i != range.end(); i++)
+            out[i] = uint16_t(std::clamp(std::round(data[i]), 0.0f, float(std::numeric_limits<uint16_t>::max())));
+    });
+    return out;
+}
+
+static std::vector<uint16_t> computeMedian(gsl::span<const uint16_t> data, const glm::ivec3& dim, int radius)
+{
+    std::vector<uint16_t> out(data.size());
+    const size_t neighbourhoodSize = size_t(2 * radius + 1) * size_t(2 * radius + 1) * size_t(2 * radius + 1);
+    tbb::parallel_for(tbb::blocked_range2d<int>(0, dim.z, 0, dim.y), [&](const tbb::blocked_range2d<int>& range) {
+        std::vector<uint16_t> neighbourhood(neighbourhoodSize);
+        for (int z = range.rows().begin(); z != range.rows().end(); z++) {
+            for (int y = range.cols().begin(); y != range.cols().end(); y++) {
+                for (int x = 0; x < dim.x; x++) {
+                    size_t i = 0;
+                    for (int dz = -radius; dz <= radius; dz++) {
+                        for (int dy = -radius; dy <= radius; dy++) {
+                            const int ny = std::clamp(y + dy, 0, dim.y - 1), nz = std::clamp(z + dz, 0, dim.z - 1);
+                            const uint16_t* pRow = &data[size_t(dim.x) * (size_t(ny) + size_t(dim.y) * size_t(nz))];
+                            for (int dx = -radius; dx <= radius; dx++)
+                                neighbourhood[i++] = pRow[std::clamp(x + dx, 0, dim.x - 1)];
+                        }
+                    }
+                    const auto middle = std::begin(neighbourhood) + std::ptrdiff_t(neighbourhoodSize / 2);
+                    std::nth_element(std::begin(neighbourhood), middle, std::end(neighbourhood));
+                    out[size_t(x) + size_t(dim.x) * (size_t(y) + size_t(dim.y) * size_t(z))] = *middle;
+                }
+            }
+        }
+    });
+    return out;
+}
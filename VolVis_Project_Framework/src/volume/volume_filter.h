@@ -0,0 +1,34 @@
+#pragma once
+#include "volume/volume.h"
+#include <glm/vec3.hpp>
+#include <gsl/span>
+#include <string_view>
+#include <vector>
+
+// Preprocessing filters that produce a new volume (e.g. to smooth noisy data before isosurfacing).
+// Separable filters run one pass per axis; every pass works on contiguous rows of voxels (such that the inner loops
+// vectorize) and distributes the rows over the cores. Voxels outside of the volume are clamped to the border.
+namespace volume {
+
+enum class VolumeFilter {
+    None = 0,
+    Gaussian, // Size is the standard deviation in voxels.
+    Box, // Size is the radius in voxels (the kernel covers 2 * radius + 1 voxels per axis).
+    Median // Size is the radius in voxels (not separable: the median of the whole (2 * radius + 1)^3 neighbourhood).
+};
+std::string_view volumeFilterName(VolumeFilter filter);
+
+Volume filterVolume(const Volume& volume, VolumeFilter filter, float size);
+
+// 1D kernel with an odd number of weights, the center weight applies to the voxel itself.
+using Kernel = std::vector<float>;
+Kernel gaussianKernel(float sigma);
+// Derivative of a Gaussian, scaled such that the response to a linear ramp equals its slope.
+Kernel gaussianDerivativeKernel(float sigma);
+Kernel boxKernel(int radius);
+
+// Correlate the voxels with kernelX along x, kernelY along y and kernelZ along z.
+std::vector<float> convolveSeparable(gsl::span<const float> data, const glm::ivec3& dim, const Kernel& kernelX, const Kernel& kernelY, const Kernel& kernelZ);
+std::vector<float> convertToFloat(const Volume& volume);
+
+}